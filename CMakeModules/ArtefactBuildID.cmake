@@ -0,0 +1,21 @@
+#Run at build time by the ArtefactBuildID target in src/CMakeLists.txt
+#Hash every source file (the artefacts depend on most of the code, and a list of the files which matter would be forgotten), and write the hash as ARTEFACT_BUILD_ID to OUTPUT. The file is only written when the hash changed, so nothing is compiled again for nothing
+file(GLOB_RECURSE SOURCES ${SOURCE_DIR}/src/*.cpp ${SOURCE_DIR}/include/*.hpp ${SOURCE_DIR}/include/*.h)
+list(SORT SOURCES)
+set(HASHES "")
+foreach(F ${SOURCES})
+    file(SHA256 ${F} H)
+    file(RELATIVE_PATH NAME ${SOURCE_DIR} ${F})
+    string(APPEND HASHES "${NAME} ${H}\n")
+endforeach()
+string(SHA256 HASH "${HASHES}")
+string(SUBSTRING ${HASH} 0 16 ID)
+
+set(TEXT "//Made by CMakeModules/ArtefactBuildID.cmake, do not edit\n#pragma once\n#define ARTEFACT_BUILD_ID 0x${ID}ull\n")
+set(OLD "")
+if (EXISTS ${OUTPUT})
+    file(READ ${OUTPUT} OLD)
+endif()
+if (NOT OLD STREQUAL TEXT)
+    file(WRITE ${OUTPUT} "${TEXT}")
+endif()
@@ -0,0 +1,163 @@
+#include<iostream>
+#include<sstream>
+#include<string>
+#include<vector>
+#include<chrono>
+#include<thread>
+#include<algorithm>
+#include<cctype>
+#include"json/json.h"
+#include"CityNetwork.hpp"
+#include"NameTable.hpp"
+#include"TrafficExceptions.hpp"
+
+using std::cout, std::cerr, std::endl;
+
+//An n by n grid of Intersects, 100 m apart, with a traffic light at every 10th crossing and a Hellhole hanging off every 20th node along the bottom
+static std::string gridCity(size_t n)
+{
+    std::stringstream S;
+    S<<"{\"nodes\":[";
+    for (size_t y = 0; y < n; ++y)
+        for (size_t x = 0; x < n; ++x)
+            S<<(x+y>0 ? "," : "")<<"{\"type\":\""<<((x+y)%10==0 ? "Trafficlight" : "Intersect")<<"\",\"pos\":["<<x*100<<","<<y*100<<"]}";
+    size_t holes=0;
+    for (size_t x = 0; x < n; x+=20, ++holes)
+        S<<",{\"type\":\"Hellhole\",\"pos\":["<<x*100<<",-100]}";
+    S<<"],\"auto_roads\":[";
+    bool first=true;
+    for (size_t y = 0; y < n; ++y)
+        for (size_t x = 0; x < n; ++x)
+        {
+            if (x+1<n)
+            {
+                S<<(first ? "" : ",")<<"{\"type\":\"Byvej\",\"first\":"<<x+n*y<<",\"second\":"<<x+1+n*y<<"}";
+                first=false;
+            }
+            if (y+1<n)
+            {
+                S<<(first ? "" : ",")<<"{\"type\":\"Landevej\",\"first\":"<<x+n*y<<",\"second\":"<<x+n*(y+1)<<",\"lanes\":2}";
+                first=false;
+            }
+        }
+    for (size_t h = 0; h < holes; ++h)
+        S<<",{\"type\":\"Byvej\",\"first\":"<<n*n+h<<",\"second\":"<<20*h<<"}";
+    S<<"]}";
+    return S.str();
+}
+
+//How road types were found before the NameTable: a lower case copy of the name, compared with every name in turn
+static std::string toLower(std::string s)
+{
+    std::transform(s.begin(),s.end(),s.begin(),[](unsigned char c){return std::tolower(c);});
+    return s;
+}
+static int oldRoadType(const std::string& name)
+{
+    if (toLower(name).compare("street")==0 || toLower(name).compare("byvej")==0)
+        return 0;
+    if (toLower(name).compare("country road")==0 || toLower(name).compare("landevej")==0)
+        return 1;
+    if (toLower(name).compare("motortrafficroad")==0 || toLower(name).compare("motortrafikvej")==0)
+        return 2;
+    if (toLower(name).compare("highway")==0 || name.compare("motorvej")==0)
+        return 3;
+    return -1;
+}
+
+//Time to load a big city with 1, 2, 4 ... threads, and how much of it is reading the JSON text, which is always one thread. Then the cost of every road on its own, from the parsed JSON, and of finding its type
+int main(int argc, char* argv[])
+{
+    if (argc > 3)
+    {
+        cout<<"Need: "<<argv[0]<<" [grid_size repeats]"<<endl;
+        return 1;
+    }
+
+    try
+    {
+        size_t n=argc>1 ? std::stoul(argv[1]) : 300;
+        size_t repeats=argc>2 ? std::stoul(argv[2]) : 3;
+        std::string Text=gridCity(n);
+
+        //Best of the repeats, the first is often slow while the allocator warms up
+        auto best = [repeats](auto work)
+        {
+            double fastest=1e300;
+            for (size_t i = 0; i < repeats; ++i)
+            {
+                auto start=std::chrono::steady_clock::now();
+                work();
+                fastest=std::min(fastest,std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count());
+            }
+            return fastest;
+        };
+
+        double parse=best([&Text]()
+        {
+            std::stringstream S(Text);
+            Json::Value root;
+            S>>root;
+        });
+
+        size_t nodes=0,roads=0;
+        unsigned cores=std::max(1u,std::thread::hardware_concurrency());
+        std::vector<std::pair<unsigned,double> > times;
+        for (unsigned threads = 1; threads <= 2*cores && threads <= 64; threads*=2)
+            times.push_back({threads,best([&]()
+            {
+                std::stringstream S(Text);
+                CityNetwork City(S,CityNetwork::fileOrder,threads);
+                nodes=City.getNodesSize();
+                roads=City.getRoadsSize();
+            })});
+
+        cout<<nodes<<" nodes, "<<roads<<" roads, "<<Text.size()/1024<<" kB of JSON, "<<cores<<" cores"<<endl;
+        cout<<"JSON parse alone: "<<1e3*parse<<" ms"<<endl;
+        for (auto [threads,time] : times)
+            cout<<threads<<" threads:\t"<<1e3*time<<" ms, "<<1e3*(time-parse)<<" ms after parsing, speedup "<<times[0].second/time<<" ("<<(times[0].second-parse)/(time-parse)<<" after parsing)"<<endl;
+
+        //Making the roads again from the JSON, without adding them to the nodes (which already have them)
+        std::stringstream S(Text);
+        CityNetwork City(S);
+        std::stringstream S2(Text);
+        Json::Value root;
+        S2>>root;
+        Json::Value& RoadsJson=root["auto_roads"];
+        std::vector<std::shared_ptr<Road> > Again(roads);
+        double perRoad=best([&]()
+        {
+            for (size_t r = 0; r < roads; ++r)
+                Again[r]=std::make_shared<Road>(r,RoadsJson[Json::ArrayIndex(r)],City,false);
+        })/roads;
+
+        std::vector<std::string> names;
+        for (size_t r = 0; r < roads; ++r)
+            names.push_back(RoadsJson[Json::ArrayIndex(r)]["type"].asString());
+        const NameTable Table={{"street",0},{"byvej",0},{"country road",1},{"landevej",1},{"motortrafficroad",2},{"motortrafikvej",2},{"highway",3},{"motorvej",3}};
+        long sum=0;
+        double oldLookup=best([&]()
+        {
+            for (const std::string& N : names)
+                sum+=oldRoadType(N);
+        })/roads;
+        double newLookup=best([&]()
+        {
+            for (const std::string& N : names)
+                sum+=Table.find(N);
+        })/roads;
+
+        cout<<"Per road: "<<1e9*perRoad<<" ns from parsed JSON, of which finding the type "<<1e9*newLookup<<" ns (was "<<1e9*oldLookup<<" ns with lower case copies, checksum "<<sum<<")"<<endl;
+    }
+    catch(TrafficSimulation_error& E)
+    {
+        cerr<<E.what()<<endl;
+        return 1;
+    }
+    catch(std::logic_error& E)
+    {
+        cerr<<"Bad number: "<<E.what()<<endl;
+        return 1;
+    }
+    return 0;
+}
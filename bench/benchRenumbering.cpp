@@ -0,0 +1,177 @@
+#include<iostream>
+#include<sstream>
+#include<string>
+#include<vector>
+#include<chrono>
+#include<numeric>
+#include<algorithm>
+#include<cstring>
+#include"CityNetwork.hpp"
+#include"RoutingGraph.hpp"
+#include"Router.hpp"
+#include"CounterRNG.hpp"
+#include"TrafficExceptions.hpp"
+
+#ifdef __linux__
+#include<unistd.h>
+#include<sys/ioctl.h>
+#include<sys/syscall.h>
+#include<linux/perf_event.h>
+#endif
+
+using std::cout, std::cerr, std::endl;
+
+//Counts the cache misses of this thread, where the kernel lets us (Linux, with perf events allowed), otherwise reports -1
+class CacheMissCounter
+{
+private:
+    int fd=-1;
+public:
+    CacheMissCounter()
+    {
+#ifdef __linux__
+        perf_event_attr A;
+        std::memset(&A,0,sizeof(A));
+        A.type=PERF_TYPE_HARDWARE;
+        A.size=sizeof(A);
+        A.config=PERF_COUNT_HW_CACHE_MISSES;
+        A.disabled=1;
+        A.exclude_kernel=1;
+        A.exclude_hv=1;
+        fd=syscall(__NR_perf_event_open,&A,0,-1,-1,0);
+#endif
+    }
+    ~CacheMissCounter()
+    {
+#ifdef __linux__
+        if (fd>=0)
+            close(fd);
+#endif
+    }
+    void start()
+    {
+#ifdef __linux__
+        if (fd>=0)
+        {
+            ioctl(fd,PERF_EVENT_IOC_RESET,0);
+            ioctl(fd,PERF_EVENT_IOC_ENABLE,0);
+        }
+#endif
+    }
+    long long stop()
+    {
+#ifdef __linux__
+        long long count=-1;
+        if (fd>=0)
+        {
+            ioctl(fd,PERF_EVENT_IOC_DISABLE,0);
+            if (read(fd,&count,sizeof(count))!=sizeof(count))
+                count=-1;
+        }
+        return count;
+#else
+        return -1;
+#endif
+    }
+};
+
+//Fisher-Yates, by hand, std::shuffle shuffles differently in every standard library, and the city must be the same everywhere for the numbers to be compared
+template<class T>
+static void shuffle(std::vector<T>& V, RandomStream& G)
+{
+    for (size_t i = V.size(); i > 1; --i)
+        std::swap(V[i-1],V[size_t(G.uniform()*i)]);
+}
+
+//An n by n grid, 100 m apart, with the nodes and roads written in a random order, as city files made by hand (or exported from a map) tend to be
+static std::string shuffledGrid(size_t n, RandomStream& G)
+{
+    std::vector<size_t> place(n*n);
+    std::iota(place.begin(),place.end(),0);
+    shuffle(place,G);
+
+    std::vector<std::string> nodes(n*n);
+    std::vector<std::string> roads;
+    for (size_t y = 0; y < n; ++y)
+        for (size_t x = 0; x < n; ++x)
+        {
+            nodes[place[x+n*y]]="{\"type\":\"Intersect\",\"pos\":["+std::to_string(x*100)+","+std::to_string(y*100)+"]}";
+            if (x+1<n)
+                roads.push_back("{\"type\":\"Byvej\",\"first\":"+std::to_string(place[x+n*y])+",\"second\":"+std::to_string(place[x+1+n*y])+"}");
+            if (y+1<n)
+                roads.push_back("{\"type\":\"Byvej\",\"first\":"+std::to_string(place[x+n*y])+",\"second\":"+std::to_string(place[x+n*(y+1)])+"}");
+        }
+    shuffle(roads,G);
+
+    std::string out="{\"nodes\":[";
+    for (size_t i = 0; i < nodes.size(); ++i)
+        out+=(i>0 ? "," : "")+nodes[i];
+    out+="],\"auto_roads\":[";
+    for (size_t i = 0; i < roads.size(); ++i)
+        out+=(i>0 ? "," : "")+roads[i];
+    return out+"]}";
+}
+
+//The same route queries (by the IDs in the file) on a shuffled city, loaded in file order, and renumbered
+int main(int argc, char* argv[])
+{
+    if (argc > 3)
+    {
+        cout<<"Need: "<<argv[0]<<" [grid_size queries]"<<endl;
+        return 1;
+    }
+
+    try
+    {
+        size_t n=argc>1 ? std::stoul(argv[1]) : 300;
+        size_t queries=argc>2 ? std::stoul(argv[2]) : 200;
+
+        RandomStream G(CounterRNG(1),0,0,demand);
+        std::string Json=shuffledGrid(n,G);
+        std::vector<std::pair<size_t,size_t> > trips;
+        for (size_t q = 0; q < queries; ++q)
+            trips.push_back({G()%(n*n),G()%(n*n)});
+
+        cout<<n*n<<" nodes, "<<queries<<" queries"<<endl;
+        cout<<"order\tload (s)\tus/query\tcache misses/query"<<endl;
+        const char* names[]={"file","hilbert","bandwidth"};
+        for (CityNetwork::Ordering Order : {CityNetwork::fileOrder,CityNetwork::hilbertOrder,CityNetwork::bandwidthOrder})
+        {
+            auto start=std::chrono::steady_clock::now();
+            std::stringstream S(Json);
+            CityNetwork City(S,Order);
+            double load=std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+
+            RoutingGraph Graph(City);
+            Router R(Graph);
+            std::vector<size_t> roads;
+            double sum=0;
+            CacheMissCounter Misses;
+
+            start=std::chrono::steady_clock::now();
+            Misses.start();
+            for (auto [o,d] : trips)
+                sum+=R.route(City.getNodeFromFileID(o),City.getNodeFromFileID(d),roads);
+            long long misses=Misses.stop();
+            double time=std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+
+            cout<<names[Order]<<'\t'<<load<<'\t'<<1e6*time/queries<<'\t';
+            if (misses>=0)
+                cout<<double(misses)/queries;
+            else
+                cout<<"n/a";
+            cout<<"\t(checksum "<<sum<<")"<<endl;
+        }
+    }
+    catch(TrafficSimulation_error& E)
+    {
+        cerr<<E.what()<<endl;
+        return 1;
+    }
+    catch(std::logic_error& E)
+    {
+        cerr<<"Bad number: "<<E.what()<<endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,128 @@
+#include<iostream>
+#include<sstream>
+#include<string>
+#include<vector>
+#include<chrono>
+#include<cmath>
+#include"CityNetwork.hpp"
+#include"RoutingGraph.hpp"
+#include"TravelTimeProfiles.hpp"
+#include"Router.hpp"
+#include"TrafficExceptions.hpp"
+
+using std::cout, std::cerr, std::endl;
+
+//An n by n grid of Intersects, 100 m apart, every 5th street a bigger road
+static std::string gridCity(size_t n)
+{
+    std::stringstream S;
+    S<<"{\"nodes\":[";
+    for (size_t y = 0; y < n; ++y)
+        for (size_t x = 0; x < n; ++x)
+            S<<(x+y>0 ? "," : "")<<"{\"type\":\"Intersect\",\"pos\":["<<x*100<<","<<y*100<<"]}";
+    S<<"],\"auto_roads\":[";
+    bool first=true;
+    for (size_t y = 0; y < n; ++y)
+        for (size_t x = 0; x < n; ++x)
+        {
+            if (x+1<n)
+            {
+                S<<(first ? "" : ",")<<"{\"type\":\""<<(y%5==0 ? "Landevej" : "Byvej")<<"\",\"first\":"<<x+n*y<<",\"second\":"<<x+1+n*y<<"}";
+                first=false;
+            }
+            if (y+1<n)
+            {
+                S<<(first ? "" : ",")<<"{\"type\":\""<<(x%5==0 ? "Landevej" : "Byvej")<<"\",\"first\":"<<x+n*y<<",\"second\":"<<x+n*(y+1)<<"}";
+                first=false;
+            }
+        }
+    S<<"]}";
+    return S.str();
+}
+
+//Cheap repeatable random numbers, we do not want the benchmark to depend on the standard library
+static uint64_t nextRandom(uint64_t& x)
+{
+    x=x*6364136223846793005ull+1442695040888963407ull;
+    return x>>33;
+}
+
+//Static, time dependent and edge based (with turns) searches between the same random nodes, leaving in the morning rush hour, where the big roads are up to 3 times slower than at night
+int main(int argc, char* argv[])
+{
+    if (argc > 3)
+    {
+        cout<<"Need: "<<argv[0]<<" [grid_size queries]"<<endl;
+        return 1;
+    }
+
+    try
+    {
+        size_t n=argc>1 ? std::stoul(argv[1]) : 150;
+        size_t queries=argc>2 ? std::stoul(argv[2]) : 500;
+
+        std::stringstream S(gridCity(n));
+        CityNetwork City(S);
+        RoutingGraph G(City);
+        TravelTimeProfiles Profiles(G);
+
+        //Rush hours at 8 and 17, worst on the fast roads everyone wants to use
+        uint64_t x=1;
+        std::vector<double> profile(Profiles.getPointNumber());
+        for (size_t r = 0; r < G.getRoadNumber(); ++r)
+        {
+            double busy=City.getRoad(r)->getSpeedLimit()>20 ? 2.0 : 0.5*(nextRandom(x)%100)/100;
+            for (size_t h = 0; h < profile.size(); ++h)
+            {
+                double t=h+0.5;
+                profile[h]=G.getFreeFlowTime(r)*(1+busy*std::exp(-(t-8)*(t-8))+0.8*busy*std::exp(-(t-17)*(t-17)/1.5));
+            }
+            Profiles.setProfile(r,profile);
+            //The static search uses the travel times at 8
+            G.setTravelTime(r,Profiles.travelTime(r,8*3600));
+        }
+
+        std::vector<std::pair<size_t,size_t> > trips;
+        for (size_t q = 0; q < queries; ++q)
+            trips.push_back({nextRandom(x)%G.getNodeNumber(),nextRandom(x)%G.getNodeNumber()});
+
+        Router R(G);
+        std::vector<size_t> roads;
+        double sum=0;
+
+        auto start=std::chrono::steady_clock::now();
+        for (auto [o,d] : trips)
+            sum+=R.route(o,d,roads);
+        double staticTime=std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+        uint64_t staticSettled=R.getSettled();
+
+        start=std::chrono::steady_clock::now();
+        for (auto [o,d] : trips)
+            sum+=R.route(o,d,7.5*3600,Profiles,roads);
+        double dependentTime=std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+        uint64_t dependentSettled=R.getSettled()-staticSettled;
+
+        start=std::chrono::steady_clock::now();
+        for (auto [o,d] : trips)
+            sum+=R.routeWithTurns(o,d,roads);
+        double turnTime=std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+        uint64_t turnSettled=R.getSettled()-staticSettled-dependentSettled;
+
+        cout<<G.getNodeNumber()<<" nodes, "<<G.getRoadNumber()<<" roads, "<<queries<<" queries (checksum "<<sum<<")"<<endl;
+        cout<<"Static:         "<<1e6*staticTime/queries<<" us/query, "<<staticSettled/queries<<" nodes settled/query"<<endl;
+        cout<<"Time dependent: "<<1e6*dependentTime/queries<<" us/query, "<<dependentSettled/queries<<" nodes settled/query"<<endl;
+        cout<<"With turns:     "<<1e6*turnTime/queries<<" us/query, "<<turnSettled/queries<<" edges settled/query, "<<G.getTurnBytes()/1024<<" kB of turns"<<endl;
+        cout<<"Slowdown:       "<<dependentTime/staticTime<<" time dependent, "<<turnTime/staticTime<<" with turns"<<endl;
+    }
+    catch(TrafficSimulation_error& E)
+    {
+        cerr<<E.what()<<endl;
+        return 1;
+    }
+    catch(std::logic_error& E)
+    {
+        cerr<<"Bad number: "<<E.what()<<endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <cstdint>
+#include <cstddef>
+
+#include "BinaryIO.hpp"
+#include "TrafficExceptions.hpp"
+
+/**
+* Keeps the things made from a city file (the renumbering, the routing graphs, the spatial index) in a directory on disk, so the next run on the same city, and every run of a parameter sweep, reads them back instead of making them again.
+*
+* Everything is filed under a key made from the bytes of the city file, the version of the cache, and a hash of every source file (made at build time, see src/CMakeLists.txt, so a change to the turn times of Intersection or to how RoutingGraph is built gives new keys), so a changed city, or a program which makes or writes the artefacts differently, simply never finds the old files, and there is nothing to throw away by hand. Any change to the source makes the cache start over, which costs one rebuild of the artefacts, where a missed change would read wrong ones. The name of an artefact says what it is and what it was made with (say "routing-16" for a RoutingGraph with maxMatrixRoads 16). Every file repeats the key and the name, and has a checksum of its content, a file which does not match, or is cut short, is treated as missing and made again. The hash is NOT cryptographic, it protects against changed files and accidents, not against someone making collisions on purpose.
+*
+* Files are written under a temporary name and renamed when done, so several runs sharing the directory never see half a file (the last one to finish wins, with the same content anyway).
+*/
+
+//The 128 bit hash of a city file
+struct ArtefactKey
+{
+    uint64_t low=0;
+    uint64_t high=0;
+
+    bool operator==(const ArtefactKey& O) const noexcept {return low==O.low && high==O.high;}
+    bool operator!=(const ArtefactKey& O) const noexcept {return !(*this==O);}
+
+    //32 hex digits, used in the file names
+    std::string hex() const;
+};
+
+class ArtefactCache
+{
+private:
+    std::string directory;
+
+    size_t hits=0;
+    size_t misses=0;
+
+public:
+    //Change this whenever anything which is cached is written differently, or made differently from the same city, by code the source hash does not cover (see above), so old files are never read
+    static constexpr uint32_t version=1;
+
+    //The hash of the bytes, with the version and the source hash mixed in
+    static ArtefactKey keyOf(std::string_view content) noexcept;
+
+    //@param _directory made if it does not exist
+    //@throw TrafficSimulation_error if it can not be made
+    ArtefactCache(const std::string& _directory);
+
+    const std::string& getDirectory() const noexcept {return directory;}
+    std::string getPath(const ArtefactKey& key, const std::string& name) const;
+
+    //@param name letters, digits, '-', '_' and '.' only
+    //@return true if the artefact is there, and whole, then it is in content
+    //@throw TrafficSimulation_error if the name has other characters
+    bool load(const ArtefactKey& key, const std::string& name, std::string& content);
+    //@throw TrafficSimulation_error if the name has other characters, or the file can not be written
+    void store(const ArtefactKey& key, const std::string& name, const std::string& content);
+
+    /*The artefact from the cache if it is there and can be read, else made by build and stored for next time. T needs:
+    *   void toBinary(std::string& out) const
+    *   static T fromBinary(const std::string& in), which throws file_format_exception if it can not read it*/
+    template<class T, class Build>
+    T get(const ArtefactKey& key, const std::string& name, Build build)
+    {
+        std::string content;
+        if (load(key,name,content))
+        {
+            try
+            {
+                return T::fromBinary(content);
+            }
+            catch (file_format_exception&)
+            {
+                //Whole, but not what we expected, made again below and overwritten
+                --hits;
+                ++misses;
+            }
+        }
+        T made=build();
+        content.clear();
+        made.toBinary(content);
+        store(key,name,content);
+        return made;
+    }
+
+    //How many artefacts were read, and how many had to be made
+    size_t getHits() const noexcept {return hits;}
+    size_t getMisses() const noexcept {return misses;}
+};
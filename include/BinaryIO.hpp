@@ -0,0 +1,189 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <string_view>
+#include <bit>
+#include <istream>
+#include <ostream>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+#include "TrafficExceptions.hpp"
+
+/**
+* Small helpers for the binary output files (keyframes, statistics, journey logs ...)
+*
+* Numbers are written little-endian in the native layout (all the machines we run on are little-endian), small integers as LEB128 varints (7 bits per byte, high bit set if more bytes follow), and signed numbers zigzag encoded first, so small negative numbers are also short.
+*/
+
+class file_format_exception: public TrafficSimulation_error
+{
+public:
+    file_format_exception(const std::string& what) noexcept : TrafficSimulation_error("Error reading binary file; "+what){}
+};
+
+namespace BinaryIO
+{
+    inline uint64_t zigzag(int64_t x) noexcept {return (uint64_t(x)<<1)^uint64_t(x>>63);}
+    inline int64_t unzigzag(uint64_t x) noexcept {return int64_t(x>>1)^-int64_t(x&1);}
+
+    inline void putVarint(std::string& out, uint64_t x)
+    {
+        while (x>=0x80)
+        {
+            out.push_back(char(x|0x80));
+            x>>=7;
+        }
+        out.push_back(char(x));
+    }
+
+    //@param p where to read, moved past the number
+    //@param end end of the buffer
+    //@throw file_format_exception if the number runs past the end
+    inline uint64_t getVarint(const char*& p, const char* end)
+    {
+        uint64_t x=0;
+        for (int shift = 0; shift < 64; shift+=7)
+        {
+            if (p>=end)
+                throw file_format_exception("varint past end of buffer");
+            uint8_t b=uint8_t(*p++);
+            x|=uint64_t(b&0x7F)<<shift;
+            if (!(b&0x80))
+                return x;
+        }
+        throw file_format_exception("varint too long");
+    }
+
+    //Plain old data, as raw bytes
+    template<class T>
+    void put(std::string& out, const T& x)
+    {
+        static_assert(std::is_trivially_copyable<T>::value,"Only plain data can be written raw");
+        out.append(reinterpret_cast<const char*>(&x),sizeof(T));
+    }
+
+    template<class T>
+    T get(const char*& p, const char* end)
+    {
+        static_assert(std::is_trivially_copyable<T>::value,"Only plain data can be read raw");
+        if (end-p<static_cast<std::ptrdiff_t>(sizeof(T)))
+            throw file_format_exception("value past end of buffer");
+        T x;
+        std::memcpy(&x,p,sizeof(T));
+        p+=sizeof(T);
+        return x;
+    }
+
+    //A whole array of plain data, its length first
+    template<class T>
+    void putVector(std::string& out, const std::vector<T>& V)
+    {
+        static_assert(std::is_trivially_copyable<T>::value,"Only plain data can be written raw");
+        putVarint(out,V.size());
+        if (!V.empty())
+            out.append(reinterpret_cast<const char*>(V.data()),V.size()*sizeof(T));
+    }
+
+    template<class T>
+    std::vector<T> getVector(const char*& p, const char* end)
+    {
+        static_assert(std::is_trivially_copyable<T>::value,"Only plain data can be read raw");
+        uint64_t N=getVarint(p,end);
+        if (uint64_t(end-p)/sizeof(T)<N)
+            throw file_format_exception("array past end of buffer");
+        std::vector<T> V(N);
+        if (N>0)
+            std::memcpy(V.data(),p,N*sizeof(T));
+        p+=N*sizeof(T);
+        return V;
+    }
+
+    inline void putString(std::string& out, const std::string& S)
+    {
+        putVarint(out,S.size());
+        out+=S;
+    }
+
+    inline std::string getString(const char*& p, const char* end)
+    {
+        uint64_t N=getVarint(p,end);
+        if (uint64_t(end-p)<N)
+            throw file_format_exception("string past end of buffer");
+        std::string S(p,N);
+        p+=N;
+        return S;
+    }
+
+    //Varints directly from a stream, for the lengths in front of blocks in files read from start to end
+    //@return false if the stream ended before the first byte
+    //@throw file_format_exception if the stream ends in the middle
+    inline bool streamVarint(std::istream& in, uint64_t& x)
+    {
+        x=0;
+        for (int shift = 0; shift < 64; shift+=7)
+        {
+            int c=in.get();
+            if (c==std::char_traits<char>::eof())
+            {
+                if (shift==0)
+                    return false;
+                throw file_format_exception("file cut short in a varint");
+            }
+            x|=uint64_t(c&0x7F)<<shift;
+            if (!(c&0x80))
+                return true;
+        }
+        throw file_format_exception("varint too long");
+    }
+
+    //The end of splitmix64, every bit of the input changes about half the bits of the output
+    inline uint64_t mix64(uint64_t x) noexcept
+    {
+        x^=x>>30;
+        x*=0xBF58476D1CE4E5B9ull;
+        x^=x>>27;
+        x*=0x94D049BB133111EBull;
+        x^=x>>31;
+        return x;
+    }
+
+    //A 128 bit hash of the bytes (low and high half), for checksums and content keys. Two lanes, 8 bytes at a time, each with its own multiplier and rotation, which is about as fast as reading the bytes. It is NOT cryptographic, it catches changed, damaged and cut short files, not collisions made on purpose. Different seeds give hashes which have nothing to do with each other
+    inline std::pair<uint64_t,uint64_t> hash128(std::string_view content, uint64_t seed=0) noexcept
+    {
+        uint64_t a=0x9E3779B97F4A7C15ull^seed;
+        uint64_t b=0xC2B2AE3D27D4EB4Full+seed;
+        size_t i=0;
+        for (; i+8<=content.size(); i+=8)
+        {
+            uint64_t w;
+            std::memcpy(&w,content.data()+i,8);
+            a=std::rotl((a^w)*0x87C37B91114253D5ull,31);
+            b=std::rotl((b+w)*0x4CF5AD432745937Full,27);
+        }
+        uint64_t w=0;
+        //The data of an empty view may be null, which memcpy must not get even for 0 bytes
+        if (i<content.size())
+            std::memcpy(&w,content.data()+i,content.size()-i);
+        a=std::rotl((a^w)*0x87C37B91114253D5ull,31);
+        b=std::rotl((b+w)*0x4CF5AD432745937Full,27);
+
+        uint64_t low=mix64(a^content.size());
+        return {low,mix64(b+low)};
+    }
+
+    //Read exactly N bytes at this offset of the stream
+    //@throw file_format_exception if the stream is too short
+    inline void readAt(std::istream& in, uint64_t offset, std::vector<char>& buffer, size_t N)
+    {
+        buffer.resize(N);
+        in.clear();
+        in.seekg(offset);
+        in.read(buffer.data(),N);
+        if (!in || static_cast<size_t>(in.gcount())!=N)
+            throw file_format_exception("file too short, wanted "+std::to_string(N)+" bytes at offset "+std::to_string(offset));
+    }
+}
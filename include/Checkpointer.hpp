@@ -0,0 +1,108 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <cstdint>
+#include <cstddef>
+
+#include "EventQueue.hpp"
+
+/**
+* Checkpoints of a running simulation, so a day-long run which crashes in the afternoon, or a what-if question about the evening, can go on from the last checkpoint instead of from midnight.
+*
+* The checkpointer does not know what the simulation is made of, the parts are added by name (the event queue, the city, the vehicle pool, the statistics, anything with saveState and loadState), and a checkpoint is the state of every part, in the order they were added. It is taken between two events (after EventQueue::runUntil), so it is consistent. Taking it only copies the state into memory, and the simulation goes on while a background thread writes it to the directory, under a temporary name which is renamed when done, so a crash while writing leaves the checkpoints before it. If the writer falls behind, the next checkpoint waits for it, so only a couple of checkpoints are ever in memory.
+*
+* To resume, set the simulation up exactly like the run which was saved (the same city, the handlers registered in the same order, the signals and sources started with the same seed at the same time, and so on), and restore a checkpoint: every part is overwritten with the saved state, and the run goes on exactly as the saved one did, event for event. The random numbers are counter based (see CounterRNG), so the counters are all the state they have.
+*
+* Whatever the parts do not save is NOT in the checkpoint: output already written (see RoadStatistics::loadState), caches which only make things faster (RouteCache), and the journey log.
+*/
+
+class Checkpointer
+{
+public:
+    typedef std::function<void(std::string& out)> SaveFunction;
+    typedef std::function<void(const char*& p, const char* end)> LoadFunction;
+
+    //"TSCP" at the start of the files
+    static constexpr uint32_t magic=0x50435354;
+    static constexpr uint32_t version=1;
+
+private:
+    struct Part
+    {
+        std::string name;
+        SaveFunction save;
+        LoadFunction load;
+    };
+    std::vector<Part> parts;
+
+    std::string directory;
+    double interval;
+    double next;
+
+    //Checkpoints waiting for the writer (the file name and the bytes)
+    std::deque<std::pair<std::string,std::string> > pending;
+    const size_t maxPending=2;
+    size_t written=0;
+    bool stopping=false;
+    bool closed=false;
+    std::exception_ptr writerError;
+    std::mutex lock;
+    std::condition_variable changed;
+    std::thread writer;
+    void writeLoop();
+
+public:
+    //@param _directory where the checkpoints go, made if it does not exist
+    //@param _interval seconds of simulated time between checkpoints, see runUntil
+    //@param startTime the time the simulation starts at, the first checkpoint is one interval later
+    //@throw TrafficSimulation_error if the interval is not positive, or the directory can not be made
+    Checkpointer(const std::string& _directory, double _interval, double startTime=0);
+    //Waits for the writer, exceptions are swallowed, so call close yourself if you care
+    ~Checkpointer();
+
+    //Add a part of the simulation, the save function appends the state to out, and the load function reads it back from p, up to end (moving p past it)
+    //@throw TrafficSimulation_error if the name is already used
+    void add(const std::string& name, SaveFunction save, LoadFunction load);
+    //The same for anything with saveState(std::string&) and loadState(const char*&, const char*), which must outlive the checkpointer
+    template<class T>
+    void add(const std::string& name, T& part)
+    {
+        add(name,[&part](std::string& out){part.saveState(out);},[&part](const char*& p, const char* end){part.loadState(p,end);});
+    }
+
+    //Run the events until this time, stopping for a checkpoint every interval on the way (and at this time, if a checkpoint is due exactly then)
+    //@return the number of events run
+    //@throw TrafficSimulation_error if writing an earlier checkpoint failed
+    size_t runUntil(EventQueue& Q, double time);
+
+    //Take a checkpoint of every part now, labelled with this time, and queue it for writing. Nothing may change the parts while it is taken
+    //@return the file it will be written to
+    //@throw TrafficSimulation_error if writing an earlier checkpoint failed
+    std::string checkpoint(double time);
+
+    //Wait for every checkpoint to be written
+    //@throw TrafficSimulation_error if writing failed
+    void close();
+
+    /*Overwrite every part with the state saved in this checkpoint, and carry on checkpointing one interval after it
+    *@return the time of the checkpoint, continue the simulation from there
+    *@throw TrafficSimulation_error if the file can not be read
+    *@throw file_format_exception if it is not a whole checkpoint, with the same parts as this one (the file is checked before anything is changed), or a part does not fit the saved state, then the simulation is half restored and must be set up again*/
+    double restore(const std::string& path);
+
+    double getInterval() const noexcept {return interval;}
+    double getNextCheckpoint() const noexcept {return next;}
+    size_t getWritten();
+
+    //The file for a checkpoint at this time, the names sort in the order of the times
+    static std::string getPath(const std::string& directory, double time);
+    //The newest checkpoint in the directory, "" if there are none
+    static std::string latest(const std::string& directory);
+};
@@ -6,11 +6,26 @@
 #include "Node.hpp"
 #include "Road.hpp"
 #include "ICityNetwork.hpp"
+#include "Trafficlight.hpp"
+#include "Hellhole.hpp"
+#include "TrafficSource.hpp"
+#include "EventQueue.hpp"
+#include "StrongComponents.hpp"
+#include "NameTable.hpp"
+#include "ArtefactCache.hpp"
 
 #include "TrafficExceptions.hpp"
 
 /**
 *The basic class loading and storing roads and nodes
+*
+*By default the nodes and roads get the IDs of their place in the file, but the file is written by whoever made the city, in whatever order, so nodes next to each other on the map can be far apart in memory and in every array indexed by node ID (routing, statistics), which makes the searches and scans miss the cache all the time. Optionally the city is renumbered on load: the nodes along a Hilbert curve over the map, or with reverse Cuthill-McKee (breadth first through the roads, which keeps the IDs of neighbours close), and the roads after the lowest ID of their nodes. The IDs in the file can still be looked up, for reading and writing files which use them.
+*
+*Big cities can be loaded by more threads: the JSON text is still read by one thread (it is a single tree), but making the nodes, checking the roads, and telling every node about its roads is split between them. Telling the nodes is done node by node, with the roads of every node gathered first, so no two threads touch the same node. If anything is wrong with the city, it is loaded again by one thread, which throws the same error as a serial load would.
+*
+*Renumbering a big city takes a while, so given an ArtefactCache, the order is stored there, under the hash of the file, and read back the next time the same file is loaded with the same ordering.
+*
+*On load the strongly connected components of the roads are found (see StrongComponents), a city where some nodes can not be reached from others, or not left again, still loads, but anyone can look up which nodes are cut off.
 */
 
 class CityNetwork : public ICityNetwork
@@ -20,6 +35,11 @@ private:
     std::vector<std::shared_ptr<Node> > Nodes;
     std::vector<std::shared_ptr<Road> > Roads;
 
+    //The signalised nodes are ALSO in the node list, this is just so we don't have to look for them when starting the signals
+    std::vector<std::shared_ptr<Trafficlight> > Trafficlights;
+    //Same thing for the Hellholes which spawn traffic
+    std::vector<std::shared_ptr<Hellhole> > Sources;
+
     //HERE IS WHY THIS IS A std::vector and NOT ANY OTHER CONTAINER
     //We want a sequence container (std::array, std::vector, std::deque, std::list or std::forward_list), which is resizable (precluding std::array)
     //I would like easy random access with the [] operator (precluding linked lists)
@@ -31,10 +51,110 @@ private:
     size_t nodeSize;
     size_t roadSize;
 
+public:
+    enum Ordering: int {fileOrder=0, hilbertOrder, bandwidthOrder};
+
+private:
+    Ordering ordering;
+
+    //Only when renumbered, the ID in the file of every node and road, and the other way around
+    std::vector<size_t> fileNodeID;
+    std::vector<size_t> nodeFromFile;
+    std::vector<size_t> fileRoadID;
+    std::vector<size_t> roadFromFile;
+
+    //Fill in the IDs above
+    void findOrder(const Json::Value& NodesJson, const Json::Value& RoadsJson, Ordering Order);
+
+    //The hash of the file, and of the file with the ordering (the city as numbered), if loaded with a cache and not edited since
+    ArtefactKey fileKey;
+    ArtefactKey contentKey;
+    bool keyed=false;
+
+    //The IDs above from the cache (filed under the fileKey), or store them there
+    //@return false if they are not there, or not for this many nodes and roads
+    std::string orderName() const;
+    bool loadOrder(ArtefactCache& Cache, size_t nodes, size_t roads);
+    void storeOrder(ArtefactCache& Cache) const;
+
+    StrongComponents components;
+    void findComponents();
+
+    //The "type" of the nodes in the file (in any case)
+    enum NodeKind: int {hellholeNode=0, intersectionNode, trafficlightNode};
+    static const NameTable& nodeTypeNames();
+
+    //The "profiles" element of the file, the time-of-day profiles the sources share
+    Json::Value Profiles;
+
+    //The node with this ID, from the file ID and element
+    std::shared_ptr<Node> loadNode(size_t id, size_t fileID, Json::Value& V);
+    //The road with this ID, with the node IDs of the element renumbered if needed
+    std::shared_ptr<Road> loadRoad(size_t id, Json::Value& V, bool link);
+
+    //One node and road at the time, in the order of the IDs and the file
+    void loadSerial(Json::Value& NodesJson, Json::Value& RoadsJson);
+    //The nodes and then the roads split between the threads, and then the roads of every node added at once
+    //@return false if anything went wrong, then the city is not loaded
+    bool loadParallel(Json::Value& NodesJson, Json::Value& RoadsJson, unsigned threads);
+
 
 public:
 
-    CityNetwork(std::istream& CityNetworkJsonStream);
+    //@param Order how to number the nodes and roads
+    //@param Threads load the nodes and roads with this many threads, 0 to use every core. The city and the errors thrown are the same for any number
+    //@param Cache if not null, the renumbering is read from here if it was found for the same file before, else found and stored, and the city gets a content key, for caching everything else made from it
+    //@throw TrafficSimulation_error if the renumbering can not be stored in the cache
+    CityNetwork(std::istream& CityNetworkJsonStream, Ordering Order=fileOrder, unsigned Threads=1, ArtefactCache* Cache=nullptr);
+
+    Ordering getOrdering() const noexcept {return ordering;}
+
+    //The hash of the city file and the ordering, to find what was made from it before in an ArtefactCache (the same file numbered another way gets another key, as everything made from it has other IDs). Only if the city was loaded with a cache, and has not been edited since (then it is no longer what the file says)
+    bool hasContentKey() const noexcept {return keyed;}
+    const ArtefactKey& getContentKey() const noexcept {return contentKey;}
+
+    //Who can drive where
+    const StrongComponents& getComponents() const noexcept {return components;}
+
+    /*Edit the city, to try out a new road or a wider one between runs (not while the simulation is running). The city ends up exactly as if it had been loaded from the file with the same change: a new node or road is added at the end of the file, and gets the next ID, when a road is removed the roads after it get one lower ID, and the nodes at its ends give the roads after it one lower local ID. The node IDs in the JSON of a new road are the IDs in this city (the same as in the file, unless renumbered, then the new roads and nodes are not put in order with the rest). The components are found again after every edit. Anything else which keeps a table per road or node must be told too, see RoutingGraph
+    *@param NodeJson,RoadJson a node or road, as in the city file
+    *@return the ID of the new node or road
+    *@throw the same as when loading the node or road, road_address_exception if a node at the end of a new road already has all the roads it can have, or the road to remove or change does not exist, TrafficSimulation_error for less than one lane or a type which does not exist. When an edit throws, the city is not changed*/
+    size_t addNode(Json::Value& NodeJson);
+    size_t addRoad(Json::Value& RoadJson);
+    void removeRoad(size_t RoadID);
+    void setLanes(size_t RoadID, int lanes);
+    void setRoadType(size_t RoadID, RoadType type);
+
+    //The nodes outside the largest component, which can not be reached from the rest of the city, or from which the rest can not be reached, in order of ID
+    std::vector<size_t> getCutOffNodes() const;
+
+    //The ID a node or road has in the file, and the other way around (the same if not renumbered)
+    //@throw node_address_exception or road_address_exception if out of bounds
+    size_t getFileNodeID(size_t NodeID) const
+    {
+        if(NodeID>=nodeSize)
+            throw node_address_exception(NodeID,nodeSize);
+        return fileNodeID.empty() ? NodeID : fileNodeID[NodeID];
+    }
+    size_t getNodeFromFileID(size_t FileID) const
+    {
+        if(FileID>=nodeSize)
+            throw node_address_exception(FileID,nodeSize);
+        return nodeFromFile.empty() ? FileID : nodeFromFile[FileID];
+    }
+    size_t getFileRoadID(size_t RoadID) const
+    {
+        if(RoadID>=roadSize)
+            throw road_address_exception(RoadID,roadSize);
+        return fileRoadID.empty() ? RoadID : fileRoadID[RoadID];
+    }
+    size_t getRoadFromFileID(size_t FileID) const
+    {
+        if(FileID>=roadSize)
+            throw road_address_exception(FileID,roadSize);
+        return roadFromFile.empty() ? FileID : roadFromFile[FileID];
+    }
 
     virtual size_t getNodesSize() const noexcept
     {
@@ -55,8 +175,24 @@ public:
     }
     virtual std::shared_ptr<Road> getRoad(size_t RoadID)
     {
-        if(RoadID>=nodeSize)
+        if(RoadID>=roadSize)
             throw road_address_exception(RoadID,roadSize);
         return Roads[RoadID];
     }
+
+    size_t getTrafficlightsSize() const noexcept {return Trafficlights.size();}
+
+    //Start the signal cycle of every traffic light, the phase changes are scheduled in the queue
+    void startSignals(EventQueue& Q, double time);
+
+    size_t getSourcesSize() const noexcept {return Sources.size();}
+
+    //Start every traffic source, the spawn handler is called at the time and node of every new vehicle
+    //@param seed the same seed gives the same arrivals
+    void startSources(EventQueue& Q, double time, uint64_t seed, TrafficSource::SpawnHandler H);
+
+    //What changes in the nodes while the simulation runs (signals, sources, reservations, see Node::saveState), in the order of the node IDs, for checkpoints
+    void saveState(std::string& out) const;
+    //@throw file_format_exception if the bytes are not from a city with as many nodes, set up the same way
+    void loadState(const char*& p, const char* end);
 };
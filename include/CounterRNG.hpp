@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <limits>
+
+/**
+* Counter based random numbers (Philox4x32-10, from Salmon et al. "Parallel random numbers: as easy as 1, 2, 3").
+*
+* A normal generator (like std::mt19937) has a state, so the numbers an entity gets depend on how many numbers were drawn before it, which in a parallel run depends on the thread scheduling. A counter based generator has no state, random number i of an entity is a scrambling of (seed, entity, day, purpose, i), so every entity gets the same numbers no matter which thread asks or in which order.
+*
+* The seed is the key of the scrambling, the counter is:
+*   word 0: the index of the draw
+*   word 1: day (high 16 bits) and purpose (low 16 bits)
+*   word 2,3: entity ID (person, vehicle, node ...)
+* Each block gives 128 random bits, which is two 64 bit numbers or two doubles.
+*/
+
+//What the numbers are used for, so the same entity gets unrelated numbers for different things
+enum RandomPurpose: uint16_t {trafficSource=0, demand, driverBehaviour, routeChoice};
+
+class CounterRNG
+{
+private:
+    uint64_t seed;
+
+public:
+    CounterRNG(uint64_t _seed) noexcept : seed(_seed){}
+
+    //The raw scrambling function, 10 rounds of Philox4x32
+    static void philox(const uint32_t counter[4], const uint32_t key[2], uint32_t out[4]) noexcept;
+
+    //Random 64 bits number index of this stream
+    uint64_t bits(uint64_t entity, uint16_t day, uint16_t purpose, uint64_t index) const noexcept;
+
+    //Uniform double in [0,1) number index of this stream, (the same bits as bits(...) with the same index)
+    double uniform(uint64_t entity, uint16_t day, uint16_t purpose, uint64_t index) const noexcept;
+
+    //Same as calling uniform with index firstIndex, firstIndex+1 ... firstIndex+N-1, but many blocks are scrambled side by side, so the compiler can use SIMD instructions
+    void fillUniform(uint64_t entity, uint16_t day, uint16_t purpose, uint64_t firstIndex, double* out, size_t N) const noexcept;
+
+    uint64_t getSeed() const noexcept {return seed;}
+};
+
+/**
+* The numbers of one entity for one purpose on one day, with a counter so it can be used like a normal generator (it fulfils the requirements of a UniformRandomBitGenerator, so it works with the std distributions, but how those use the bits is up to the standard library, so sample from uniform() where the results must be the same on every platform).
+* The counter is the ONLY state, so it is cheap to copy, and saving the counter is enough to continue the stream later
+*/
+class RandomStream
+{
+private:
+    CounterRNG rng;
+    uint64_t entity;
+    uint16_t day;
+    uint16_t purpose;
+    uint64_t index=0;
+
+public:
+    typedef uint64_t result_type;
+
+    RandomStream(const CounterRNG& _rng, uint64_t _entity, uint16_t _day, uint16_t _purpose) noexcept : rng(_rng),entity(_entity),day(_day),purpose(_purpose){}
+
+    static constexpr result_type min() noexcept {return 0;}
+    static constexpr result_type max() noexcept {return std::numeric_limits<uint64_t>::max();}
+
+    result_type operator()() noexcept {return rng.bits(entity,day,purpose,index++);}
+    double uniform() noexcept {return rng.uniform(entity,day,purpose,index++);}
+
+    uint64_t getIndex() const noexcept {return index;}
+    void setIndex(uint64_t i) noexcept {index=i;}
+};
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstddef>
+#include <cstdint>
+
+/**
+* The simulation engine is event driven: nothing is polled every tick, instead everything which needs to happen at some time (a traffic light changing, a vehicle reaching the end of a road) puts an event in this queue, and the queue hands them out in time order.
+*
+* Events do NOT store std::function or other closures, they store the ID of a registered handler, a kind and an argument, which the handler decides the meaning of. That way the queue is just plain data, which can be compared, copied and saved.
+*/
+
+//Anything which wants to receive events must implement this
+class IEventHandler
+{
+public:
+    //@param time simulation time in seconds, when the event happens
+    //@param kind, arg whatever was given to EventQueue::schedule, the handler decides what they mean
+    virtual void handleEvent(double time, int kind, uint64_t arg)=0;
+
+    virtual ~IEventHandler(){}
+};
+
+struct Event
+{
+    double time;
+    uint64_t seq;//Order of scheduling, used to break ties so events at the same time always happen in the same order
+    size_t handler;//ID from EventQueue::registerHandler
+    int kind;
+    uint64_t arg;
+};
+
+class EventQueue
+{
+private:
+    //Binary min-heap on (time,seq), I do not use std::priority_queue because I want to be able to look at (and save) the raw list of events
+    std::vector<Event> heap;
+
+    //We DO NOT own the handlers, they must outlive the queue (or at least any events scheduled for them)
+    std::vector<IEventHandler*> handlers;
+
+    uint64_t nextSeq=0;
+    double now=0;
+
+    void siftUp(size_t i) noexcept;
+    void siftDown(size_t i) noexcept;
+
+public:
+    EventQueue() noexcept{};
+
+    //@return the ID to use when scheduling events for this handler
+    //@throw TrafficSimulation_error if H is nullptr
+    size_t registerHandler(IEventHandler* H);
+
+    //@param time when the event should happen, in seconds
+    //@param handler ID from registerHandler
+    //@throw TrafficSimulation_error if time is before the current time, or the handler does not exist
+    void schedule(double time, size_t handler, int kind, uint64_t arg=0);
+
+    //Run all events, with time less than or equal to this time, events scheduled by the handlers while running are also run if they fall before the time
+    //@return the number of events run
+    size_t runUntil(double time);
+
+    //Run the very next event, return false if there was none
+    bool runNext();
+
+    //Time of the next event, or -1 if the queue is empty (same convention as RoadVehicle::nextUpdate)
+    double nextTime() const noexcept {return heap.empty() ? -1.0 : heap.front().time;}
+
+    double getTime() const noexcept {return now;}
+    size_t size() const noexcept {return heap.size();}
+    bool empty() const noexcept {return heap.empty();}
+
+    //The events and the clock, for checkpoints (see Checkpointer). The handlers are not saved, a restored queue must have the same handlers registered in the same order, as they are when the simulation is set up the same way
+    void saveState(std::string& out) const;
+    //@throw file_format_exception if the bytes are not a queue, or were saved with another number of handlers
+    void loadState(const char*& p, const char* end);
+};
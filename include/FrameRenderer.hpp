@@ -0,0 +1,96 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <ostream>
+
+#include "KeyframeFormat.hpp"
+#include "KeyframeReader.hpp"
+#include "KeyframeReplay.hpp"
+
+class ICityNetwork;
+
+/**
+* Draws frames of a simulation run from the city and the binary keyframe file, without a screen, so review videos can be made on the build servers (the Processing sketch in animate_data/ is far too slow for a whole city)
+*
+* Roads are drawn as lines, as wide as their lanes, and coloured by congestion: green when the vehicles on it drive at the speed limit, red when they stand still, grey when it is empty. Vehicles are drawn as white squares, as long as the vehicle.
+*
+* The image is split into square tiles, and the roads and vehicles are first sorted into the tiles they touch. Then every thread takes one tile at a time and draws it on its own, so no two threads ever write the same pixel and nothing needs to be locked.
+*/
+
+//An RGB image, rows from the top
+struct FrameImage
+{
+    size_t width=0;
+    size_t height=0;
+    std::vector<uint8_t> pixels;//3 bytes per pixel
+
+    uint8_t* at(size_t x, size_t y) noexcept {return pixels.data()+3*(y*width+x);}
+    const uint8_t* at(size_t x, size_t y) const noexcept {return pixels.data()+3*(y*width+x);}
+
+    //Binary PPM (P6), which every video encoder can read
+    void writePPM(std::ostream& out) const;
+};
+
+class FrameRenderer
+{
+private:
+    ICityNetwork& city;
+    KeyframeReader& reader;
+    KeyframeReplay replay;
+
+    size_t width;
+    size_t height;
+    unsigned threads;
+    size_t tileSize;
+    size_t tilesX;
+    size_t tilesY;
+
+    //The part of the map we draw, and meters to pixels
+    KeyframeBox view;
+    double scale=1;
+
+    //Roads in pixels, set up by setView
+    struct RoadLine
+    {
+        double ax,ay,bx,by;
+        double halfWidth;
+    };
+    std::vector<RoadLine> lines;
+    std::vector<double> speedLimit;
+
+    //Set up by render before the threads start, then only read
+    std::vector<VehicleState> vehicles;
+    std::vector<double> congestion;//Per road, 0 free flow, 1 standing still, negative if empty
+    std::vector<std::vector<size_t> > tileRoads;
+    std::vector<std::vector<size_t> > tileVehicles;
+
+    double toPixelX(double x) const noexcept {return (x-view.minX)*scale;}
+    double toPixelY(double y) const noexcept {return (view.maxY-y)*scale;}
+
+    //Sort the roads and vehicles into the tiles they touch
+    void binTiles();
+
+    //Draw a whole tile, only writes pixels inside the tile
+    void drawTile(size_t tile, FrameImage& out) const;
+
+public:
+    //@param _reader must stay alive as long as the renderer
+    //@param _threads number of threads drawing tiles, 0 to use every core
+    //@throw TrafficSimulation_error if the image or tiles are empty
+    FrameRenderer(ICityNetwork& _city, KeyframeReader& _reader, size_t _width, size_t _height, unsigned _threads=0, size_t _tileSize=64);
+
+    //Draw this part of the map, the default is the whole city, the aspect ratio is kept, so there may be more to see on one axis
+    //@throw TrafficSimulation_error if the box is empty
+    void setView(const KeyframeBox& View);
+    const KeyframeBox& getView() const noexcept {return view;}
+
+    //Draw the city at this time, out is resized if needed
+    void render(double time, FrameImage& out);
+
+    //Green to yellow to red, grey if negative
+    static void congestionColour(double c, uint8_t rgb[3]) noexcept;
+
+    size_t getWidth() const noexcept {return width;}
+    size_t getHeight() const noexcept {return height;}
+};
@@ -3,6 +3,8 @@
 
 #include <memory>//Shared pointers
 #include "Node.hpp"
+#include "VehiclePool.hpp"
+#include "TrafficSource.hpp"
 
 /**
 * Hellholes, are a special type of nodes, with only one road.
@@ -19,6 +21,12 @@ private:
     const Road *myRoad=nullptr;
     const Node *myNeighbour=nullptr;//Only one neighbour
 
+    //How many vehicles have fallen in
+    size_t swallowed=0;
+
+    //Hellholes may ALSO spit vehicles out, for load testing, null if they don't
+    std::unique_ptr<TrafficSource> source;
+
 public:
     //Load, without loading the roads (they get loaded later, and then they are matched to the nodes)
     //@param ID the nodeID of this node
@@ -43,6 +51,9 @@ public:
     */
     virtual void addRoad(const Road *R);
 
+    //Take our road away, see Node::removeRoad
+    virtual void removeRoad(const Road *R);
+
 
 
 
@@ -59,5 +70,29 @@ public:
     *Get a const pointer to the Neighbour of this Node at the end of this road*/
     virtual const Node &getNeighbour(size_t roadId, bool local=false);
 
+    /*A vehicle drives into the hellhole, and disappears from the simulation, its slot in the pool is given back for the next vehicle to spawn in
+    *@param Pool the pool the vehicle lives in
+    *@param H the vehicle
+    *@throw vehicle_handle_exception if the vehicle already despawned*/
+    template<class VehicleType>
+    void swallow(VehiclePool<VehicleType>& Pool, VehicleHandle H)
+    {
+        Pool.despawn(H);
+        ++swallowed;
+    }
+
+    size_t getSwallowed() const noexcept {return swallowed;}
+
+    //The vehicles swallowed, and the source, see Node::saveState
+    virtual void saveState(std::string& out) const;
+    virtual void loadState(const char*& p, const char* end);
+
+    //Make this hellhole a source of vehicles as well
+    //@param fileID the ID of the node in the city file, if it has been renumbered, the random numbers of the source are keyed on it
+    //@throw TrafficSimulation_error on illegal config, see TrafficSource
+    void setSource(const TrafficSourceConfig& config, size_t fileID=SIZE_MAX){source=std::make_unique<TrafficSource>(getNodeID(),config,300,fileID==SIZE_MAX ? UINT64_MAX : fileID);}
+
+    //nullptr if this is not a source
+    TrafficSource* getSource() noexcept {return source.get();}
 
 };
@@ -0,0 +1,88 @@
+#pragma once
+#include "json/json.h"
+
+#include <vector>
+#include <memory>
+#include "Node.hpp"
+#include "ReservationTable.hpp"
+
+/**
+* Intersections are nodes where any number of roads meet (up to some maximum), and vehicles transfer from one road to another
+* A plain intersection has no signals, the traffic lights are a derived class
+*/
+
+class Road;//We don't need to use any members of road in this header file
+
+class Intersection: public Node{
+private:
+    //Same argument as in the Hellhole, we NEED raw const pointers here, since the roads are not loaded when we are constructed, and smart pointers would go in a circle
+    //myRoads[i] and myNeighbours[i] always belong together, i is the local ID of the road
+    std::vector<const Road*> myRoads;
+    std::vector<const Node*> myNeighbours;
+
+    size_t maxRoads;
+
+    //Only built on request, plenty of intersections are so quiet that conflicts are not worth tracking
+    std::unique_ptr<ReservationTable> reservations;
+
+public:
+    //Load, without loading the roads (they get loaded later, and then they are matched to the nodes)
+    //@param ID the nodeID of this node
+    //@param x,y position in meters
+    //@param _maxRoads the most roads which may meet here
+    Intersection(size_t ID,double x, double y, size_t _maxRoads=8) noexcept :Node(ID,x,y),maxRoads(_maxRoads){};
+
+    //Get number of roads, and max legal number of roads
+    virtual size_t getRoadNumber() const noexcept {return myRoads.size();}
+    virtual size_t getMaxRoadNumber() const noexcept {return maxRoads;}
+
+    /*Add a new road, the local ID of the road is the order it was added in
+    *@param R the road to add, see Node::addRoad for why this is a raw pointer
+    *@throw road_address_exception if we already have the maximum number of roads
+    *@throw TrafficSimulation_error if R is NULL, or does not have this node as one of its ends
+    */
+    virtual void addRoad(const Road *R);
+
+    //The same for many roads, with room made for all of them first
+    virtual void addRoads(const Road* const* R, size_t count);
+
+    //Take a road away, see Node::removeRoad, the reservation table (if any) is thrown away, as the movements are not the same anymore
+    virtual void removeRoad(const Road *R);
+
+    /*Get a const reference to the road with this roadID
+    *@param roadID the roadID of the road we are looking for
+    *@param localID Use the ID in the list of roads of this node instead (0 to RoadNumber) the latter is more uesful for pathfinding
+    *@throw road_address_exception on illegal roadID (including road not loaded)*/
+    virtual const Road &getRoad(size_t roadId, bool local=false);
+
+    /*Get a const reference to the neighbour at the end of this roadID
+    *@param roadID the roadID of the road we are looking for
+    *@param localID Use the ID in the list of roads of this node instead (0 to RoadNumber) the latter is more uesful for pathfinding
+    *@throw road_address_exception on illegal roadID (including road not loaded)*/
+    virtual const Node &getNeighbour(size_t roadId, bool local=false);
+
+    //Local ID of the road with this global ID
+    //@throw road_address_exception if the road does not meet here
+    size_t getLocalID(size_t roadId) const;
+
+    /*How long does it (ideally: with no traffic) take to transfer from this one road to this other, from the angle of the turn: nothing for going straight, more for sharper turns, more for left turns (crossing the oncoming traffic) than for right turns, and most for turning around on the same road
+    *@param road0id the road we come from
+    *@param road1id the road we leave by
+    *@param local Use the ID in the list of roads of this node instead (0 to RoadNumber)
+    *@throw road_address_exception on illegal roadID*/
+    double idealTransferTime(size_t road0id, size_t road1id, bool local=false) const;
+
+    //The part of the transfer time from the angle between the direction we drive in on the way in, and on the way out (need not be unit vectors), for turning between two different roads
+    static double turnTime(double inX, double inY, double outX, double outY) noexcept;
+
+    //Build (or rebuild) the movement reservation table, must be called after all roads have been added
+    //@throw TrafficSimulation_error see ReservationTable
+    ReservationTable& buildReservations(double windowLength=2.0, size_t windows=64);
+
+    //nullptr if buildReservations has not been called
+    ReservationTable* getReservations() noexcept {return reservations.get();}
+
+    //The reservations (if any), see Node::saveState
+    virtual void saveState(std::string& out) const;
+    virtual void loadState(const char*& p, const char* end);
+};
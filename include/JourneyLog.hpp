@@ -0,0 +1,71 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <string>
+#include <ostream>
+#include <thread>
+#include <atomic>
+#include <exception>
+
+#include "JourneyLogFormat.hpp"
+#include "SPSCQueue.hpp"
+#include "RouteStore.hpp"
+
+/**
+* Writes every journey leg of the simulation to an append-only columnar file (see design_documents/journeys.bin.md)
+*
+* The simulation thread hands the legs to a lock-free queue, and a background thread turns them into columns and writes them, so the simulation never waits for the disk. If the disk falls so far behind that the queue is full, the legs wait in a backlog on the simulation side and are pushed later, which costs memory, but never blocks.
+*
+* With internRoutes, the writer thread keeps a RouteStore, and every block only stores the routes of its legs as route IDs, and the trie nodes which are new since the last block, so routes used by thousands of commuters are only written once.
+*
+* Only one thread may log legs (the queue has one producer), if more threads finish journeys, give them a JourneyLog each.
+*/
+
+class JourneyLog
+{
+private:
+    std::ostream& out;
+    SPSCQueue<JourneyLeg> queue;
+    std::deque<JourneyLeg> backlog;//Producer only
+
+    std::atomic<bool> stopping=false;
+    std::atomic<bool> draining=false;//close is waiting for the writer, so it should not sleep
+    bool closed=false;
+    std::exception_ptr writerError;//Set by the writer before it stops
+    std::atomic<bool> failed=false;
+    uint64_t legsWritten=0;//Only read after the writer stopped
+
+    //Only used by the writer thread, until close
+    bool internRoutes;
+    RouteStore routes;
+
+    std::thread writer;
+
+    void writeLoop();
+
+    //Move as much of the backlog into the queue as fits
+    void drainBacklog();
+
+public:
+    //@param queueCapacity legs which can wait for the writer before the backlog is used
+    //@param _internRoutes store every distinct route once (see RouteStore)
+    //@throw TrafficSimulation_error if the header can not be written
+    JourneyLog(std::ostream& _out, size_t queueCapacity=1<<16, bool _internRoutes=false);
+
+    //Closes the file, exceptions are swallowed, so call close yourself if you care
+    ~JourneyLog();
+
+    //Log a finished leg, the roads are moved out of it
+    //@throw TrafficSimulation_error if the writer has failed, or the log is closed
+    void log(JourneyLeg& Leg);
+
+    //Wait for every leg to be written
+    //@throw TrafficSimulation_error if writing failed
+    void close();
+
+    size_t getBacklog() const noexcept {return backlog.size();}
+    //Only known after close
+    uint64_t getLegsWritten() const noexcept {return legsWritten;}
+    const RouteStore& getRouteStore() const noexcept {return routes;}
+};
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+/**
+* The data in the journey log files (see design_documents/journeys.bin.md)
+* Shared between the JourneyLog writer and the JourneyLogReader
+*/
+
+enum TravelMode: uint8_t {byCar=0,byBus,byTruck,byBicycle,onFoot};
+
+//One leg of a journey, travelled with one mode, all in SI units
+struct JourneyLeg
+{
+    uint64_t journey=0;//Legs of the same journey share this
+    TravelMode mode=byCar;
+    double distance=0;
+    double startTime=0;
+    double eta=0;//When we expected to arrive when we set out
+    double arrival=0;//When we actually arrived
+    std::vector<size_t> roads;//In the order they were driven
+};
+
+namespace JourneyLogFormat
+{
+    //"TSJL" at the start of the file
+    const uint32_t magic=0x4C4A5354;
+    const uint32_t version=2;//2: flags in the header, and optionally interned routes
+
+    //Flags in the header
+    const uint8_t internedRoutes=1;
+
+    //Legs per block, the reader never needs more than one block in memory
+    const size_t blockLegs=4096;
+}
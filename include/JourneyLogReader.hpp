@@ -0,0 +1,36 @@
+#pragma once
+
+#include <vector>
+#include <istream>
+
+#include "JourneyLogFormat.hpp"
+#include "RouteStore.hpp"
+
+/**
+* Reads the journey log files written by JourneyLog, one block at the time
+*/
+
+class JourneyLogReader
+{
+private:
+    std::istream& in;
+    bool internedRoutes=false;
+    RouteStore routes;//Rebuilt block by block, if the routes are interned
+
+    //Reused between blocks
+    std::vector<char> buffer;
+
+public:
+    //@param _in must stay alive as long as the reader
+    //@throw file_format_exception if the file is not a journey log
+    JourneyLogReader(std::istream& _in);
+
+    //Read the legs of the next block, replacing the content of out
+    //@return false if there are no more blocks
+    //@throw file_format_exception if the block is cut short or corrupt
+    bool nextBlock(std::vector<JourneyLeg>& out);
+
+    bool hasInternedRoutes() const noexcept {return internedRoutes;}
+    //The routes of the blocks read so far
+    const RouteStore& getRouteStore() const noexcept {return routes;}
+};
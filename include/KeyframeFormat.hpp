@@ -0,0 +1,80 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+/**
+* The data in the keyframe files, (see design_documents/keyframes.json.md and design_documents/keyframes.bin.md)
+* Shared between the KeyframeWriter and KeyframeReader
+*/
+
+//The state of a vehicle at a critical time-point, between keyframes vehicles move with constant acceleration, all in SI units
+struct Keyframe
+{
+    double time=0;
+    size_t road=0;
+    bool direction=true;//true when going from the first node of the road to the second
+    int lane=0;
+    double pos=0;
+    double speed=0;
+    double acc=0;
+};
+
+//One row in the file
+struct KeyframeRecord
+{
+    size_t vehicle;
+    Keyframe frame;
+};
+
+//The constant information about a vehicle
+struct KeyframeVehicle
+{
+    std::string type;//car, bus or truck, for display only
+    double length=3;
+    //Filled in by the writer
+    double firstTime=0;
+    double lastTime=0;//The last keyframe is the despawn
+    uint64_t keyframes=0;
+};
+
+//Where a chunk is in the file
+struct KeyframeChunkInfo
+{
+    double startTime;//All keyframes in the chunk are at or after this, and before the start of the next chunk
+    uint64_t offset;
+    uint64_t bytes;
+    uint64_t rows;
+};
+
+//Bounding box on the map, used by the spatial index of the roads
+struct KeyframeBox
+{
+    double minX=0;
+    double minY=0;
+    double maxX=0;
+    double maxY=0;
+
+    bool intersects(const KeyframeBox& B) const noexcept {return minX<=B.maxX && B.minX<=maxX && minY<=B.maxY && B.minY<=maxY;}
+};
+
+namespace KeyframeFormat
+{
+    //"TSKF" at the start of the file, "TSKI" at the end
+    const uint32_t headMagic=0x464B5354;
+    const uint32_t tailMagic=0x494B5354;
+    //2: chunks start with a snapshot of the vehicles alive at the start of the chunk
+    //3: the keyframes of a chunk are split in groups by grid cell, and the tail has the cell of every road
+    //4: with more than one group, every group ends with the place of its rows in the chunk
+    const uint32_t version=4;
+
+    //Quantisation of the stored values
+    const double timeResolution=1e-3;//s
+    const double posResolution=1e-2;//m
+    const double speedResolution=1e-2;//m/s
+    const double accResolution=1e-3;//m/s^2
+
+    //Lanes are packed with the direction in one byte
+    const int maxLane=127;
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <istream>
+#include <ostream>
+
+#include "KeyframeFormat.hpp"
+
+/**
+* Reads the binary keyframe files written by KeyframeWriter.
+*
+* Opening the file only reads the vehicle table and the chunk index at the end, the chunks are read when asked for, so seeking to any time costs one binary search and reading one chunk.
+*/
+
+class KeyframeReader
+{
+private:
+    std::istream& in;
+    double chunkDuration;
+
+    std::vector<KeyframeVehicle> vehicles;
+    std::vector<KeyframeChunkInfo> chunks;
+
+    //Spatial index, empty if the writer was not given the roads
+    std::vector<uint64_t> roadCell;
+    std::vector<KeyframeBox> roadBox;
+    //The cells with roads, in order, and the box covering the roads of each
+    std::vector<uint64_t> usedCells;
+    std::vector<KeyframeBox> cellBox;
+    //Index of the cell in usedCells, or usedCells.size() if it has no roads
+    size_t findCell(uint64_t cell) const noexcept;
+
+    //Reused between reads
+    std::vector<char> buffer;
+    std::vector<KeyframeRecord> decoded;
+
+    //Decode one block of rows (the snapshot or the keyframes of a chunk), p is moved past it
+    void decodeRows(const char*& p, const char* end, double startTime, std::vector<KeyframeRecord>& out) const;
+
+    //Read the chunk into the buffer, and skip the snapshot if asked
+    const char* loadChunk(size_t chunk, bool skipSnapshot);
+
+    //Decode the keyframe groups of a loaded chunk (p after the snapshot), only the cells where visible is true (by index in usedCells, all if visible is null)
+    void decodeGroups(size_t chunk, const char* p, const std::vector<char>* visible, std::vector<KeyframeRecord>& out);
+
+public:
+    //@param _in must be seekable, and stay alive as long as the reader
+    //@throw file_format_exception if the file is not a keyframe file, or it is cut short
+    KeyframeReader(std::istream& _in);
+
+    size_t getVehicleNumber() const noexcept {return vehicles.size();}
+    const KeyframeVehicle& getVehicle(size_t i) const {return vehicles.at(i);}
+
+    size_t getChunkNumber() const noexcept {return chunks.size();}
+    const KeyframeChunkInfo& getChunk(size_t i) const {return chunks.at(i);}
+    double getChunkDuration() const noexcept {return chunkDuration;}
+
+    //The chunk which would contain this time, (the last chunk starting at or before the time), or getChunkNumber() if time is before all chunks
+    size_t findChunk(double time) const noexcept;
+
+    //Decode the keyframes of one chunk, appended to out
+    //@throw file_format_exception if the chunk is corrupt
+    void readChunk(size_t chunk, std::vector<KeyframeRecord>& out);
+
+    //Decode the snapshot at the start of a chunk: the latest keyframe (before the chunk) of every vehicle which had not despawned, appended to out
+    //@throw file_format_exception if the chunk is corrupt
+    void readSnapshot(size_t chunk, std::vector<KeyframeRecord>& out);
+
+    //All keyframes with t0<=time<t1, in time order, appended to out
+    void read(double t0, double t1, std::vector<KeyframeRecord>& out);
+
+    //Keyframes with t0<=time<t1 on roads which touch this box, in time order, appended to out. Only the groups of the grid cells touching the box are decoded, so the cost scales with what is in view, not with the city
+    //If the file has no spatial index, this is the same as read
+    void query(double t0, double t1, const KeyframeBox& View, std::vector<KeyframeRecord>& out);
+
+    bool hasSpatialIndex() const noexcept {return !roadCell.empty();}
+
+    //Write everything as a keyframes.json file (see design_documents/keyframes.json.md), only sensible for small debug runs
+    void writeJson(std::ostream& out);
+};
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+#include "KeyframeFormat.hpp"
+#include "KeyframeReader.hpp"
+
+class ICityNetwork;
+
+/**
+* Finds where every vehicle is at any time, from a binary keyframe file
+*
+* Every chunk starts with a snapshot of the vehicles alive at its start, so we only need to decode one chunk, apply its keyframes up to the time we want, and move every vehicle forward with constant acceleration from its latest keyframe. Scrubbing back and forth within a chunk does not read the file again.
+*/
+
+//A vehicle at some time, x and y are only set if the replay knows the city
+struct VehicleState
+{
+    size_t vehicle;
+    Keyframe frame;//Moved forward to the time asked for
+    double x=0;
+    double y=0;
+};
+
+class KeyframeReplay
+{
+private:
+    KeyframeReader& reader;
+    ICityNetwork* city;
+
+    //The last chunk we decoded, we are likely asked for the same chunk again
+    size_t cachedChunk;
+    std::vector<KeyframeRecord> snapshot;
+    std::vector<KeyframeRecord> rows;
+
+    //Latest keyframe of every vehicle seen so far, slot[v] is the index in latest or -1, only the slots we touch are reset, so this is O(vehicles in the chunk), not O(all vehicles)
+    std::vector<KeyframeRecord> latest;
+    std::vector<int64_t> slot;
+
+    void loadChunk(size_t chunk);
+
+public:
+    //@param _reader must stay alive as long as the replay
+    //@param _city optional, without it the positions on the map are not set
+    KeyframeReplay(KeyframeReader& _reader, ICityNetwork* _city=nullptr);
+
+    //Every vehicle which has spawned and not despawned at this time, replaces the content of out
+    //@throw file_format_exception if the file is corrupt
+    void stateAt(double time, std::vector<VehicleState>& out);
+
+    //Same, but only the vehicles inside this box on the map
+    //@throw TrafficSimulation_error if we do not have a city
+    void stateIn(double time, double minX, double minY, double maxX, double maxY, std::vector<VehicleState>& out);
+
+    //Move the vehicle forward with constant acceleration, braking vehicles stop rather than reverse
+    static Keyframe extrapolate(const Keyframe& K, double time) noexcept;
+};
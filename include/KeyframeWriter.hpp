@@ -0,0 +1,87 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <ostream>
+
+#include "KeyframeFormat.hpp"
+
+class ICityNetwork;
+
+/**
+* Writes the keyframes of a simulation run to a binary, chunked, columnar file (see design_documents/keyframes.bin.md)
+*
+* The JSON keyframe file repeats every key name in every keyframe, and prints every number as text, which for a full city-day is tens of gigabytes. Here the keyframes are split into chunks by time, and each chunk stores each value as a column: times as deltas, roads and vehicles as varints, lane and direction in one byte, and position, speed and acceleration quantised to integers. An index of the chunks at the end of the file lets the reader jump straight to any time.
+*
+* Every chunk also starts with a snapshot: the latest keyframe of every vehicle alive at the start of the chunk, so the state at any time can be found from one chunk, without replaying the keyframes from the start.
+*
+* If the writer is given the roads, the keyframes of each chunk are also grouped by a grid over the map, so a viewer zoomed into one district only decodes the groups it can see.
+*
+* Keyframes must be added in time order (which is the order the simulation produces them in)
+*/
+
+class KeyframeWriter
+{
+private:
+    std::ostream& out;
+    double chunkDuration;
+
+    std::vector<KeyframeVehicle> vehicles;
+    std::vector<KeyframeChunkInfo> chunks;
+
+    //Rows of the chunk we are filling, and the snapshot at its start
+    std::vector<KeyframeRecord> rows;
+    std::vector<KeyframeRecord> snapshot;
+
+    //Latest keyframe of every vehicle, and the vehicles which have spawned and not despawned, (aliveAt[v] is the index in alive, or -1), so the snapshot is O(alive vehicles)
+    std::vector<Keyframe> latest;
+    std::vector<size_t> alive;
+    std::vector<int64_t> aliveAt;
+    int64_t currentChunk=-1;
+
+    //Spatial index, empty if indexRoads was not called, then every chunk has one group
+    std::vector<uint64_t> roadCell;
+    std::vector<KeyframeBox> roadBox;
+    uint64_t cells=1;
+
+    uint64_t offset=0;//Bytes written so far
+    double lastTime=0;
+    bool closed=false;
+
+    void write(const std::string& bytes);
+    void flushChunk();
+
+    //Columns of these rows, appended to out
+    static void encodeRows(const std::vector<KeyframeRecord>& R, double startTime, std::string& out);
+
+public:
+    //@param _out where to write, does not need to be seekable
+    //@param _chunkDuration seconds of simulation per chunk
+    //@throw TrafficSimulation_error if the chunk duration is not positive
+    KeyframeWriter(std::ostream& _out, double _chunkDuration=60.0);
+
+    //Closes the file, if not done already, exceptions are swallowed, so call close yourself if you care
+    ~KeyframeWriter();
+
+    //Group the keyframes of every chunk by the grid cell the middle of their road is in
+    //@param cellSize side of the grid cells in meters
+    //@throw TrafficSimulation_error if keyframes have already been added, or the cell size is not positive
+    void indexRoads(ICityNetwork& City, double cellSize=500.0);
+
+    //@return the vehicle ID to use with add
+    size_t addVehicle(const std::string& type, double length);
+
+    //@throw TrafficSimulation_error if the vehicle does not exist or has despawned, the time is before the last keyframe, the lane does not fit, or the road is not in the index
+    void add(size_t vehicle, const Keyframe& K);
+
+    //Add the last keyframe of a vehicle, after this it is no longer in the snapshots (if this is never called, the vehicle stays in the snapshots until the end, which is correct, but wasteful)
+    //@throw TrafficSimulation_error same as add
+    void despawn(size_t vehicle, const Keyframe& K);
+
+    //Write the last chunk, the vehicle table and the index
+    void close();
+
+    size_t getVehicleNumber() const noexcept {return vehicles.size();}
+    size_t getChunkNumber() const noexcept {return chunks.size();}
+    uint64_t getBytesWritten() const noexcept {return offset;}
+};
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+/**
+* A histogram with logarithmic buckets (like HDR histograms), every power of two is split into 16 buckets, so any value is known to within about 3%, from the smallest unit to very large numbers, with under a thousand buckets even in theory (a few dozen for realistic speeds and travel times).
+*
+* Values are first divided by the unit and rounded down, values below 16 units get a bucket each.
+*
+* The counts are only allocated up to the highest bucket used, so an empty histogram costs nothing, and two histograms with the same unit can be added together (for instance from different threads)
+*/
+
+class LogHistogram
+{
+private:
+    double unit;
+    std::vector<uint64_t> counts;
+    uint64_t total=0;
+
+public:
+    //Buckets per power of two is 2^subBucketBits
+    static const int subBucketBits=4;
+
+    //@param _unit the smallest difference we care about, must be positive
+    LogHistogram(double _unit=1) noexcept : unit(_unit){}
+
+    //Which bucket a value in units goes in, and the smallest value in units in a bucket
+    static size_t bucketOf(uint64_t v) noexcept;
+    static uint64_t bucketStart(size_t bucket) noexcept;
+
+    //Negative values count as 0
+    void add(double value, uint64_t count=1);
+
+    //Add every count of the other histogram
+    //@throw TrafficSimulation_error if the units are different
+    void merge(const LogHistogram& Other);
+
+    //Set every count to 0, but keep the memory for the next hour
+    void clear() noexcept;
+
+    //The value below which this fraction (0 to 1) of the values are, (the middle of the bucket), 0 if empty
+    double quantile(double q) const noexcept;
+
+    uint64_t getTotal() const noexcept {return total;}
+    double getUnit() const noexcept {return unit;}
+
+    //Raw buckets, for writing to files, trailing empty buckets are not included
+    size_t getBucketNumber() const noexcept;
+    uint64_t getCount(size_t bucket) const noexcept {return bucket<counts.size() ? counts[bucket] : 0;}
+    void setCount(size_t bucket, uint64_t count);
+};
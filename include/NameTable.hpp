@@ -0,0 +1,54 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <string_view>
+#include <initializer_list>
+#include <utility>
+#include <cstdint>
+#include <cstddef>
+
+/**
+* Turns the names used in the city files (road types, node types) into numbers, ignoring upper and lower case (only A to Z, like the C locale), without allocating anything: the names are hashed and compared one character at a time, folding the case as we go, instead of making a lower case copy of the name first.
+*
+* The table is open addressing, never more than a quarter full, so almost every name is found in the first slot. Several names may give the same number (the Danish and English names of the road types), and new names can be added at any time, before the table is used by more than one thread.
+*/
+
+class NameTable
+{
+private:
+    //The names in lower case, and their numbers
+    std::vector<std::string> names;
+    std::vector<int> values;
+
+    //Index in names, or empty, the size is a power of 2
+    std::vector<uint32_t> slots;
+    static constexpr uint32_t empty=UINT32_MAX;
+
+    static char fold(char c) noexcept {return c>='A' && c<='Z' ? c-'A'+'a' : c;}
+    static uint64_t hash(std::string_view name) noexcept;
+
+    //Slot of the name, or the empty slot where it would go
+    size_t findSlot(std::string_view name) const noexcept;
+
+public:
+    static constexpr int notFound=-1;
+
+    NameTable()=default;
+    //@throw TrafficSimulation_error as add
+    NameTable(std::initializer_list<std::pair<std::string_view,int> > _names);
+
+    //@throw TrafficSimulation_error if the name is already there (in any case), or the value is negative
+    void add(std::string_view name, int value);
+
+    //The number of the name, or notFound
+    int find(std::string_view name) const noexcept
+    {
+        if (slots.empty())
+            return notFound;
+        uint32_t i=slots[findSlot(name)];
+        return i==empty ? notFound : values[i];
+    }
+
+    size_t size() const noexcept {return names.size();}
+};
@@ -2,6 +2,7 @@
 #include "json/json.h"
 
 #include <memory>//Shared pointers
+#include <string>
 
 /**
 * Nodes are connected by differing numbers of roads (depending on the type of node)
@@ -32,6 +33,10 @@ public:
 
     double getDist(const Node& Other)const;
 
+    //Position on the map in meters
+    double getX() const noexcept {return x;}
+    double getY() const noexcept {return y;}
+
 
     //Checks all own
 
@@ -53,6 +58,24 @@ public:
     */
     virtual void addRoad(const Road* R) =0;
 
+    /*Add many roads at once, exactly as addRoad one at a time in this order would (the parallel city loader links all the roads of a node in one go)
+    *@param R count roads, see addRoad
+    *@throw the same as addRoad, the roads before the one which failed are added
+    */
+    virtual void addRoads(const Road* const* R, size_t count);
+
+    /*Take a road away again, when the city is edited, the roads after it get one lower local ID
+    *@param R the road to remove
+    *@throw road_address_exception if the road is not at this node
+    */
+    virtual void removeRoad(const Road* R) =0;
+
+    /*What changes while the simulation runs (not the roads, which come from the city file), for checkpoints (see Checkpointer), plain nodes have nothing
+    *loadState must be called on a node set up the same way as the saved one (same roads, signals and sources started)
+    *@throw file_format_exception if the bytes do not fit this node*/
+    virtual void saveState(std::string& out) const;
+    virtual void loadState(const char*& p, const char* end);
+
 
     /*Get a const reference to the road with this roadID
     *@param roadID the roadID of the road we are looking for
@@ -71,10 +94,5 @@ public:
     virtual const Node &getNeighbour(size_t roadId, bool local=false)=0;
 
 
-    //CORRECTION, THIS SHOULD BE MOVED TO AN INTERSECTION SUBCLASS, IT DOES NOT MAKE SENSE FOR END-NODES
-    //How long does it (ideally: with no traffic) take to transit from this one road to this other (indexed by RoadID, not the number they have in the road).
-    //@param roadID the roadID of the road we are looking for
-    //@param localID Use the ID in the list of roads of this node instead (0 to RoadNumber) the latter is more uesful for pathfinding
-    //@throw a road_address_exception on illegal roadID
-    //virtual double idealTransferTime(size_t road0id,size_t road1id)=0;
+    //The ideal transfer time between roads has been moved to Intersection::idealTransferTime, it does not make sense for end-nodes
 };
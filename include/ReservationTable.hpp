@@ -0,0 +1,87 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+#include "Node.hpp"
+
+/**
+* Time slot reservations for the movements through a Node, a movement is going from one road (local ID) to another.
+*
+* Time is split into windows of fixed length, and a vehicle approaching the node books its movement in the window it expects to cross in. Two movements conflict if they enter from the same road, leave by the same road, or their paths cross, and two conflicting movements can not be booked in the same window.
+*
+* Instead of checking every approaching vehicle against every other, each window is a 64 bit word: the low 48 bits say which movements are booked, and the high 16 bits say which window the word belongs to. Each movement has a precomputed mask of the movements it conflicts with, so checking is a single AND, and booking is a single compare-and-swap, so many worker threads can book at the same time without locks.
+*
+* Nodes with more than 6 roads have more than 48 movements, then each window is several such words, and a movement lives in one of them. Booking sets the bit in its own word (checking that word as above), then checks the other words, and takes the bit back if it finds a conflict there. Two threads booking conflicting movements in different words at the same time can then both be refused, but never both booked; the vehicles just try the next window.
+*
+* The windows are kept in a ring, only windows between the current window (see advance) and the number of windows in the ring can be booked.
+*/
+
+class ReservationTable
+{
+private:
+    size_t nodeID;
+    size_t roadNumber;
+    double windowLength;//seconds
+    size_t windows;//Power of 2
+    size_t words;//per window
+
+    //conflicts[movement*words+word] the movements in that word which can not share a window with this one (including itself)
+    std::vector<uint64_t> conflicts;
+
+    //Global road IDs of the local roads, so the vehicles can ask using the road they are on
+    std::vector<size_t> roadIDs;
+
+    std::unique_ptr<std::atomic<uint64_t>[]> slots;
+
+    //First window which may be booked, only moved forward by advance
+    std::atomic<int64_t> firstWindow;
+
+    //Index of movement, and the window of a time (or -1 if it can not be booked)
+    size_t movement(size_t from, size_t to) const;
+    int64_t window(double time) const noexcept;
+
+    //Take the bit of a movement out of a slot, if the slot still belongs to the window with this tag
+    static void unbook(std::atomic<uint64_t>& slot, uint64_t tag, uint64_t bit) noexcept;
+
+public:
+    //Build the table from the roads currently at the node, the conflicts are found from the directions of the roads (the positions of the neighbours)
+    //@param N the node, all roads must have been added
+    //@param _windowLength length of a time window in seconds
+    //@param _windows how many windows ahead of the current we may book, rounded up to a power of 2
+    //@throw TrafficSimulation_error if the window length is not positive
+    ReservationTable(Node& N, double _windowLength=2.0, size_t _windows=64);
+
+    //Book passage from road to road (local IDs) in the window of this time
+    //@return true if booked, false if the window is outside the bookable range or a conflicting movement has already booked it
+    //@throw road_address_exception on illegal local road
+    bool book(size_t from, size_t to, double time);
+
+    //Undo a booking, for instance if the vehicle was delayed, does nothing if it was not booked
+    void release(size_t from, size_t to, double time);
+
+    //Could this movement be booked right now?
+    bool isFree(size_t from, size_t to, double time) const;
+
+    //Do these two movements conflict?
+    bool conflict(size_t from0, size_t to0, size_t from1, size_t to1) const;
+
+    //Local ID of the road with this global ID, to translate road IDs from the vehicles
+    //@throw road_address_exception if the road does not meet here
+    size_t getLocalID(size_t roadID) const;
+
+    //Move the bookable range forward to start at this time, old windows are forgotten. Should only be called from one thread (the engine)
+    void advance(double time) noexcept;
+
+    //The bookings, for checkpoints, no thread may book while these run
+    void saveState(std::string& out) const;
+    //@throw file_format_exception if the bytes are not a table with the same number of windows
+    void loadState(const char*& p, const char* end);
+
+    double getWindowLength() const noexcept {return windowLength;}
+    size_t getWindows() const noexcept {return windows;}
+};
@@ -42,10 +42,14 @@ private:
     //For telling if a car has driven of the end, the length of the road from one end to another
     float length;
 
+    //The city changes the ID, lanes and type when it is edited, no one else may (everyone else only sees them through the city)
+    friend class CityNetwork;
+
 
 public:
+    //@param link add the road to its nodes, the parallel city loader leaves that for later, and adds all the roads of a node at once
     //@throws city_loader_errors
-    Road(size_t _roadID,Json::Value& object,ICityNetwork& City/*Not const, as we will be updating the nodes we connect to*/);
+    Road(size_t _roadID,Json::Value& object,ICityNetwork& City/*Not const, as we will be updating the nodes we connect to*/, bool link=true);
 
     ~Road();
 
@@ -58,6 +62,10 @@ public:
     //@throw TrafficSimulation_error if This is not one of my ends, or if Start or End is null
     const Node& getOther(size_t ThisID) const;
 
+    //The ends of the road, the direction of travel on the road is from the start (first) to the end (second)
+    const Node& getStart() const noexcept {return *start;}
+    const Node& getEnd() const noexcept {return *end;}
+
 
     //Mainly for Testing that the JSon file is loaded correctly
     RoadType getType() const{return type;}
@@ -68,4 +76,7 @@ public:
     int  getLanes() const{return lanes;}
 
     double getLength() const{return length;}
+
+    //Speed limit in m/s, from the type (the Danish defaults, 50, 80, 90 and 130 km/h)
+    double getSpeedLimit() const noexcept;
 };
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <string>
+#include <ostream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+
+#include "RoadStatisticsFormat.hpp"
+
+/**
+* Collects the per-road, per-hour statistics while the simulation runs (cars on each road, and their average speed), instead of working them out from the keyframes afterwards.
+*
+* Every simulation thread has its own shard, with one accumulator per road, so the threads never write the same memory. The accumulators keep the number of vehicles on the road and the sum of their speeds, and add up vehicle-seconds and distance every time something changes. All of that is linear, so a vehicle may enter a road in one shard and leave in another, the shards only make sense added together.
+*
+* Vehicles which drive the whole road also add their travel time and average speed to log-bucketed histograms (see LogHistogram), so the percentiles can be found, not just the average. The histograms only take memory for the roads which are used, and at most a fixed amount per road.
+*
+* At the end of every hour (when no thread is using its shard) closeHour adds the shards together, and hands the hour to a background thread which writes it to the file, so the simulation does not wait for the disk. Only a few finished hours are kept waiting for the writer, so the memory is O(roads*shards)
+*/
+
+class RoadStatistics
+{
+public:
+    //Only to be used by one thread at the time
+    class Shard
+    {
+    private:
+        friend class RoadStatistics;
+
+        struct Accumulator
+        {
+            double lastTime=0;
+            int64_t vehicles=0;//May be negative in one shard, if vehicles entered in another
+            double speedSum=0;
+            RoadStatisticsRecord hour;
+        };
+        std::vector<Accumulator> roads;
+        double hourStart=0;
+        double hourEnd=0;
+
+        //Add up what happened since the last change, and check the time is in this hour
+        Accumulator& update(double time, size_t road);
+
+    public:
+        //@throw TrafficSimulation_error if the road does not exist, or the time is not in the current hour
+        void enterRoad(double time, size_t road, double speed);
+        void leaveRoad(double time, size_t road, double speed);
+        void changeSpeed(double time, size_t road, double oldSpeed, double newSpeed);
+
+        //A vehicle drove the whole road, (call when it leaves), adds to the speed and travel time histograms
+        //@throw TrafficSimulation_error same as enterRoad
+        void traversal(double time, size_t road, double travelTime, double averageSpeed);
+    };
+
+private:
+    std::ostream& out;
+    double hourLength;
+    double hourStart;
+    std::vector<Shard> shards;
+
+    //Finished hours waiting for the writer, and empty buffers to reuse
+    std::deque<std::vector<RoadStatisticsRecord> > pending;
+    std::vector<std::vector<RoadStatisticsRecord> > spare;
+    const size_t maxPending=4;
+    size_t hoursWritten=0;
+    size_t hoursClosed=0;
+    bool stopping=false;
+    bool closed=false;
+    std::exception_ptr writerError;
+
+    std::mutex lock;
+    std::condition_variable changed;
+    std::thread writer;
+
+    void writeLoop();
+
+public:
+    //@param roads number of roads in the city
+    //@param shardNumber one per thread updating the statistics
+    //@throw TrafficSimulation_error if the hour length is not positive, or there are no shards
+    RoadStatistics(std::ostream& _out, size_t roads, unsigned shardNumber=1, double _hourLength=3600, double startTime=0);
+
+    //Waits for the writer, exceptions are swallowed, so call close yourself if you care
+    ~RoadStatistics();
+
+    Shard& getShard(unsigned i) {return shards.at(i);}
+    unsigned getShardNumber() const noexcept {return shards.size();}
+
+    double getHourStart() const noexcept {return hourStart;}
+    double getHourLength() const noexcept {return hourLength;}
+
+    //Add the shards together and queue the hour for writing, then start the next hour. No shard may be in use while this runs
+    //Waits if the writer is more than a few hours behind
+    //@throw TrafficSimulation_error if writing an earlier hour failed
+    void closeHour();
+
+    //Wait for every queued hour to be written, the hour in progress is NOT written (call closeHour first if you want it)
+    //@throw TrafficSimulation_error if writing failed
+    void close();
+
+    //Hours written to the file so far
+    size_t getHoursWritten();
+
+    //The hour in progress, for checkpoints (see Checkpointer). First waits for the writer to write every closed hour, so the file has all the hours before the checkpoint. No shard may be in use while this runs
+    //@throw TrafficSimulation_error if writing an earlier hour failed
+    void saveState(std::string& out);
+    //Continue the hour in progress when the state was saved, this must be a new RoadStatistics with the same roads, shards and hour length, started at the start of that hour (its file then has the hours from there on)
+    //@throw file_format_exception if the bytes are not statistics, or do not fit these
+    void loadState(const char*& p, const char* end);
+};
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+#include "LogHistogram.hpp"
+
+/**
+* The data in the road statistics files (see design_documents/road_statistics.bin.md)
+* Shared between the RoadStatistics writer and the RoadStatisticsReader
+*/
+
+namespace RoadStatisticsFormat
+{
+    //"TSRS" at the start of the file
+    const uint32_t magic=0x53525354;
+    const uint32_t version=2;//2: speed and travel time histograms
+
+    //Units of the histograms
+    const double speedUnit=0.1;//m/s
+    const double travelTimeUnit=0.1;//s
+}
+
+//What happened on one road in one hour
+struct RoadStatisticsRecord
+{
+    uint64_t entered=0;//Vehicles which drove onto the road
+    double vehicleSeconds=0;//Time spent on the road by all vehicles together
+    double distance=0;//m driven on the road by all vehicles together
+
+    //One value per vehicle which drove the whole road: its average speed on the road, and how long it took
+    LogHistogram speed=LogHistogram(RoadStatisticsFormat::speedUnit);
+    LogHistogram travelTime=LogHistogram(RoadStatisticsFormat::travelTimeUnit);
+
+    //Back to 0, but keep the memory of the histograms
+    void reset() noexcept
+    {
+        entered=0;
+        vehicleSeconds=0;
+        distance=0;
+        speed.clear();
+        travelTime.clear();
+    }
+
+    //Time averaged speed of the vehicles on the road in m/s, 0 if the road was empty
+    double averageSpeed() const noexcept {return vehicleSeconds>0 ? distance/vehicleSeconds : 0;}
+    //Average number of vehicles on the road
+    double averageVehicles(double hourLength) const noexcept {return vehicleSeconds/hourLength;}
+};
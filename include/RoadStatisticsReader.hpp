@@ -0,0 +1,40 @@
+#pragma once
+
+#include <vector>
+#include <istream>
+
+#include "RoadStatisticsFormat.hpp"
+
+/**
+* Reads the road statistics files written by RoadStatistics, one hour at the time
+*/
+
+class RoadStatisticsReader
+{
+private:
+    std::istream& in;
+    size_t roads;
+    double hourLength;
+    double startTime;
+    size_t hoursRead=0;
+
+    //Reused between hours
+    std::vector<char> buffer;
+
+public:
+    //@param _in must stay alive as long as the reader
+    //@throw file_format_exception if the file is not a road statistics file
+    RoadStatisticsReader(std::istream& _in);
+
+    size_t getRoadNumber() const noexcept {return roads;}
+    double getHourLength() const noexcept {return hourLength;}
+    double getStartTime() const noexcept {return startTime;}
+
+    //Read the next hour, one record per road, replacing the content of out
+    //@return false if there are no more hours
+    //@throw file_format_exception if the hour is cut short or corrupt
+    bool nextHour(std::vector<RoadStatisticsRecord>& out);
+
+    //Start time of the hour the last nextHour read
+    double getHourStart() const noexcept {return startTime+(hoursRead-1)*hourLength;}
+};
@@ -2,6 +2,7 @@
 
 
 #include <vector>
+#include <cstddef>
 
 /**Vehicle base class, this is the interface the road knows about
 * All vehicles have the same basic stats, like length, maxSpeed and acceleration
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+#include <cstddef>
+
+#include "RoutingGraph.hpp"
+#include "Router.hpp"
+#include "RouteStore.hpp"
+#include "JourneyLogFormat.hpp"
+
+/**
+* Remembers the routes the router found, so the same trip tomorrow (most people drive from home to work every day) does not need a new search.
+*
+* Routes are looked up by origin, destination, mode and the time of day of the departure, rounded to buckets (15 minutes by default), and the day itself is ignored, so the cache works across days. The roads of the routes are interned in a RouteStore, so commuters sharing a route share the memory.
+*
+* Travel time updates go through the cache, every road knows which cached routes use it, and every route keeps track of how far its travel time has drifted since it was planned. When that is more than a threshold (20% by default), the route is thrown out, and will be found again next time it is asked for. Routes using only roads which did not change are never searched again.
+*
+* All modes use the same road network for now, the mode is in the key so they can differ later.
+*
+* The cached routes are lists of road IDs, which an edit of the network (see RoutingGraph::nodeAdded and the rest) may move, so when the graph has followed an edit since the cache last looked, every route is thrown out (see rebuild) before the next lookup or travel time update. The Router must follow the same graph.
+*/
+
+class RouteCache
+{
+private:
+    RoutingGraph& graph;
+    Router& router;
+    RouteStore routes;
+
+    double bucketLength;
+    double dayLength;
+    double driftThreshold;
+
+    struct Key
+    {
+        uint32_t origin;
+        uint32_t destination;
+        uint32_t bucket;
+        TravelMode mode;
+        bool operator==(const Key& O) const noexcept {return origin==O.origin && destination==O.destination && bucket==O.bucket && mode==O.mode;}
+    };
+    struct KeyHash
+    {
+        size_t operator()(const Key& K) const noexcept
+        {
+            uint64_t h=(uint64_t(K.origin)<<32)^K.destination;
+            h^=(uint64_t(K.bucket)<<8|K.mode)*0x9E3779B97F4A7C15ull;
+            return size_t(h^(h>>29));
+        }
+    };
+
+    struct Entry
+    {
+        Key key;
+        RouteID route;
+        double plannedTime;//-1 if there is no route
+        double drift=0;//Current travel time minus planned time
+        uint32_t generation=0;//Bumped when the slot is thrown out, so old references from the roads are recognised
+        bool alive=false;
+    };
+    std::vector<Entry> entries;
+    std::vector<uint32_t> freeEntries;
+    std::unordered_map<Key,uint32_t,KeyHash> index;
+
+    //For every road, the (entry, generation) of the cached routes using it, old references are removed when found
+    std::vector<std::vector<std::pair<uint32_t,uint32_t> > > roadUsers;
+
+    uint64_t hits=0;
+    uint64_t misses=0;
+    uint64_t invalidations=0;
+
+    //RoutingGraph::getEdits when the routes were last thrown out
+    uint64_t graphEdits;
+    void followEdits() {if (graph.getEdits()!=graphEdits) rebuild();}
+
+    void invalidate(uint32_t entry);
+    void addUser(size_t road, uint32_t entry);
+
+public:
+    //@param _graph the travel times must be changed through the cache, or the cache will not know
+    //@param _bucketLength seconds of departure time which share a route
+    //@param _driftThreshold fraction the travel time of a route may change before it is planned again
+    //@throw TrafficSimulation_error if the bucket or day length is not positive, or the threshold is negative
+    RouteCache(RoutingGraph& _graph, Router& _router, double _bucketLength=900, double _driftThreshold=0.2, double _dayLength=86400);
+
+    //The fastest route, from the cache if we have it, replacing the content of roads
+    //@return travel time when it was planned, or -1 if the destination can not be reached
+    //@throw node_address_exception if a node does not exist
+    double lookup(size_t origin, size_t destination, double departure, TravelMode mode, std::vector<size_t>& roads);
+
+    //Change the travel time of a road in the graph, and throw out the routes which have drifted too far
+    //@throw TrafficSimulation_error as RoutingGraph::setTravelTime
+    void setTravelTime(size_t road, double time);
+
+    //Throw out every route, and start again from the roads of the graph as it is now. Done by itself after edits of the graph, the RouteIDs from before are gone with the routes
+    void rebuild();
+
+    uint64_t getHits() const noexcept {return hits;}
+    uint64_t getMisses() const noexcept {return misses;}
+    uint64_t getInvalidations() const noexcept {return invalidations;}
+    double getHitRate() const noexcept {return hits+misses>0 ? double(hits)/double(hits+misses) : 0;}
+    size_t getSize() const noexcept {return index.size();}
+    const RouteStore& getRouteStore() const noexcept {return routes;}
+};
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+#include <cstddef>
+
+/**
+* Stores routes (lists of road IDs) once, no matter how many vehicles or journeys use them.
+*
+* The routes are kept in a trie: every node is one road, and the route is the path from the root to the node, so a route is just the ID of its last node (4 bytes, instead of a vector of roads). Routes starting the same way (all the commuters leaving the same neighbourhood by the same roads) share the nodes of the common start, and a route already seen costs nothing at all.
+*
+* Not thread safe, every thread (or the journey log writer) should have its own, or lock around it
+*/
+
+//0 is the empty route
+typedef uint32_t RouteID;
+
+class RouteStore
+{
+private:
+    struct Node
+    {
+        uint32_t parent;
+        uint32_t length;//Number of roads from the root to here
+        size_t road;
+    };
+    std::vector<Node> nodes;
+
+    //(parent<<32)|road to the child node
+    std::unordered_map<uint64_t,RouteID> children;
+
+    uint64_t interned=0;
+    uint64_t roadsInterned=0;
+
+public:
+    RouteStore();
+
+    //@throw TrafficSimulation_error if a road ID does not fit in 32 bits, or the store is full
+    RouteID intern(const std::vector<size_t>& roads);
+
+    //The route of prefix with one more road at the end
+    //@throw TrafficSimulation_error as intern, or if prefix does not exist
+    RouteID extend(RouteID prefix, size_t road);
+
+    //Replaces the content of out
+    //@throw TrafficSimulation_error if the route does not exist
+    void getRoute(RouteID route, std::vector<size_t>& out) const;
+    size_t getLength(RouteID route) const;
+
+    //The last road and the route without it, for walking a route backwards, or writing the trie to a file
+    size_t getLastRoad(RouteID route) const;
+    RouteID getParent(RouteID route) const;
+
+    //Nodes in the trie, including the empty route, new nodes always get the next ID
+    size_t getNodeNumber() const noexcept {return nodes.size();}
+
+    //Statistics
+    uint64_t getInterned() const noexcept {return interned;}
+    uint64_t getRoadsInterned() const noexcept {return roadsInterned;}
+    //Roads asked to be stored, per road actually stored, (1 if nothing was shared)
+    double getDedupRatio() const noexcept {return nodes.size()>1 ? double(roadsInterned)/double(nodes.size()-1) : 1.0;}
+    //Rough memory use of the trie
+    size_t getBytes() const noexcept {return nodes.capacity()*sizeof(Node)+children.size()*(sizeof(uint64_t)+sizeof(RouteID)+2*sizeof(void*));}
+};
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+#include "RoutingGraph.hpp"
+#include "TravelTimeProfiles.hpp"
+
+/**
+* Finds the fastest route between two nodes with Dijkstra's algorithm, using the current travel times of the RoutingGraph, or the travel times at the time we get to each road from TravelTimeProfiles. Then the search keeps the time we arrive at every node instead of the time since we left, which only gives the fastest route because the profiles are FIFO (waiting never helps). Both searches are the same code, only the cost of a road differs.
+*
+* The edge based search (routeWithTurns) also pays for turning from one road to the next, and never makes forbidden turns. It searches over the edges (a road in one direction) instead of the nodes, since the cost of going on from a node depends on which road we came in by, and keeps a second set of arrays, one entry per edge, made the first time it is used.
+*
+* Trips between parts of the city which can not reach each other (see StrongComponents) are turned down before searching, instead of searching everything that can be reached from the origin first.
+*
+* All the arrays the search needs are kept between searches, and instead of clearing them, every entry has the number of the search which last wrote it, so a short search in a big city only touches the nodes it visits.
+*
+* Not thread safe, give every thread its own Router (they can share the graph, as long as no one changes the travel times while they search)
+*/
+
+class Router
+{
+private:
+    const RoutingGraph& graph;
+
+    std::vector<double> dist;
+    std::vector<uint32_t> viaRoad;
+    std::vector<uint32_t> viaNode;
+    std::vector<uint32_t> stamp;
+    uint32_t search=0;
+
+    struct HeapEntry
+    {
+        double dist;
+        uint32_t node;//Or edge, in the edge based search
+        bool operator>(const HeapEntry& O) const noexcept {return dist>O.dist;}
+    };
+    std::vector<HeapEntry> heap;
+
+    //The same, for the edge based search
+    std::vector<double> edgeDist;
+    std::vector<uint32_t> edgeVia;
+    std::vector<uint32_t> edgeStamp;
+    uint32_t edgeSearch=0;
+
+    uint64_t searches=0;
+    uint64_t settled=0;
+    uint64_t rejected=0;
+
+    //Check the nodes exist, and clear the route
+    //@return false if the destination certainly can not be reached from the origin
+    bool startSearch(size_t origin, size_t destination, std::vector<size_t>& roads);
+
+    //Dijkstra from origin, leaving at time start, where cost(road,time) is the time to drive the road when entering it at that time
+    //@return the time we get to destination, or -1
+    template<class Cost>
+    double dijkstra(size_t origin, size_t destination, double start, Cost cost, std::vector<size_t>& roads);
+
+public:
+    //@param _graph must stay alive as long as the router
+    Router(const RoutingGraph& _graph);
+
+    //The fastest route, as the list of roads to drive, replacing the content of roads
+    //@return travel time in seconds, or -1 if the destination can not be reached (then roads is empty)
+    //@throw node_address_exception if a node does not exist
+    double route(size_t origin, size_t destination, std::vector<size_t>& roads);
+
+    //The fastest route leaving at this time, when the travel times change through the day as in the profiles
+    //@return travel time in seconds, or -1 if the destination can not be reached (then roads is empty)
+    //@throw node_address_exception if a node does not exist
+    //@throw TrafficSimulation_error if the profiles are for another city
+    double route(size_t origin, size_t destination, double departure, const TravelTimeProfiles& Profiles, std::vector<size_t>& roads);
+
+    //The fastest route, including the time spent turning at the nodes on the way, and without forbidden turns (see RoutingGraph)
+    //@return travel time in seconds, or -1 if the destination can not be reached (then roads is empty)
+    //@throw node_address_exception if a node does not exist
+    double routeWithTurns(size_t origin, size_t destination, std::vector<size_t>& roads);
+
+    //Statistics, for benchmarks
+    uint64_t getSearches() const noexcept {return searches;}
+    uint64_t getSettled() const noexcept {return settled;}
+    //Trips turned down without searching, these are not counted as searches
+    uint64_t getRejected() const noexcept {return rejected;}
+};
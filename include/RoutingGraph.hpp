@@ -0,0 +1,210 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include <limits>
+#include <cstdint>
+#include <cstddef>
+
+#include "StrongComponents.hpp"
+
+class ICityNetwork;
+
+/**
+* The road network as the router sees it: for every node, the roads leaving it (one-way roads only from their first node), packed in one array (compressed sparse rows), so finding the neighbours of a node is one lookup and a linear scan, instead of going through the shared pointers of the Nodes and Roads.
+*
+* Every road has a travel time, which starts as the time to drive it at the speed limit, and can be updated as the simulation finds out how congested the road really is.
+*
+* A graph can be compressed (see compressChains): every chain of plain intersections with exactly two roads, which cost nothing to drive straight through, becomes a single "road" between the nodes at its ends, so the searches look at far fewer nodes. The roads of a compressed graph are the chains, and it knows which roads of the full graph they are made of, to turn the routes back into roads the vehicles can drive.
+*
+* The graph knows its strongly connected components (see StrongComponents), so the router can give up on trips into or out of parts of the city which are cut off by one-way roads without searching.
+*
+* When the city is edited, the graph can follow along (nodeAdded, roadAdded, roadRemoved, roadChanged), only the nodes at the ends of the road are made again, the rest of the arrays are just moved.
+*
+* Turns from one road to another at a node have a cost too, or are forbidden (infinite cost), for the edge based search in the Router. The roads at a node are numbered by their local ID at the Node (their slot), and most nodes keep a small dense matrix of turn costs, from slot to slot, which starts as Intersection::idealTransferTime with U-turns forbidden (except at dead ends). A node with n roads has n*n turns though, so nodes with more roads than maxMatrixRoads get no matrix, their turns are found from the directions of the roads when asked for, and only the turns changed by hand are stored, in a hash map.
+*/
+
+//A road leaving a node
+struct RoutingEdge
+{
+    uint32_t to;
+    uint32_t road;
+};
+
+class RoutingGraph
+{
+private:
+    //Edges of node n are firstEdge[n] to firstEdge[n+1]
+    std::vector<uint32_t> firstEdge;
+    std::vector<RoutingEdge> edges;
+
+    std::vector<double> travelTime;
+    std::vector<double> freeFlowTime;
+    std::vector<double> length;
+
+    //The nodes at the ends of every road, and if it may only be driven from start to end
+    std::vector<uint32_t> roadStart;
+    std::vector<uint32_t> roadEnd;
+    std::vector<uint8_t> oneWay;
+
+    //Only in compressed graphs: chain c is the roads chainFirst[c] to chainFirst[c+1] in chainRoads (full graph road IDs, from the start to the end of the chain), the chain every road of the full graph is part of, and the full graph ID of every node and the other way around
+    std::vector<uint32_t> chainFirst;
+    std::vector<uint32_t> chainRoads;
+    std::vector<uint32_t> chainOfRoad;
+    std::vector<uint32_t> originalNode;
+    std::vector<uint32_t> compressedNode;
+
+    //The roads at node n are slots firstSlot[n] to firstSlot[n+1] in slotRoad, in the order of their local IDs at the node, with the direction from the node along the road (unit vector)
+    std::vector<uint32_t> firstSlot;
+    std::vector<uint32_t> slotRoad;
+    std::vector<float> slotX;
+    std::vector<float> slotY;
+
+    //Per node, 1 if it is a plain Intersection, the only kind a chain may run through (vehicles wait at traffic lights, and appear and disappear at Hellholes)
+    std::vector<uint8_t> plainNode;
+
+    //Per edge, the slot of its road at the node it leaves, and the node it enters
+    std::vector<uint16_t> tailSlot;
+    std::vector<uint16_t> headSlot;
+
+    //Per node, where its matrix starts in turns (turn from slot i to slot j is at i*degree+j), or noMatrix
+    std::vector<uint32_t> turnOffset;
+    std::vector<float> turns;
+    static constexpr uint32_t noMatrix=UINT32_MAX;
+
+    size_t matrixRoads=16;
+
+    //Edits followed so far, so whatever keeps road or node IDs of this graph (RouteCache) can tell they may have moved
+    uint64_t edits=0;
+
+    //Turns set by hand at nodes without a matrix
+    std::unordered_map<uint64_t,float> sparseTurns;
+    static uint64_t turnKey(size_t node, size_t from, size_t to) noexcept {return (uint64_t(node)<<32)|(uint64_t(from)<<16)|to;}
+
+    //The turn cost of a node without a matrix, from the directions of the roads
+    double defaultTurnCost(size_t node, size_t from, size_t to) const noexcept;
+
+    //Slot of the road at the node
+    //@throw road_address_exception if the road does not meet at the node
+    size_t findSlot(size_t node, size_t road) const;
+
+    //Make the turn matrix of the node, at the end of turns, if it is small enough
+    void addMatrix(ICityNetwork& City, size_t n);
+
+    //After an edit of the city, make the slots, turns and edges of these nodes again, from the city
+    void refreshNodes(ICityNetwork& City, std::vector<size_t> nodes);
+    //@throw TrafficSimulation_error if the graph is compressed, or the city does not have this many nodes and roads
+    void checkEditable(ICityNetwork& City, size_t nodes, size_t roads) const;
+
+    StrongComponents components;
+    //Find the components from the edges, once they are all there
+    void findComponents();
+
+    //Only used by compressChains
+    RoutingGraph()=default;
+
+public:
+    static constexpr double forbidden=std::numeric_limits<double>::infinity();
+
+    //@param maxMatrixRoads nodes with more roads than this have no turn matrix
+    //@throw TrafficSimulation_error if the city has more than 2^32 nodes or roads, or a node has more than 2^16 roads
+    RoutingGraph(ICityNetwork& City, size_t maxMatrixRoads=16);
+
+    //Collapse every chain of nodes with exactly two roads into a single road. A node is only collapsed if it is a plain Intersection, it can be driven through the same ways as the roads on either side (both two-way, or both one-way in the same direction), and driving through it costs nothing (a bend in the road has a turn cost, which a chain can not keep, as it is not the same both ways). The nodes left are numbered from 0 in the order of their full IDs, a ring of collapsed nodes keeps one node. Turn costs and restrictions at the nodes left are copied (turning inside a chain is free), and the travel times are the sums over the chains.
+    //Journeys start and end at nodes with one road, so they are never collapsed, use getCompressedNode to find them
+    //@throw TrafficSimulation_error if the graph is already compressed
+    static RoutingGraph compressChains(const RoutingGraph& Full);
+
+    //For compressed graphs, node ID in the full graph, and the other way around (removedNode if collapsed), for full graphs, the same ID
+    static constexpr size_t removedNode=SIZE_MAX;
+    bool isCompressed() const noexcept {return !originalNode.empty();}
+    size_t getOriginalNode(size_t node) const noexcept {return isCompressed() ? originalNode[node] : node;}
+    size_t getCompressedNode(size_t fullNode) const noexcept {return isCompressed() ? (compressedNode[fullNode]==UINT32_MAX ? removedNode : compressedNode[fullNode]) : fullNode;}
+
+    //For compressed graphs, the full graph roads of a chain, from start to end, and the chain a full graph road is part of
+    size_t getChainLength(size_t chain) const noexcept {return chainFirst[chain+1]-chainFirst[chain];}
+    size_t getChainRoad(size_t chain, size_t i) const noexcept {return chainRoads[chainFirst[chain]+i];}
+    size_t getChainOf(size_t fullRoad) const noexcept {return chainOfRoad[fullRoad];}
+
+    //Turn a route found in a compressed graph (chains, leaving from origin) into the full graph roads, replacing the content of roads, for full graphs this copies the route. A two-way chain from a node back to itself is always driven from its start to its end
+    //@throw TrafficSimulation_error if the chains are not a route from origin
+    void expandRoute(size_t origin, const std::vector<size_t>& route, std::vector<size_t>& roads) const;
+
+    //For compressed graphs, set the travel time of every chain to the sum of the current travel times of its roads in the full graph
+    //@throw TrafficSimulation_error if this graph was not compressed from that one
+    void updateTravelTimes(const RoutingGraph& Full);
+
+    //The nodes at the ends of a road (or chain), and if it may only be driven from start to end
+    size_t getRoadStart(size_t road) const noexcept {return roadStart[road];}
+    size_t getRoadEnd(size_t road) const noexcept {return roadEnd[road];}
+    bool getOneWay(size_t road) const noexcept {return oneWay[road];}
+
+    const StrongComponents& getComponents() const noexcept {return components;}
+
+    size_t getNodeNumber() const noexcept {return firstEdge.size()-1;}
+    size_t getRoadNumber() const noexcept {return travelTime.size();}
+    size_t getEdgeNumber() const noexcept {return edges.size();}
+
+    //The roads leaving this node, (no bounds check, the router is the hot path)
+    const RoutingEdge* edgesBegin(size_t node) const noexcept {return edges.data()+firstEdge[node];}
+    const RoutingEdge* edgesEnd(size_t node) const noexcept {return edges.data()+firstEdge[node+1];}
+
+    //The same by index, for the edge based search, the edges of node n are getFirstEdge(n) to getFirstEdge(n+1)
+    size_t getFirstEdge(size_t node) const noexcept {return firstEdge[node];}
+    const RoutingEdge& getEdge(size_t edge) const noexcept {return edges[edge];}
+    size_t getTailSlot(size_t edge) const noexcept {return tailSlot[edge];}
+    size_t getHeadSlot(size_t edge) const noexcept {return headSlot[edge];}
+
+    //Number of roads at the node (including one-way roads in both directions)
+    size_t getDegree(size_t node) const noexcept {return firstSlot[node+1]-firstSlot[node];}
+
+    //Seconds lost turning from one slot to another at the node, forbidden if the turn is not allowed (no bounds check)
+    double getTurnCost(size_t node, size_t fromSlot, size_t toSlot) const noexcept
+    {
+        uint32_t offset=turnOffset[node];
+        if (offset!=noMatrix)
+            return turns[offset+fromSlot*getDegree(node)+toSlot];
+        if (!sparseTurns.empty())
+        {
+            auto It=sparseTurns.find(turnKey(node,fromSlot,toSlot));
+            if (It!=sparseTurns.end())
+                return It->second;
+        }
+        return defaultTurnCost(node,fromSlot,toSlot);
+    }
+
+    //Set the cost of turning from one road to another (global road IDs) at the node, forbidden to forbid it
+    //@throw node_address_exception if the node does not exist
+    //@throw road_address_exception if a road does not meet at the node
+    //@throw TrafficSimulation_error if the cost is negative or not a number
+    void setTurnCost(size_t node, size_t fromRoad, size_t toRoad, double cost);
+    void forbidTurn(size_t node, size_t fromRoad, size_t toRoad) {setTurnCost(node,fromRoad,toRoad,forbidden);}
+
+    //Memory used by the turns
+    size_t getTurnBytes() const noexcept {return turns.size()*sizeof(float)+sparseTurns.size()*(sizeof(uint64_t)+sizeof(float));}
+
+    //Seconds to drive the road, at the moment and in empty roads
+    double getTravelTime(size_t road) const noexcept {return travelTime[road];}
+    double getFreeFlowTime(size_t road) const noexcept {return freeFlowTime[road];}
+    //Meters
+    double getLength(size_t road) const noexcept {return length[road];}
+
+    //@throw TrafficSimulation_error if the road does not exist or the time is not positive
+    void setTravelTime(size_t road, double time);
+
+    //Follow an edit of the city (see CityNetwork) without building the whole graph again: only the nodes at the ends of the road are made again, and the rest is moved along. The graph ends up as if built from the edited city, the travel time of a new or changed road is its free flow time, and the nodes at the ends of a new or removed road get their default turns back (turns set by hand there are forgotten). Call it right after the edit, once per edit
+    //@throw TrafficSimulation_error if the graph is compressed (compress the edited full graph again instead), or does not match the edited city
+    //@throw road_address_exception if the road does not exist
+    void nodeAdded(ICityNetwork& City);
+    void roadAdded(ICityNetwork& City);
+    void roadRemoved(ICityNetwork& City, size_t road);
+    void roadChanged(ICityNetwork& City, size_t road);
+    //How many edits the graph has followed
+    uint64_t getEdits() const noexcept {return edits;}
+
+    //The whole graph as bytes (appended to out), and back, for the ArtefactCache. The components are found again when read
+    void toBinary(std::string& out) const;
+    //@throw file_format_exception if the bytes are not a graph
+    static RoutingGraph fromBinary(const std::string& in);
+};
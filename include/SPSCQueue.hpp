@@ -0,0 +1,67 @@
+#pragma once
+
+#include <vector>
+#include <atomic>
+#include <utility>
+#include <cstddef>
+
+#include "TrafficExceptions.hpp"
+
+/**
+* A fixed size ring buffer for passing things from exactly one producer thread to exactly one consumer thread, without locks.
+*
+* The producer only writes the tail and the consumer only writes the head, each reads the other's index with acquire, and publishes its own with release, so the slot is always fully written before the other side can see it. The two indices are on separate cache lines (and since the class is aligned to a cache line, nothing else shares the last one), so the threads do not fight over one line.
+*/
+
+template<class T>
+class SPSCQueue
+{
+private:
+    std::vector<T> slots;
+    size_t mask;
+
+    alignas(64) std::atomic<size_t> head=0;//Next slot to pop, only written by the consumer
+    alignas(64) std::atomic<size_t> tail=0;//Next slot to push, only written by the producer
+
+public:
+    //@param capacity rounded up to a power of two
+    //@throw TrafficSimulation_error if the capacity is 0
+    SPSCQueue(size_t capacity)
+    {
+        if (capacity==0)
+            throw TrafficSimulation_error("Queue capacity must be positive");
+        size_t N=1;
+        while (N<capacity)
+            N*=2;
+        slots.resize(N);
+        mask=N-1;
+    }
+
+    //Producer only
+    //@return false if the queue is full, then X is left as it was
+    bool tryPush(T& X)
+    {
+        size_t t=tail.load(std::memory_order_relaxed);
+        if (t-head.load(std::memory_order_acquire)>mask)
+            return false;
+        slots[t&mask]=std::move(X);
+        tail.store(t+1,std::memory_order_release);
+        return true;
+    }
+
+    //Consumer only
+    //@return false if the queue is empty
+    bool tryPop(T& X)
+    {
+        size_t h=head.load(std::memory_order_relaxed);
+        if (h==tail.load(std::memory_order_acquire))
+            return false;
+        X=std::move(slots[h&mask]);
+        head.store(h+1,std::memory_order_release);
+        return true;
+    }
+
+    //Only exact when neither side is working
+    bool empty() const noexcept {return head.load(std::memory_order_acquire)==tail.load(std::memory_order_acquire);}
+    size_t getCapacity() const noexcept {return slots.size();}
+};
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+#include "KeyframeFormat.hpp"
+
+class ICityNetwork;
+
+/**
+* Finds the nodes and roads close to a point, or inside a rectangle, for snapping the homes, jobs and shops of the population model to the road network, and for drawing and summing up parts of the map.
+*
+* The map is split into a uniform grid of square cells, every node is in the cell it is in, and every road is in all the cells its bounding box touches, with the items of all cells packed in one array (like the edges of the RoutingGraph). Roads in a city are short compared to the cells, so that is only a few cells per road.
+*
+* Nothing is allocated while querying, the results go in arrays owned by the caller, and the index is never changed after it is built, so any number of threads can query it at once.
+*/
+
+//A node or road found by a query, and the closest point of it
+struct SpatialHit
+{
+    size_t id=0;
+    double distance=0;//m from the query point
+    double x=0;
+    double y=0;
+    double along=0;//For roads, how far along from start to end the closest point is, 0 to 1
+};
+
+class SpatialIndex
+{
+private:
+    double originX=0;
+    double originY=0;
+    double cellSize=1;
+    size_t cellsX=1;
+    size_t cellsY=1;
+
+    //Items of cell c are firstNode[c] to firstNode[c+1] in cellNodes, and the same for the roads
+    std::vector<uint32_t> firstNode;
+    std::vector<uint32_t> cellNodes;
+    std::vector<uint32_t> firstRoad;
+    std::vector<uint32_t> cellRoads;
+
+    std::vector<double> nodeX;
+    std::vector<double> nodeY;
+
+    //The roads as line segments, and the cells their bounding boxes cover (inclusive)
+    struct Segment
+    {
+        double ax,ay,bx,by;
+        uint32_t cx0,cy0,cx1,cy1;
+    };
+    std::vector<Segment> segments;
+
+    //The cell of a position, clamped to the grid
+    size_t cellX(double x) const noexcept;
+    size_t cellY(double y) const noexcept;
+
+    //Closest point on a road
+    SpatialHit closestOnRoad(size_t road, double x, double y) const noexcept;
+
+    //Search outwards from the cell of the point, one ring of cells at a time, until the k best can not be beaten, Roads chooses nodes or roads
+    template<bool Roads>
+    size_t nearest(double x, double y, SpatialHit* out, size_t k) const noexcept;
+
+    //Only used by fromBinary
+    SpatialIndex()=default;
+
+public:
+    //@param _cellSize side of the cells in m, 0 to pick one with about one node per cell
+    //@throw TrafficSimulation_error if the cell size is negative, or the city has more than 2^32 nodes or roads
+    SpatialIndex(ICityNetwork& City, double _cellSize=0);
+
+    //The k closest nodes or roads (fewer if the city does not have that many), closest first, in out which must have room for k
+    //@return how many were found
+    size_t nearestNodes(double x, double y, SpatialHit* out, size_t k) const noexcept;
+    size_t nearestRoads(double x, double y, SpatialHit* out, size_t k) const noexcept;
+
+    //The nodes inside the box, or the roads which pass through it, in no particular order, every one once. Only the first capacity go in out
+    //@return how many there are, which may be more than capacity
+    size_t nodesIn(const KeyframeBox& Box, size_t* out, size_t capacity) const noexcept;
+    size_t roadsIn(const KeyframeBox& Box, size_t* out, size_t capacity) const noexcept;
+
+    //The whole index as bytes (appended to out), and back, for the ArtefactCache
+    void toBinary(std::string& out) const;
+    //@throw file_format_exception if the bytes are not an index
+    static SpatialIndex fromBinary(const std::string& in);
+
+    double getCellSize() const noexcept {return cellSize;}
+    size_t getCellNumber() const noexcept {return cellsX*cellsY;}
+};
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+/**
+* The strongly connected components of a road network: the sets of nodes where you can drive from every node to every other. A city should be one component, but with one-way roads it is easy to make a dead end you can drive into and never out of (a trap), or a place you can leave but never get to, and a vehicle trying to get from one to the other makes the router search the entire city before giving up.
+*
+* Found with Tarjan's algorithm, written with an explicit stack instead of recursion, so a long chain of nodes can not overflow the call stack. Tarjan finds the components in reverse topological order: if any road leads from component a to component b, then b has the lower number. So a node can only reach nodes with the same or lower component number, which, together with knowing which components no road leaves or enters, and which are not connected at all, lets mayReach reject most impossible trips with a few lookups, before any search.
+*/
+
+class StrongComponents
+{
+private:
+    std::vector<uint32_t> component;//Of every node
+
+    //Per component
+    std::vector<uint32_t> size;
+    std::vector<uint32_t> piece;//The weakly connected piece of the city it is in (connected when ignoring the directions of the roads)
+    std::vector<uint8_t> flags;
+    static constexpr uint8_t entered=1;//Some road leads here from another component
+    static constexpr uint8_t left=2;//Some road leads from here to another component
+
+    size_t largest=0;
+    size_t pieces=0;
+
+public:
+    //No nodes
+    StrongComponents()=default;
+
+    //The roads leaving node n lead to the nodes to[first[n]] to to[first[n+1]-1]
+    StrongComponents(const std::vector<uint32_t>& first, const std::vector<uint32_t>& to);
+
+    size_t getNodeNumber() const noexcept {return component.size();}
+    size_t getComponentNumber() const noexcept {return size.size();}
+    size_t getPieceNumber() const noexcept {return pieces;}
+
+    //(no bounds checks)
+    size_t getComponent(size_t node) const noexcept {return component[node];}
+    size_t getComponentSize(size_t c) const noexcept {return size[c];}
+    size_t getPiece(size_t c) const noexcept {return piece[c];}
+    //The biggest component, the lowest numbered if more are equally big, which is the main road network in any sensible city
+    size_t getLargestComponent() const noexcept {return largest;}
+    //No road leaves the component, a vehicle which gets in can never get out
+    bool isTrap(size_t c) const noexcept {return getComponentNumber()>1 && !(flags[c]&left);}
+    //No road enters the component, nothing can get in
+    bool isUnreachable(size_t c) const noexcept {return getComponentNumber()>1 && !(flags[c]&entered);}
+
+    //False if there is certainly no way from origin to destination, true if there may be one (always if there is). Only pairs which pass through components in between in the wrong order are let through, the search will fail for those
+    bool mayReach(size_t origin, size_t destination) const noexcept
+    {
+        uint32_t a=component[origin];
+        uint32_t b=component[destination];
+        if (a==b)
+            return true;
+        return a>b && piece[a]==piece[b] && (flags[a]&left) && (flags[b]&entered);
+    }
+};
@@ -40,6 +40,11 @@ public:
 };
 
 
+class vehicle_handle_exception: public TrafficSimulation_error{
+public:
+    vehicle_handle_exception(unsigned int index, unsigned int generation) noexcept : TrafficSimulation_error ("Vehicle in slot "+std::to_string(index)+" generation "+std::to_string(generation)+" does not exist (despawned or never spawned)"){}
+};
+
 
 class road_address_exception: public TrafficSimulation_error
 {
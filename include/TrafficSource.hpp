@@ -0,0 +1,80 @@
+#pragma once
+#include "json/json.h"
+
+#include <vector>
+#include <functional>
+#include <cstdint>
+
+#include "EventQueue.hpp"
+#include "CounterRNG.hpp"
+
+/**
+* A source of vehicles at a node, for load testing without the full population model.
+*
+* Vehicles arrive as a Poisson process, with a rate (vehicles per hour) multiplied by a time-of-day profile (one factor per hour). Instead of asking the random number generator every tick whether a vehicle spawns, we sample all the arrival times of a window (5 minutes by default) at once, and schedule them as events; the last event of the window samples the next one.
+*
+* The numbers come from a counter based stream keyed on the run seed and the node ID, so the same seed gives the same vehicles, no matter how many sources there are, what order they are started in, or which thread samples them.
+*/
+
+struct TrafficSourceConfig
+{
+    double rate=0;//vehicles per hour
+    std::vector<double> profile;//Factor for each hour of the day (repeating every 24 hours), empty means 1 all day
+};
+
+class TrafficSource : public IEventHandler
+{
+public:
+    //Called once per vehicle, at the time it should spawn
+    typedef std::function<void(double time, size_t nodeID)> SpawnHandler;
+
+    enum EventKind: int {spawn=0, nextWindow};
+
+private:
+    size_t nodeID;
+    uint64_t streamKey;//The random numbers are keyed on this, normally the node ID
+    TrafficSourceConfig config;
+    double windowLength;
+
+    RandomStream generator;
+
+    SpawnHandler onSpawn;
+    EventQueue* queue=nullptr;
+    size_t handlerID=0;
+
+    //Reused between windows
+    std::vector<double> arrivals;
+
+    //Arrivals per hour at this time
+    double rateAt(double time) const noexcept;
+
+    //Sample and schedule all arrivals in [t0,t1), and the event to sample the next window
+    void sampleWindow(double t0, double t1);
+
+public:
+    //@param _nodeID the node vehicles spawn at
+    //@param _windowLength seconds of arrivals sampled at once
+    //@param _streamKey key the random numbers on this instead of the node ID, so a city renumbered on load (see CityNetwork) gives the same vehicles as the file order
+    //@throw TrafficSimulation_error on negative rate or window length
+    TrafficSource(size_t _nodeID, const TrafficSourceConfig& _config, double _windowLength=300, uint64_t _streamKey=UINT64_MAX);
+
+    //Read the "source" element of a node in the city file
+    //@param Profiles the "profiles" element of the city file, the profile of the source may be the name of one of these instead of a list
+    //@throw TrafficSimulation_error on malformed source, or a profile name which is not in Profiles
+    static TrafficSourceConfig loadConfig(const Json::Value& SourceJson, const Json::Value& Profiles=Json::Value());
+
+    //Start generating arrivals from this time
+    //@param seed the seed of the run
+    //@throw TrafficSimulation_error if it is already started
+    void start(EventQueue& Q, double time, uint64_t seed, SpawnHandler H);
+
+    //The position in the random numbers, for checkpoints, the arrivals already sampled are events in the queue
+    void saveState(std::string& out) const;
+    //@throw file_format_exception if the bytes do not fit this source (started when the saved one was not, or the other way around, or with another handler ID)
+    void loadState(const char*& p, const char* end);
+
+    size_t getNodeID() const noexcept {return nodeID;}
+    const TrafficSourceConfig& getConfig() const noexcept {return config;}
+
+    virtual void handleEvent(double time, int kind, uint64_t arg);
+};
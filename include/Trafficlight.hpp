@@ -0,0 +1,88 @@
+#pragma once
+#include "json/json.h"
+
+#include <vector>
+#include <functional>
+#include <cstdint>
+
+#include "Intersection.hpp"
+#include "EventQueue.hpp"
+
+/**
+* A signalised intersection, the signal goes through a fixed cycle of phases, each phase lets some of the roads (by local ID) drive, and stops the rest.
+*
+* The phase changes are events in the EventQueue, the light is NOT polled by the vehicles, a vehicle arriving on red is put in the queue of its road, and all the queued vehicles of a road are released in one go when it turns green.
+*/
+
+struct SignalPhase
+{
+    std::vector<size_t> green;//Local IDs of the roads with green light
+    double duration;//seconds
+};
+
+class Trafficlight: public Intersection, public IEventHandler{
+public:
+    //Called with all the vehicles which were waiting on this road (local ID) when it turns green
+    typedef std::function<void(double time, size_t localRoad, const std::vector<uint64_t>& vehicles)> ReleaseHandler;
+
+    //Event kinds we schedule for ourself
+    enum EventKind: int {phaseChange=0};
+
+private:
+    std::vector<SignalPhase> phases;
+    bool defaulted=false;//The phases were made by defaultPhases, not given, and are made again if the roads change
+    size_t currentPhase=0;
+
+    //isGreen[i] is true if the road with local ID i currently has green light, updated on every phase change, so lookup is O(1)
+    std::vector<bool> greenNow;
+
+    //Vehicles stopped at red light, per local road ID, the vectors are cleared but not freed when released, so a busy light stops allocating after a few cycles
+    std::vector<std::vector<uint64_t> > stopped;
+
+    ReleaseHandler onRelease;
+
+    EventQueue* queue=nullptr;
+    size_t handlerID=0;
+
+    //Set greenNow for phase i, and release the queues of the roads which just turned green
+    void enterPhase(size_t i, double time);
+
+    //If no phases were given, roads pointing (roughly) east-west go in one phase, and north-south in the other
+    void defaultPhases();
+
+public:
+    //@param ID the nodeID of this node
+    //@param x,y position in meters
+    //@param _phases the signal cycle, if empty a default two-phase cycle is made when the light is started
+    Trafficlight(size_t ID,double x, double y, std::vector<SignalPhase> _phases=std::vector<SignalPhase>(), size_t _maxRoads=8) noexcept :Intersection(ID,x,y,_maxRoads),phases(_phases){};
+
+    //Read the optional "phases" element of a Trafficlight node in the city file
+    //@throw TrafficSimulation_error on malformed phases
+    static std::vector<SignalPhase> loadPhases(const Json::Value& NodeJson);
+
+    void setReleaseHandler(ReleaseHandler H){onRelease=H;}
+
+    //Start the signal cycle in phase 0 at this time, must be called after ALL roads have been added
+    //@throw TrafficSimulation_error if a phase refers to a road we do not have, or the cycle has no duration, or the light is already started
+    void start(EventQueue& Q, double time);
+
+    //A vehicle arrives at the stop line of this road (local ID)
+    //@return true if it may drive through right now, false if it has been put in the queue, and will be released later
+    //@throw road_address_exception if the road does not exist
+    bool arrive(size_t localRoad, uint64_t vehicle);
+
+    bool isGreen(size_t localRoad) const noexcept {return localRoad<greenNow.size() && greenNow[localRoad];}
+    size_t getCurrentPhase() const noexcept {return currentPhase;}
+    size_t getPhaseNumber() const noexcept {return phases.size();}
+    size_t getQueueLength(size_t localRoad) const noexcept {return localRoad<stopped.size() ? stopped[localRoad].size() : 0;}
+
+    //As for Intersection, and default phases are thrown away, to be made again from the new roads on the next start (phases which were given are kept, just like when the city is loaded again)
+    virtual void addRoad(const Road *R);
+    virtual void removeRoad(const Road *R);
+
+    //The phase, the lights and the vehicles waiting, see Node::saveState
+    virtual void saveState(std::string& out) const;
+    virtual void loadState(const char*& p, const char* end);
+
+    virtual void handleEvent(double time, int kind, uint64_t arg);
+};
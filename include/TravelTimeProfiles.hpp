@@ -0,0 +1,64 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+#include <cmath>
+
+class RoutingGraph;
+class RoadStatisticsReader;
+
+/**
+* The travel time of every road as a function of the time of day, so people can plan with how busy the roads were yesterday, instead of how busy they are right now.
+*
+* Every road has the same number of points, evenly spread over the day (by default one per hour, in the middle of the hour), and between them the travel time is linear, after the last point it wraps around to the first. Because the points are evenly spread, finding the travel time at a time is one division and two lookups, so the time dependent router is not much slower than the static one.
+*
+* The profiles are FIFO: leaving later never gets you there earlier. If the data says otherwise (a road which took 10 minutes at 8:00 and 1 minute at 8:05), the later points are raised until it does not, otherwise the router could find "routes" which wait for the traffic to clear before driving in.
+*/
+
+class TravelTimeProfiles
+{
+private:
+    size_t roads;
+    size_t points;
+    double dayLength;
+    double step;//Time between points
+
+    //Point k of road r is at index r*points+k, its time of day is (k+0.5)*step
+    std::vector<double> times;
+
+    //Raise the points of one road until it is FIFO
+    void makeFIFO(size_t road);
+
+public:
+    //Every road takes its free flow time all day
+    //@throw TrafficSimulation_error if there are no points or the day is not positive
+    TravelTimeProfiles(const RoutingGraph& G, size_t _points=24, double _dayLength=86400);
+
+    //Replace the points of a road, the profile is made FIFO
+    //@throw road_address_exception if the road does not exist
+    //@throw TrafficSimulation_error if there is not one positive time per point
+    void setProfile(size_t road, const std::vector<double>& profile);
+
+    //Build the profiles from a day of road statistics: the median travel time of the vehicles which drove the road in the hour, or if there were none the time at the average speed, or the free flow time if the road was empty. Never faster than the free flow time. If the file has more than a day, the later days replace the earlier.
+    //@throw TrafficSimulation_error if the statistics are for another city or have another hour length than the points
+    //@throw file_format_exception if the statistics are corrupt
+    void loadStatistics(RoadStatisticsReader& Reader, const RoutingGraph& G);
+
+    //Seconds to drive the road when entering it at this time (any time, also past the first day)
+    double travelTime(size_t road, double time) const noexcept
+    {
+        double x=time/step-0.5;
+        double f=x-std::floor(x/points)*points;//Position in the day, 0 to points
+        size_t k=size_t(f);
+        if (k>=points)//Rounding of times just before midnight
+            k=points-1;
+        double w=f-k;
+        const double* P=times.data()+road*points;
+        return P[k]+(P[k+1==points ? 0 : k+1]-P[k])*w;
+    }
+
+    size_t getRoadNumber() const noexcept {return roads;}
+    size_t getPointNumber() const noexcept {return points;}
+    double getDayLength() const noexcept {return dayLength;}
+    double getPoint(size_t road, size_t k) const noexcept {return times[road*points+k];}
+};
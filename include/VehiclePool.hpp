@@ -0,0 +1,208 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <new>
+#include <utility>
+#include <string>
+#include <cstring>
+#include <type_traits>
+#include <cstdint>
+#include <cstddef>
+
+#include "TrafficExceptions.hpp"
+#include "BinaryIO.hpp"
+
+/**
+* Storage for the vehicles currently in the simulation.
+*
+* In a day-long run millions of vehicles are spawned and despawned (when they fall into a Hellhole), so instead of new and delete for every vehicle, they live in slots in big blocks, and despawned slots go on a free-list to be reused by the next vehicle. The general heap is only touched when all slots are in use and a new block is needed.
+*
+* Vehicles are referred to by handles, which are the slot and the generation of the slot. The generation is bumped every time the slot is spawned into or despawned from, so an old handle to a despawned vehicle is recognised as stale, even if the slot has been reused.
+*/
+
+struct VehicleHandle
+{
+    uint32_t index;
+    uint32_t generation;
+
+    //Packed into one number, used where vehicles are stored as plain IDs (such as the queues at traffic lights)
+    uint64_t toID() const noexcept {return (uint64_t(generation)<<32)|index;}
+    static VehicleHandle fromID(uint64_t ID) noexcept {return VehicleHandle{uint32_t(ID&0xFFFFFFFF),uint32_t(ID>>32)};}
+
+    bool operator==(const VehicleHandle& Other) const noexcept {return index==Other.index && generation==Other.generation;}
+};
+
+template<class VehicleType>
+class VehiclePool
+{
+private:
+    struct Slot
+    {
+        alignas(VehicleType) unsigned char data[sizeof(VehicleType)];
+    };
+
+    size_t blockSize;
+
+    //Blocks are never moved or freed while the pool lives, so pointers to vehicles stay valid until they despawn
+    std::vector<std::unique_ptr<Slot[]> > blocks;
+
+    //Odd generation: slot is in use, even: slot is free
+    std::vector<uint32_t> generations;
+
+    //Free slots, used as a stack so recently freed (and still cached) slots are reused first
+    std::vector<uint32_t> freeList;
+
+    size_t live=0;
+    size_t peak=0;
+    size_t growths=0;
+
+    VehicleType* slot(uint32_t index) noexcept
+    {
+        return reinterpret_cast<VehicleType*>(blocks[index/blockSize][index%blockSize].data);
+    }
+
+    void grow()
+    {
+        uint32_t first=blocks.size()*blockSize;
+        blocks.push_back(std::make_unique<Slot[]>(blockSize));
+        generations.resize(first+blockSize,0);
+        freeList.reserve(generations.size());
+        //Push in reverse, so the lowest index is used first
+        for (size_t i = blockSize; i > 0; --i)
+            freeList.push_back(first+i-1);
+    }
+
+public:
+    //@param capacity slots to allocate up front, if we need more we grow by one block at the time
+    //@param _blockSize slots per block
+    VehiclePool(size_t capacity=0, size_t _blockSize=4096) : blockSize(_blockSize==0 ? 1 : _blockSize)
+    {
+        while (generations.size()<capacity)
+            grow();
+    }
+
+    ~VehiclePool()
+    {
+        for (size_t i = 0; i < generations.size(); ++i)
+            if (generations[i]&1)
+                slot(i)->~VehicleType();
+    }
+
+    VehiclePool(const VehiclePool&)=delete;
+    VehiclePool& operator=(const VehiclePool&)=delete;
+
+    //Construct a new vehicle in a free slot, the arguments are passed to the constructor of the vehicle
+    template<class... Args>
+    VehicleHandle spawn(Args&&... args)
+    {
+        if (freeList.empty())
+        {
+            grow();
+            ++growths;
+        }
+
+        uint32_t index=freeList.back();
+        new (slot(index)) VehicleType(std::forward<Args>(args)...);
+        freeList.pop_back();
+
+        ++generations[index];
+        ++live;
+        if (live>peak)
+            peak=live;
+        return VehicleHandle{index,generations[index]};
+    }
+
+    //Remove the vehicle, and give the slot back
+    //@throw vehicle_handle_exception if the handle is stale
+    void despawn(VehicleHandle H)
+    {
+        if (!isLive(H))
+            throw vehicle_handle_exception(H.index,H.generation);
+
+        slot(H.index)->~VehicleType();
+        ++generations[H.index];
+        freeList.push_back(H.index);
+        --live;
+    }
+
+    bool isLive(VehicleHandle H) const noexcept
+    {
+        return H.index<generations.size() && generations[H.index]==H.generation && (H.generation&1);
+    }
+
+    //@return the vehicle, or nullptr if the handle is stale
+    VehicleType* get(VehicleHandle H) noexcept
+    {
+        return isLive(H) ? slot(H.index) : nullptr;
+    }
+
+    //Every slot, free or not, and the vehicles in them as raw bytes, for checkpoints, so this only works for plain data vehicles (which Car is). Handles saved before are good after loading, and the next vehicles spawn in the same slots
+    void saveState(std::string& out) const
+    {
+        static_assert(std::is_trivially_copyable<VehicleType>::value,"Only plain data vehicles can be saved raw");
+        using namespace BinaryIO;
+        putVarint(out,sizeof(VehicleType));
+        putVarint(out,blockSize);
+        putVarint(out,live);
+        putVarint(out,peak);
+        putVarint(out,growths);
+        putVector(out,generations);
+        putVector(out,freeList);
+        for (size_t i = 0; i < generations.size(); ++i)
+            if (generations[i]&1)
+                out.append(reinterpret_cast<const char*>(blocks[i/blockSize][i%blockSize].data),sizeof(VehicleType));
+    }
+
+    //Replaces every vehicle in the pool
+    //@throw file_format_exception if the bytes are not a pool of this vehicle type, then the pool is not changed
+    void loadState(const char*& p, const char* end)
+    {
+        static_assert(std::is_trivially_copyable<VehicleType>::value,"Only plain data vehicles can be loaded raw");
+        using namespace BinaryIO;
+        if (getVarint(p,end)!=sizeof(VehicleType))
+            throw file_format_exception("vehicle pool saved with another vehicle type");
+        size_t B=getVarint(p,end);
+        size_t L=getVarint(p,end);
+        size_t P=getVarint(p,end);
+        size_t G=getVarint(p,end);
+        std::vector<uint32_t> Generations=getVector<uint32_t>(p,end);
+        std::vector<uint32_t> Free=getVector<uint32_t>(p,end);
+        size_t used=0;
+        for (uint32_t g : Generations)
+            used+=g&1;
+        if (B==0 || Generations.size()%B!=0 || used!=L || used+Free.size()!=Generations.size() || L>P)
+            throw file_format_exception("vehicle pool with slots which do not add up");
+        for (uint32_t f : Free)
+            if (f>=Generations.size() || (Generations[f]&1))
+                throw file_format_exception("vehicle pool with a used slot on the free list");
+        if (uint64_t(end-p)<used*sizeof(VehicleType))
+            throw file_format_exception("vehicle pool past end of buffer");
+
+        for (size_t i = 0; i < generations.size(); ++i)
+            if (generations[i]&1)
+                slot(i)->~VehicleType();
+        blockSize=B;
+        blocks.clear();
+        for (size_t i = 0; i < Generations.size(); i+=blockSize)
+            blocks.push_back(std::make_unique<Slot[]>(blockSize));
+        generations=std::move(Generations);
+        freeList=std::move(Free);
+        freeList.reserve(generations.size());
+        for (size_t i = 0; i < generations.size(); ++i)
+            if (generations[i]&1)
+            {
+                std::memcpy(blocks[i/blockSize][i%blockSize].data,p,sizeof(VehicleType));
+                p+=sizeof(VehicleType);
+            }
+        live=L;
+        peak=P;
+        growths=G;
+    }
+
+    //Monitoring
+    size_t getLive() const noexcept {return live;}
+    size_t getPeak() const noexcept {return peak;}
+    size_t getCapacity() const noexcept {return generations.size();}
+    size_t getGrowths() const noexcept {return growths;}//Number of times we had to go to the heap after construction
+};
@@ -0,0 +1,134 @@
+#include "ArtefactCache.hpp"
+
+#include <chrono>
+#include <thread>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <cstring>
+#include <filesystem>
+#include <system_error>
+
+//ARTEFACT_BUILD_ID, the hash of the source, made at build time, see src/CMakeLists.txt
+#include "ArtefactBuildID.hpp"
+
+//The start of every file
+static const char magic[8]={'T','S','C','A','C','H','E','1'};
+
+//Letters, digits, '-', '_' and '.', so it is safe in a file name on any system
+static void checkName(const std::string& name)
+{
+    bool good=!name.empty();
+    for (char c : name)
+        good=good && ((c>='a' && c<='z') || (c>='A' && c<='Z') || (c>='0' && c<='9') || c=='-' || c=='_' || c=='.');
+    if (!good)
+        throw TrafficSimulation_error("Artefact name \""+name+"\" may only have letters, digits, '-', '_' and '.'");
+}
+
+std::string ArtefactKey::hex() const
+{
+    std::stringstream S;
+    S<<std::hex<<std::setfill('0')<<std::setw(16)<<high<<std::setw(16)<<low;
+    return S.str();
+}
+
+ArtefactKey ArtefactCache::keyOf(std::string_view content) noexcept
+{
+    auto [low,high]=BinaryIO::hash128(content,(uint64_t(version)<<32)^ARTEFACT_BUILD_ID);
+    ArtefactKey K;
+    K.low=low;
+    K.high=high;
+    return K;
+}
+
+ArtefactCache::ArtefactCache(const std::string& _directory):directory(_directory)
+{
+    std::error_code E;
+    std::filesystem::create_directories(directory,E);
+    if (E || !std::filesystem::is_directory(directory))
+        throw TrafficSimulation_error("Could not make the artefact cache directory "+directory+(E ? "; "+E.message() : std::string()));
+}
+
+std::string ArtefactCache::getPath(const ArtefactKey& key, const std::string& name) const
+{
+    return (std::filesystem::path(directory)/(key.hex()+"-"+name+".bin")).string();
+}
+
+bool ArtefactCache::load(const ArtefactKey& key, const std::string& name, std::string& content)
+{
+    checkName(name);
+    std::ifstream In(getPath(key,name),std::ios::binary);
+    if (!In)
+    {
+        ++misses;
+        return false;
+    }
+    std::string file((std::istreambuf_iterator<char>(In)),std::istreambuf_iterator<char>());
+
+    //Anything wrong with the file and it is just not there
+    const char* p=file.data();
+    const char* end=p+file.size();
+    try
+    {
+        bool good=file.size()>=sizeof(magic) && std::memcmp(p,magic,sizeof(magic))==0;
+        p+=sizeof(magic);
+        good=good && BinaryIO::get<uint32_t>(p,end)==version;
+        ArtefactKey K;
+        K.low=BinaryIO::get<uint64_t>(p,end);
+        K.high=BinaryIO::get<uint64_t>(p,end);
+        good=good && K==key && BinaryIO::getString(p,end)==name;
+        uint64_t size=BinaryIO::getVarint(p,end);
+        ArtefactKey Check;
+        Check.low=BinaryIO::get<uint64_t>(p,end);
+        Check.high=BinaryIO::get<uint64_t>(p,end);
+        good=good && uint64_t(end-p)==size && keyOf(std::string_view(p,size))==Check;
+        if (good)
+        {
+            content.assign(p,size);
+            ++hits;
+            return true;
+        }
+    }
+    catch (file_format_exception&)
+    {
+    }
+    ++misses;
+    return false;
+}
+
+void ArtefactCache::store(const ArtefactKey& key, const std::string& name, const std::string& content)
+{
+    checkName(name);
+    std::string header(magic,sizeof(magic));
+    BinaryIO::put<uint32_t>(header,version);
+    BinaryIO::put<uint64_t>(header,key.low);
+    BinaryIO::put<uint64_t>(header,key.high);
+    BinaryIO::putString(header,name);
+    BinaryIO::putVarint(header,content.size());
+    ArtefactKey Check=keyOf(content);
+    BinaryIO::put<uint64_t>(header,Check.low);
+    BinaryIO::put<uint64_t>(header,Check.high);
+
+    //A temporary name no other run or thread will use at the same time
+    std::string path=getPath(key,name);
+    std::string temporary=path+"."+std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()))+"."+std::to_string(std::chrono::steady_clock::now().time_since_epoch().count())+".tmp";
+    {
+        std::ofstream Out(temporary,std::ios::binary|std::ios::trunc);
+        Out.write(header.data(),header.size());
+        Out.write(content.data(),content.size());
+        Out.close();
+        if (!Out)
+        {
+            std::error_code E;
+            std::filesystem::remove(temporary,E);
+            throw TrafficSimulation_error("Could not write the artefact "+temporary);
+        }
+    }
+    std::error_code E;
+    std::filesystem::rename(temporary,path,E);
+    if (E)
+    {
+        std::filesystem::remove(temporary,E);
+        throw TrafficSimulation_error("Could not move the artefact to "+path);
+    }
+}
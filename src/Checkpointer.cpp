@@ -0,0 +1,227 @@
+#include "Checkpointer.hpp"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <filesystem>
+#include <system_error>
+
+#include "BinaryIO.hpp"
+#include "TrafficExceptions.hpp"
+
+using namespace BinaryIO;
+
+Checkpointer::Checkpointer(const std::string& _directory, double _interval, double startTime):directory(_directory),interval(_interval),next(startTime+_interval)
+{
+    if (!(interval>0))
+        throw TrafficSimulation_error("Checkpoint interval must be positive");
+    std::error_code E;
+    std::filesystem::create_directories(directory,E);
+    if (E || !std::filesystem::is_directory(directory))
+        throw TrafficSimulation_error("Could not make the checkpoint directory "+directory+(E ? "; "+E.message() : std::string()));
+
+    writer=std::thread(&Checkpointer::writeLoop,this);
+}
+
+Checkpointer::~Checkpointer()
+{
+    try
+    {
+        close();
+    }
+    catch(...)
+    {
+        //Nothing sensible to do in a destructor
+    }
+}
+
+void Checkpointer::add(const std::string& name, SaveFunction save, LoadFunction load)
+{
+    for (const Part& P : parts)
+        if (P.name==name)
+            throw TrafficSimulation_error("Checkpoint part \""+name+"\" added twice");
+    parts.push_back(Part{name,save,load});
+}
+
+std::string Checkpointer::getPath(const std::string& directory, double time)
+{
+    //Milliseconds, zero padded, so the names sort in time order
+    char name[64];
+    std::snprintf(name,sizeof(name),"checkpoint-%015lld.bin",static_cast<long long>(std::llround(time*1000)));
+    return (std::filesystem::path(directory)/name).string();
+}
+
+std::string Checkpointer::latest(const std::string& directory)
+{
+    std::string best;
+    std::error_code E;
+    for (const std::filesystem::directory_entry& F : std::filesystem::directory_iterator(directory,E))
+    {
+        //Only whole checkpoints, with names like getPath makes, not the temporary files or anything else in there
+        std::string name=F.path().filename().string();
+        bool good=name.size()==30 && name.compare(0,11,"checkpoint-")==0 && name.compare(26,4,".bin")==0;
+        for (size_t i = 11; good && i < 26; ++i)
+            good=name[i]>='0' && name[i]<='9';
+        if (good && (best.empty() || name>std::filesystem::path(best).filename().string()))
+            best=F.path().string();
+    }
+    return best;
+}
+
+size_t Checkpointer::runUntil(EventQueue& Q, double time)
+{
+    size_t events=0;
+    while (next<=time)
+    {
+        events+=Q.runUntil(next);
+        checkpoint(next);
+    }
+    return events+Q.runUntil(time);
+}
+
+std::string Checkpointer::checkpoint(double time)
+{
+    //The copy is made while the simulation waits, the writing is not
+    std::string bytes;
+    put(bytes,magic);
+    put(bytes,version);
+    put(bytes,time);
+    putVarint(bytes,parts.size());
+    std::string state;
+    for (const Part& P : parts)
+    {
+        state.clear();
+        P.save(state);
+        putString(bytes,P.name);
+        putString(bytes,state);
+    }
+    auto [low,high]=hash128(bytes);
+    put(bytes,low);
+    put(bytes,high);
+
+    std::string path=getPath(directory,time);
+    {
+        std::unique_lock<std::mutex> L(lock);
+        if (closed)
+            throw TrafficSimulation_error("Checkpoint after the checkpointer was closed");
+        changed.wait(L,[this](){return pending.size()<maxPending || writerError;});
+        if (writerError)
+            std::rethrow_exception(writerError);
+        pending.push_back({path,std::move(bytes)});
+        changed.notify_all();
+    }
+    next=std::max(next,time)+interval;
+    return path;
+}
+
+void Checkpointer::writeLoop()
+{
+    std::unique_lock<std::mutex> L(lock);
+    while (true)
+    {
+        changed.wait(L,[this](){return stopping || !pending.empty();});
+        if (pending.empty())
+            return;//Stopping, and nothing left to write
+
+        //Left at the front until written, so it counts against maxPending while we write it
+        std::string path=pending.front().first;
+        std::string bytes=std::move(pending.front().second);
+        L.unlock();
+
+        std::string temporary=path+".tmp";
+        bool failed;
+        {
+            std::ofstream Out(temporary,std::ios::binary|std::ios::trunc);
+            Out.write(bytes.data(),bytes.size());
+            Out.close();
+            failed=!Out;
+        }
+        std::error_code E;
+        if (!failed)
+            std::filesystem::rename(temporary,path,E);
+        if (failed || E)
+            std::filesystem::remove(temporary,E);
+
+        L.lock();
+        pending.pop_front();
+        if ((failed || E) && !writerError)
+            writerError=std::make_exception_ptr(TrafficSimulation_error("Error writing checkpoint "+path));
+        ++written;
+        changed.notify_all();
+    }
+}
+
+void Checkpointer::close()
+{
+    {
+        std::unique_lock<std::mutex> L(lock);
+        if (closed)
+            return;
+        closed=true;
+        stopping=true;
+        changed.notify_all();
+    }
+    writer.join();
+    if (writerError)
+        std::rethrow_exception(writerError);
+}
+
+size_t Checkpointer::getWritten()
+{
+    std::unique_lock<std::mutex> L(lock);
+    return written;
+}
+
+double Checkpointer::restore(const std::string& path)
+{
+    std::ifstream In(path,std::ios::binary);
+    if (!In)
+        throw TrafficSimulation_error("Could not open checkpoint "+path);
+    std::string file((std::istreambuf_iterator<char>(In)),std::istreambuf_iterator<char>());
+
+    //Check all of it before touching anything
+    const size_t checkBytes=2*sizeof(uint64_t);
+    if (file.size()<checkBytes)
+        throw file_format_exception("checkpoint "+path+" is too short");
+    const char* p=file.data();
+    const char* end=p+file.size()-checkBytes;
+    std::pair<uint64_t,uint64_t> Check;
+    std::memcpy(&Check.first,end,sizeof(uint64_t));
+    std::memcpy(&Check.second,end+sizeof(uint64_t),sizeof(uint64_t));
+    if (hash128(std::string_view(p,end-p))!=Check)
+        throw file_format_exception("checkpoint "+path+" is damaged or cut short");
+    if (get<uint32_t>(p,end)!=magic)
+        throw file_format_exception(path+" is not a checkpoint");
+    if (get<uint32_t>(p,end)!=version)
+        throw file_format_exception("checkpoint "+path+" is from another version");
+    double time=get<double>(p,end);
+    if (getVarint(p,end)!=parts.size())
+        throw file_format_exception("checkpoint "+path+" has another number of parts than the simulation");
+    std::vector<std::pair<const char*,const char*> > states;
+    for (const Part& P : parts)
+    {
+        std::string name=getString(p,end);
+        if (name!=P.name)
+            throw file_format_exception("checkpoint "+path+" has the part \""+name+"\" where the simulation has \""+P.name+"\"");
+        uint64_t size=getVarint(p,end);
+        if (uint64_t(end-p)<size)
+            throw file_format_exception("checkpoint "+path+" part \""+name+"\" past end of file");
+        states.push_back({p,p+size});
+        p+=size;
+    }
+    if (p!=end)
+        throw file_format_exception("checkpoint "+path+" has more bytes after the parts");
+
+    for (size_t i = 0; i < parts.size(); ++i)
+    {
+        const char* q=states[i].first;
+        parts[i].load(q,states[i].second);
+        if (q!=states[i].second)
+            throw file_format_exception("checkpoint "+path+" part \""+parts[i].name+"\" has "+std::to_string(states[i].second-q)+" bytes more than it read");
+    }
+    next=time+interval;
+    return time;
+}
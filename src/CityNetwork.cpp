@@ -1,57 +1,608 @@
 #include "CityNetwork.hpp"
 #include "ICityNetwork.hpp"
 #include "Hellhole.hpp"
+#include "Intersection.hpp"
+#include "Trafficlight.hpp"
+#include "BinaryIO.hpp"
 
-CityNetwork::CityNetwork(std::istream& CityNetworkJsonStream)
+#include <algorithm>
+#include <numeric>
+#include <deque>
+#include <thread>
+#include <atomic>
+#include <sstream>
+#include <iterator>
+
+//Position along a Hilbert curve through a 2^16 by 2^16 grid, points close on the curve are close on the map
+static uint64_t hilbertIndex(uint32_t x, uint32_t y)
+{
+    const uint32_t n=1u<<16;
+    uint64_t d=0;
+    for (uint32_t s = n/2; s > 0; s/=2)
+    {
+        uint32_t rx=(x&s)>0;
+        uint32_t ry=(y&s)>0;
+        d+=uint64_t(s)*s*((3*rx)^ry);
+        //Rotate the quadrant, so the curve inside it starts and ends where it should
+        if (ry==0)
+        {
+            if (rx==1)
+            {
+                x=n-1-x;
+                y=n-1-y;
+            }
+            std::swap(x,y);
+        }
+    }
+    return d;
+}
+
+void CityNetwork::findOrder(const Json::Value& NodesJson, const Json::Value& RoadsJson, Ordering Order)
+{
+    size_t nodes=NodesJson.size();
+    size_t roads=RoadsJson.size();
+    std::vector<size_t> order(nodes);//order[new ID]=file ID
+    std::iota(order.begin(),order.end(),0);
+
+    //The ends of the roads, as far as we can read them, broken roads are left for the Road constructor to complain about
+    std::vector<std::pair<size_t,size_t> > ends(roads,{SIZE_MAX,SIZE_MAX});
+    for (size_t r = 0; r < roads; ++r)
+    {
+        const Json::Value& R=RoadsJson[Json::ArrayIndex(r)];
+        const Json::Value& First=R["first"];
+        const Json::Value& Second=R["second"];
+        if (First.isIntegral() && Second.isIntegral() && First.asLargestUInt()<nodes && Second.asLargestUInt()<nodes)
+            ends[r]={First.asLargestUInt(),Second.asLargestUInt()};
+    }
+
+    if (Order==hilbertOrder)
+    {
+        std::vector<double> x(nodes),y(nodes);
+        for (size_t n = 0; n < nodes; ++n)
+        {
+            const Json::Value& Pos=NodesJson[Json::ArrayIndex(n)]["pos"];
+            if (Pos.isArray() && Pos.size()>=2 && Pos[0].isNumeric() && Pos[1].isNumeric())
+            {
+                x[n]=Pos[0].asDouble();
+                y[n]=Pos[1].asDouble();
+            }
+        }
+        double minX=nodes>0 ? *std::min_element(x.begin(),x.end()) : 0;
+        double minY=nodes>0 ? *std::min_element(y.begin(),y.end()) : 0;
+        double size=1;
+        for (size_t n = 0; n < nodes; ++n)
+            size=std::max({size,x[n]-minX,y[n]-minY});
+
+        std::vector<uint64_t> d(nodes);
+        for (size_t n = 0; n < nodes; ++n)
+            d[n]=hilbertIndex(uint32_t((x[n]-minX)/size*65535),uint32_t((y[n]-minY)/size*65535));
+        std::stable_sort(order.begin(),order.end(),[&d](size_t a, size_t b){return d[a]<d[b];});
+    }
+    else if (Order==bandwidthOrder)
+    {
+        //Reverse Cuthill-McKee: breadth first from a node with few roads, the neighbours with fewest roads first, and then everything backwards
+        std::vector<std::vector<size_t> > neighbours(nodes);
+        for (auto [a,b] : ends)
+            if (a!=SIZE_MAX)
+            {
+                neighbours[a].push_back(b);
+                neighbours[b].push_back(a);
+            }
+        auto fewerRoads = [&neighbours](size_t a, size_t b){return neighbours[a].size()<neighbours[b].size();};
+        for (std::vector<size_t>& N : neighbours)
+            std::stable_sort(N.begin(),N.end(),fewerRoads);
+
+        std::vector<size_t> byDegree(nodes);
+        std::iota(byDegree.begin(),byDegree.end(),0);
+        std::stable_sort(byDegree.begin(),byDegree.end(),fewerRoads);
+
+        order.clear();
+        std::vector<uint8_t> visited(nodes,0);
+        std::deque<size_t> queue;
+        for (size_t start : byDegree)
+        {
+            if (visited[start])
+                continue;
+            visited[start]=1;
+            queue.push_back(start);
+            while (!queue.empty())
+            {
+                size_t n=queue.front();
+                queue.pop_front();
+                order.push_back(n);
+                for (size_t m : neighbours[n])
+                    if (!visited[m])
+                    {
+                        visited[m]=1;
+                        queue.push_back(m);
+                    }
+            }
+        }
+        std::reverse(order.begin(),order.end());
+    }
+
+    fileNodeID.assign(order.begin(),order.end());
+    nodeFromFile.resize(nodes);
+    for (size_t n = 0; n < nodes; ++n)
+        nodeFromFile[fileNodeID[n]]=n;
+
+    //The roads in the order of their first node, so the roads of a node are next to each other too
+    std::vector<size_t> roadOrder(roads);
+    std::iota(roadOrder.begin(),roadOrder.end(),0);
+    auto key = [&](size_t r)
+    {
+        if (ends[r].first==SIZE_MAX)
+            return std::make_pair(SIZE_MAX,SIZE_MAX);
+        size_t a=nodeFromFile[ends[r].first];
+        size_t b=nodeFromFile[ends[r].second];
+        return std::make_pair(std::min(a,b),std::max(a,b));
+    };
+    std::stable_sort(roadOrder.begin(),roadOrder.end(),[&key](size_t a, size_t b){return key(a)<key(b);});
+    fileRoadID.assign(roadOrder.begin(),roadOrder.end());
+    roadFromFile.resize(roads);
+    for (size_t r = 0; r < roads; ++r)
+        roadFromFile[fileRoadID[r]]=r;
+}
+
+std::string CityNetwork::orderName() const
+{
+    return ordering==fileOrder ? "order-file" : ordering==hilbertOrder ? "order-hilbert" : "order-bandwidth";
+}
+
+bool CityNetwork::loadOrder(ArtefactCache& Cache, size_t nodes, size_t roads)
 {
-    Nodes=std::vector<std::shared_ptr<Node> >();
-    Roads=std::vector<std::shared_ptr<Road> >();
+    std::string content;
+    if (!Cache.load(fileKey,orderName(),content))
+        return false;
+
+    //Both must be a reordering of the whole file, anything else and we find the order again
+    auto read = [](const char*& p, const char* end, size_t size, std::vector<size_t>& order, std::vector<size_t>& inverse)
+    {
+        if (BinaryIO::getVarint(p,end)!=size)
+            return false;
+        order.resize(size);
+        inverse.assign(size,SIZE_MAX);
+        for (size_t i = 0; i < size; ++i)
+        {
+            order[i]=BinaryIO::getVarint(p,end);
+            if (order[i]>=size || inverse[order[i]]!=SIZE_MAX)
+                return false;
+            inverse[order[i]]=i;
+        }
+        return true;
+    };
+    const char* p=content.data();
+    const char* end=p+content.size();
     try
     {
-        Json::Value root;
-        CityNetworkJsonStream>>root;
+        if (read(p,end,nodes,fileNodeID,nodeFromFile) && read(p,end,roads,fileRoadID,roadFromFile) && p==end)
+            return true;
+    }
+    catch (file_format_exception&)
+    {
+    }
+    fileNodeID.clear();
+    nodeFromFile.clear();
+    fileRoadID.clear();
+    roadFromFile.clear();
+    return false;
+}
 
+void CityNetwork::storeOrder(ArtefactCache& Cache) const
+{
+    std::string content;
+    for (const std::vector<size_t>* Order : {&fileNodeID,&fileRoadID})
+    {
+        BinaryIO::putVarint(content,Order->size());
+        for (size_t id : *Order)
+            BinaryIO::putVarint(content,id);
+    }
+    Cache.store(fileKey,orderName(),content);
+}
 
-        if (!root.isMember("nodes"))
-            throw TrafficSimulation_error(std::string("Error loading City Network; JSON did not contain nodes:"));
-        if (!root.isMember("roads"))
-            throw TrafficSimulation_error(std::string("Error loading City Network; JSON did not contain roads:"));
+const NameTable& CityNetwork::nodeTypeNames()
+{
+    //A new kind of node needs a name here, and a case in loadNode
+    static const NameTable Names={{"Hellhole",hellholeNode},{"Intersect",intersectionNode},{"Trafficlight",trafficlightNode}};
+    return Names;
+}
 
-        Json::Value NodesJson=root["nodes"];
-        Json::Value RoadsJson=root["roads"];
+std::shared_ptr<Node> CityNetwork::loadNode(size_t id, size_t fileID, Json::Value& V)
+{
+    if (!V.isMember("type"))
+        throw TrafficSimulation_error(std::string("Error loading City Network; Node without type"));
+    if (!V.isMember("pos"))
+        throw TrafficSimulation_error(std::string("Error loading City Network; Node without position"));
+
+    Json::Value& Pos = V["pos"];
 
-        int id = 0;
-        for (Json::Value& V : NodesJson)
+    //TEMP insert more checks
+
+    const char* nameBegin=nullptr;
+    const char* nameEnd=nullptr;
+    int kind=NameTable::notFound;
+    if (static_cast<const Json::Value&>(V)["type"].getString(&nameBegin,&nameEnd))
+        kind=nodeTypeNames().find(std::string_view(nameBegin,nameEnd-nameBegin));
+    switch (kind)
+    {
+        case hellholeNode:
         {
-            if (!V.isMember("type"))
-                throw TrafficSimulation_error(std::string("Error loading City Network; Node without type"));
-            if (!V.isMember("pos"))
-                throw TrafficSimulation_error(std::string("Error loading City Network; Node without position"));
+            std::shared_ptr<Hellhole> H = std::make_shared<Hellhole>(id,Pos[0].asInt(),Pos[1].asInt());
+            if (V.isMember("source"))
+                H->setSource(TrafficSource::loadConfig(V["source"],Profiles),fileID);
+            return H;
+        }
+        case intersectionNode:
+            return std::make_shared<Intersection>(id,Pos[0].asInt(),Pos[1].asInt());
+        case trafficlightNode:
+            return std::make_shared<Trafficlight>(id,Pos[0].asInt(),Pos[1].asInt(),Trafficlight::loadPhases(V));
+    }
+    //Silently dropping the node would shift the ID of every node after it
+    throw TrafficSimulation_error("Error loading City Network; Node "+std::to_string(fileID)+" has unknown type "+V["type"].asString());
+}
 
-            std::string Type = V["type"].asString();
-            Json::Value& Pos = V["pos"];
+std::shared_ptr<Road> CityNetwork::loadRoad(size_t id, Json::Value& V, bool link)
+{
+    //Const, so asking does not add the members
+    const Json::Value& First=static_cast<const Json::Value&>(V)["first"];
+    const Json::Value& Second=static_cast<const Json::Value&>(V)["second"];
+    if (ordering!=fileOrder && First.isIntegral() && Second.isIntegral() && First.asLargestUInt()<nodeSize && Second.asLargestUInt()<nodeSize)
+    {
+        Json::Value Renumbered=V;
+        Json::Value NewFirst(Json::UInt(nodeFromFile[First.asLargestUInt()]));
+        Json::Value NewSecond(Json::UInt(nodeFromFile[Second.asLargestUInt()]));
+        Renumbered["first"].swap(NewFirst);
+        Renumbered["second"].swap(NewSecond);
+        return std::make_shared<Road>(id,Renumbered,*this,link);
+    }
+    return std::make_shared<Road>(id,V,*this,link);
+}
+
+void CityNetwork::loadSerial(Json::Value& NodesJson, Json::Value& RoadsJson)
+{
+    Nodes.clear();
+    Roads.clear();
+    for (size_t id = 0; id < NodesJson.size(); ++id)
+    {
+        size_t fileID=fileNodeID.empty() ? id : fileNodeID[id];
+        Nodes.push_back(loadNode(id,fileID,NodesJson[Json::ArrayIndex(fileID)]));
+    }
+    //The roads look up their nodes while loading, so the size must be known now
+    nodeSize=Nodes.size();
+    roadSize=0;
+
+    //The roads are loaded in the order of the file even when renumbered, the local IDs of the roads at the nodes are the order they are loaded in, and the traffic light phases use them
+    Roads.resize(RoadsJson.size());
+    for (size_t fileID = 0; fileID < RoadsJson.size(); ++fileID)
+    {
+        size_t id=roadFromFile.empty() ? fileID : roadFromFile[fileID];
+        Roads[id]=loadRoad(id,RoadsJson[Json::ArrayIndex(fileID)],true);
+    }
+}
+
+//Split 0 to items in about equal ranges, and run work(begin,end) on each in its own thread (the first on this one)
+template<class Work>
+static void inShards(size_t items, unsigned threads, Work work)
+{
+    size_t shards=std::max<size_t>(1,std::min<size_t>(threads,items/256));
+    std::vector<std::thread> helpers;
+    for (size_t s = 1; s < shards; ++s)
+        helpers.emplace_back(work,items*s/shards,items*(s+1)/shards);
+    work(0,items/shards);
+    for (std::thread& T : helpers)
+        T.join();
+}
 
-            //TEMP insert more checks
+bool CityNetwork::loadParallel(Json::Value& NodesJson, Json::Value& RoadsJson, unsigned threads)
+{
+    size_t nodes=NodesJson.size();
+    size_t roads=RoadsJson.size();
+    //Stop everyone as soon as anything is wrong, the serial loader will find out what
+    std::atomic<bool> failed=false;
 
-            if (Type.compare("Hellhole")==0)
+    //The elements of the arrays are only looked up, never added, so the threads can share them, and every node and road is only touched by one thread
+    Nodes.assign(nodes,nullptr);
+    inShards(nodes,threads,[&](size_t begin, size_t end)
+    {
+        try
+        {
+            for (size_t id = begin; id < end && !failed; ++id)
             {
-                Nodes.push_back(std::make_shared<Hellhole>(id++,Pos[0].asInt(),Pos[1].asInt()));
+                size_t fileID=fileNodeID.empty() ? id : fileNodeID[id];
+                Nodes[id]=loadNode(id,fileID,NodesJson[Json::ArrayIndex(fileID)]);
             }
+        }
+        catch(...)
+        {
+            failed=true;
+        }
+    });
+    if (failed)
+        return false;
+    nodeSize=nodes;
+    roadSize=0;
 
+    //The roads check themselves and find their nodes, without telling the nodes yet
+    Roads.assign(roads,nullptr);
+    inShards(roads,threads,[&](size_t begin, size_t end)
+    {
+        try
+        {
+            for (size_t fileID = begin; fileID < end && !failed; ++fileID)
+            {
+                size_t id=roadFromFile.empty() ? fileID : roadFromFile[fileID];
+                Roads[id]=loadRoad(id,RoadsJson[Json::ArrayIndex(fileID)],false);
+            }
+        }
+        catch(...)
+        {
+            failed=true;
+        }
+    });
+    if (failed)
+        return false;
+
+    //The roads of every node in the order of the file, the order the serial loader adds them in, counted first and then placed
+    std::vector<size_t> first(nodes+1,0);
+    for (const std::shared_ptr<Road>& R : Roads)
+    {
+        ++first[R->getStart().getNodeID()+1];
+        ++first[R->getEnd().getNodeID()+1];
+    }
+    for (size_t n = 0; n < nodes; ++n)
+    {
+        //A node with too many roads, the serial loader throws at the right road
+        if (first[n+1]>Nodes[n]->getMaxRoadNumber())
+            return false;
+        first[n+1]+=first[n];
+    }
+    std::vector<const Road*> nodeRoads(first[nodes]);
+    std::vector<size_t> next(first.begin(),first.end()-1);
+    for (size_t fileID = 0; fileID < roads; ++fileID)
+    {
+        const Road* R=Roads[roadFromFile.empty() ? fileID : roadFromFile[fileID]].get();
+        nodeRoads[next[R->getStart().getNodeID()]++]=R;
+        nodeRoads[next[R->getEnd().getNodeID()]++]=R;
+    }
 
+    inShards(nodes,threads,[&](size_t begin, size_t end)
+    {
+        try
+        {
+            for (size_t n = begin; n < end && !failed; ++n)
+                Nodes[n]->addRoads(nodeRoads.data()+first[n],first[n+1]-first[n]);
+        }
+        catch(...)
+        {
+            failed=true;
         }
+    });
+    return !failed;
+}
+
+CityNetwork::CityNetwork(std::istream& CityNetworkJsonStream, Ordering Order, unsigned Threads, ArtefactCache* Cache):ordering(Order)
+{
+    if (Threads==0)
+        Threads=std::max(1u,std::thread::hardware_concurrency());
 
+    try
+    {
+        Json::Value root;
+        if (Cache!=nullptr)
+        {
+            //The whole file first, the key is the hash of exactly what we read
+            std::string Text((std::istreambuf_iterator<char>(CityNetworkJsonStream)),std::istreambuf_iterator<char>());
+            fileKey=ArtefactCache::keyOf(Text);
+            contentKey=ArtefactCache::keyOf(fileKey.hex()+"-"+orderName());
+            keyed=true;
+            std::istringstream S(std::move(Text));
+            S>>root;
+        }
+        else
+            CityNetworkJsonStream>>root;
 
-        id=0;
-        for (Json::Value& V : RoadsJson)
-            Roads.push_back(std::make_shared<Road>(id++,V,*this));
+
+        if (!root.isMember("nodes"))
+            throw TrafficSimulation_error(std::string("Error loading City Network; JSON did not contain nodes:"));
+        //The design document calls the roads "auto_roads" (to leave room for other kinds of paths later), older files just say "roads"
+        const char* roadsKey = root.isMember("roads") ? "roads" : "auto_roads";
+        if (!root.isMember(roadsKey))
+            throw TrafficSimulation_error(std::string("Error loading City Network; JSON did not contain roads:"));
+
+        Json::Value NodesJson=root["nodes"];
+        Json::Value RoadsJson=root[roadsKey];
+        if (root.isMember("profiles"))
+            Profiles.swap(root["profiles"]);
+
+        if (ordering!=fileOrder && (Cache==nullptr || !loadOrder(*Cache,NodesJson.size(),RoadsJson.size())))
+        {
+            findOrder(NodesJson,RoadsJson,ordering);
+            if (Cache!=nullptr)
+                storeOrder(*Cache);
+        }
+
+        //Broken cities are loaded again serially, which throws the same error (at the same place) whatever the number of threads
+        if (Threads<=1 || !loadParallel(NodesJson,RoadsJson,Threads))
+            loadSerial(NodesJson,RoadsJson);
     }
     catch(Json::Exception& E)
     {
         throw TrafficSimulation_error(std::string("Error loading City Network; Got JSON error: ")+E.what());
     }
 
+    //The signalised nodes and the sources, in the order of their IDs
+    for (const std::shared_ptr<Node>& N : Nodes)
+    {
+        if (std::shared_ptr<Trafficlight> T=std::dynamic_pointer_cast<Trafficlight>(N))
+            Trafficlights.push_back(T);
+        else if (std::shared_ptr<Hellhole> H=std::dynamic_pointer_cast<Hellhole>(N); H!=nullptr && H->getSource()!=nullptr)
+            Sources.push_back(H);
+    }
+
     nodeSize=Nodes.size();
     roadSize=Roads.size();
+
+    findComponents();
+}
+
+void CityNetwork::findComponents()
+{
+    //The roads leaving every node, both ways unless one-way
+    std::vector<uint32_t> first(nodeSize+1,0);
+    for (const std::shared_ptr<Road>& R : Roads)
+    {
+        ++first[R->getStart().getNodeID()+1];
+        if (!R->getOneWay())
+            ++first[R->getEnd().getNodeID()+1];
+    }
+    for (size_t n = 0; n < nodeSize; ++n)
+        first[n+1]+=first[n];
+    std::vector<uint32_t> to(first.back());
+    std::vector<uint32_t> next(first.begin(),first.end()-1);
+    for (const std::shared_ptr<Road>& R : Roads)
+    {
+        to[next[R->getStart().getNodeID()]++]=R->getEnd().getNodeID();
+        if (!R->getOneWay())
+            to[next[R->getEnd().getNodeID()]++]=R->getStart().getNodeID();
+    }
+    components=StrongComponents(first,to);
+}
+
+size_t CityNetwork::addNode(Json::Value& NodeJson)
+{
+    //Last in the file too
+    size_t id=nodeSize;
+    std::shared_ptr<Node> N;
+    try
+    {
+        N=loadNode(id,id,NodeJson);
+    }
+    catch(Json::Exception& E)
+    {
+        throw TrafficSimulation_error(std::string("Error loading City Network; Got JSON error: ")+E.what());
+    }
+
+    Nodes.push_back(N);
+    ++nodeSize;
+    if (!fileNodeID.empty())
+    {
+        fileNodeID.push_back(id);
+        nodeFromFile.push_back(id);
+    }
+    if (std::shared_ptr<Trafficlight> T=std::dynamic_pointer_cast<Trafficlight>(N))
+        Trafficlights.push_back(T);
+    else if (std::shared_ptr<Hellhole> H=std::dynamic_pointer_cast<Hellhole>(N); H!=nullptr && H->getSource()!=nullptr)
+        Sources.push_back(H);
+    findComponents();
+    keyed=false;
+    return id;
 }
 
+size_t CityNetwork::addRoad(Json::Value& RoadJson)
+{
+    size_t id=roadSize;
+    std::shared_ptr<Road> R=std::make_shared<Road>(id,RoadJson,*this,false);
+
+    //Both ends must have room before either is told, so a failed edit changes nothing
+    for (const Node* End : {&R->getStart(),&R->getEnd()})
+        if (End->getRoadNumber()>=End->getMaxRoadNumber())
+            throw road_address_exception(End->getRoadNumber(),End->getMaxRoadNumber(),End->getNodeID());
+    Nodes[R->getStart().getNodeID()]->addRoad(R.get());
+    Nodes[R->getEnd().getNodeID()]->addRoad(R.get());
+
+    Roads.push_back(R);
+    ++roadSize;
+    if (!fileRoadID.empty())
+    {
+        fileRoadID.push_back(id);
+        roadFromFile.push_back(id);
+    }
+    findComponents();
+    keyed=false;
+    return id;
+}
+
+void CityNetwork::removeRoad(size_t RoadID)
+{
+    if (RoadID>=roadSize)
+        throw road_address_exception(RoadID,roadSize);
+    std::shared_ptr<Road> R=Roads[RoadID];
+    Nodes[R->getStart().getNodeID()]->removeRoad(R.get());
+    Nodes[R->getEnd().getNodeID()]->removeRoad(R.get());
+
+    //Everyone after it moves down, as if it had never been in the file
+    Roads.erase(Roads.begin()+RoadID);
+    --roadSize;
+    for (size_t r = RoadID; r < roadSize; ++r)
+        Roads[r]->roadID=r;
+    if (!fileRoadID.empty())
+    {
+        size_t fileID=fileRoadID[RoadID];
+        fileRoadID.erase(fileRoadID.begin()+RoadID);
+        for (size_t& f : fileRoadID)
+            if (f>fileID)
+                --f;
+        roadFromFile.resize(roadSize);
+        for (size_t r = 0; r < roadSize; ++r)
+            roadFromFile[fileRoadID[r]]=r;
+    }
+    findComponents();
+    keyed=false;
+}
+
+void CityNetwork::setLanes(size_t RoadID, int lanes)
+{
+    if (RoadID>=roadSize)
+        throw road_address_exception(RoadID,roadSize);
+    if (lanes<1)
+        throw TrafficSimulation_error("Road "+std::to_string(RoadID)+" must have at least one lane, not "+std::to_string(lanes));
+    Roads[RoadID]->lanes=lanes;
+    keyed=false;
+}
+
+void CityNetwork::setRoadType(size_t RoadID, RoadType type)
+{
+    if (RoadID>=roadSize)
+        throw road_address_exception(RoadID,roadSize);
+    if (type<street || type>highway)
+        throw TrafficSimulation_error("Road "+std::to_string(RoadID)+" can not have type "+std::to_string(int(type)));
+    Roads[RoadID]->type=type;
+    keyed=false;
+}
+
+std::vector<size_t> CityNetwork::getCutOffNodes() const
+{
+    std::vector<size_t> cutOff;
+    for (size_t n = 0; n < nodeSize; ++n)
+        if (components.getComponent(n)!=components.getLargestComponent())
+            cutOff.push_back(n);
+    return cutOff;
+}
+
+void CityNetwork::startSignals(EventQueue& Q, double time)
+{
+    for (std::shared_ptr<Trafficlight>& T : Trafficlights)
+        T->start(Q,time);
+}
+
+void CityNetwork::startSources(EventQueue& Q, double time, uint64_t seed, TrafficSource::SpawnHandler H)
+{
+    for (std::shared_ptr<Hellhole>& S : Sources)
+        S->getSource()->start(Q,time,seed,H);
+}
+
+void CityNetwork::saveState(std::string& out) const
+{
+    BinaryIO::putVarint(out,nodeSize);
+    for (const std::shared_ptr<Node>& N : Nodes)
+        N->saveState(out);
+}
+
+void CityNetwork::loadState(const char*& p, const char* end)
+{
+    uint64_t nodes=BinaryIO::getVarint(p,end);
+    if (nodes!=nodeSize)
+        throw file_format_exception("city saved with "+std::to_string(nodes)+" nodes, this one has "+std::to_string(nodeSize));
+    for (std::shared_ptr<Node>& N : Nodes)
+        N->loadState(p,end);
+}
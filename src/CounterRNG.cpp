@@ -0,0 +1,110 @@
+#include "CounterRNG.hpp"
+
+//The Philox4x32 constants
+#define PhiloxM0 0xD2511F53u
+#define PhiloxM1 0xCD9E8D57u
+#define PhiloxW0 0x9E3779B9u
+#define PhiloxW1 0xBB67AE85u
+#define PhiloxRounds 10
+
+//Blocks scrambled side by side in fillUniform, 8 blocks of 32 bit words fill a 256 bit register
+#define Lanes 8
+
+//Top 53 bits as a double in [0,1)
+static inline double toUniform(uint64_t x) noexcept
+{
+    return (x>>11)*(1.0/9007199254740992.0);
+}
+
+void CounterRNG::philox(const uint32_t counter[4], const uint32_t key[2], uint32_t out[4]) noexcept
+{
+    uint32_t c0=counter[0], c1=counter[1], c2=counter[2], c3=counter[3];
+    uint32_t k0=key[0], k1=key[1];
+    for (int r = 0; r < PhiloxRounds; ++r)
+    {
+        uint64_t p0=uint64_t(PhiloxM0)*c0;
+        uint64_t p1=uint64_t(PhiloxM1)*c2;
+        uint32_t n0=uint32_t(p1>>32)^c1^k0;
+        uint32_t n2=uint32_t(p0>>32)^c3^k1;
+        c1=uint32_t(p1);
+        c3=uint32_t(p0);
+        c0=n0;
+        c2=n2;
+        k0+=PhiloxW0;
+        k1+=PhiloxW1;
+    }
+    out[0]=c0; out[1]=c1; out[2]=c2; out[3]=c3;
+}
+
+uint64_t CounterRNG::bits(uint64_t entity, uint16_t day, uint16_t purpose, uint64_t index) const noexcept
+{
+    //Each block gives two numbers, the index picks the block and the half
+    uint32_t counter[4]={uint32_t(index>>1),(uint32_t(day)<<16)|purpose,uint32_t(entity),uint32_t(entity>>32)};
+    uint32_t key[2]={uint32_t(seed),uint32_t(seed>>32)};
+    uint32_t out[4];
+    philox(counter,key,out);
+    return (index&1) ? (uint64_t(out[3])<<32)|out[2] : (uint64_t(out[1])<<32)|out[0];
+}
+
+double CounterRNG::uniform(uint64_t entity, uint16_t day, uint16_t purpose, uint64_t index) const noexcept
+{
+    return toUniform(bits(entity,day,purpose,index));
+}
+
+void CounterRNG::fillUniform(uint64_t entity, uint16_t day, uint16_t purpose, uint64_t firstIndex, double* out, size_t N) const noexcept
+{
+    size_t i=0;
+
+    //Start on a block boundary
+    if ((firstIndex&1) && N>0)
+    {
+        out[i++]=uniform(entity,day,purpose,firstIndex);
+    }
+
+    const uint32_t c1=(uint32_t(day)<<16)|purpose;
+    const uint32_t c2=uint32_t(entity);
+    const uint32_t c3=uint32_t(entity>>32);
+
+    //Structure of arrays over the lanes, with no branches in the rounds, this is vectorised at -O3
+    while (N-i>=2*Lanes)
+    {
+        uint32_t x0[Lanes],x1[Lanes],x2[Lanes],x3[Lanes];
+        uint64_t block=(firstIndex+i)>>1;
+        for (int l = 0; l < Lanes; ++l)
+        {
+            x0[l]=uint32_t(block+l);
+            x1[l]=c1;
+            x2[l]=c2;
+            x3[l]=c3;
+        }
+
+        uint32_t k0=uint32_t(seed), k1=uint32_t(seed>>32);
+        for (int r = 0; r < PhiloxRounds; ++r)
+        {
+            for (int l = 0; l < Lanes; ++l)
+            {
+                uint64_t p0=uint64_t(PhiloxM0)*x0[l];
+                uint64_t p1=uint64_t(PhiloxM1)*x2[l];
+                uint32_t n0=uint32_t(p1>>32)^x1[l]^k0;
+                uint32_t n2=uint32_t(p0>>32)^x3[l]^k1;
+                x1[l]=uint32_t(p1);
+                x3[l]=uint32_t(p0);
+                x0[l]=n0;
+                x2[l]=n2;
+            }
+            k0+=PhiloxW0;
+            k1+=PhiloxW1;
+        }
+
+        for (int l = 0; l < Lanes; ++l)
+        {
+            out[i+2*l]  =toUniform((uint64_t(x1[l])<<32)|x0[l]);
+            out[i+2*l+1]=toUniform((uint64_t(x3[l])<<32)|x2[l]);
+        }
+        i+=2*Lanes;
+    }
+
+    //The rest one at the time
+    for (; i < N; ++i)
+        out[i]=uniform(entity,day,purpose,firstIndex+i);
+}
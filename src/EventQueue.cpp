@@ -0,0 +1,139 @@
+#include "EventQueue.hpp"
+
+#include <utility>
+#include <string>
+
+#include "TrafficExceptions.hpp"
+#include "BinaryIO.hpp"
+
+//Strict ordering of events, time first, and then the order they were scheduled in
+static inline bool before(const Event& A, const Event& B) noexcept
+{
+    return A.time<B.time || (A.time==B.time && A.seq<B.seq);
+}
+
+void EventQueue::siftUp(size_t i) noexcept
+{
+    while (i>0)
+    {
+        size_t parent=(i-1)/2;
+        if (!before(heap[i],heap[parent]))
+            break;
+        std::swap(heap[i],heap[parent]);
+        i=parent;
+    }
+}
+
+void EventQueue::siftDown(size_t i) noexcept
+{
+    size_t N=heap.size();
+    while (true)
+    {
+        size_t smallest=i;
+        size_t left=2*i+1;
+        size_t right=left+1;
+        if (left<N && before(heap[left],heap[smallest]))
+            smallest=left;
+        if (right<N && before(heap[right],heap[smallest]))
+            smallest=right;
+        if (smallest==i)
+            break;
+        std::swap(heap[i],heap[smallest]);
+        i=smallest;
+    }
+}
+
+size_t EventQueue::registerHandler(IEventHandler* H)
+{
+    if (H==nullptr)
+        throw TrafficSimulation_error("Registering NULL event handler");
+    handlers.push_back(H);
+    return handlers.size()-1;
+}
+
+void EventQueue::schedule(double time, size_t handler, int kind, uint64_t arg)
+{
+    if (handler>=handlers.size())
+        throw TrafficSimulation_error("Scheduling event for handler "+std::to_string(handler)+", but only "+std::to_string(handlers.size())+" handlers are registered");
+    if (time<now)
+        throw TrafficSimulation_error("Scheduling event at time "+std::to_string(time)+", which is before the current time "+std::to_string(now));
+
+    heap.push_back(Event{time,nextSeq++,handler,kind,arg});
+    siftUp(heap.size()-1);
+}
+
+bool EventQueue::runNext()
+{
+    if (heap.empty())
+        return false;
+
+    //Pop BEFORE handling, the handler may very well schedule new events
+    Event E=heap.front();
+    heap.front()=heap.back();
+    heap.pop_back();
+    if (!heap.empty())
+        siftDown(0);
+
+    now=E.time;
+    handlers[E.handler]->handleEvent(E.time,E.kind,E.arg);
+    return true;
+}
+
+size_t EventQueue::runUntil(double time)
+{
+    size_t count=0;
+    while (!heap.empty() && heap.front().time<=time)
+    {
+        runNext();
+        ++count;
+    }
+    if (time>now)
+        now=time;
+    return count;
+}
+
+void EventQueue::saveState(std::string& out) const
+{
+    using namespace BinaryIO;
+    put<double>(out,now);
+    putVarint(out,nextSeq);
+    putVarint(out,handlers.size());
+    //Field by field, so the padding of Event does not end up in the file
+    putVarint(out,heap.size());
+    for (const Event& E : heap)
+    {
+        put<double>(out,E.time);
+        putVarint(out,E.seq);
+        putVarint(out,E.handler);
+        putVarint(out,zigzag(E.kind));
+        putVarint(out,E.arg);
+    }
+}
+
+void EventQueue::loadState(const char*& p, const char* end)
+{
+    using namespace BinaryIO;
+    double time=get<double>(p,end);
+    uint64_t seq=getVarint(p,end);
+    uint64_t handlerNumber=getVarint(p,end);
+    if (handlerNumber!=handlers.size())
+        throw file_format_exception("event queue saved with "+std::to_string(handlerNumber)+" handlers, this one has "+std::to_string(handlers.size()));
+    uint64_t N=getVarint(p,end);
+    std::vector<Event> events;
+    for (uint64_t i = 0; i < N; ++i)
+    {
+        Event E;
+        E.time=get<double>(p,end);
+        E.seq=getVarint(p,end);
+        E.handler=getVarint(p,end);
+        E.kind=int(unzigzag(getVarint(p,end)));
+        E.arg=getVarint(p,end);
+        if (E.handler>=handlers.size() || E.time<time || E.seq>=seq)
+            throw file_format_exception("event queue with an impossible event");
+        events.push_back(E);
+    }
+    //The heap order is saved too, so it pops in the same order as the queue which was saved
+    heap=std::move(events);
+    nextSeq=seq;
+    now=time;
+}
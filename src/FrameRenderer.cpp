@@ -0,0 +1,229 @@
+#include "FrameRenderer.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <thread>
+#include <atomic>
+
+#include "Road.hpp"
+#include "Node.hpp"
+#include "ICityNetwork.hpp"
+#include "TrafficExceptions.hpp"
+
+//Meters per lane, for the width of the roads
+#define laneWidth 3.5
+
+void FrameImage::writePPM(std::ostream& out) const
+{
+    out<<"P6\n"<<width<<' '<<height<<"\n255\n";
+    out.write(reinterpret_cast<const char*>(pixels.data()),pixels.size());
+    if (!out)
+        throw TrafficSimulation_error("Error writing image");
+}
+
+FrameRenderer::FrameRenderer(ICityNetwork& _city, KeyframeReader& _reader, size_t _width, size_t _height, unsigned _threads, size_t _tileSize):city(_city),reader(_reader),replay(_reader,&_city),width(_width),height(_height),threads(_threads),tileSize(_tileSize)
+{
+    if (width==0 || height==0)
+        throw TrafficSimulation_error("Can not render an empty image");
+    if (tileSize==0)
+        throw TrafficSimulation_error("Can not render with empty tiles");
+    if (threads==0)
+        threads=std::max(1u,std::thread::hardware_concurrency());
+
+    tilesX=(width+tileSize-1)/tileSize;
+    tilesY=(height+tileSize-1)/tileSize;
+    tileRoads.resize(tilesX*tilesY);
+    tileVehicles.resize(tilesX*tilesY);
+
+    for (size_t i = 0; i < city.getRoadsSize(); ++i)
+        speedLimit.push_back(city.getRoad(i)->getSpeedLimit());
+
+    //The whole city, with a bit of space around it
+    KeyframeBox All{-1,-1,1,1};
+    for (size_t i = 0; i < city.getNodesSize(); ++i)
+    {
+        std::shared_ptr<Node> N=city.getNode(i);
+        if (i==0)
+            All=KeyframeBox{N->getX(),N->getY(),N->getX(),N->getY()};
+        All=KeyframeBox{std::min(All.minX,N->getX()),std::min(All.minY,N->getY()),std::max(All.maxX,N->getX()),std::max(All.maxY,N->getY())};
+    }
+    double margin=std::max({All.maxX-All.minX,All.maxY-All.minY,1.0})*0.05;
+    setView(KeyframeBox{All.minX-margin,All.minY-margin,All.maxX+margin,All.maxY+margin});
+}
+
+void FrameRenderer::setView(const KeyframeBox& View)
+{
+    if (!(View.maxX>View.minX && View.maxY>View.minY))
+        throw TrafficSimulation_error("Can not render an empty part of the map");
+    view=View;
+    scale=std::min(width/(view.maxX-view.minX),height/(view.maxY-view.minY));
+
+    lines.clear();
+    for (size_t i = 0; i < city.getRoadsSize(); ++i)
+    {
+        std::shared_ptr<Road> R=city.getRoad(i);
+        RoadLine L;
+        L.ax=toPixelX(R->getStart().getX());
+        L.ay=toPixelY(R->getStart().getY());
+        L.bx=toPixelX(R->getEnd().getX());
+        L.by=toPixelY(R->getEnd().getY());
+        //At least one pixel wide, or zoomed out cities disappear
+        L.halfWidth=std::max(0.5,R->getLanes()*laneWidth*scale/2);
+        lines.push_back(L);
+    }
+}
+
+void FrameRenderer::congestionColour(double c, uint8_t rgb[3]) noexcept
+{
+    if (c<0)
+    {
+        rgb[0]=rgb[1]=rgb[2]=90;
+        return;
+    }
+    c=std::min(c,1.0);
+    //Green to yellow for the first half, yellow to red for the second
+    rgb[0]=uint8_t(std::lround(255*std::min(1.0,2*c)));
+    rgb[1]=uint8_t(std::lround(255*std::min(1.0,2*(1-c))));
+    rgb[2]=0;
+}
+
+void FrameRenderer::binTiles()
+{
+    for (std::vector<size_t>& T : tileRoads)
+        T.clear();
+    for (std::vector<size_t>& T : tileVehicles)
+        T.clear();
+
+    //The tiles a pixel box touches, clamped to the image
+    auto bin = [this](double minX, double minY, double maxX, double maxY, size_t item, std::vector<std::vector<size_t> >& tiles)
+    {
+        if (maxX<0 || maxY<0 || minX>=double(width) || minY>=double(height))
+            return;
+        size_t x0=size_t(std::max(0.0,minX))/tileSize;
+        size_t y0=size_t(std::max(0.0,minY))/tileSize;
+        size_t x1=std::min(tilesX-1,size_t(maxX)/tileSize);
+        size_t y1=std::min(tilesY-1,size_t(maxY)/tileSize);
+        for (size_t y = y0; y <= y1; ++y)
+            for (size_t x = x0; x <= x1; ++x)
+                tiles[y*tilesX+x].push_back(item);
+    };
+
+    for (size_t i = 0; i < lines.size(); ++i)
+    {
+        const RoadLine& L=lines[i];
+        bin(std::min(L.ax,L.bx)-L.halfWidth,std::min(L.ay,L.by)-L.halfWidth,std::max(L.ax,L.bx)+L.halfWidth,std::max(L.ay,L.by)+L.halfWidth,i,tileRoads);
+    }
+    for (size_t i = 0; i < vehicles.size(); ++i)
+    {
+        double half=std::max(1.0,reader.getVehicle(vehicles[i].vehicle).length*scale/2);
+        double x=toPixelX(vehicles[i].x);
+        double y=toPixelY(vehicles[i].y);
+        bin(x-half,y-half,x+half,y+half,i,tileVehicles);
+    }
+}
+
+void FrameRenderer::drawTile(size_t tile, FrameImage& out) const
+{
+    size_t x0=(tile%tilesX)*tileSize;
+    size_t y0=(tile/tilesX)*tileSize;
+    size_t x1=std::min(width,x0+tileSize);
+    size_t y1=std::min(height,y0+tileSize);
+
+    for (size_t y = y0; y < y1; ++y)
+        for (size_t x = x0; x < x1; ++x)
+        {
+            uint8_t* P=out.at(x,y);
+            P[0]=P[1]=P[2]=20;
+        }
+
+    //Every pixel within half the width of the line, only looking at the part of the tile the road can touch
+    for (size_t r : tileRoads[tile])
+    {
+        const RoadLine& L=lines[r];
+        uint8_t rgb[3];
+        congestionColour(congestion[r],rgb);
+
+        size_t px0=size_t(std::clamp(std::floor(std::min(L.ax,L.bx)-L.halfWidth),double(x0),double(x1)));
+        size_t py0=size_t(std::clamp(std::floor(std::min(L.ay,L.by)-L.halfWidth),double(y0),double(y1)));
+        size_t px1=size_t(std::clamp(std::ceil(std::max(L.ax,L.bx)+L.halfWidth),double(x0),double(x1)));
+        size_t py1=size_t(std::clamp(std::ceil(std::max(L.ay,L.by)+L.halfWidth),double(y0),double(y1)));
+
+        double dx=L.bx-L.ax;
+        double dy=L.by-L.ay;
+        double length2=dx*dx+dy*dy;
+        for (size_t y = py0; y < py1; ++y)
+            for (size_t x = px0; x < px1; ++x)
+            {
+                //Distance from the middle of the pixel to the closest point on the road
+                double cx=x+0.5-L.ax;
+                double cy=y+0.5-L.ay;
+                double f=length2>0 ? std::clamp((cx*dx+cy*dy)/length2,0.0,1.0) : 0;
+                double ex=cx-f*dx;
+                double ey=cy-f*dy;
+                if (ex*ex+ey*ey<=L.halfWidth*L.halfWidth)
+                {
+                    uint8_t* P=out.at(x,y);
+                    P[0]=rgb[0];
+                    P[1]=rgb[1];
+                    P[2]=rgb[2];
+                }
+            }
+    }
+
+    for (size_t v : tileVehicles[tile])
+    {
+        double half=std::max(1.0,reader.getVehicle(vehicles[v].vehicle).length*scale/2);
+        double x=toPixelX(vehicles[v].x);
+        double y=toPixelY(vehicles[v].y);
+        size_t px0=size_t(std::clamp(std::floor(x-half),double(x0),double(x1)));
+        size_t py0=size_t(std::clamp(std::floor(y-half),double(y0),double(y1)));
+        size_t px1=size_t(std::clamp(std::ceil(x+half),double(x0),double(x1)));
+        size_t py1=size_t(std::clamp(std::ceil(y+half),double(y0),double(y1)));
+        for (size_t py = py0; py < py1; ++py)
+            for (size_t px = px0; px < px1; ++px)
+            {
+                uint8_t* P=out.at(px,py);
+                P[0]=P[1]=P[2]=255;
+            }
+    }
+}
+
+void FrameRenderer::render(double time, FrameImage& out)
+{
+    replay.stateAt(time,vehicles);
+
+    //Average speed on every road, compared to the speed limit
+    std::vector<double> speedSum(lines.size(),0);
+    std::vector<size_t> count(lines.size(),0);
+    for (const VehicleState& S : vehicles)
+        if (S.frame.road<lines.size())
+        {
+            speedSum[S.frame.road]+=S.frame.speed;
+            ++count[S.frame.road];
+        }
+    congestion.assign(lines.size(),-1);
+    for (size_t r = 0; r < lines.size(); ++r)
+        if (count[r]>0)
+            congestion[r]=std::clamp(1-speedSum[r]/count[r]/speedLimit[r],0.0,1.0);
+
+    binTiles();
+
+    out.width=width;
+    out.height=height;
+    out.pixels.resize(3*width*height);
+
+    //Every thread takes the next tile no one has drawn, until there are none
+    std::atomic<size_t> next=0;
+    size_t tiles=tilesX*tilesY;
+    auto work = [&]()
+    {
+        for (size_t tile=next++; tile<tiles; tile=next++)
+            drawTile(tile,out);
+    };
+    std::vector<std::thread> helpers;
+    for (unsigned i = 1; i < std::min<size_t>(threads,tiles); ++i)
+        helpers.emplace_back(work);
+    work();
+    for (std::thread& T : helpers)
+        T.join();
+}
@@ -3,6 +3,7 @@
 #include <iostream>
 
 #include "TrafficExceptions.hpp"
+#include "BinaryIO.hpp"
 
 #include "Road.hpp"
 
@@ -30,6 +31,19 @@ void Hellhole::addRoad(const Road* R){
 }
 
 
+void Hellhole::removeRoad(const Road* R)
+{
+    if (R==nullptr || R!=myRoad)
+    {
+        std::vector<int> legal;
+        if (myRoad!=nullptr)
+            legal.push_back(myRoad->getRoadID());
+        throw road_address_exception(R==nullptr ? -1 : int(R->getRoadID()),legal,getNodeID());
+    }
+    myRoad=nullptr;
+    myNeighbour=nullptr;
+}
+
 const Road &Hellhole::getRoad(size_t roadID, bool local){
 
     if (local){
@@ -56,3 +70,21 @@ const Node &Hellhole::getNeighbour(size_t roadID, bool local){
     //myRoad is only non null if myNeighbour is not null so if we got here myNeighbour is NOT NULL
     return *myNeighbour;//As there is only one road, just return tha
 }
+
+void Hellhole::saveState(std::string& out) const
+{
+    BinaryIO::putVarint(out,swallowed);
+    BinaryIO::putVarint(out,source!=nullptr);
+    if (source!=nullptr)
+        source->saveState(out);
+}
+
+void Hellhole::loadState(const char*& p, const char* end)
+{
+    uint64_t S=BinaryIO::getVarint(p,end);
+    if (bool(BinaryIO::getVarint(p,end))!=(source!=nullptr))
+        throw file_format_exception("Hellhole "+std::to_string(getNodeID())+(source!=nullptr ? " is" : " is not")+" a source, the saved one was the opposite");
+    if (source!=nullptr)
+        source->loadState(p,end);
+    swallowed=S;
+}
@@ -0,0 +1,139 @@
+#include "Intersection.hpp"
+
+#include "TrafficExceptions.hpp"
+#include "BinaryIO.hpp"
+
+#include "Road.hpp"
+
+#include <cmath>
+#include <algorithm>
+
+//Seconds lost in a 90 degree turn, and turning around, with no one else around, the same for every road type
+namespace TurnTime
+{
+    static constexpr double right=3.0;
+    static constexpr double left=6.0;
+    static constexpr double uTurn=20.0;
+}
+
+void Intersection::addRoad(const Road* R){
+    if (R==nullptr)
+        throw TrafficSimulation_error("Adding NULL road to Node "+std::to_string(getNodeID()));
+    else if (myRoads.size()>=maxRoads)
+        throw road_address_exception(myRoads.size(),maxRoads,getNodeID());
+
+    //NOTE this only works if addRoad is called AFTER both end and start has been assigned correctly
+    //getOther throws if we are not one of the ends, so do it before modifying anything
+    const Node* Neighbour = &(R->getOther(getNodeID()));
+
+    myRoads.push_back(R);
+    myNeighbours.push_back(Neighbour);
+    reservations.reset();//Only matters when the city is edited after the table was built
+}
+
+void Intersection::removeRoad(const Road* R)
+{
+    for (size_t i = 0; i < myRoads.size(); ++i)
+        if (myRoads[i]==R)
+        {
+            myRoads.erase(myRoads.begin()+i);
+            myNeighbours.erase(myNeighbours.begin()+i);
+            reservations.reset();
+            return;
+        }
+    std::vector<int> legal;
+    for (const Road* Mine : myRoads)
+        legal.push_back(Mine->getRoadID());
+    throw road_address_exception(R==nullptr ? -1 : int(R->getRoadID()),legal,getNodeID());
+}
+
+void Intersection::addRoads(const Road* const* R, size_t count)
+{
+    myRoads.reserve(std::min(myRoads.size()+count,maxRoads));
+    myNeighbours.reserve(std::min(myNeighbours.size()+count,maxRoads));
+    for (size_t i = 0; i < count; ++i)
+        Intersection::addRoad(R[i]);
+}
+
+size_t Intersection::getLocalID(size_t roadID) const
+{
+    //Intersections only have a handful of roads, so a linear search beats anything fancier
+    for (size_t i = 0; i < myRoads.size(); ++i)
+        if (myRoads[i]->getRoadID()==roadID)
+            return i;
+
+    std::vector<int> legal;
+    for (const Road* R : myRoads)
+        legal.push_back(R->getRoadID());
+    throw road_address_exception(roadID,legal,getNodeID());
+}
+
+const Road &Intersection::getRoad(size_t roadID, bool local){
+    if (local){
+        if(roadID>=myRoads.size())
+            throw road_address_exception(roadID,myRoads.size(),getNodeID());
+        return *myRoads[roadID];
+    }
+    return *myRoads[getLocalID(roadID)];
+}
+
+const Node &Intersection::getNeighbour(size_t roadID, bool local){
+    if (local){
+        if(roadID>=myRoads.size())
+            throw road_address_exception(roadID,myRoads.size(),getNodeID());
+        return *myNeighbours[roadID];
+    }
+    return *myNeighbours[getLocalID(roadID)];
+}
+
+double Intersection::idealTransferTime(size_t road0id, size_t road1id, bool local) const
+{
+    size_t from=road0id;
+    size_t to=road1id;
+    if (local)
+    {
+        if (from>=myRoads.size())
+            throw road_address_exception(from,myRoads.size(),getNodeID());
+        if (to>=myRoads.size())
+            throw road_address_exception(to,myRoads.size(),getNodeID());
+    }
+    else
+    {
+        from=getLocalID(road0id);
+        to=getLocalID(road1id);
+    }
+
+    if (from==to)
+        return TurnTime::uTurn;
+
+    //The direction we drive in, on the way in and on the way out
+    return turnTime(getX()-myNeighbours[from]->getX(),getY()-myNeighbours[from]->getY(),myNeighbours[to]->getX()-getX(),myNeighbours[to]->getY()-getY());
+}
+
+double Intersection::turnTime(double inX, double inY, double outX, double outY) noexcept
+{
+    //Positive is to the left
+    double angle=std::atan2(inX*outY-inY*outX,inX*outX+inY*outY);
+    return std::abs(angle)/(M_PI/2)*(angle>0 ? TurnTime::left : TurnTime::right);
+}
+
+ReservationTable& Intersection::buildReservations(double windowLength, size_t windows)
+{
+    reservations=std::make_unique<ReservationTable>(*this,windowLength,windows);
+    return *reservations;
+}
+
+void Intersection::saveState(std::string& out) const
+{
+    BinaryIO::putVarint(out,reservations!=nullptr);
+    if (reservations!=nullptr)
+        reservations->saveState(out);
+}
+
+void Intersection::loadState(const char*& p, const char* end)
+{
+    if (bool(BinaryIO::getVarint(p,end))!=(reservations!=nullptr))
+        throw file_format_exception("Node "+std::to_string(getNodeID())+(reservations!=nullptr ? " has" : " has no")+" reservation table, the saved one was the opposite");
+    if (reservations!=nullptr)
+        reservations->loadState(p,end);
+}
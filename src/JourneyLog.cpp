@@ -0,0 +1,186 @@
+#include "JourneyLog.hpp"
+
+#include <chrono>
+
+#include "BinaryIO.hpp"
+#include "TrafficExceptions.hpp"
+
+using namespace BinaryIO;
+
+JourneyLog::JourneyLog(std::ostream& _out, size_t queueCapacity, bool _internRoutes):out(_out),queue(queueCapacity),internRoutes(_internRoutes)
+{
+    std::string header;
+    put(header,JourneyLogFormat::magic);
+    put(header,JourneyLogFormat::version);
+    put(header,uint8_t(internRoutes ? JourneyLogFormat::internedRoutes : 0));
+    out.write(header.data(),header.size());
+    if (!out)
+        throw TrafficSimulation_error("Error writing journey log");
+
+    writer=std::thread(&JourneyLog::writeLoop,this);
+}
+
+JourneyLog::~JourneyLog()
+{
+    try
+    {
+        close();
+    }
+    catch(...)
+    {
+        //Nothing sensible to do in a destructor
+    }
+}
+
+//Write the columns of these legs as one block, Routes is null if the routes are not interned
+static void writeBlock(std::ostream& out, const std::vector<JourneyLeg>& Legs, RouteStore* Routes, std::string& block)
+{
+    block.clear();
+    putVarint(block,Legs.size());
+
+    //Fixed width columns first, so a reader can find any value of any leg without decoding the others
+    for (const JourneyLeg& L : Legs)
+        put(block,L.journey);
+    for (const JourneyLeg& L : Legs)
+        put(block,uint8_t(L.mode));
+    for (const JourneyLeg& L : Legs)
+        put(block,L.distance);
+    for (const JourneyLeg& L : Legs)
+        put(block,L.startTime);
+    for (const JourneyLeg& L : Legs)
+        put(block,L.eta);
+    for (const JourneyLeg& L : Legs)
+        put(block,L.arrival);
+    for (const JourneyLeg& L : Legs)
+        put(block,uint32_t(L.roads.size()));
+
+    std::string roads;
+    if (Routes)
+    {
+        //The new trie nodes, as the parent and the road (as the difference from the road of the parent), and then the route of every leg
+        size_t before=Routes->getNodeNumber();
+        std::vector<RouteID> IDs;
+        IDs.reserve(Legs.size());
+        for (const JourneyLeg& L : Legs)
+            IDs.push_back(Routes->intern(L.roads));
+        putVarint(roads,Routes->getNodeNumber()-before);
+        for (RouteID N = before; N < Routes->getNodeNumber(); ++N)
+        {
+            RouteID parent=Routes->getParent(N);
+            int64_t parentRoad=parent==0 ? 0 : int64_t(Routes->getLastRoad(parent));
+            putVarint(roads,parent);
+            putVarint(roads,zigzag(int64_t(Routes->getLastRoad(N))-parentRoad));
+        }
+        for (RouteID ID : IDs)
+            putVarint(roads,ID);
+    }
+    else
+    {
+        //The roads of a journey are mostly close to each other in the road list, so the differences are short varints
+        int64_t previous=0;
+        for (const JourneyLeg& L : Legs)
+            for (size_t r : L.roads)
+            {
+                putVarint(roads,zigzag(int64_t(r)-previous));
+                previous=int64_t(r);
+            }
+    }
+    putVarint(block,roads.size());
+    block+=roads;
+
+    std::string length;
+    putVarint(length,block.size());
+    out.write(length.data(),length.size());
+    out.write(block.data(),block.size());
+}
+
+void JourneyLog::writeLoop()
+{
+    std::vector<JourneyLeg> Legs;
+    Legs.reserve(JourneyLogFormat::blockLegs);
+    std::string block;
+    JourneyLeg Leg;
+    int idle=0;
+    try
+    {
+        while (true)
+        {
+            if (queue.tryPop(Leg))
+            {
+                idle=0;
+                Legs.push_back(std::move(Leg));
+                if (Legs.size()==JourneyLogFormat::blockLegs)
+                {
+                    writeBlock(out,Legs,internRoutes ? &routes : nullptr,block);
+                    legsWritten+=Legs.size();
+                    Legs.clear();
+                    if (!out)
+                        throw TrafficSimulation_error("Error writing journey log");
+                }
+                continue;
+            }
+
+            //The producer only sets stopping after its last push, so an empty queue now really is the end
+            if (stopping.load(std::memory_order_acquire) && queue.empty())
+                break;
+
+            //Nothing to do, spin a little in case more is coming, then sleep so we do not take a core from the simulation
+            if (++idle<64 || draining.load(std::memory_order_relaxed))
+                std::this_thread::yield();
+            else
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+
+        if (!Legs.empty())
+        {
+            writeBlock(out,Legs,internRoutes ? &routes : nullptr,block);
+            legsWritten+=Legs.size();
+        }
+        out.flush();
+        if (!out)
+            throw TrafficSimulation_error("Error writing journey log");
+    }
+    catch(...)
+    {
+        writerError=std::current_exception();
+        failed.store(true,std::memory_order_release);
+    }
+}
+
+void JourneyLog::drainBacklog()
+{
+    while (!backlog.empty() && queue.tryPush(backlog.front()))
+        backlog.pop_front();
+}
+
+void JourneyLog::log(JourneyLeg& Leg)
+{
+    if (closed)
+        throw TrafficSimulation_error("Logging journey leg to closed journey log");
+    if (failed.load(std::memory_order_acquire))
+        throw TrafficSimulation_error("Journey log writer has failed");
+
+    drainBacklog();
+    if (!backlog.empty() || !queue.tryPush(Leg))
+        backlog.push_back(std::move(Leg));
+}
+
+void JourneyLog::close()
+{
+    if (closed)
+        return;
+    closed=true;
+    draining.store(true,std::memory_order_relaxed);
+
+    //Now we have to wait, the backlog must get into the queue before we tell the writer to stop
+    while (!backlog.empty() && !failed.load(std::memory_order_acquire))
+    {
+        drainBacklog();
+        if (!backlog.empty())
+            std::this_thread::yield();
+    }
+    stopping.store(true,std::memory_order_release);
+    writer.join();
+    if (writerError)
+        std::rethrow_exception(writerError);
+}
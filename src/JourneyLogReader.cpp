@@ -0,0 +1,120 @@
+#include "JourneyLogReader.hpp"
+
+#include "BinaryIO.hpp"
+
+using namespace BinaryIO;
+
+//Magic, version and flags
+#define headerBytes (2*sizeof(uint32_t)+sizeof(uint8_t))
+
+JourneyLogReader::JourneyLogReader(std::istream& _in):in(_in)
+{
+    buffer.resize(headerBytes);
+    in.read(buffer.data(),headerBytes);
+    if (in.gcount()!=static_cast<std::streamsize>(headerBytes))
+        throw file_format_exception("journey log too short");
+    const char* p=buffer.data();
+    const char* end=p+headerBytes;
+    if (get<uint32_t>(p,end)!=JourneyLogFormat::magic)
+        throw file_format_exception("not a journey log");
+    uint32_t version=get<uint32_t>(p,end);
+    if (version!=JourneyLogFormat::version)
+        throw file_format_exception("journey log version "+std::to_string(version)+" is not supported");
+    uint8_t flags=get<uint8_t>(p,end);
+    internedRoutes=flags&JourneyLogFormat::internedRoutes;
+}
+
+bool JourneyLogReader::nextBlock(std::vector<JourneyLeg>& out)
+{
+    uint64_t bytes;
+    if (!streamVarint(in,bytes))
+        return false;
+    buffer.resize(bytes);
+    in.read(buffer.data(),bytes);
+    if (static_cast<uint64_t>(in.gcount())!=bytes)
+        throw file_format_exception("journey log block cut short");
+
+    const char* p=buffer.data();
+    const char* end=p+bytes;
+    uint64_t N=getVarint(p,end);
+    //Each leg takes at least 45 bytes of fixed columns, so this also catches absurd counts before we allocate
+    if (N>bytes)
+        throw file_format_exception("journey log block has more legs than bytes");
+    out.resize(N);
+
+    for (JourneyLeg& L : out)
+        L.journey=get<uint64_t>(p,end);
+    for (JourneyLeg& L : out)
+    {
+        uint8_t mode=get<uint8_t>(p,end);
+        if (mode>onFoot)
+            throw file_format_exception("journey leg with unknown mode "+std::to_string(mode));
+        L.mode=TravelMode(mode);
+    }
+    for (JourneyLeg& L : out)
+        L.distance=get<double>(p,end);
+    for (JourneyLeg& L : out)
+        L.startTime=get<double>(p,end);
+    for (JourneyLeg& L : out)
+        L.eta=get<double>(p,end);
+    for (JourneyLeg& L : out)
+        L.arrival=get<double>(p,end);
+    std::vector<uint32_t> roadCounts(N);
+    for (uint32_t& C : roadCounts)
+        C=get<uint32_t>(p,end);
+
+    uint64_t roadBytes=getVarint(p,end);
+    if (uint64_t(end-p)!=roadBytes)
+        throw file_format_exception("journey log road column has the wrong length");
+    if (internedRoutes)
+    {
+        try
+        {
+            uint64_t newNodes=getVarint(p,end);
+            for (uint64_t i = 0; i < newNodes; ++i)
+            {
+                RouteID parent=getVarint(p,end);
+                int64_t parentRoad=(parent==0 || parent>=routes.getNodeNumber()) ? 0 : int64_t(routes.getLastRoad(parent));
+                int64_t road=parentRoad+unzigzag(getVarint(p,end));
+                size_t expected=routes.getNodeNumber();
+                if (road<0 || routes.extend(parent,size_t(road))!=expected)
+                    throw file_format_exception("journey log route trie is corrupt");
+            }
+            for (size_t i = 0; i < N; ++i)
+            {
+                RouteID route=getVarint(p,end);
+                routes.getRoute(route,out[i].roads);
+                if (out[i].roads.size()!=roadCounts[i])
+                    throw file_format_exception("journey log route has the wrong length");
+            }
+        }
+        catch(file_format_exception&)
+        {
+            throw;
+        }
+        catch(TrafficSimulation_error& E)
+        {
+            //Route IDs which do not exist
+            throw file_format_exception(std::string("journey log route column is corrupt; ")+E.what());
+        }
+    }
+    else
+    {
+        int64_t previous=0;
+        for (size_t i = 0; i < N; ++i)
+        {
+            //Every road takes at least a byte
+            if (roadCounts[i]>uint64_t(end-p))
+                throw file_format_exception("journey log road column too short");
+            out[i].roads.resize(roadCounts[i]);
+            for (size_t& r : out[i].roads)
+            {
+                previous+=unzigzag(getVarint(p,end));
+                r=size_t(previous);
+            }
+        }
+    }
+    if (p!=end)
+        throw file_format_exception("journey log road column has the wrong length");
+    return true;
+}
@@ -0,0 +1,350 @@
+#include "KeyframeReader.hpp"
+
+#include <algorithm>
+#include <memory>
+#include <cmath>
+#include <iomanip>
+
+#include "BinaryIO.hpp"
+
+using namespace BinaryIO;
+
+//Tail offset and magic
+#define footerBytes (sizeof(uint64_t)+sizeof(uint32_t))
+//Magic, version and chunk duration
+#define headerBytes (2*sizeof(uint32_t)+sizeof(double))
+
+KeyframeReader::KeyframeReader(std::istream& _in):in(_in)
+{
+    in.clear();
+    in.seekg(0,std::ios::end);
+    std::streamoff size=in.tellg();
+    if (size<static_cast<std::streamoff>(headerBytes+footerBytes))
+        throw file_format_exception("keyframe file too short");
+
+    readAt(in,0,buffer,headerBytes);
+    const char* p=buffer.data();
+    const char* end=p+buffer.size();
+    if (get<uint32_t>(p,end)!=KeyframeFormat::headMagic)
+        throw file_format_exception("not a keyframe file");
+    uint32_t version=get<uint32_t>(p,end);
+    if (version!=KeyframeFormat::version)
+        throw file_format_exception("keyframe file version "+std::to_string(version)+" is not supported");
+    chunkDuration=get<double>(p,end);
+
+    readAt(in,size-footerBytes,buffer,footerBytes);
+    p=buffer.data();
+    end=p+buffer.size();
+    uint64_t tailOffset=get<uint64_t>(p,end);
+    if (get<uint32_t>(p,end)!=KeyframeFormat::tailMagic)
+        throw file_format_exception("keyframe file has no index, it was probably not closed");
+    if (tailOffset<headerBytes || tailOffset>uint64_t(size)-footerBytes)
+        throw file_format_exception("keyframe index out of bounds");
+
+    readAt(in,tailOffset,buffer,size-footerBytes-tailOffset);
+    p=buffer.data();
+    end=p+buffer.size();
+
+    uint64_t N=getVarint(p,end);
+    for (uint64_t i = 0; i < N; ++i)
+    {
+        KeyframeVehicle V;
+        V.type=getString(p,end);
+        V.length=get<double>(p,end);
+        V.firstTime=get<double>(p,end);
+        V.lastTime=get<double>(p,end);
+        V.keyframes=getVarint(p,end);
+        vehicles.push_back(V);
+    }
+
+    N=getVarint(p,end);
+    for (uint64_t i = 0; i < N; ++i)
+    {
+        KeyframeChunkInfo C;
+        C.startTime=get<double>(p,end);
+        C.offset=getVarint(p,end);
+        C.bytes=getVarint(p,end);
+        C.rows=getVarint(p,end);
+        if (C.offset+C.bytes>tailOffset)
+            throw file_format_exception("keyframe chunk "+std::to_string(i)+" out of bounds");
+        chunks.push_back(C);
+    }
+
+    //The grid can be far bigger than the file (most cells of a sparse city are empty), so only the cells with roads get a box, and the number of roads is checked against the bytes we have before anything is allocated
+    uint64_t cells=getVarint(p,end);
+    N=getVarint(p,end);
+    if (uint64_t(end-p)/(1+4*sizeof(double))<N)
+        throw file_format_exception("keyframe road index past end of file");
+    roadCell.reserve(N);
+    roadBox.reserve(N);
+    for (uint64_t i = 0; i < N; ++i)
+    {
+        uint64_t cell=getVarint(p,end);
+        if (cell>=cells)
+            throw file_format_exception("keyframe road "+std::to_string(i)+" is in cell "+std::to_string(cell)+" outside the grid");
+        KeyframeBox B;
+        B.minX=get<double>(p,end);
+        B.minY=get<double>(p,end);
+        B.maxX=get<double>(p,end);
+        B.maxY=get<double>(p,end);
+        roadCell.push_back(cell);
+        roadBox.push_back(B);
+    }
+
+    usedCells=roadCell;
+    std::sort(usedCells.begin(),usedCells.end());
+    usedCells.erase(std::unique(usedCells.begin(),usedCells.end()),usedCells.end());
+    cellBox.resize(usedCells.size());
+    std::vector<bool> cellSeen(usedCells.size(),false);
+    for (size_t r = 0; r < roadCell.size(); ++r)
+    {
+        size_t c=findCell(roadCell[r]);
+        const KeyframeBox& B=roadBox[r];
+        KeyframeBox& C=cellBox[c];
+        if (!cellSeen[c])
+            C=B;
+        else
+            C=KeyframeBox{std::min(C.minX,B.minX),std::min(C.minY,B.minY),std::max(C.maxX,B.maxX),std::max(C.maxY,B.maxY)};
+        cellSeen[c]=true;
+    }
+    //Empty cells never have keyframes, so they have no box
+}
+
+size_t KeyframeReader::findCell(uint64_t cell) const noexcept
+{
+    auto It=std::lower_bound(usedCells.begin(),usedCells.end(),cell);
+    return It!=usedCells.end() && *It==cell ? It-usedCells.begin() : usedCells.size();
+}
+
+size_t KeyframeReader::findChunk(double time) const noexcept
+{
+    //First chunk starting after the time, the one before it is ours
+    auto It=std::upper_bound(chunks.begin(),chunks.end(),time,[](double t, const KeyframeChunkInfo& C){return t<C.startTime;});
+    if (It==chunks.begin())
+        return chunks.size();
+    return (It-chunks.begin())-1;
+}
+
+void KeyframeReader::decodeRows(const char*& p, const char* end, double startTime, std::vector<KeyframeRecord>& out) const
+{
+    uint64_t rows=getVarint(p,end);
+
+    //Find the start and end of every column
+    const int columns=7;
+    const char* begin[columns];
+    const char* stop[columns];
+    for (int c = 0; c < columns; ++c)
+    {
+        uint64_t bytes=getVarint(p,end);
+        if (uint64_t(end-p)<bytes)
+            throw file_format_exception("keyframe column past end of chunk");
+        begin[c]=p;
+        stop[c]=p+bytes;
+        p+=bytes;
+    }
+
+    size_t first=out.size();
+    out.resize(first+rows);
+
+    //Decode column by column, so each loop only touches one stream of bytes
+    const char* q=begin[0];
+    for (size_t i = 0; i < rows; ++i)
+        out[first+i].vehicle=getVarint(q,stop[0]);
+
+    q=begin[1];
+    int64_t tick=std::llround(startTime/KeyframeFormat::timeResolution);
+    for (size_t i = 0; i < rows; ++i)
+    {
+        tick+=unzigzag(getVarint(q,stop[1]));
+        out[first+i].frame.time=tick*KeyframeFormat::timeResolution;
+    }
+
+    q=begin[2];
+    for (size_t i = 0; i < rows; ++i)
+        out[first+i].frame.road=getVarint(q,stop[2]);
+
+    if (uint64_t(stop[3]-begin[3])!=rows)
+        throw file_format_exception("keyframe lane column has wrong length");
+    for (size_t i = 0; i < rows; ++i)
+    {
+        uint8_t b=uint8_t(begin[3][i]);
+        out[first+i].frame.lane=b>>1;
+        out[first+i].frame.direction=b&1;
+    }
+
+    q=begin[4];
+    for (size_t i = 0; i < rows; ++i)
+        out[first+i].frame.pos=unzigzag(getVarint(q,stop[4]))*KeyframeFormat::posResolution;
+
+    q=begin[5];
+    for (size_t i = 0; i < rows; ++i)
+        out[first+i].frame.speed=unzigzag(getVarint(q,stop[5]))*KeyframeFormat::speedResolution;
+
+    q=begin[6];
+    for (size_t i = 0; i < rows; ++i)
+        out[first+i].frame.acc=unzigzag(getVarint(q,stop[6]))*KeyframeFormat::accResolution;
+
+    for (size_t i = first; i < out.size(); ++i)
+        if (out[i].vehicle>=vehicles.size())
+            throw file_format_exception("keyframe for vehicle "+std::to_string(out[i].vehicle)+" which is not in the vehicle table");
+}
+
+const char* KeyframeReader::loadChunk(size_t chunk, bool skipSnapshot)
+{
+    const KeyframeChunkInfo& C=chunks.at(chunk);
+    readAt(in,C.offset,buffer,C.bytes);
+    const char* p=buffer.data();
+    const char* end=p+buffer.size();
+    if (skipSnapshot)
+    {
+        getVarint(p,end);//rows
+        for (int c = 0; c < 7; ++c)
+        {
+            uint64_t bytes=getVarint(p,end);
+            if (uint64_t(end-p)<bytes)
+                throw file_format_exception("keyframe column past end of chunk");
+            p+=bytes;
+        }
+    }
+    return p;
+}
+
+void KeyframeReader::decodeGroups(size_t chunk, const char* p, const std::vector<char>* visible, std::vector<KeyframeRecord>& out)
+{
+    const char* end=buffer.data()+buffer.size();
+    size_t first=out.size();
+    uint64_t groups=getVarint(p,end);
+    //With more than one group, the place of every row in the chunk as written
+    std::vector<uint64_t> sequence;
+    for (uint64_t g = 0; g < groups; ++g)
+    {
+        uint64_t cell=getVarint(p,end);
+        uint64_t bytes=getVarint(p,end);
+        if (uint64_t(end-p)<bytes)
+            throw file_format_exception("keyframe group past end of chunk");
+        const char* groupEnd=p+bytes;
+        size_t c=visible ? findCell(cell) : 0;
+        if (!visible || (c<visible->size() && (*visible)[c]))
+        {
+            size_t before=out.size();
+            decodeRows(p,groupEnd,chunks[chunk].startTime,out);
+            if (groups>1)
+            {
+                uint64_t sequenceBytes=getVarint(p,groupEnd);
+                if (uint64_t(groupEnd-p)!=sequenceBytes)
+                    throw file_format_exception("keyframe group order column has the wrong length");
+                uint64_t previous=0;
+                for (size_t i = before; i < out.size(); ++i)
+                {
+                    previous+=getVarint(p,groupEnd);
+                    sequence.push_back(previous);
+                }
+            }
+            if (p!=groupEnd)
+                throw file_format_exception("keyframe group has the wrong length");
+        }
+        p=groupEnd;
+    }
+
+    //Every group is in time order, but not the groups together, back in the order they were written, which is time order, and for one vehicle with several keyframes at the same time, the order it made them in
+    if (groups>1)
+    {
+        std::vector<std::pair<uint64_t,KeyframeRecord> > Sorted;
+        Sorted.reserve(out.size()-first);
+        for (size_t i = first; i < out.size(); ++i)
+            Sorted.push_back({sequence[i-first],out[i]});
+        std::sort(Sorted.begin(),Sorted.end(),[](const std::pair<uint64_t,KeyframeRecord>& A, const std::pair<uint64_t,KeyframeRecord>& B){return A.first<B.first;});
+        for (size_t i = first; i < out.size(); ++i)
+            out[i]=Sorted[i-first].second;
+    }
+}
+
+void KeyframeReader::readChunk(size_t chunk, std::vector<KeyframeRecord>& out)
+{
+    const char* p=loadChunk(chunk,true);
+    size_t first=out.size();
+    decodeGroups(chunk,p,nullptr,out);
+    if (out.size()-first!=chunks[chunk].rows)
+        throw file_format_exception("keyframe chunk "+std::to_string(chunk)+" row count does not match the index");
+}
+
+void KeyframeReader::readSnapshot(size_t chunk, std::vector<KeyframeRecord>& out)
+{
+    const char* p=loadChunk(chunk,false);
+    decodeRows(p,buffer.data()+buffer.size(),chunks[chunk].startTime,out);
+}
+
+void KeyframeReader::read(double t0, double t1, std::vector<KeyframeRecord>& out)
+{
+    size_t chunk=findChunk(t0);
+    if (chunk==chunks.size())
+        chunk=0;
+
+    for (; chunk < chunks.size() && chunks[chunk].startTime<t1; ++chunk)
+    {
+        decoded.clear();
+        readChunk(chunk,decoded);
+        for (const KeyframeRecord& R : decoded)
+            if (R.frame.time>=t0 && R.frame.time<t1)
+                out.push_back(R);
+    }
+}
+
+void KeyframeReader::query(double t0, double t1, const KeyframeBox& View, std::vector<KeyframeRecord>& out)
+{
+    if (roadCell.empty())
+    {
+        read(t0,t1,out);
+        return;
+    }
+
+    std::vector<char> visible(cellBox.size());
+    for (size_t c = 0; c < cellBox.size(); ++c)
+        visible[c]=cellBox[c].intersects(View);
+
+    size_t chunk=findChunk(t0);
+    if (chunk==chunks.size())
+        chunk=0;
+
+    for (; chunk < chunks.size() && chunks[chunk].startTime<t1; ++chunk)
+    {
+        decoded.clear();
+        decodeGroups(chunk,loadChunk(chunk,true),&visible,decoded);
+        //The cells are coarse, now check the roads themselves
+        for (const KeyframeRecord& R : decoded)
+            if (R.frame.time>=t0 && R.frame.time<t1 && R.frame.road<roadBox.size() && roadBox[R.frame.road].intersects(View))
+                out.push_back(R);
+    }
+}
+
+void KeyframeReader::writeJson(std::ostream& out)
+{
+    //Group the keyframes by vehicle, this is why this is only for small runs
+    std::vector<std::vector<Keyframe> > frames(vehicles.size());
+    std::vector<KeyframeRecord> rows;
+    for (size_t c = 0; c < chunks.size(); ++c)
+    {
+        rows.clear();
+        readChunk(c,rows);
+        for (const KeyframeRecord& R : rows)
+            frames[R.vehicle].push_back(R.frame);
+    }
+
+    //Written by hand rather than through Json::Value, the format is simple, and this way we don't build a second copy of everything in memory
+    std::streamsize oldPrecision=out.precision(17);
+    out<<"{\n    \"vehicles\":\n    [";
+    for (size_t v = 0; v < vehicles.size(); ++v)
+    {
+        out<<(v==0 ? "\n" : ",\n");
+        out<<"        {\n            \"type\":"<<std::quoted(vehicles[v].type)<<",\n            \"length\":"<<vehicles[v].length<<",\n            \"keyframes\":\n            [";
+        for (size_t k = 0; k < frames[v].size(); ++k)
+        {
+            const Keyframe& K=frames[v][k];
+            out<<(k==0 ? "\n" : ",\n");
+            out<<"                {\"time\":"<<K.time<<", \"road\":"<<K.road<<", \"direction\":"<<(K.direction ? "true" : "false")<<", \"lane\":"<<K.lane<<", \"pos\":"<<K.pos<<", \"speed\":"<<K.speed<<", \"acc\":"<<K.acc<<"}";
+        }
+        out<<"\n            ]\n        }";
+    }
+    out<<"\n    ]\n}\n";
+    out.precision(oldPrecision);
+}
@@ -0,0 +1,106 @@
+#include "KeyframeReplay.hpp"
+
+#include "Road.hpp"
+#include "Node.hpp"
+#include "ICityNetwork.hpp"
+#include "TrafficExceptions.hpp"
+
+KeyframeReplay::KeyframeReplay(KeyframeReader& _reader, ICityNetwork* _city):reader(_reader),city(_city),cachedChunk(_reader.getChunkNumber()),slot(_reader.getVehicleNumber(),-1)
+{
+}
+
+void KeyframeReplay::loadChunk(size_t chunk)
+{
+    if (chunk==cachedChunk)
+        return;
+    snapshot.clear();
+    rows.clear();
+    //If this throws, the cache is left empty, not half filled
+    cachedChunk=reader.getChunkNumber();
+    reader.readSnapshot(chunk,snapshot);
+    reader.readChunk(chunk,rows);
+    cachedChunk=chunk;
+}
+
+Keyframe KeyframeReplay::extrapolate(const Keyframe& K, double time) noexcept
+{
+    Keyframe Out=K;
+    double dt=time-K.time;
+    //Braking all the way to a stop happens before the time we want, after that we stand still
+    if (K.acc<0 && K.speed+K.acc*dt<0)
+        dt=-K.speed/K.acc;
+    Out.pos=K.pos+K.speed*dt+0.5*K.acc*dt*dt;
+    Out.speed=K.speed+K.acc*dt;
+    Out.time=time;
+    return Out;
+}
+
+void KeyframeReplay::stateAt(double time, std::vector<VehicleState>& out)
+{
+    out.clear();
+    size_t chunk=reader.findChunk(time);
+    if (chunk==reader.getChunkNumber())
+        return;//Before anything happened
+    loadChunk(chunk);
+
+    latest.clear();
+    auto apply = [this](const KeyframeRecord& Row)
+    {
+        if (slot[Row.vehicle]<0)
+        {
+            slot[Row.vehicle]=latest.size();
+            latest.push_back(Row);
+        }
+        else
+            latest[slot[Row.vehicle]]=Row;
+    };
+    for (const KeyframeRecord& Row : snapshot)
+        apply(Row);
+    //The rows are in time order, so we can stop at the first one in the future
+    for (const KeyframeRecord& Row : rows)
+    {
+        if (Row.frame.time>time)
+            break;
+        apply(Row);
+    }
+
+    //Reset the slots first, so they are clean even if looking up a road throws
+    for (const KeyframeRecord& Row : latest)
+        slot[Row.vehicle]=-1;
+
+    for (const KeyframeRecord& Row : latest)
+    {
+        //The last keyframe is the despawn
+        if (time>=reader.getVehicle(Row.vehicle).lastTime)
+            continue;
+
+        VehicleState S;
+        S.vehicle=Row.vehicle;
+        S.frame=extrapolate(Row.frame,time);
+        if (city)
+        {
+            std::shared_ptr<Road> R=city->getRoad(S.frame.road);
+            const Node& Start=R->getStart();
+            const Node& End=R->getEnd();
+            //pos is measured in the direction of travel
+            double length=R->getLength();
+            double fromStart=S.frame.direction ? S.frame.pos : length-S.frame.pos;
+            double f=length>0 ? fromStart/length : 0;
+            S.x=Start.getX()+(End.getX()-Start.getX())*f;
+            S.y=Start.getY()+(End.getY()-Start.getY())*f;
+        }
+        out.push_back(S);
+    }
+}
+
+void KeyframeReplay::stateIn(double time, double minX, double minY, double maxX, double maxY, std::vector<VehicleState>& out)
+{
+    if (!city)
+        throw TrafficSimulation_error("Can not find vehicles in an area without knowing the city");
+    stateAt(time,out);
+    size_t kept=0;
+    for (const VehicleState& S : out)
+        if (S.x>=minX && S.x<=maxX && S.y>=minY && S.y<=maxY)
+            out[kept++]=S;
+    out.resize(kept);
+}
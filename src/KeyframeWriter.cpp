@@ -0,0 +1,284 @@
+#include "KeyframeWriter.hpp"
+
+#include <cmath>
+#include <algorithm>
+
+#include "BinaryIO.hpp"
+#include "TrafficExceptions.hpp"
+#include "Road.hpp"
+#include "Node.hpp"
+#include "ICityNetwork.hpp"
+
+using namespace BinaryIO;
+
+KeyframeWriter::KeyframeWriter(std::ostream& _out, double _chunkDuration):out(_out),chunkDuration(_chunkDuration)
+{
+    if (!(chunkDuration>0))
+        throw TrafficSimulation_error("Keyframe chunk duration must be positive");
+
+    std::string header;
+    put(header,KeyframeFormat::headMagic);
+    put(header,KeyframeFormat::version);
+    put(header,chunkDuration);
+    write(header);
+}
+
+KeyframeWriter::~KeyframeWriter()
+{
+    try
+    {
+        close();
+    }
+    catch(...)
+    {
+        //Nothing sensible to do in a destructor
+    }
+}
+
+void KeyframeWriter::write(const std::string& bytes)
+{
+    out.write(bytes.data(),bytes.size());
+    if (!out)
+        throw TrafficSimulation_error("Error writing keyframe file");
+    offset+=bytes.size();
+}
+
+void KeyframeWriter::indexRoads(ICityNetwork& City, double cellSize)
+{
+    if (currentChunk!=-1 || closed)
+        throw TrafficSimulation_error("Keyframe roads must be indexed before adding keyframes");
+    if (!(cellSize>0))
+        throw TrafficSimulation_error("Keyframe grid cell size must be positive");
+
+    roadBox.clear();
+    roadCell.clear();
+    for (size_t i = 0; i < City.getRoadsSize(); ++i)
+    {
+        std::shared_ptr<Road> R=City.getRoad(i);
+        const Node& A=R->getStart();
+        const Node& B=R->getEnd();
+        roadBox.push_back(KeyframeBox{std::min(A.getX(),B.getX()),std::min(A.getY(),B.getY()),std::max(A.getX(),B.getX()),std::max(A.getY(),B.getY())});
+    }
+    if (roadBox.empty())
+        return;
+
+    //The grid starts at the lower left corner of the map
+    KeyframeBox Map=roadBox[0];
+    for (const KeyframeBox& B : roadBox)
+        Map=KeyframeBox{std::min(Map.minX,B.minX),std::min(Map.minY,B.minY),std::max(Map.maxX,B.maxX),std::max(Map.maxY,B.maxY)};
+    uint64_t cellsX=uint64_t((Map.maxX-Map.minX)/cellSize)+1;
+    uint64_t cellsY=uint64_t((Map.maxY-Map.minY)/cellSize)+1;
+    cells=cellsX*cellsY;
+
+    for (const KeyframeBox& B : roadBox)
+    {
+        uint64_t x=uint64_t(((B.minX+B.maxX)/2-Map.minX)/cellSize);
+        uint64_t y=uint64_t(((B.minY+B.maxY)/2-Map.minY)/cellSize);
+        roadCell.push_back(std::min(y,cellsY-1)*cellsX+std::min(x,cellsX-1));
+    }
+}
+
+size_t KeyframeWriter::addVehicle(const std::string& type, double length)
+{
+    KeyframeVehicle V;
+    V.type=type;
+    V.length=length;
+    vehicles.push_back(V);
+    latest.push_back(Keyframe());
+    aliveAt.push_back(-1);
+    return vehicles.size()-1;
+}
+
+void KeyframeWriter::add(size_t vehicle, const Keyframe& K)
+{
+    if (closed)
+        throw TrafficSimulation_error("Adding keyframe to closed keyframe file");
+    if (vehicle>=vehicles.size())
+        throw TrafficSimulation_error("Adding keyframe for vehicle "+std::to_string(vehicle)+" but only "+std::to_string(vehicles.size())+" vehicles exist");
+    if (K.time<lastTime)
+        throw TrafficSimulation_error("Keyframe at time "+std::to_string(K.time)+" added after keyframe at time "+std::to_string(lastTime));
+    if (vehicles[vehicle].keyframes>0 && aliveAt[vehicle]<0)
+        throw TrafficSimulation_error("Adding keyframe for vehicle "+std::to_string(vehicle)+" which has despawned");
+    if (K.lane<0 || K.lane>KeyframeFormat::maxLane)
+        throw TrafficSimulation_error("Keyframe lane "+std::to_string(K.lane)+" can not be stored");
+    if (!roadCell.empty() && K.road>=roadCell.size())
+        throw TrafficSimulation_error("Keyframe on road "+std::to_string(K.road)+" but only "+std::to_string(roadCell.size())+" roads are indexed");
+
+    int64_t chunk=static_cast<int64_t>(std::floor(K.time/chunkDuration));
+    if (chunk!=currentChunk)
+    {
+        flushChunk();
+        currentChunk=chunk;
+
+        //Everyone alive now, before this keyframe
+        snapshot.clear();
+        for (size_t v : alive)
+            snapshot.push_back(KeyframeRecord{v,latest[v]});
+    }
+    rows.push_back(KeyframeRecord{vehicle,K});
+    lastTime=K.time;
+
+    KeyframeVehicle& V=vehicles[vehicle];
+    if (V.keyframes==0)
+    {
+        V.firstTime=K.time;
+        aliveAt[vehicle]=alive.size();
+        alive.push_back(vehicle);
+    }
+    V.lastTime=K.time;
+    ++V.keyframes;
+    latest[vehicle]=K;
+}
+
+void KeyframeWriter::despawn(size_t vehicle, const Keyframe& K)
+{
+    add(vehicle,K);
+
+    //Swap with the last alive vehicle, and pop
+    size_t i=aliveAt[vehicle];
+    size_t last=alive.back();
+    alive[i]=last;
+    aliveAt[last]=i;
+    alive.pop_back();
+    aliveAt[vehicle]=-1;
+}
+
+void KeyframeWriter::encodeRows(const std::vector<KeyframeRecord>& R, double startTime, std::string& out)
+{
+    //Every column is written to its own buffer, and then they are written one after another with their lengths in front, so a reader can skip the columns it does not need
+    std::string vehicleColumn,timeColumn,roadColumn,laneColumn,posColumn,speedColumn,accColumn;
+
+    int64_t previousTick=std::llround(startTime/KeyframeFormat::timeResolution);
+    for (const KeyframeRecord& Row : R)
+    {
+        const Keyframe& K=Row.frame;
+        putVarint(vehicleColumn,Row.vehicle);
+
+        //Zigzag, since the snapshot rows are before the start of the chunk
+        int64_t tick=std::llround(K.time/KeyframeFormat::timeResolution);
+        putVarint(timeColumn,zigzag(tick-previousTick));
+        previousTick=tick;
+
+        putVarint(roadColumn,K.road);
+        laneColumn.push_back(char((K.lane<<1)|(K.direction ? 1 : 0)));
+        putVarint(posColumn,zigzag(std::llround(K.pos/KeyframeFormat::posResolution)));
+        putVarint(speedColumn,zigzag(std::llround(K.speed/KeyframeFormat::speedResolution)));
+        putVarint(accColumn,zigzag(std::llround(K.acc/KeyframeFormat::accResolution)));
+    }
+
+    putVarint(out,R.size());
+    for (const std::string* C : {&vehicleColumn,&timeColumn,&roadColumn,&laneColumn,&posColumn,&speedColumn,&accColumn})
+    {
+        putVarint(out,C->size());
+        out+=*C;
+    }
+}
+
+void KeyframeWriter::flushChunk()
+{
+    if (rows.empty())
+        return;
+
+    double startTime=currentChunk*chunkDuration;
+    std::string chunk;
+    encodeRows(snapshot,startTime,chunk);
+
+    //Sort the keyframes into groups by cell, within a group they stay in time order
+    if (roadCell.empty())
+    {
+        putVarint(chunk,1);
+        std::string group;
+        encodeRows(rows,startTime,group);
+        putVarint(chunk,0);
+        putVarint(chunk,group.size());
+        chunk+=group;
+    }
+    else
+    {
+        //The rows in the order they were written, sorted by cell
+        std::vector<uint32_t> order(rows.size());
+        for (size_t i = 0; i < rows.size(); ++i)
+            order[i]=i;
+        std::stable_sort(order.begin(),order.end(),[this](uint32_t a, uint32_t b){return roadCell[rows[a].frame.road]<roadCell[rows[b].frame.road];});
+        size_t groups=0;
+        for (size_t i = 0; i < order.size(); ++i)
+            if (i==0 || roadCell[rows[order[i]].frame.road]!=roadCell[rows[order[i-1]].frame.road])
+                ++groups;
+        putVarint(chunk,groups);
+
+        std::vector<KeyframeRecord> G;
+        std::string group;
+        std::string sequence;
+        for (size_t i = 0; i < order.size();)
+        {
+            uint64_t cell=roadCell[rows[order[i]].frame.road];
+            G.clear();
+            sequence.clear();
+            uint32_t previous=0;
+            for (; i < order.size() && roadCell[rows[order[i]].frame.road]==cell; ++i)
+            {
+                G.push_back(rows[order[i]]);
+                putVarint(sequence,order[i]-previous);
+                previous=order[i];
+            }
+            group.clear();
+            encodeRows(G,startTime,group);
+            //With more than one group, where every row was in the chunk, so the reader can put keyframes at the same time back in the order they were written
+            if (groups>1)
+            {
+                putVarint(group,sequence.size());
+                group+=sequence;
+            }
+            putVarint(chunk,cell);
+            putVarint(chunk,group.size());
+            chunk+=group;
+        }
+    }
+
+    chunks.push_back(KeyframeChunkInfo{startTime,offset,chunk.size(),rows.size()});
+    write(chunk);
+    rows.clear();
+    snapshot.clear();
+}
+
+void KeyframeWriter::close()
+{
+    if (closed)
+        return;
+    flushChunk();
+    closed=true;
+
+    uint64_t tailOffset=offset;
+    std::string tail;
+    putVarint(tail,vehicles.size());
+    for (const KeyframeVehicle& V : vehicles)
+    {
+        putString(tail,V.type);
+        put(tail,V.length);
+        put(tail,V.firstTime);
+        put(tail,V.lastTime);
+        putVarint(tail,V.keyframes);
+    }
+    putVarint(tail,chunks.size());
+    for (const KeyframeChunkInfo& C : chunks)
+    {
+        put(tail,C.startTime);
+        putVarint(tail,C.offset);
+        putVarint(tail,C.bytes);
+        putVarint(tail,C.rows);
+    }
+    putVarint(tail,cells);
+    putVarint(tail,roadCell.size());
+    for (size_t i = 0; i < roadCell.size(); ++i)
+    {
+        putVarint(tail,roadCell[i]);
+        put(tail,roadBox[i].minX);
+        put(tail,roadBox[i].minY);
+        put(tail,roadBox[i].maxX);
+        put(tail,roadBox[i].maxY);
+    }
+    put(tail,tailOffset);
+    put(tail,KeyframeFormat::tailMagic);
+    write(tail);
+    out.flush();
+}
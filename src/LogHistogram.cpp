@@ -0,0 +1,92 @@
+#include "LogHistogram.hpp"
+
+#include <cmath>
+#include <bit>
+#include <algorithm>
+
+#include "TrafficExceptions.hpp"
+
+#define subBuckets (size_t(1)<<LogHistogram::subBucketBits)
+
+size_t LogHistogram::bucketOf(uint64_t v) noexcept
+{
+    if (v<subBuckets)
+        return v;
+    //The highest bit picks the power of two, and the next subBucketBits bits the bucket in it
+    int exponent=std::bit_width(v)-1;
+    int shift=exponent-subBucketBits;
+    return subBuckets+size_t(shift)*subBuckets+((v>>shift)-subBuckets);
+}
+
+uint64_t LogHistogram::bucketStart(size_t bucket) noexcept
+{
+    if (bucket<subBuckets)
+        return bucket;
+    size_t shift=(bucket-subBuckets)/subBuckets;
+    size_t sub=(bucket-subBuckets)%subBuckets;
+    return uint64_t(subBuckets+sub)<<shift;
+}
+
+void LogHistogram::add(double value, uint64_t count)
+{
+    double units=std::floor(value/unit);
+    //Anything beyond 2^63 units is not a speed or time we will ever see, so it all goes in the last bucket
+    uint64_t v=units<=0 ? 0 : (units>=9.2e18 ? (uint64_t(1)<<63) : uint64_t(units));
+    size_t bucket=bucketOf(v);
+    if (bucket>=counts.size())
+        counts.resize(bucket+1,0);
+    counts[bucket]+=count;
+    total+=count;
+}
+
+void LogHistogram::merge(const LogHistogram& Other)
+{
+    if (Other.unit!=unit)
+        throw TrafficSimulation_error("Can not merge histograms with different units");
+    if (Other.total==0)
+        return;
+    if (Other.counts.size()>counts.size())
+        counts.resize(Other.counts.size(),0);
+    for (size_t i = 0; i < Other.counts.size(); ++i)
+        counts[i]+=Other.counts[i];
+    total+=Other.total;
+}
+
+void LogHistogram::clear() noexcept
+{
+    std::fill(counts.begin(),counts.end(),0);
+    total=0;
+}
+
+double LogHistogram::quantile(double q) const noexcept
+{
+    if (total==0)
+        return 0;
+    //The rank of the value we want, counting from 1
+    uint64_t rank=std::max<uint64_t>(1,uint64_t(std::ceil(std::clamp(q,0.0,1.0)*total)));
+    uint64_t seen=0;
+    for (size_t i = 0; i < counts.size(); ++i)
+    {
+        seen+=counts[i];
+        if (seen>=rank)
+            return (bucketStart(i)+bucketStart(i+1))*0.5*unit;
+    }
+    return bucketStart(counts.size())*unit;
+}
+
+size_t LogHistogram::getBucketNumber() const noexcept
+{
+    size_t N=counts.size();
+    while (N>0 && counts[N-1]==0)
+        --N;
+    return N;
+}
+
+void LogHistogram::setCount(size_t bucket, uint64_t count)
+{
+    if (bucket>=counts.size())
+        counts.resize(bucket+1,0);
+    total+=count;
+    total-=counts[bucket];
+    counts[bucket]=count;
+}
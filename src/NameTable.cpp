@@ -0,0 +1,66 @@
+#include "NameTable.hpp"
+
+#include <algorithm>
+
+#include "TrafficExceptions.hpp"
+
+NameTable::NameTable(std::initializer_list<std::pair<std::string_view,int> > _names)
+{
+    for (const auto& [name,value] : _names)
+        add(name,value);
+}
+
+uint64_t NameTable::hash(std::string_view name) noexcept
+{
+    //FNV-1a, the names are short, so anything fancier costs more than it saves
+    uint64_t h=14695981039346656037ull;
+    for (char c : name)
+    {
+        h^=uint8_t(fold(c));
+        h*=1099511628211ull;
+    }
+    return h;
+}
+
+size_t NameTable::findSlot(std::string_view name) const noexcept
+{
+    size_t mask=slots.size()-1;
+    for (size_t s = hash(name)&mask; ; s=(s+1)&mask)
+    {
+        uint32_t i=slots[s];
+        if (i==empty)
+            return s;
+        const std::string& N=names[i];
+        if (N.size()!=name.size())
+            continue;
+        size_t c=0;
+        while (c<N.size() && N[c]==fold(name[c]))
+            ++c;
+        if (c==N.size())
+            return s;
+    }
+}
+
+void NameTable::add(std::string_view name, int value)
+{
+    if (value<0)
+        throw TrafficSimulation_error("Name \""+std::string(name)+"\" can not have a negative number");
+    if (find(name)!=notFound)
+        throw TrafficSimulation_error("Name \""+std::string(name)+"\" is already in the table");
+
+    std::string lower(name);
+    for (char& c : lower)
+        c=fold(c);
+    names.push_back(lower);
+    values.push_back(value);
+
+    //Keep it at most a quarter full, rebuilding when it grows
+    if (4*names.size()>slots.size())
+    {
+        slots.assign(std::max<size_t>(16,2*slots.size()),empty);
+        for (size_t i = 0; i < names.size(); ++i)
+            slots[findSlot(names[i])]=i;
+    }
+    else
+        slots[findSlot(lower)]=names.size()-1;
+}
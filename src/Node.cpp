@@ -5,3 +5,17 @@ double Node::getDist(const Node& Other)const
 {
     return sqrt(pow(x-Other.x,2)+pow(y-Other.y,2));
 }
+
+void Node::saveState(std::string& /*out*/) const
+{
+}
+
+void Node::loadState(const char*& /*p*/, const char* /*end*/)
+{
+}
+
+void Node::addRoads(const Road* const* R, size_t count)
+{
+    for (size_t i = 0; i < count; ++i)
+        addRoad(R[i]);
+}
@@ -0,0 +1,224 @@
+#include "ReservationTable.hpp"
+
+#include <cmath>
+#include <string>
+#include <algorithm>
+
+#include "TrafficExceptions.hpp"
+#include "BinaryIO.hpp"
+
+#include "Road.hpp"
+
+//Layout of a slot
+#define movementBits 48
+#define movementMask ((uint64_t(1)<<movementBits)-1)
+#define tagOf(window) (uint64_t(window)<<movementBits)
+
+//Is angle c strictly inside the counter-clockwise arc from a to b
+static bool insideArc(double a, double b, double c)
+{
+    const double tau=2*M_PI;
+    double ab=std::fmod(b-a+tau,tau);
+    double ac=std::fmod(c-a+tau,tau);
+    return ac>0 && ac<ab;
+}
+
+ReservationTable::ReservationTable(Node& N, double _windowLength, size_t _windows):nodeID(N.getNodeID()),roadNumber(N.getRoadNumber()),windowLength(_windowLength),windows(1),firstWindow(0)
+{
+    if (!(windowLength>0))
+        throw TrafficSimulation_error("Reservation table window length must be positive");
+
+    //The tag is 16 bits, so keep the ring shorter than that, or a slot could be mistaken for one a full ring ago
+    while (windows<_windows && windows<(1<<15))
+        windows*=2;
+
+    //Direction of each road, as seen from the middle of the node
+    std::vector<double> angle(roadNumber);
+    for (size_t i = 0; i < roadNumber; ++i)
+    {
+        roadIDs.push_back(N.getRoad(i,true).getRoadID());
+        const Node& Other=N.getNeighbour(i,true);
+        angle[i]=std::atan2(Other.getY()-N.getY(),Other.getX()-N.getX());
+    }
+
+    size_t M=roadNumber*roadNumber;
+    words=std::max<size_t>(1,(M+movementBits-1)/movementBits);
+    conflicts.assign(M*words,0);
+    for (size_t a = 0; a < roadNumber; ++a)
+        for (size_t b = 0; b < roadNumber; ++b)
+            for (size_t c = 0; c < roadNumber; ++c)
+                for (size_t d = 0; d < roadNumber; ++d)
+                {
+                    bool conflicting;
+                    //Sharing the stop line or the exit, (this includes the movement itself)
+                    if (a==c || b==d)
+                        conflicting=true;
+                    //U-turns and movements sharing a road only touch the edge of the node
+                    else if (a==b || c==d || a==d || b==c)
+                        conflicting=false;
+                    //The paths cross if exactly one end of the one is between the ends of the other
+                    else
+                        conflicting=insideArc(angle[a],angle[b],angle[c])!=insideArc(angle[a],angle[b],angle[d]);
+
+                    if (conflicting)
+                    {
+                        size_t other=c*roadNumber+d;
+                        conflicts[(a*roadNumber+b)*words+other/movementBits]|=uint64_t(1)<<(other%movementBits);
+                    }
+                }
+
+    slots=std::make_unique<std::atomic<uint64_t>[]>(windows*words);
+    for (size_t i = 0; i < windows*words; ++i)
+        slots[i].store(0,std::memory_order_relaxed);
+}
+
+size_t ReservationTable::movement(size_t from, size_t to) const
+{
+    if (from>=roadNumber)
+        throw road_address_exception(from,roadNumber,nodeID);
+    if (to>=roadNumber)
+        throw road_address_exception(to,roadNumber,nodeID);
+    return from*roadNumber+to;
+}
+
+int64_t ReservationTable::window(double time) const noexcept
+{
+    int64_t w=static_cast<int64_t>(std::floor(time/windowLength));
+    int64_t first=firstWindow.load(std::memory_order_acquire);
+    if (w<first || w>=first+static_cast<int64_t>(windows))
+        return -1;
+    return w;
+}
+
+bool ReservationTable::book(size_t from, size_t to, double time)
+{
+    size_t m=movement(from,to);
+    int64_t w=window(time);
+    if (w<0)
+        return false;
+
+    std::atomic<uint64_t>* here=&slots[(w&(windows-1))*words];
+    const uint64_t* conflict=&conflicts[m*words];
+    size_t home=m/movementBits;
+    uint64_t bit=uint64_t(1)<<(m%movementBits);
+    uint64_t tag=tagOf(w&0xFFFF);
+
+    //Sequentially consistent, so of two threads booking conflicting movements in different words, at least one sees the bit of the other below
+    std::atomic<uint64_t>& slot=here[home];
+    uint64_t old=slot.load(std::memory_order_seq_cst);
+    while (true)
+    {
+        //A slot still tagged with an older window is empty as far as we are concerned
+        uint64_t booked = (old&~movementMask)==tag ? old&movementMask : 0;
+        if (booked&conflict[home])
+            return false;
+        if (slot.compare_exchange_weak(old,tag|booked|bit,std::memory_order_seq_cst,std::memory_order_seq_cst))
+            break;
+        //old has been updated with what the other thread wrote, try again
+    }
+
+    for (size_t k = 0; k < words; ++k)
+    {
+        if (k==home)
+            continue;
+        uint64_t other=here[k].load(std::memory_order_seq_cst);
+        if ((other&~movementMask)==tag && (other&conflict[k]))
+        {
+            unbook(slot,tag,bit);
+            return false;
+        }
+    }
+    return true;
+}
+
+void ReservationTable::unbook(std::atomic<uint64_t>& slot, uint64_t tag, uint64_t bit) noexcept
+{
+    uint64_t old=slot.load(std::memory_order_acquire);
+    while ((old&~movementMask)==tag && (old&bit))
+    {
+        if (slot.compare_exchange_weak(old,old&~bit,std::memory_order_acq_rel,std::memory_order_acquire))
+            return;
+    }
+}
+
+void ReservationTable::release(size_t from, size_t to, double time)
+{
+    size_t m=movement(from,to);
+    int64_t w=window(time);
+    if (w<0)
+        return;
+
+    unbook(slots[(w&(windows-1))*words+m/movementBits],tagOf(w&0xFFFF),uint64_t(1)<<(m%movementBits));
+}
+
+bool ReservationTable::isFree(size_t from, size_t to, double time) const
+{
+    size_t m=movement(from,to);
+    int64_t w=window(time);
+    if (w<0)
+        return false;
+
+    const std::atomic<uint64_t>* here=&slots[(w&(windows-1))*words];
+    uint64_t tag=tagOf(w&0xFFFF);
+    for (size_t k = 0; k < words; ++k)
+    {
+        uint64_t old=here[k].load(std::memory_order_acquire);
+        if ((old&~movementMask)==tag && (old&conflicts[m*words+k]))
+            return false;
+    }
+    return true;
+}
+
+bool ReservationTable::conflict(size_t from0, size_t to0, size_t from1, size_t to1) const
+{
+    size_t other=movement(from1,to1);
+    return (conflicts[movement(from0,to0)*words+other/movementBits]>>(other%movementBits))&1;
+}
+
+size_t ReservationTable::getLocalID(size_t roadID) const
+{
+    for (size_t i = 0; i < roadIDs.size(); ++i)
+        if (roadIDs[i]==roadID)
+            return i;
+
+    std::vector<int> legal(roadIDs.begin(),roadIDs.end());
+    throw road_address_exception(roadID,legal,nodeID);
+}
+
+void ReservationTable::advance(double time) noexcept
+{
+    int64_t w=static_cast<int64_t>(std::floor(time/windowLength));
+    int64_t first=firstWindow.load(std::memory_order_relaxed);
+    if (w<=first)
+        return;
+
+    //Empty the windows we leave BEFORE the new windows they are reused for can be booked.
+    //A booking which sneaks into an old window while we do this keeps its old tag, so it is ignored, and it is wiped next time around the ring
+    int64_t stop = w-first<static_cast<int64_t>(windows) ? w : first+windows;
+    for (int64_t i = first; i < stop; ++i)
+        for (size_t k = 0; k < words; ++k)
+            slots[(i&(windows-1))*words+k].store(0,std::memory_order_release);
+
+    firstWindow.store(w,std::memory_order_release);
+}
+
+void ReservationTable::saveState(std::string& out) const
+{
+    BinaryIO::putVarint(out,BinaryIO::zigzag(firstWindow.load(std::memory_order_acquire)));
+    BinaryIO::putVarint(out,windows);
+    for (size_t i = 0; i < windows*words; ++i)
+        BinaryIO::putVarint(out,slots[i].load(std::memory_order_acquire));
+}
+
+void ReservationTable::loadState(const char*& p, const char* end)
+{
+    int64_t first=BinaryIO::unzigzag(BinaryIO::getVarint(p,end));
+    if (BinaryIO::getVarint(p,end)!=windows)
+        throw file_format_exception("reservation table at Node "+std::to_string(nodeID)+" saved with another number of windows");
+    std::vector<uint64_t> saved(windows*words);
+    for (uint64_t& S : saved)
+        S=BinaryIO::getVarint(p,end);
+    for (size_t i = 0; i < windows*words; ++i)
+        slots[i].store(saved[i],std::memory_order_relaxed);
+    firstWindow.store(first,std::memory_order_release);
+}
@@ -1,23 +1,26 @@
 #include "Road.hpp"
 #include "Node.hpp"
 #include "json/json.h"
+#include "NameTable.hpp"
 #include<string>
-#include<algorithm>
 #include<iostream>
 
-//Yanked from https://en.cppreference.com/w/cpp/string/byte/tolower
-inline std::string str_tolower(std::string s)
+//Every name a road type goes by, in English and Danish, any case
+static const NameTable& roadTypeNames()
 {
-    std::transform(s.begin(), s.end(), s.begin(),[](unsigned char c){ return std::tolower(c); });
-    return s;
+    static const NameTable Names={
+        {"street",street},{"byvej",street},
+        {"country road",countryRoad},{"landevej",countryRoad},
+        {"motortrafficroad",motortrafficroad},{"motortrafikvej",motortrafficroad},
+        {"highway",highway},{"motorvej",highway}};
+    return Names;
 }
 
-
 using std::string,  std::to_string;
 
 #include "TrafficExceptions.hpp"
 
-Road::Road(size_t _roadID,Json::Value& object,ICityNetwork& City){
+Road::Road(size_t _roadID,Json::Value& object,ICityNetwork& City, bool link){
     size_t first ;
     size_t second;
     try
@@ -37,31 +40,21 @@ Road::Road(size_t _roadID,Json::Value& object,ICityNetwork& City){
         if (!object.isMember("second"))
             throw TrafficSimulation_error("Error loading required element in Road "+std::to_string(roadID)+"; \"second\" not found");
 
-        string type_name=object.get("type","null").asString();
         first   = object["first"].asLargestUInt();
         second  = object["second"].asLargestUInt();
 
         if (first==second)
             throw TrafficSimulation_error("Error loading required element in Road "+std::to_string(roadID)+"; \"first\" and \"second\" element must be unique");
 
-        if (str_tolower(type_name).compare("street")==0||str_tolower(type_name).compare("byvej")==0)
-        {
-            type=street;
-        }
-        else if (str_tolower(type_name).compare("country road")==0||str_tolower(type_name).compare("landevej")==0)
-        {
-            type=countryRoad;
-        }
-        else if (str_tolower(type_name).compare("motortrafficroad")==0||str_tolower(type_name).compare("motortrafikvej")==0)
-        {
-            type=motortrafficroad;
-        }
-        else if (str_tolower(type_name).compare("highway")==0||type_name.compare("motorvej")==0)
-        {
-            type=highway;
-        }
-        else
-            throw TrafficSimulation_error("Error loading required element in Road "+std::to_string(roadID)+"; type does not exist : "+type_name);
+        //Looked up straight from the string inside the JSON value, only copied if we need it for the error
+        const char* nameBegin=nullptr;
+        const char* nameEnd=nullptr;
+        int found=NameTable::notFound;
+        if (static_cast<const Json::Value&>(object)["type"].getString(&nameBegin,&nameEnd))
+            found=roadTypeNames().find(std::string_view(nameBegin,nameEnd-nameBegin));
+        if (found==NameTable::notFound)
+            throw TrafficSimulation_error("Error loading required element in Road "+std::to_string(roadID)+"; type does not exist : "+object.get("type","null").asString());
+        type=RoadType(found);
 
 
         if (first>City.getNodesSize())
@@ -88,8 +81,11 @@ Road::Road(size_t _roadID,Json::Value& object,ICityNetwork& City){
 
     length =start->getDist(*end);
 
-    notconst_start->addRoad(this);
-    notconst_end->addRoad(this);
+    if (link)
+    {
+        notconst_start->addRoad(this);
+        notconst_end->addRoad(this);
+    }
 
 
 
@@ -110,6 +106,18 @@ const Node& Road::getOther(size_t ThisID) const
 
 }
 
+double Road::getSpeedLimit() const noexcept
+{
+    //TEMP, this belongs in the LAW class too
+    switch (type)
+    {
+        case street:           return 50/3.6;
+        case countryRoad:      return 80/3.6;
+        case motortrafficroad: return 90/3.6;
+        case highway:          return 130/3.6;
+    }
+    return 50/3.6;
+}
 
 Road::~Road()
 {
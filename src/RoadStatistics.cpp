@@ -0,0 +1,281 @@
+#include "RoadStatistics.hpp"
+
+#include "BinaryIO.hpp"
+#include "TrafficExceptions.hpp"
+
+using namespace BinaryIO;
+
+RoadStatistics::Shard::Accumulator& RoadStatistics::Shard::update(double time, size_t road)
+{
+    if (road>=roads.size())
+        throw TrafficSimulation_error("Statistics for road "+std::to_string(road)+" but only "+std::to_string(roads.size())+" roads exist");
+    if (time<hourStart || time>hourEnd)
+        throw TrafficSimulation_error("Statistics at time "+std::to_string(time)+" outside the current hour "+std::to_string(hourStart)+" to "+std::to_string(hourEnd));
+
+    Accumulator& A=roads[road];
+    double dt=time-A.lastTime;
+    A.hour.vehicleSeconds+=A.vehicles*dt;
+    A.hour.distance+=A.speedSum*dt;
+    A.lastTime=time;
+    return A;
+}
+
+void RoadStatistics::Shard::enterRoad(double time, size_t road, double speed)
+{
+    Accumulator& A=update(time,road);
+    ++A.vehicles;
+    A.speedSum+=speed;
+    ++A.hour.entered;
+}
+
+void RoadStatistics::Shard::leaveRoad(double time, size_t road, double speed)
+{
+    Accumulator& A=update(time,road);
+    --A.vehicles;
+    A.speedSum-=speed;
+}
+
+void RoadStatistics::Shard::changeSpeed(double time, size_t road, double oldSpeed, double newSpeed)
+{
+    Accumulator& A=update(time,road);
+    A.speedSum+=newSpeed-oldSpeed;
+}
+
+void RoadStatistics::Shard::traversal(double time, size_t road, double travelTime, double averageSpeed)
+{
+    Accumulator& A=update(time,road);
+    A.hour.travelTime.add(travelTime);
+    A.hour.speed.add(averageSpeed);
+}
+
+//Number of buckets, and then every bucket (most are 0, so one byte each)
+static void putHistogram(std::string& out, const LogHistogram& H)
+{
+    size_t N=H.getBucketNumber();
+    putVarint(out,N);
+    for (size_t i = 0; i < N; ++i)
+        putVarint(out,H.getCount(i));
+}
+
+static void getHistogram(const char*& p, const char* end, LogHistogram& H)
+{
+    H.clear();
+    uint64_t N=getVarint(p,end);
+    if (N>(64<<LogHistogram::subBucketBits))
+        throw file_format_exception("road statistics histogram with too many buckets");
+    for (uint64_t i = 0; i < N; ++i)
+    {
+        uint64_t count=getVarint(p,end);
+        if (count>0)
+            H.setCount(i,count);
+    }
+}
+
+RoadStatistics::RoadStatistics(std::ostream& _out, size_t roads, unsigned shardNumber, double _hourLength, double startTime):out(_out),hourLength(_hourLength),hourStart(startTime)
+{
+    if (!(hourLength>0))
+        throw TrafficSimulation_error("Statistics hour length must be positive");
+    if (shardNumber==0)
+        throw TrafficSimulation_error("Statistics need at least one shard");
+
+    shards.resize(shardNumber);
+    for (Shard& S : shards)
+    {
+        S.roads.resize(roads);
+        for (Shard::Accumulator& A : S.roads)
+            A.lastTime=startTime;
+        S.hourStart=startTime;
+        S.hourEnd=startTime+hourLength;
+    }
+
+    std::string header;
+    put(header,RoadStatisticsFormat::magic);
+    put(header,RoadStatisticsFormat::version);
+    putVarint(header,roads);
+    put(header,hourLength);
+    put(header,startTime);
+    out.write(header.data(),header.size());
+    if (!out)
+        throw TrafficSimulation_error("Error writing road statistics file");
+
+    writer=std::thread(&RoadStatistics::writeLoop,this);
+}
+
+RoadStatistics::~RoadStatistics()
+{
+    try
+    {
+        close();
+    }
+    catch(...)
+    {
+        //Nothing sensible to do in a destructor
+    }
+}
+
+void RoadStatistics::writeLoop()
+{
+    std::string bytes;
+    std::string block;
+    std::unique_lock<std::mutex> L(lock);
+    while (true)
+    {
+        changed.wait(L,[this](){return stopping || !pending.empty();});
+        if (pending.empty())
+            return;//Stopping, and nothing left to write
+
+        std::vector<RoadStatisticsRecord> hour=std::move(pending.front());
+        pending.pop_front();
+        L.unlock();
+
+        //Encode and write without holding the lock, this is the slow part
+        block.clear();
+        for (const RoadStatisticsRecord& R : hour)
+        {
+            putVarint(block,R.entered);
+            put(block,R.vehicleSeconds);
+            put(block,R.distance);
+            putHistogram(block,R.speed);
+            putHistogram(block,R.travelTime);
+        }
+        bytes.clear();
+        putVarint(bytes,block.size());
+        bytes+=block;
+        out.write(bytes.data(),bytes.size());
+        out.flush();
+        bool failed=!out;
+
+        L.lock();
+        if (failed && !writerError)
+            writerError=std::make_exception_ptr(TrafficSimulation_error("Error writing road statistics file"));
+        ++hoursWritten;
+        spare.push_back(std::move(hour));
+        changed.notify_all();
+    }
+}
+
+void RoadStatistics::closeHour()
+{
+    double hourEnd=hourStart+hourLength;
+
+    std::vector<RoadStatisticsRecord> hour;
+    {
+        std::unique_lock<std::mutex> L(lock);
+        if (closed)
+            throw TrafficSimulation_error("Closing an hour of closed road statistics");
+        if (writerError)
+            std::rethrow_exception(writerError);
+        if (!spare.empty())
+        {
+            hour=std::move(spare.back());
+            spare.pop_back();
+        }
+    }
+    hour.resize(shards.front().roads.size());
+    for (RoadStatisticsRecord& R : hour)
+        R.reset();
+
+    for (Shard& S : shards)
+        for (size_t r = 0; r < S.roads.size(); ++r)
+        {
+            //The vehicles still on the road count until the end of the hour, and carry over to the next
+            Shard::Accumulator& A=S.update(hourEnd,r);
+            hour[r].entered+=A.hour.entered;
+            hour[r].vehicleSeconds+=A.hour.vehicleSeconds;
+            hour[r].distance+=A.hour.distance;
+            hour[r].speed.merge(A.hour.speed);
+            hour[r].travelTime.merge(A.hour.travelTime);
+            A.hour.reset();
+        }
+
+    hourStart=hourEnd;
+    for (Shard& S : shards)
+    {
+        S.hourStart=hourStart;
+        S.hourEnd=hourStart+hourLength;
+    }
+
+    std::unique_lock<std::mutex> L(lock);
+    changed.wait(L,[this](){return pending.size()<maxPending || writerError;});
+    if (writerError)
+        std::rethrow_exception(writerError);
+    pending.push_back(std::move(hour));
+    ++hoursClosed;
+    changed.notify_all();
+}
+
+void RoadStatistics::close()
+{
+    {
+        std::unique_lock<std::mutex> L(lock);
+        if (closed)
+            return;
+        closed=true;
+        stopping=true;
+        changed.notify_all();
+    }
+    writer.join();
+    if (writerError)
+        std::rethrow_exception(writerError);
+}
+
+size_t RoadStatistics::getHoursWritten()
+{
+    std::unique_lock<std::mutex> L(lock);
+    return hoursWritten;
+}
+
+void RoadStatistics::saveState(std::string& out)
+{
+    {
+        std::unique_lock<std::mutex> L(lock);
+        changed.wait(L,[this](){return hoursWritten==hoursClosed || writerError;});
+        if (writerError)
+            std::rethrow_exception(writerError);
+    }
+
+    put(out,hourLength);
+    put(out,hourStart);
+    putVarint(out,shards.size());
+    putVarint(out,shards.front().roads.size());
+    for (const Shard& S : shards)
+        for (const Shard::Accumulator& A : S.roads)
+        {
+            put(out,A.lastTime);
+            putVarint(out,zigzag(A.vehicles));
+            put(out,A.speedSum);
+            putVarint(out,A.hour.entered);
+            put(out,A.hour.vehicleSeconds);
+            put(out,A.hour.distance);
+            putHistogram(out,A.hour.speed);
+            putHistogram(out,A.hour.travelTime);
+        }
+}
+
+void RoadStatistics::loadState(const char*& p, const char* end)
+{
+    double length=get<double>(p,end);
+    double start=get<double>(p,end);
+    uint64_t shardNumber=getVarint(p,end);
+    uint64_t roads=getVarint(p,end);
+    if (length!=hourLength || start!=hourStart || shardNumber!=shards.size() || roads!=shards.front().roads.size())
+        throw file_format_exception("road statistics saved in the hour from "+std::to_string(start)+" ("+std::to_string(length)+" s long), with "+std::to_string(shardNumber)+" shards and "+std::to_string(roads)+" roads, these start at "+std::to_string(hourStart)+" ("+std::to_string(hourLength)+" s hours), with "+std::to_string(shards.size())+" shards and "+std::to_string(shards.front().roads.size())+" roads");
+
+    //Read into a copy, so nothing changes if the bytes are bad
+    std::vector<Shard> S=shards;
+    for (Shard& Sh : S)
+        for (Shard::Accumulator& A : Sh.roads)
+        {
+            A.lastTime=get<double>(p,end);
+            A.vehicles=unzigzag(getVarint(p,end));
+            A.speedSum=get<double>(p,end);
+            A.hour.entered=getVarint(p,end);
+            A.hour.vehicleSeconds=get<double>(p,end);
+            A.hour.distance=get<double>(p,end);
+            getHistogram(p,end,A.hour.speed);
+            getHistogram(p,end,A.hour.travelTime);
+            if (A.lastTime<hourStart || A.lastTime>hourStart+hourLength)
+                throw file_format_exception("road statistics updated outside the hour they were saved in");
+        }
+    shards=std::move(S);
+}
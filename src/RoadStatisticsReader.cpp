@@ -0,0 +1,78 @@
+#include "RoadStatisticsReader.hpp"
+
+#include "BinaryIO.hpp"
+
+using namespace BinaryIO;
+
+//Magic and version, then comes the varint number of roads, so the rest is read after
+#define fixedHeaderBytes (2*sizeof(uint32_t))
+
+static void getHistogram(const char*& p, const char* end, LogHistogram& H)
+{
+    H.clear();
+    uint64_t N=getVarint(p,end);
+    //Far more buckets than 64 bit values can fill
+    if (N>(64<<LogHistogram::subBucketBits))
+        throw file_format_exception("road statistics histogram with too many buckets");
+    for (uint64_t i = 0; i < N; ++i)
+    {
+        uint64_t count=getVarint(p,end);
+        if (count>0)
+            H.setCount(i,count);
+    }
+}
+
+RoadStatisticsReader::RoadStatisticsReader(std::istream& _in):in(_in)
+{
+    buffer.resize(fixedHeaderBytes+2*sizeof(double));
+    in.read(buffer.data(),fixedHeaderBytes);
+    if (in.gcount()!=static_cast<std::streamsize>(fixedHeaderBytes))
+        throw file_format_exception("road statistics file too short");
+    const char* p=buffer.data();
+    const char* end=p+fixedHeaderBytes;
+    if (get<uint32_t>(p,end)!=RoadStatisticsFormat::magic)
+        throw file_format_exception("not a road statistics file");
+    uint32_t version=get<uint32_t>(p,end);
+    if (version!=RoadStatisticsFormat::version)
+        throw file_format_exception("road statistics file version "+std::to_string(version)+" is not supported");
+
+    uint64_t N;
+    if (!streamVarint(in,N))
+        throw file_format_exception("road statistics file too short");
+    roads=N;
+
+    in.read(buffer.data(),2*sizeof(double));
+    if (in.gcount()!=static_cast<std::streamsize>(2*sizeof(double)))
+        throw file_format_exception("road statistics file too short");
+    p=buffer.data();
+    end=p+2*sizeof(double);
+    hourLength=get<double>(p,end);
+    startTime=get<double>(p,end);
+}
+
+bool RoadStatisticsReader::nextHour(std::vector<RoadStatisticsRecord>& out)
+{
+    uint64_t bytes;
+    if (!streamVarint(in,bytes))
+        return false;
+    buffer.resize(bytes);
+    in.read(buffer.data(),bytes);
+    if (static_cast<uint64_t>(in.gcount())!=bytes)
+        throw file_format_exception("road statistics hour "+std::to_string(hoursRead)+" cut short");
+
+    const char* p=buffer.data();
+    const char* end=p+bytes;
+    out.resize(roads);
+    for (RoadStatisticsRecord& R : out)
+    {
+        R.entered=getVarint(p,end);
+        R.vehicleSeconds=get<double>(p,end);
+        R.distance=get<double>(p,end);
+        getHistogram(p,end,R.speed);
+        getHistogram(p,end,R.travelTime);
+    }
+    if (p!=end)
+        throw file_format_exception("road statistics hour "+std::to_string(hoursRead)+" has the wrong length");
+    ++hoursRead;
+    return true;
+}
@@ -0,0 +1,126 @@
+#include "RouteCache.hpp"
+
+#include <cmath>
+
+#include "TrafficExceptions.hpp"
+
+RouteCache::RouteCache(RoutingGraph& _graph, Router& _router, double _bucketLength, double _driftThreshold, double _dayLength):graph(_graph),router(_router),bucketLength(_bucketLength),dayLength(_dayLength),driftThreshold(_driftThreshold),roadUsers(_graph.getRoadNumber()),graphEdits(_graph.getEdits())
+{
+    if (!(bucketLength>0) || !(dayLength>0))
+        throw TrafficSimulation_error("Route cache bucket and day length must be positive");
+    if (!(driftThreshold>=0))
+        throw TrafficSimulation_error("Route cache drift threshold can not be negative");
+}
+
+double RouteCache::lookup(size_t origin, size_t destination, double departure, TravelMode mode, std::vector<size_t>& roads)
+{
+    followEdits();
+    size_t N=graph.getNodeNumber();
+    if (origin>=N)
+        throw node_address_exception(origin,N);
+    if (destination>=N)
+        throw node_address_exception(destination,N);
+
+    //Time of day, so tomorrow at 8 is the same as today at 8
+    double timeOfDay=departure-std::floor(departure/dayLength)*dayLength;
+    Key K{uint32_t(origin),uint32_t(destination),uint32_t(timeOfDay/bucketLength),mode};
+
+    auto It=index.find(K);
+    if (It!=index.end())
+    {
+        ++hits;
+        const Entry& E=entries[It->second];
+        routes.getRoute(E.route,roads);
+        return E.plannedTime;
+    }
+
+    ++misses;
+    double time=router.route(origin,destination,roads);
+
+    uint32_t slot;
+    if (!freeEntries.empty())
+    {
+        slot=freeEntries.back();
+        freeEntries.pop_back();
+    }
+    else
+    {
+        slot=entries.size();
+        entries.push_back(Entry());
+    }
+    Entry& E=entries[slot];
+    E.key=K;
+    E.route=routes.intern(roads);
+    E.plannedTime=time;
+    E.drift=0;
+    E.alive=true;
+    index.emplace(K,slot);
+
+    for (size_t r : roads)
+        addUser(r,slot);
+    return time;
+}
+
+void RouteCache::addUser(size_t road, uint32_t entry)
+{
+    std::vector<std::pair<uint32_t,uint32_t> >& Users=roadUsers[road];
+    //Before the list grows, see if there are old references we can drop instead, so roads which never change do not collect references to long gone routes
+    if (Users.size()==Users.capacity())
+    {
+        size_t kept=0;
+        for (size_t i = 0; i < Users.size(); ++i)
+        {
+            const Entry& E=entries[Users[i].first];
+            if (E.alive && E.generation==Users[i].second)
+                Users[kept++]=Users[i];
+        }
+        Users.resize(kept);
+    }
+    Users.push_back({entry,entries[entry].generation});
+}
+
+void RouteCache::invalidate(uint32_t entry)
+{
+    Entry& E=entries[entry];
+    index.erase(E.key);
+    E.alive=false;
+    ++E.generation;
+    freeEntries.push_back(entry);
+    ++invalidations;
+}
+
+void RouteCache::setTravelTime(size_t road, double time)
+{
+    followEdits();
+    if (road>=graph.getRoadNumber())
+        throw road_address_exception(road,graph.getRoadNumber());
+    double change=time-graph.getTravelTime(road);
+    graph.setTravelTime(road,time);
+
+    //Walk the routes using the road, and drop the references to routes which are gone
+    std::vector<std::pair<uint32_t,uint32_t> >& Users=roadUsers[road];
+    size_t kept=0;
+    for (size_t i = 0; i < Users.size(); ++i)
+    {
+        Entry& E=entries[Users[i].first];
+        if (!E.alive || E.generation!=Users[i].second)
+            continue;
+        E.drift+=change;
+        if (std::abs(E.drift)>driftThreshold*E.plannedTime)
+            invalidate(Users[i].first);
+        else
+            Users[kept++]=Users[i];
+    }
+    Users.resize(kept);
+}
+
+void RouteCache::rebuild()
+{
+    invalidations+=index.size();
+    entries.clear();
+    freeEntries.clear();
+    index.clear();
+    roadUsers.assign(graph.getRoadNumber(),{});
+    routes=RouteStore();
+    graphEdits=graph.getEdits();
+}
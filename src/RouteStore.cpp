@@ -0,0 +1,71 @@
+#include "RouteStore.hpp"
+
+#include "TrafficExceptions.hpp"
+
+RouteStore::RouteStore()
+{
+    //The root, the empty route
+    nodes.push_back(Node{0,0,0});
+}
+
+RouteID RouteStore::extend(RouteID prefix, size_t road)
+{
+    if (prefix>=nodes.size())
+        throw TrafficSimulation_error("Route "+std::to_string(prefix)+" does not exist");
+    if (road>UINT32_MAX)
+        throw TrafficSimulation_error("Road "+std::to_string(road)+" is too large for the route store");
+
+    uint64_t key=(uint64_t(prefix)<<32)|road;
+    auto It=children.find(key);
+    if (It!=children.end())
+        return It->second;
+
+    if (nodes.size()>UINT32_MAX)
+        throw TrafficSimulation_error("Route store is full");
+    RouteID child=nodes.size();
+    nodes.push_back(Node{prefix,nodes[prefix].length+1,road});
+    children.emplace(key,child);
+    return child;
+}
+
+RouteID RouteStore::intern(const std::vector<size_t>& roads)
+{
+    RouteID route=0;
+    for (size_t road : roads)
+        route=extend(route,road);
+    ++interned;
+    roadsInterned+=roads.size();
+    return route;
+}
+
+void RouteStore::getRoute(RouteID route, std::vector<size_t>& out) const
+{
+    out.resize(getLength(route));
+    //Walk up to the root, filling from the back
+    for (size_t i = out.size(); i > 0; --i)
+    {
+        out[i-1]=nodes[route].road;
+        route=nodes[route].parent;
+    }
+}
+
+size_t RouteStore::getLength(RouteID route) const
+{
+    if (route>=nodes.size())
+        throw TrafficSimulation_error("Route "+std::to_string(route)+" does not exist");
+    return nodes[route].length;
+}
+
+size_t RouteStore::getLastRoad(RouteID route) const
+{
+    if (route==0 || route>=nodes.size())
+        throw TrafficSimulation_error("Route "+std::to_string(route)+" has no last road");
+    return nodes[route].road;
+}
+
+RouteID RouteStore::getParent(RouteID route) const
+{
+    if (route==0 || route>=nodes.size())
+        throw TrafficSimulation_error("Route "+std::to_string(route)+" has no parent");
+    return nodes[route].parent;
+}
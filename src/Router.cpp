@@ -0,0 +1,185 @@
+#include "Router.hpp"
+
+#include <algorithm>
+#include <functional>
+#include <cmath>
+
+#include "TrafficExceptions.hpp"
+
+Router::Router(const RoutingGraph& _graph):graph(_graph),dist(_graph.getNodeNumber()),viaRoad(_graph.getNodeNumber()),viaNode(_graph.getNodeNumber()),stamp(_graph.getNodeNumber(),0)
+{
+}
+
+bool Router::startSearch(size_t origin, size_t destination, std::vector<size_t>& roads)
+{
+    size_t N=graph.getNodeNumber();
+    if (origin>=N)
+        throw node_address_exception(origin,N);
+    if (destination>=N)
+        throw node_address_exception(destination,N);
+
+    //The graph may have grown since the last search (RoutingGraph::nodeAdded), the node arrays follow it, like the edge arrays in routeWithTurns
+    if (stamp.size()!=N)
+    {
+        dist.resize(N);
+        viaRoad.resize(N);
+        viaNode.resize(N);
+        stamp.assign(N,0);
+        search=0;
+    }
+
+    roads.clear();
+    if (!graph.getComponents().mayReach(origin,destination))
+    {
+        ++rejected;
+        return false;
+    }
+    ++searches;
+    return true;
+}
+
+template<class Cost>
+double Router::dijkstra(size_t origin, size_t destination, double start, Cost cost, std::vector<size_t>& roads)
+{
+    if (!startSearch(origin,destination,roads))
+        return -1;
+    //After 4 billion searches the stamps wrap around, then we have to clear them for real
+    if (++search==0)
+    {
+        std::fill(stamp.begin(),stamp.end(),0);
+        search=1;
+    }
+
+    heap.clear();
+    dist[origin]=start;
+    stamp[origin]=search;
+    heap.push_back(HeapEntry{start,uint32_t(origin)});
+
+    bool found=false;
+    while (!heap.empty())
+    {
+        std::pop_heap(heap.begin(),heap.end(),std::greater<HeapEntry>());
+        HeapEntry E=heap.back();
+        heap.pop_back();
+        //Old entries of nodes we have since found a faster way to
+        if (E.dist>dist[E.node])
+            continue;
+        ++settled;
+        if (E.node==destination)
+        {
+            found=true;
+            break;
+        }
+
+        for (const RoutingEdge* It=graph.edgesBegin(E.node); It!=graph.edgesEnd(E.node); ++It)
+        {
+            double d=E.dist+cost(It->road,E.dist);
+            if (stamp[It->to]!=search || d<dist[It->to])
+            {
+                stamp[It->to]=search;
+                dist[It->to]=d;
+                viaRoad[It->to]=It->road;
+                viaNode[It->to]=E.node;
+                heap.push_back(HeapEntry{d,It->to});
+                std::push_heap(heap.begin(),heap.end(),std::greater<HeapEntry>());
+            }
+        }
+    }
+    if (!found)
+        return -1;
+
+    for (size_t n = destination; n != origin; n=viaNode[n])
+        roads.push_back(viaRoad[n]);
+    std::reverse(roads.begin(),roads.end());
+    return dist[destination];
+}
+
+double Router::route(size_t origin, size_t destination, std::vector<size_t>& roads)
+{
+    const RoutingGraph& G=graph;
+    return dijkstra(origin,destination,0,[&G](uint32_t road, double){return G.getTravelTime(road);},roads);
+}
+
+double Router::route(size_t origin, size_t destination, double departure, const TravelTimeProfiles& Profiles, std::vector<size_t>& roads)
+{
+    if (Profiles.getRoadNumber()!=graph.getRoadNumber())
+        throw TrafficSimulation_error("Travel time profiles for "+std::to_string(Profiles.getRoadNumber())+" roads, but the city has "+std::to_string(graph.getRoadNumber()));
+    double arrival=dijkstra(origin,destination,departure,[&Profiles](uint32_t road, double time){return Profiles.travelTime(road,time);},roads);
+    return arrival<0 ? -1 : arrival-departure;
+}
+
+double Router::routeWithTurns(size_t origin, size_t destination, std::vector<size_t>& roads)
+{
+    if (!startSearch(origin,destination,roads))
+        return -1;
+    if (origin==destination)
+        return 0;
+
+    if (edgeStamp.size()!=graph.getEdgeNumber())
+    {
+        edgeDist.resize(graph.getEdgeNumber());
+        edgeVia.resize(graph.getEdgeNumber());
+        edgeStamp.assign(graph.getEdgeNumber(),0);
+        edgeSearch=0;
+    }
+    if (++edgeSearch==0)
+    {
+        std::fill(edgeStamp.begin(),edgeStamp.end(),0);
+        edgeSearch=1;
+    }
+
+    const uint32_t none=UINT32_MAX;
+    heap.clear();
+    for (size_t e = graph.getFirstEdge(origin); e < graph.getFirstEdge(origin+1); ++e)
+    {
+        double d=graph.getTravelTime(graph.getEdge(e).road);
+        edgeStamp[e]=edgeSearch;
+        edgeDist[e]=d;
+        edgeVia[e]=none;
+        heap.push_back(HeapEntry{d,uint32_t(e)});
+    }
+    std::make_heap(heap.begin(),heap.end(),std::greater<HeapEntry>());
+
+    uint32_t found=none;
+    while (!heap.empty())
+    {
+        std::pop_heap(heap.begin(),heap.end(),std::greater<HeapEntry>());
+        HeapEntry E=heap.back();
+        heap.pop_back();
+        if (E.dist>edgeDist[E.node])
+            continue;
+        ++settled;
+
+        //The first edge into the destination we settle is the fastest way there, no need to turn onto anything
+        const RoutingEdge& In=graph.getEdge(E.node);
+        if (In.to==destination)
+        {
+            found=E.node;
+            break;
+        }
+
+        size_t from=graph.getHeadSlot(E.node);
+        for (size_t e = graph.getFirstEdge(In.to); e < graph.getFirstEdge(In.to+1); ++e)
+        {
+            double turn=graph.getTurnCost(In.to,from,graph.getTailSlot(e));
+            if (std::isinf(turn))
+                continue;
+            double d=E.dist+turn+graph.getTravelTime(graph.getEdge(e).road);
+            if (edgeStamp[e]!=edgeSearch || d<edgeDist[e])
+            {
+                edgeStamp[e]=edgeSearch;
+                edgeDist[e]=d;
+                edgeVia[e]=E.node;
+                heap.push_back(HeapEntry{d,uint32_t(e)});
+                std::push_heap(heap.begin(),heap.end(),std::greater<HeapEntry>());
+            }
+        }
+    }
+    if (found==none)
+        return -1;
+
+    for (uint32_t e = found; e != none; e=edgeVia[e])
+        roads.push_back(graph.getEdge(e).road);
+    std::reverse(roads.begin(),roads.end());
+    return edgeDist[found];
+}
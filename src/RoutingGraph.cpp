@@ -0,0 +1,624 @@
+#include "RoutingGraph.hpp"
+
+#include "Road.hpp"
+#include "Node.hpp"
+#include "Intersection.hpp"
+#include "ICityNetwork.hpp"
+#include "TrafficExceptions.hpp"
+#include "BinaryIO.hpp"
+
+#include <cmath>
+#include <algorithm>
+#include <typeinfo>
+
+RoutingGraph::RoutingGraph(ICityNetwork& City, size_t maxMatrixRoads):matrixRoads(maxMatrixRoads)
+{
+    size_t nodes=City.getNodesSize();
+    size_t roads=City.getRoadsSize();
+    if (nodes>=UINT32_MAX || roads>=UINT32_MAX)
+        throw TrafficSimulation_error("City too large for the routing graph");
+
+    //Count the edges of every node first, then place them, so the edges of each node end up next to each other
+    firstEdge.assign(nodes+1,0);
+    for (size_t r = 0; r < roads; ++r)
+    {
+        std::shared_ptr<Road> R=City.getRoad(r);
+        ++firstEdge[R->getStart().getNodeID()+1];
+        if (!R->getOneWay())
+            ++firstEdge[R->getEnd().getNodeID()+1];
+        freeFlowTime.push_back(R->getLength()/R->getSpeedLimit());
+        length.push_back(R->getLength());
+        roadStart.push_back(R->getStart().getNodeID());
+        roadEnd.push_back(R->getEnd().getNodeID());
+        oneWay.push_back(R->getOneWay());
+    }
+    for (size_t n = 0; n < nodes; ++n)
+        firstEdge[n+1]+=firstEdge[n];
+
+    //The slots of the roads at their start and end
+    std::vector<uint16_t> startSlot(roads);
+    std::vector<uint16_t> endSlot(roads);
+    firstSlot.push_back(0);
+    for (size_t n = 0; n < nodes; ++n)
+    {
+        std::shared_ptr<Node> N=City.getNode(n);
+        size_t degree=N->getRoadNumber();
+        if (degree>UINT16_MAX)
+            throw TrafficSimulation_error("Node "+std::to_string(n)+" has too many roads for the routing graph");
+        plainNode.push_back(typeid(*N)==typeid(Intersection));
+        for (size_t i = 0; i < degree; ++i)
+        {
+            const Road& R=N->getRoad(i,true);
+            const Node& Other=R.getOther(n);
+            double dx=Other.getX()-N->getX();
+            double dy=Other.getY()-N->getY();
+            double d=std::max(std::sqrt(dx*dx+dy*dy),1e-9);
+            slotRoad.push_back(R.getRoadID());
+            slotX.push_back(dx/d);
+            slotY.push_back(dy/d);
+            (R.getStart().getNodeID()==n ? startSlot : endSlot)[R.getRoadID()]=i;
+        }
+        firstSlot.push_back(slotRoad.size());
+    }
+
+    edges.resize(firstEdge[nodes]);
+    tailSlot.resize(edges.size());
+    headSlot.resize(edges.size());
+    std::vector<uint32_t> next(firstEdge.begin(),firstEdge.end()-1);
+    for (size_t r = 0; r < roads; ++r)
+    {
+        std::shared_ptr<Road> R=City.getRoad(r);
+        uint32_t a=R->getStart().getNodeID();
+        uint32_t b=R->getEnd().getNodeID();
+        tailSlot[next[a]]=startSlot[r];
+        headSlot[next[a]]=endSlot[r];
+        edges[next[a]++]=RoutingEdge{b,uint32_t(r)};
+        if (!R->getOneWay())
+        {
+            tailSlot[next[b]]=endSlot[r];
+            headSlot[next[b]]=startSlot[r];
+            edges[next[b]++]=RoutingEdge{a,uint32_t(r)};
+        }
+    }
+
+    travelTime=freeFlowTime;
+
+    //Turn matrices, for the nodes small enough
+    turnOffset.assign(nodes,noMatrix);
+    for (size_t n = 0; n < nodes; ++n)
+        addMatrix(City,n);
+
+    findComponents();
+}
+
+void RoutingGraph::addMatrix(ICityNetwork& City, size_t n)
+{
+    size_t degree=getDegree(n);
+    if (degree>matrixRoads)
+        return;
+    if (turns.size()+degree*degree>=noMatrix)
+        throw TrafficSimulation_error("Too many turns for the routing graph");
+    turnOffset[n]=turns.size();
+
+    Intersection* I=dynamic_cast<Intersection*>(City.getNode(n).get());
+    for (size_t i = 0; i < degree; ++i)
+        for (size_t j = 0; j < degree; ++j)
+        {
+            double cost=0;//End nodes are where we appear and disappear, there is no turning
+            if (i==j && degree>1)
+                cost=forbidden;
+            else if (I!=nullptr)
+                cost=I->idealTransferTime(i,j,true);
+            turns.push_back(float(cost));
+        }
+}
+
+void RoutingGraph::checkEditable(ICityNetwork& City, size_t nodes, size_t roads) const
+{
+    if (isCompressed())
+        throw TrafficSimulation_error("A compressed routing graph can not follow edits of the city, compress the full graph again instead");
+    if (City.getNodesSize()!=nodes || City.getRoadsSize()!=roads)
+        throw TrafficSimulation_error("Routing graph with "+std::to_string(getNodeNumber())+" nodes and "+std::to_string(getRoadNumber())+" roads does not match the edited city with "+std::to_string(City.getNodesSize())+" nodes and "+std::to_string(City.getRoadsSize())+" roads");
+}
+
+void RoutingGraph::refreshNodes(ICityNetwork& City, std::vector<size_t> nodes)
+{
+    std::sort(nodes.begin(),nodes.end());
+    nodes.erase(std::unique(nodes.begin(),nodes.end()),nodes.end());
+
+    //The slots and turns first, the edges need the slots at both ends
+    for (size_t n : nodes)
+    {
+        size_t oldDegree=getDegree(n);
+        std::shared_ptr<Node> N=City.getNode(n);
+        size_t degree=N->getRoadNumber();
+        if (degree>UINT16_MAX)
+            throw TrafficSimulation_error("Node "+std::to_string(n)+" has too many roads for the routing graph");
+
+        std::vector<uint32_t> roads;
+        std::vector<float> x,y;
+        for (size_t i = 0; i < degree; ++i)
+        {
+            const Road& R=N->getRoad(i,true);
+            const Node& Other=R.getOther(n);
+            double dx=Other.getX()-N->getX();
+            double dy=Other.getY()-N->getY();
+            double d=std::max(std::sqrt(dx*dx+dy*dy),1e-9);
+            roads.push_back(R.getRoadID());
+            x.push_back(dx/d);
+            y.push_back(dy/d);
+        }
+        slotRoad.erase(slotRoad.begin()+firstSlot[n],slotRoad.begin()+firstSlot[n+1]);
+        slotRoad.insert(slotRoad.begin()+firstSlot[n],roads.begin(),roads.end());
+        slotX.erase(slotX.begin()+firstSlot[n],slotX.begin()+firstSlot[n+1]);
+        slotX.insert(slotX.begin()+firstSlot[n],x.begin(),x.end());
+        slotY.erase(slotY.begin()+firstSlot[n],slotY.begin()+firstSlot[n+1]);
+        slotY.insert(slotY.begin()+firstSlot[n],y.begin(),y.end());
+        for (size_t k = n+1; k < firstSlot.size(); ++k)
+            firstSlot[k]+=degree-oldDegree;
+
+        //The old matrix is taken out, and the new one goes at the end
+        uint32_t offset=turnOffset[n];
+        if (offset!=noMatrix)
+        {
+            size_t size=oldDegree*oldDegree;
+            turns.erase(turns.begin()+offset,turns.begin()+offset+size);
+            for (uint32_t& o : turnOffset)
+                if (o!=noMatrix && o>offset)
+                    o-=size;
+            turnOffset[n]=noMatrix;
+        }
+        addMatrix(City,n);
+        for (auto It=sparseTurns.begin(); It!=sparseTurns.end();)
+            It=(It->first>>32)==n ? sparseTurns.erase(It) : std::next(It);
+    }
+
+    //The edges leaving the nodes, in the order of the road IDs, as when the graph is built
+    for (size_t n : nodes)
+    {
+        std::vector<uint32_t> roads(slotRoad.begin()+firstSlot[n],slotRoad.begin()+firstSlot[n+1]);
+        std::sort(roads.begin(),roads.end());
+        std::vector<RoutingEdge> out;
+        std::vector<uint16_t> tails,heads;
+        for (uint32_t r : roads)
+        {
+            if (roadStart[r]!=n && oneWay[r])
+                continue;
+            uint32_t to=roadStart[r]==n ? roadEnd[r] : roadStart[r];
+            out.push_back(RoutingEdge{to,r});
+            tails.push_back(findSlot(n,r));
+            heads.push_back(findSlot(to,r));
+        }
+        size_t oldEdges=firstEdge[n+1]-firstEdge[n];
+        edges.erase(edges.begin()+firstEdge[n],edges.begin()+firstEdge[n+1]);
+        edges.insert(edges.begin()+firstEdge[n],out.begin(),out.end());
+        tailSlot.erase(tailSlot.begin()+firstEdge[n],tailSlot.begin()+firstEdge[n+1]);
+        tailSlot.insert(tailSlot.begin()+firstEdge[n],tails.begin(),tails.end());
+        headSlot.erase(headSlot.begin()+firstEdge[n],headSlot.begin()+firstEdge[n+1]);
+        headSlot.insert(headSlot.begin()+firstEdge[n],heads.begin(),heads.end());
+        for (size_t k = n+1; k < firstEdge.size(); ++k)
+            firstEdge[k]+=out.size()-oldEdges;
+    }
+
+    //The edges coming in from the neighbours, their roads may have moved to other slots
+    for (size_t e = 0; e < edges.size(); ++e)
+        if (std::binary_search(nodes.begin(),nodes.end(),size_t(edges[e].to)))
+            headSlot[e]=findSlot(edges[e].to,edges[e].road);
+
+    findComponents();
+}
+
+void RoutingGraph::nodeAdded(ICityNetwork& City)
+{
+    size_t n=getNodeNumber();
+    checkEditable(City,n+1,getRoadNumber());
+    firstEdge.push_back(firstEdge.back());
+    firstSlot.push_back(firstSlot.back());
+    turnOffset.push_back(noMatrix);
+    std::shared_ptr<Node> N=City.getNode(n);
+    plainNode.push_back(typeid(*N)==typeid(Intersection));
+    refreshNodes(City,{n});
+    ++edits;
+}
+
+void RoutingGraph::roadAdded(ICityNetwork& City)
+{
+    size_t r=getRoadNumber();
+    checkEditable(City,getNodeNumber(),r+1);
+    std::shared_ptr<Road> R=City.getRoad(r);
+    freeFlowTime.push_back(R->getLength()/R->getSpeedLimit());
+    travelTime.push_back(freeFlowTime.back());
+    length.push_back(R->getLength());
+    roadStart.push_back(R->getStart().getNodeID());
+    roadEnd.push_back(R->getEnd().getNodeID());
+    oneWay.push_back(R->getOneWay());
+    refreshNodes(City,{roadStart[r],roadEnd[r]});
+    ++edits;
+}
+
+void RoutingGraph::roadRemoved(ICityNetwork& City, size_t road)
+{
+    if (road>=getRoadNumber())
+        throw road_address_exception(road,getRoadNumber());
+    checkEditable(City,getNodeNumber(),getRoadNumber()-1);
+    size_t a=roadStart[road];
+    size_t b=roadEnd[road];
+
+    travelTime.erase(travelTime.begin()+road);
+    freeFlowTime.erase(freeFlowTime.begin()+road);
+    length.erase(length.begin()+road);
+    roadStart.erase(roadStart.begin()+road);
+    roadEnd.erase(roadEnd.begin()+road);
+    oneWay.erase(oneWay.begin()+road);
+    //The roads after it move down, the road itself is only at a and b, which are made again
+    for (RoutingEdge& E : edges)
+        if (E.road>road)
+            --E.road;
+    for (uint32_t& r : slotRoad)
+        if (r>road)
+            --r;
+    refreshNodes(City,{a,b});
+    ++edits;
+}
+
+void RoutingGraph::roadChanged(ICityNetwork& City, size_t road)
+{
+    if (road>=getRoadNumber())
+        throw road_address_exception(road,getRoadNumber());
+    checkEditable(City,getNodeNumber(),getRoadNumber());
+    std::shared_ptr<Road> R=City.getRoad(road);
+    freeFlowTime[road]=R->getLength()/R->getSpeedLimit();
+    travelTime[road]=freeFlowTime[road];
+    length[road]=R->getLength();
+    ++edits;
+}
+
+RoutingGraph RoutingGraph::compressChains(const RoutingGraph& Full)
+{
+    if (Full.isCompressed())
+        throw TrafficSimulation_error("Routing graph is already compressed");
+
+    size_t nodes=Full.getNodeNumber();
+    size_t roads=Full.getRoadNumber();
+    auto otherEnd = [&Full](size_t road, size_t node) {return Full.roadStart[road]==node ? Full.roadEnd[road] : Full.roadStart[road];};
+
+    //A node is collapsed if it is a plain intersection with two roads, which can be driven through the node the same ways, for free (the turn costs inside a chain are lost)
+    auto costless = [&Full](size_t n, size_t fromSlot, size_t toSlot) {return Full.getTurnCost(n,fromSlot,toSlot)==0;};
+    std::vector<uint8_t> keep(nodes,1);
+    for (size_t n = 0; n < nodes; ++n)
+    {
+        if (Full.getDegree(n)!=2 || !Full.plainNode[n])
+            continue;
+        size_t a=Full.slotRoad[Full.firstSlot[n]];
+        size_t b=Full.slotRoad[Full.firstSlot[n]+1];
+        if (!Full.oneWay[a] && !Full.oneWay[b])
+            keep[n]=!(costless(n,0,1) && costless(n,1,0));
+        else if (Full.oneWay[a] && Full.oneWay[b] && (Full.roadEnd[a]==n)!=(Full.roadEnd[b]==n))
+            keep[n]=Full.roadEnd[a]==n ? !costless(n,0,1) : !costless(n,1,0);
+    }
+
+    RoutingGraph C;
+    C.matrixRoads=Full.matrixRoads;
+    C.chainFirst.push_back(0);
+    C.chainOfRoad.assign(roads,UINT32_MAX);
+    std::vector<uint32_t> chainFrom;//Full graph nodes at the ends of the chains
+    std::vector<uint32_t> chainTo;
+
+    //Follow the chain from a kept node along one of its roads, until the next kept node
+    auto walk = [&](size_t from, size_t road)
+    {
+        size_t chain=chainFrom.size();
+        size_t first=C.chainRoads.size();
+        size_t at=from;
+        while (true)
+        {
+            C.chainRoads.push_back(road);
+            C.chainOfRoad[road]=chain;
+            at=otherEnd(road,at);
+            if (keep[at])
+                break;
+            size_t slot=Full.firstSlot[at];
+            road=Full.slotRoad[slot]==road ? Full.slotRoad[slot+1] : Full.slotRoad[slot];
+        }
+        size_t to=at;
+        //One-way chains go the way the roads do
+        if (Full.oneWay[road] && Full.roadEnd[road]!=to)
+        {
+            std::reverse(C.chainRoads.begin()+first,C.chainRoads.end());
+            std::swap(from,to);
+        }
+        chainFrom.push_back(from);
+        chainTo.push_back(to);
+        C.chainFirst.push_back(C.chainRoads.size());
+    };
+    auto walkAll = [&](size_t n)
+    {
+        for (size_t i = Full.firstSlot[n]; i < Full.firstSlot[n+1]; ++i)
+            if (C.chainOfRoad[Full.slotRoad[i]]==UINT32_MAX)
+                walk(n,Full.slotRoad[i]);
+    };
+    for (size_t n = 0; n < nodes; ++n)
+        if (keep[n])
+            walkAll(n);
+    //What is left are rings with no kept node, keep one node of each
+    for (size_t r = 0; r < roads; ++r)
+        if (C.chainOfRoad[r]==UINT32_MAX)
+        {
+            keep[Full.roadStart[r]]=1;
+            walkAll(Full.roadStart[r]);
+        }
+
+    C.compressedNode.assign(nodes,UINT32_MAX);
+    for (size_t n = 0; n < nodes; ++n)
+        if (keep[n])
+        {
+            C.compressedNode[n]=C.originalNode.size();
+            C.originalNode.push_back(n);
+        }
+
+    //The chains are the roads of the compressed graph
+    size_t chains=chainFrom.size();
+    for (size_t c = 0; c < chains; ++c)
+    {
+        double time=0,free=0,meters=0;
+        for (size_t i = C.chainFirst[c]; i < C.chainFirst[c+1]; ++i)
+        {
+            size_t r=C.chainRoads[i];
+            time+=Full.travelTime[r];
+            free+=Full.freeFlowTime[r];
+            meters+=Full.length[r];
+        }
+        C.travelTime.push_back(time);
+        C.freeFlowTime.push_back(free);
+        C.length.push_back(meters);
+        C.roadStart.push_back(C.compressedNode[chainFrom[c]]);
+        C.roadEnd.push_back(C.compressedNode[chainTo[c]]);
+        C.oneWay.push_back(Full.oneWay[C.chainRoads[C.chainFirst[c]]]);
+    }
+
+    //The kept nodes have the same slots as before, now with the chains
+    C.firstSlot.push_back(0);
+    C.turnOffset.assign(C.originalNode.size(),noMatrix);
+    for (size_t k = 0; k < C.originalNode.size(); ++k)
+    {
+        size_t n=C.originalNode[k];
+        for (size_t i = Full.firstSlot[n]; i < Full.firstSlot[n+1]; ++i)
+        {
+            C.slotRoad.push_back(C.chainOfRoad[Full.slotRoad[i]]);
+            C.slotX.push_back(Full.slotX[i]);
+            C.slotY.push_back(Full.slotY[i]);
+        }
+        C.firstSlot.push_back(C.slotRoad.size());
+        C.plainNode.push_back(Full.plainNode[n]);
+
+        if (Full.turnOffset[n]!=noMatrix)
+        {
+            size_t degree=Full.getDegree(n);
+            C.turnOffset[k]=C.turns.size();
+            C.turns.insert(C.turns.end(),Full.turns.begin()+Full.turnOffset[n],Full.turns.begin()+Full.turnOffset[n]+degree*degree);
+        }
+    }
+    for (const auto& [key,cost] : Full.sparseTurns)
+        C.sparseTurns[turnKey(C.compressedNode[key>>32],(key>>16)&0xFFFF,key&0xFFFF)]=cost;
+
+    //Edges in the same way as from the city
+    C.firstEdge.assign(C.originalNode.size()+1,0);
+    for (size_t c = 0; c < chains; ++c)
+    {
+        ++C.firstEdge[C.roadStart[c]+1];
+        if (!C.oneWay[c])
+            ++C.firstEdge[C.roadEnd[c]+1];
+    }
+    for (size_t k = 0; k < C.originalNode.size(); ++k)
+        C.firstEdge[k+1]+=C.firstEdge[k];
+    C.edges.resize(C.firstEdge.back());
+    C.tailSlot.resize(C.edges.size());
+    C.headSlot.resize(C.edges.size());
+    std::vector<uint32_t> next(C.firstEdge.begin(),C.firstEdge.end()-1);
+    for (size_t c = 0; c < chains; ++c)
+    {
+        size_t firstRoad=C.chainRoads[C.chainFirst[c]];
+        size_t lastRoad=C.chainRoads[C.chainFirst[c+1]-1];
+        uint32_t a=C.roadStart[c];
+        uint32_t b=C.roadEnd[c];
+        size_t startSlot=Full.findSlot(chainFrom[c],firstRoad);
+        size_t endSlot=Full.findSlot(chainTo[c],lastRoad);
+        C.tailSlot[next[a]]=startSlot;
+        C.headSlot[next[a]]=endSlot;
+        C.edges[next[a]++]=RoutingEdge{b,uint32_t(c)};
+        if (!C.oneWay[c])
+        {
+            C.tailSlot[next[b]]=endSlot;
+            C.headSlot[next[b]]=startSlot;
+            C.edges[next[b]++]=RoutingEdge{a,uint32_t(c)};
+        }
+    }
+    C.findComponents();
+    return C;
+}
+
+void RoutingGraph::findComponents()
+{
+    std::vector<uint32_t> to(edges.size());
+    for (size_t e = 0; e < edges.size(); ++e)
+        to[e]=edges[e].to;
+    components=StrongComponents(firstEdge,to);
+}
+
+void RoutingGraph::expandRoute(size_t origin, const std::vector<size_t>& route, std::vector<size_t>& roads) const
+{
+    roads.clear();
+    if (!isCompressed())
+    {
+        roads=route;
+        return;
+    }
+
+    //Which way we drive every chain depends on which end we are at
+    size_t at=origin;
+    for (size_t c : route)
+    {
+        if (c>=getRoadNumber() || (roadStart[c]!=at && roadEnd[c]!=at))
+            throw TrafficSimulation_error("Route does not continue from node "+std::to_string(at));
+        if (roadStart[c]==at)
+        {
+            roads.insert(roads.end(),chainRoads.begin()+chainFirst[c],chainRoads.begin()+chainFirst[c+1]);
+            at=roadEnd[c];
+        }
+        else
+        {
+            roads.insert(roads.end(),chainRoads.rbegin()+(chainRoads.size()-chainFirst[c+1]),chainRoads.rbegin()+(chainRoads.size()-chainFirst[c]));
+            at=roadStart[c];
+        }
+    }
+}
+
+void RoutingGraph::updateTravelTimes(const RoutingGraph& Full)
+{
+    if (!isCompressed() || Full.getRoadNumber()!=chainOfRoad.size())
+        throw TrafficSimulation_error("Routing graph was not compressed from this one");
+    for (size_t c = 0; c < getRoadNumber(); ++c)
+    {
+        double time=0;
+        for (size_t i = chainFirst[c]; i < chainFirst[c+1]; ++i)
+            time+=Full.travelTime[chainRoads[i]];
+        travelTime[c]=time;
+    }
+}
+
+double RoutingGraph::defaultTurnCost(size_t node, size_t from, size_t to) const noexcept
+{
+    if (from==to)
+        return forbidden;//Only nodes with many roads get here
+    size_t a=firstSlot[node]+from;
+    size_t b=firstSlot[node]+to;
+    //The direction we come in is the opposite of the direction of the road from the node
+    return Intersection::turnTime(-slotX[a],-slotY[a],slotX[b],slotY[b]);
+}
+
+size_t RoutingGraph::findSlot(size_t node, size_t road) const
+{
+    for (size_t i = firstSlot[node]; i < firstSlot[node+1]; ++i)
+        if (slotRoad[i]==road)
+            return i-firstSlot[node];
+
+    std::vector<int> legal(slotRoad.begin()+firstSlot[node],slotRoad.begin()+firstSlot[node+1]);
+    throw road_address_exception(road,legal,node);
+}
+
+void RoutingGraph::setTurnCost(size_t node, size_t fromRoad, size_t toRoad, double cost)
+{
+    if (node>=getNodeNumber())
+        throw node_address_exception(node,getNodeNumber());
+    if (!(cost>=0))
+        throw TrafficSimulation_error("Turn cost at node "+std::to_string(node)+" must not be negative");
+    size_t from=findSlot(node,fromRoad);
+    size_t to=findSlot(node,toRoad);
+
+    if (turnOffset[node]!=noMatrix)
+        turns[turnOffset[node]+from*getDegree(node)+to]=float(cost);
+    else
+        sparseTurns[turnKey(node,from,to)]=float(cost);
+}
+
+void RoutingGraph::setTravelTime(size_t road, double time)
+{
+    if (road>=travelTime.size())
+        throw road_address_exception(road,travelTime.size());
+    if (!(time>0))
+        throw TrafficSimulation_error("Travel time of road "+std::to_string(road)+" must be positive");
+    travelTime[road]=time;
+}
+
+void RoutingGraph::toBinary(std::string& out) const
+{
+    using namespace BinaryIO;
+    putVarint(out,matrixRoads);
+    putVector(out,firstEdge);
+    putVector(out,edges);
+    putVector(out,travelTime);
+    putVector(out,freeFlowTime);
+    putVector(out,length);
+    putVector(out,roadStart);
+    putVector(out,roadEnd);
+    putVector(out,oneWay);
+    putVector(out,chainFirst);
+    putVector(out,chainRoads);
+    putVector(out,chainOfRoad);
+    putVector(out,originalNode);
+    putVector(out,compressedNode);
+    putVector(out,firstSlot);
+    putVector(out,slotRoad);
+    putVector(out,slotX);
+    putVector(out,slotY);
+    putVector(out,plainNode);
+    putVector(out,tailSlot);
+    putVector(out,headSlot);
+    putVector(out,turnOffset);
+    putVector(out,turns);
+    //In key order, so the same graph is always the same bytes
+    std::vector<std::pair<uint64_t,float> > sparse(sparseTurns.begin(),sparseTurns.end());
+    std::sort(sparse.begin(),sparse.end());
+    putVarint(out,sparse.size());
+    for (const auto& [key,cost] : sparse)
+    {
+        put<uint64_t>(out,key);
+        put<float>(out,cost);
+    }
+}
+
+RoutingGraph RoutingGraph::fromBinary(const std::string& in)
+{
+    using namespace BinaryIO;
+    const char* p=in.data();
+    const char* end=p+in.size();
+    RoutingGraph G;
+    G.matrixRoads=getVarint(p,end);
+    G.firstEdge=getVector<uint32_t>(p,end);
+    G.edges=getVector<RoutingEdge>(p,end);
+    G.travelTime=getVector<double>(p,end);
+    G.freeFlowTime=getVector<double>(p,end);
+    G.length=getVector<double>(p,end);
+    G.roadStart=getVector<uint32_t>(p,end);
+    G.roadEnd=getVector<uint32_t>(p,end);
+    G.oneWay=getVector<uint8_t>(p,end);
+    G.chainFirst=getVector<uint32_t>(p,end);
+    G.chainRoads=getVector<uint32_t>(p,end);
+    G.chainOfRoad=getVector<uint32_t>(p,end);
+    G.originalNode=getVector<uint32_t>(p,end);
+    G.compressedNode=getVector<uint32_t>(p,end);
+    G.firstSlot=getVector<uint32_t>(p,end);
+    G.slotRoad=getVector<uint32_t>(p,end);
+    G.slotX=getVector<float>(p,end);
+    G.slotY=getVector<float>(p,end);
+    G.plainNode=getVector<uint8_t>(p,end);
+    G.tailSlot=getVector<uint16_t>(p,end);
+    G.headSlot=getVector<uint16_t>(p,end);
+    G.turnOffset=getVector<uint32_t>(p,end);
+    G.turns=getVector<float>(p,end);
+    size_t sparse=getVarint(p,end);
+    for (size_t i = 0; i < sparse; ++i)
+    {
+        uint64_t key=get<uint64_t>(p,end);
+        G.sparseTurns[key]=get<float>(p,end);
+    }
+    if (p!=end)
+        throw file_format_exception("routing graph followed by "+std::to_string(end-p)+" more bytes");
+
+    //Enough to not read out of bounds when searching, the rest is trusted to the checksum of the cache
+    size_t nodes=G.firstEdge.size()-1;
+    size_t roads=G.travelTime.size();
+    bool good=!G.firstEdge.empty() && G.firstEdge.back()==G.edges.size() && G.firstSlot.size()==nodes+1 && G.firstSlot.back()==G.slotRoad.size()
+        && G.freeFlowTime.size()==roads && G.length.size()==roads && G.roadStart.size()==roads && G.roadEnd.size()==roads && G.oneWay.size()==roads
+        && G.slotX.size()==G.slotRoad.size() && G.slotY.size()==G.slotRoad.size() && G.tailSlot.size()==G.edges.size() && G.headSlot.size()==G.edges.size() && G.turnOffset.size()==nodes && G.plainNode.size()==nodes;
+    for (size_t n = 0; good && n < nodes; ++n)
+        good=G.firstEdge[n]<=G.firstEdge[n+1] && G.firstSlot[n]<=G.firstSlot[n+1]
+            && (G.turnOffset[n]==noMatrix || G.turnOffset[n]+G.getDegree(n)*G.getDegree(n)<=G.turns.size());
+    for (size_t e = 0; good && e < G.edges.size(); ++e)
+        good=G.edges[e].to<nodes && G.edges[e].road<roads;
+    if (!good)
+        throw file_format_exception("routing graph arrays do not fit together");
+
+    G.findComponents();
+    return G;
+}
@@ -0,0 +1,331 @@
+#include "SpatialIndex.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include "Road.hpp"
+#include "Node.hpp"
+#include "ICityNetwork.hpp"
+#include "TrafficExceptions.hpp"
+#include "BinaryIO.hpp"
+
+//Does the segment from a to b pass through the box? (Liang-Barsky, clip the segment to each side in turn)
+static bool segmentInBox(double ax, double ay, double bx, double by, const KeyframeBox& Box) noexcept
+{
+    double t0=0;
+    double t1=1;
+    double dx=bx-ax;
+    double dy=by-ay;
+    //Each side as p*t<=q
+    const double p[4]={-dx,dx,-dy,dy};
+    const double q[4]={ax-Box.minX,Box.maxX-ax,ay-Box.minY,Box.maxY-ay};
+    for (size_t i = 0; i < 4; ++i)
+    {
+        if (p[i]==0)
+        {
+            if (q[i]<0)
+                return false;//Parallel to the side, and outside it
+            continue;
+        }
+        double t=q[i]/p[i];
+        if (p[i]<0)
+            t0=std::max(t0,t);
+        else
+            t1=std::min(t1,t);
+        if (t0>t1)
+            return false;
+    }
+    return true;
+}
+
+SpatialIndex::SpatialIndex(ICityNetwork& City, double _cellSize):cellSize(_cellSize)
+{
+    if (!(cellSize>=0))
+        throw TrafficSimulation_error("Spatial index cell size must not be negative");
+    size_t nodes=City.getNodesSize();
+    size_t roads=City.getRoadsSize();
+    if (nodes>=UINT32_MAX || roads>=UINT32_MAX)
+        throw TrafficSimulation_error("City too large for the spatial index");
+
+    double maxX=0;
+    double maxY=0;
+    for (size_t n = 0; n < nodes; ++n)
+    {
+        std::shared_ptr<Node> N=City.getNode(n);
+        nodeX.push_back(N->getX());
+        nodeY.push_back(N->getY());
+        if (n==0)
+        {
+            originX=maxX=N->getX();
+            originY=maxY=N->getY();
+        }
+        originX=std::min(originX,N->getX());
+        originY=std::min(originY,N->getY());
+        maxX=std::max(maxX,N->getX());
+        maxY=std::max(maxY,N->getY());
+    }
+
+    //About one node per cell, and never so many cells that the empty ones are most of the memory
+    double extent=std::max({maxX-originX,maxY-originY,1.0});
+    if (cellSize==0)
+        cellSize=extent/std::max(1.0,std::ceil(std::sqrt(double(nodes))));
+    while (true)
+    {
+        cellsX=size_t((maxX-originX)/cellSize)+1;
+        cellsY=size_t((maxY-originY)/cellSize)+1;
+        if (cellsX*cellsY<=4*(nodes+roads)+16)
+            break;
+        cellSize*=2;
+    }
+
+    size_t cells=cellsX*cellsY;
+    firstNode.assign(cells+1,0);
+    for (size_t n = 0; n < nodes; ++n)
+        ++firstNode[cellY(nodeY[n])*cellsX+cellX(nodeX[n])+1];
+    for (size_t c = 0; c < cells; ++c)
+        firstNode[c+1]+=firstNode[c];
+    cellNodes.resize(nodes);
+    std::vector<uint32_t> next(firstNode.begin(),firstNode.end()-1);
+    for (size_t n = 0; n < nodes; ++n)
+        cellNodes[next[cellY(nodeY[n])*cellsX+cellX(nodeX[n])]++]=n;
+
+    firstRoad.assign(cells+1,0);
+    for (size_t r = 0; r < roads; ++r)
+    {
+        std::shared_ptr<Road> R=City.getRoad(r);
+        Segment S;
+        S.ax=R->getStart().getX();
+        S.ay=R->getStart().getY();
+        S.bx=R->getEnd().getX();
+        S.by=R->getEnd().getY();
+        S.cx0=cellX(std::min(S.ax,S.bx));
+        S.cy0=cellY(std::min(S.ay,S.by));
+        S.cx1=cellX(std::max(S.ax,S.bx));
+        S.cy1=cellY(std::max(S.ay,S.by));
+        segments.push_back(S);
+        for (size_t y = S.cy0; y <= S.cy1; ++y)
+            for (size_t x = S.cx0; x <= S.cx1; ++x)
+                ++firstRoad[y*cellsX+x+1];
+    }
+    for (size_t c = 0; c < cells; ++c)
+        firstRoad[c+1]+=firstRoad[c];
+    cellRoads.resize(firstRoad[cells]);
+    next.assign(firstRoad.begin(),firstRoad.end()-1);
+    for (size_t r = 0; r < roads; ++r)
+    {
+        const Segment& S=segments[r];
+        for (size_t y = S.cy0; y <= S.cy1; ++y)
+            for (size_t x = S.cx0; x <= S.cx1; ++x)
+                cellRoads[next[y*cellsX+x]++]=r;
+    }
+}
+
+size_t SpatialIndex::cellX(double x) const noexcept
+{
+    double f=(x-originX)/cellSize;
+    if (!(f>0))//Also catches NaN
+        return 0;
+    return std::min(size_t(f),cellsX-1);
+}
+
+size_t SpatialIndex::cellY(double y) const noexcept
+{
+    double f=(y-originY)/cellSize;
+    if (!(f>0))
+        return 0;
+    return std::min(size_t(f),cellsY-1);
+}
+
+SpatialHit SpatialIndex::closestOnRoad(size_t road, double x, double y) const noexcept
+{
+    const Segment& S=segments[road];
+    double dx=S.bx-S.ax;
+    double dy=S.by-S.ay;
+    double length2=dx*dx+dy*dy;
+    double f=length2>0 ? std::clamp(((x-S.ax)*dx+(y-S.ay)*dy)/length2,0.0,1.0) : 0;
+
+    SpatialHit H;
+    H.id=road;
+    H.x=S.ax+f*dx;
+    H.y=S.ay+f*dy;
+    H.along=f;
+    H.distance=std::hypot(x-H.x,y-H.y);
+    return H;
+}
+
+template<bool Roads>
+size_t SpatialIndex::nearest(double x, double y, SpatialHit* out, size_t k) const noexcept
+{
+    if (k==0)
+        return 0;
+    size_t found=0;
+
+    //Keep out sorted, closest first, with at most k
+    auto offer = [&](const SpatialHit& H)
+    {
+        if (found==k && !(H.distance<out[k-1].distance))
+            return;
+        if (Roads)//Roads are in more than one cell, but should only be found once
+            for (size_t i = 0; i < found; ++i)
+                if (out[i].id==H.id)
+                    return;
+        size_t i=found<k ? found++ : k-1;
+        for (; i>0 && H.distance<out[i-1].distance; --i)
+            out[i]=out[i-1];
+        out[i]=H;
+    };
+
+    long cx=cellX(x);
+    long cy=cellY(y);
+    for (long ring = 0; ; ++ring)
+    {
+        //The cells at the edge of the square ring cells out from the middle
+        for (long gy = cy-ring; gy <= cy+ring; ++gy)
+        {
+            if (gy<0 || gy>=long(cellsY))
+                continue;
+            bool edgeRow=gy==cy-ring || gy==cy+ring;
+            for (long gx = cx-ring; gx <= cx+ring; gx+=(edgeRow || ring==0 ? 1 : 2*ring))
+            {
+                if (gx<0 || gx>=long(cellsX))
+                    continue;
+                size_t c=gy*cellsX+gx;
+                if (Roads)
+                    for (size_t i = firstRoad[c]; i < firstRoad[c+1]; ++i)
+                        offer(closestOnRoad(cellRoads[i],x,y));
+                else
+                    for (size_t i = firstNode[c]; i < firstNode[c+1]; ++i)
+                    {
+                        SpatialHit H;
+                        H.id=cellNodes[i];
+                        H.x=nodeX[H.id];
+                        H.y=nodeY[H.id];
+                        H.distance=std::hypot(x-H.x,y-H.y);
+                        offer(H);
+                    }
+            }
+        }
+
+        //Done when we have looked everywhere
+        if (cx-ring<=0 && cy-ring<=0 && cx+ring>=long(cellsX)-1 && cy+ring>=long(cellsY)-1)
+            break;
+        //Or anything we have not looked at is further away than what we have
+        double bound=std::min({x-(originX+(cx-ring)*cellSize),originX+(cx+ring+1)*cellSize-x,y-(originY+(cy-ring)*cellSize),originY+(cy+ring+1)*cellSize-y});
+        if (found==k && out[k-1].distance<=bound)
+            break;
+    }
+    return found;
+}
+
+size_t SpatialIndex::nearestNodes(double x, double y, SpatialHit* out, size_t k) const noexcept
+{
+    return nearest<false>(x,y,out,k);
+}
+
+size_t SpatialIndex::nearestRoads(double x, double y, SpatialHit* out, size_t k) const noexcept
+{
+    return nearest<true>(x,y,out,k);
+}
+
+size_t SpatialIndex::nodesIn(const KeyframeBox& Box, size_t* out, size_t capacity) const noexcept
+{
+    size_t count=0;
+    for (size_t y = cellY(Box.minY); y <= cellY(Box.maxY); ++y)
+        for (size_t x = cellX(Box.minX); x <= cellX(Box.maxX); ++x)
+        {
+            size_t c=y*cellsX+x;
+            for (size_t i = firstNode[c]; i < firstNode[c+1]; ++i)
+            {
+                size_t n=cellNodes[i];
+                if (nodeX[n]>=Box.minX && nodeX[n]<=Box.maxX && nodeY[n]>=Box.minY && nodeY[n]<=Box.maxY)
+                {
+                    if (count<capacity)
+                        out[count]=n;
+                    ++count;
+                }
+            }
+        }
+    return count;
+}
+
+size_t SpatialIndex::roadsIn(const KeyframeBox& Box, size_t* out, size_t capacity) const noexcept
+{
+    size_t count=0;
+    size_t qx0=cellX(Box.minX);
+    size_t qy0=cellY(Box.minY);
+    for (size_t y = qy0; y <= cellY(Box.maxY); ++y)
+        for (size_t x = qx0; x <= cellX(Box.maxX); ++x)
+        {
+            size_t c=y*cellsX+x;
+            for (size_t i = firstRoad[c]; i < firstRoad[c+1]; ++i)
+            {
+                size_t r=cellRoads[i];
+                const Segment& S=segments[r];
+                //A road in more than one of the cells is only looked at in the first of them
+                if (x!=std::max<size_t>(S.cx0,qx0) || y!=std::max<size_t>(S.cy0,qy0))
+                    continue;
+                if (segmentInBox(S.ax,S.ay,S.bx,S.by,Box))
+                {
+                    if (count<capacity)
+                        out[count]=r;
+                    ++count;
+                }
+            }
+        }
+    return count;
+}
+
+void SpatialIndex::toBinary(std::string& out) const
+{
+    using namespace BinaryIO;
+    put<double>(out,originX);
+    put<double>(out,originY);
+    put<double>(out,cellSize);
+    putVarint(out,cellsX);
+    putVarint(out,cellsY);
+    putVector(out,firstNode);
+    putVector(out,cellNodes);
+    putVector(out,firstRoad);
+    putVector(out,cellRoads);
+    putVector(out,nodeX);
+    putVector(out,nodeY);
+    putVector(out,segments);
+}
+
+SpatialIndex SpatialIndex::fromBinary(const std::string& in)
+{
+    using namespace BinaryIO;
+    const char* p=in.data();
+    const char* end=p+in.size();
+    SpatialIndex I;
+    I.originX=get<double>(p,end);
+    I.originY=get<double>(p,end);
+    I.cellSize=get<double>(p,end);
+    I.cellsX=getVarint(p,end);
+    I.cellsY=getVarint(p,end);
+    I.firstNode=getVector<uint32_t>(p,end);
+    I.cellNodes=getVector<uint32_t>(p,end);
+    I.firstRoad=getVector<uint32_t>(p,end);
+    I.cellRoads=getVector<uint32_t>(p,end);
+    I.nodeX=getVector<double>(p,end);
+    I.nodeY=getVector<double>(p,end);
+    I.segments=getVector<Segment>(p,end);
+    if (p!=end)
+        throw file_format_exception("spatial index followed by "+std::to_string(end-p)+" more bytes");
+
+    //Enough to not read out of bounds when querying
+    size_t cells=I.cellsX*I.cellsY;
+    bool good=I.cellSize>0 && I.cellsX>0 && I.cellsY>0 && cells/I.cellsX==I.cellsY && I.firstNode.size()==cells+1 && I.firstRoad.size()==cells+1
+        && I.firstNode.back()==I.cellNodes.size() && I.firstRoad.back()==I.cellRoads.size() && I.nodeX.size()==I.nodeY.size();
+    for (size_t c = 0; good && c < cells; ++c)
+        good=I.firstNode[c]<=I.firstNode[c+1] && I.firstRoad[c]<=I.firstRoad[c+1];
+    for (uint32_t n : I.cellNodes)
+        good=good && n<I.nodeX.size();
+    for (uint32_t r : I.cellRoads)
+        good=good && r<I.segments.size();
+    for (const Segment& S : I.segments)
+        good=good && S.cx1<I.cellsX && S.cy1<I.cellsY && S.cx0<=S.cx1 && S.cy0<=S.cy1;
+    if (!good)
+        throw file_format_exception("spatial index arrays do not fit together");
+    return I;
+}
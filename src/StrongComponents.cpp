@@ -0,0 +1,117 @@
+#include "StrongComponents.hpp"
+
+#include <algorithm>
+
+#include "TrafficExceptions.hpp"
+
+StrongComponents::StrongComponents(const std::vector<uint32_t>& first, const std::vector<uint32_t>& to)
+{
+    if (first.empty() || first.back()!=to.size())
+        throw TrafficSimulation_error("Strong components need one more edge offset than there are nodes, and the last must be the number of edges");
+    size_t nodes=first.size()-1;
+    const uint32_t none=UINT32_MAX;
+
+    //Tarjan: index is the order the depth first search got to the node, low the lowest index it can get back to. A node which has been visited but has no component yet is on the stack
+    std::vector<uint32_t> index(nodes,none);
+    std::vector<uint32_t> low(nodes);
+    component.assign(nodes,none);
+    std::vector<uint32_t> stack;
+    //Instead of recursion, the nodes we are in the middle of, and the next of their roads to look at
+    std::vector<std::pair<uint32_t,uint32_t> > calls;
+    uint32_t counter=0;
+
+    for (size_t root = 0; root < nodes; ++root)
+    {
+        if (index[root]!=none)
+            continue;
+        index[root]=low[root]=counter++;
+        stack.push_back(root);
+        calls.push_back({uint32_t(root),first[root]});
+
+        while (!calls.empty())
+        {
+            uint32_t v=calls.back().first;
+            uint32_t e=calls.back().second;
+            if (e<first[v+1])
+            {
+                ++calls.back().second;
+                uint32_t w=to[e];
+                if (index[w]==none)
+                {
+                    index[w]=low[w]=counter++;
+                    stack.push_back(w);
+                    calls.push_back({w,first[w]});
+                }
+                else if (component[w]==none)
+                    low[v]=std::min(low[v],index[w]);
+                continue;
+            }
+
+            //Done with v, if nothing below it got further back, it and everything above it on the stack is a component
+            calls.pop_back();
+            if (low[v]==index[v])
+            {
+                uint32_t c=size.size();
+                uint32_t members=0;
+                uint32_t w;
+                do
+                {
+                    w=stack.back();
+                    stack.pop_back();
+                    component[w]=c;
+                    ++members;
+                } while (w!=v);
+                size.push_back(members);
+            }
+            if (!calls.empty())
+            {
+                uint32_t parent=calls.back().first;
+                low[parent]=std::min(low[parent],low[v]);
+            }
+        }
+    }
+
+    //Which components have roads in and out, and the pieces (union find over the roads, ignoring directions)
+    size_t components=size.size();
+    flags.assign(components,0);
+    std::vector<uint32_t> parent(components);
+    for (size_t c = 0; c < components; ++c)
+        parent[c]=c;
+    auto find = [&parent](uint32_t c)
+    {
+        while (parent[c]!=c)
+        {
+            parent[c]=parent[parent[c]];
+            c=parent[c];
+        }
+        return c;
+    };
+    for (size_t n = 0; n < nodes; ++n)
+        for (size_t e = first[n]; e < first[n+1]; ++e)
+        {
+            uint32_t a=component[n];
+            uint32_t b=component[to[e]];
+            if (a==b)
+                continue;
+            flags[a]|=left;
+            flags[b]|=entered;
+            a=find(a);
+            b=find(b);
+            if (a!=b)
+                parent[std::max(a,b)]=std::min(a,b);
+        }
+
+    piece.assign(components,none);
+    std::vector<uint32_t> pieceOfRoot(components,none);
+    for (size_t c = 0; c < components; ++c)
+    {
+        uint32_t r=find(c);
+        if (pieceOfRoot[r]==none)
+            pieceOfRoot[r]=pieces++;
+        piece[c]=pieceOfRoot[r];
+    }
+
+    for (size_t c = 1; c < components; ++c)
+        if (size[c]>size[largest])
+            largest=c;
+}
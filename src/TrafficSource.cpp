@@ -0,0 +1,140 @@
+#include "TrafficSource.hpp"
+
+#include <cmath>
+#include <algorithm>
+#include <string>
+
+#include "TrafficExceptions.hpp"
+#include "BinaryIO.hpp"
+
+#define secondsPerHour 3600.0
+
+TrafficSource::TrafficSource(size_t _nodeID, const TrafficSourceConfig& _config, double _windowLength, uint64_t _streamKey):nodeID(_nodeID),streamKey(_streamKey==UINT64_MAX ? _nodeID : _streamKey),config(_config),windowLength(_windowLength),generator(CounterRNG(0),streamKey,0,trafficSource)
+{
+    if (!(config.rate>=0))
+        throw TrafficSimulation_error("Traffic source at Node "+std::to_string(nodeID)+" has negative rate");
+    for (double f : config.profile)
+        if (!(f>=0))
+            throw TrafficSimulation_error("Traffic source at Node "+std::to_string(nodeID)+" has negative profile factor");
+    if (!(windowLength>0))
+        throw TrafficSimulation_error("Traffic source window length must be positive");
+}
+
+TrafficSourceConfig TrafficSource::loadConfig(const Json::Value& SourceJson, const Json::Value& Profiles)
+{
+    TrafficSourceConfig out;
+    try
+    {
+        out.rate=SourceJson.get("rate",0.0).asDouble();
+        if (SourceJson.isMember("profile"))
+        {
+            const Json::Value* Profile=&SourceJson["profile"];
+            //Many sources can share one named profile, instead of repeating it
+            if (Profile->isString())
+            {
+                std::string name=Profile->asString();
+                if (!Profiles.isObject() || !Profiles.isMember(name))
+                    throw TrafficSimulation_error("Error loading traffic source; No profile named \""+name+"\"");
+                Profile=&Profiles[name];
+            }
+            for (const Json::Value& F : *Profile)
+                out.profile.push_back(F.asDouble());
+        }
+    }
+    catch(Json::Exception& E)
+    {
+        throw TrafficSimulation_error(std::string("Error loading traffic source; Got JSON error: ")+E.what());
+    }
+    return out;
+}
+
+double TrafficSource::rateAt(double time) const noexcept
+{
+    if (config.profile.empty())
+        return config.rate;
+    size_t hour=static_cast<size_t>(std::floor(time/secondsPerHour));
+    return config.rate*config.profile[hour%config.profile.size()];
+}
+
+void TrafficSource::start(EventQueue& Q, double time, uint64_t seed, SpawnHandler H)
+{
+    //A second start would register again, and spawn every vehicle twice
+    if (queue!=nullptr)
+        throw TrafficSimulation_error("Traffic source at Node "+std::to_string(nodeID)+" is already started");
+    generator=RandomStream(CounterRNG(seed),streamKey,0,trafficSource);
+
+    onSpawn=H;
+    queue=&Q;
+    handlerID=Q.registerHandler(this);
+    sampleWindow(time,time+windowLength);
+}
+
+//A Poisson distributed count with this expected value, by the sequential product method. Poisson counts add up, so a busy source is counted in parts, before the product of the uniforms could underflow
+static size_t poissonCount(RandomStream& G, double expected)
+{
+    size_t N=0;
+    while (expected>0)
+    {
+        double part=std::min(expected,500.0);
+        expected-=part;
+        double limit=std::exp(-part);
+        for (double product=G.uniform(); product>limit; product*=G.uniform())
+            ++N;
+    }
+    return N;
+}
+
+void TrafficSource::sampleWindow(double t0, double t1)
+{
+    arrivals.clear();
+
+    //The rate is constant within each hour, so split the window on the hours
+    double a=t0;
+    while (a<t1)
+    {
+        double b=std::min(t1,(std::floor(a/secondsPerHour)+1)*secondsPerHour);
+        double expected=rateAt(a)*(b-a)/secondsPerHour;
+        if (expected>0)
+        {
+            //Straight from the uniforms of the stream, the std distributions use the bits differently in every standard library, and the same seed must give the same vehicles everywhere
+            //Given the number of arrivals in an interval, the arrival times of a Poisson process are independent and uniform
+            size_t N=poissonCount(generator,expected);
+            for (size_t i = 0; i < N; ++i)
+                arrivals.push_back(a+(b-a)*generator.uniform());
+        }
+        a=b;
+    }
+    std::sort(arrivals.begin(),arrivals.end());
+
+    for (double t : arrivals)
+        queue->schedule(t,handlerID,spawn);
+    queue->schedule(t1,handlerID,nextWindow);
+}
+
+void TrafficSource::handleEvent(double time, int kind, uint64_t /*arg*/)
+{
+    if (kind==spawn)
+    {
+        if (onSpawn)
+            onSpawn(time,nodeID);
+    }
+    else if (kind==nextWindow)
+        sampleWindow(time,time+windowLength);
+}
+
+void TrafficSource::saveState(std::string& out) const
+{
+    BinaryIO::putVarint(out,queue!=nullptr);
+    BinaryIO::putVarint(out,handlerID);
+    BinaryIO::putVarint(out,generator.getIndex());
+}
+
+void TrafficSource::loadState(const char*& p, const char* end)
+{
+    bool started=BinaryIO::getVarint(p,end);
+    uint64_t handler=BinaryIO::getVarint(p,end);
+    uint64_t index=BinaryIO::getVarint(p,end);
+    if (started!=(queue!=nullptr) || handler!=handlerID)
+        throw file_format_exception("traffic source at Node "+std::to_string(nodeID)+" was not started the same way as the saved one");
+    generator.setIndex(index);
+}
@@ -0,0 +1,219 @@
+#include "Trafficlight.hpp"
+
+#include <cmath>
+#include <algorithm>
+
+#include "TrafficExceptions.hpp"
+#include "BinaryIO.hpp"
+
+#include "Road.hpp"
+
+//Default length of a phase, if the city file does not say otherwise
+#define defaultPhaseDuration 30.0
+
+std::vector<SignalPhase> Trafficlight::loadPhases(const Json::Value& NodeJson)
+{
+    std::vector<SignalPhase> out;
+    if (!NodeJson.isMember("phases"))
+        return out;
+
+    try
+    {
+        for (const Json::Value& P : NodeJson["phases"])
+        {
+            SignalPhase Phase;
+            Phase.duration=P.get("duration",defaultPhaseDuration).asDouble();
+            if (!(Phase.duration>0))
+                throw TrafficSimulation_error("Error loading Trafficlight; phase duration must be positive");
+            if (!P.isMember("green"))
+                throw TrafficSimulation_error("Error loading Trafficlight; phase without \"green\" roads");
+            for (const Json::Value& G : P["green"])
+                Phase.green.push_back(G.asLargestUInt());
+            out.push_back(Phase);
+        }
+    }
+    catch(Json::Exception& E)
+    {
+        throw TrafficSimulation_error(std::string("Error loading Trafficlight; Got JSON error: ")+E.what());
+    }
+    return out;
+}
+
+void Trafficlight::defaultPhases()
+{
+    SignalPhase EastWest{{},defaultPhaseDuration};
+    SignalPhase NorthSouth{{},defaultPhaseDuration};
+
+    for (size_t i = 0; i < getRoadNumber(); ++i)
+    {
+        const Node& N=getNeighbour(i,true);
+        double dx=std::abs(N.getX()-getX());
+        double dy=std::abs(N.getY()-getY());
+        if (dx>=dy)
+            EastWest.green.push_back(i);
+        else
+            NorthSouth.green.push_back(i);
+    }
+
+    if (!EastWest.green.empty())
+        phases.push_back(EastWest);
+    if (!NorthSouth.green.empty())
+        phases.push_back(NorthSouth);
+    defaulted=true;
+}
+
+void Trafficlight::addRoad(const Road *R)
+{
+    Intersection::addRoad(R);
+    if (defaulted)
+    {
+        phases.clear();
+        defaulted=false;
+    }
+}
+
+void Trafficlight::removeRoad(const Road *R)
+{
+    Intersection::removeRoad(R);
+    if (defaulted)
+    {
+        phases.clear();
+        defaulted=false;
+    }
+}
+
+void Trafficlight::start(EventQueue& Q, double time)
+{
+    //A second start would register again, and leave a second chain of phase changes running
+    if (queue!=nullptr)
+        throw TrafficSimulation_error("Trafficlight at Node "+std::to_string(getNodeID())+" is already started");
+    if (phases.empty())
+        defaultPhases();
+    if (phases.empty())
+        throw TrafficSimulation_error("Trafficlight at Node "+std::to_string(getNodeID())+" has no roads to signal");
+
+    for (const SignalPhase& P : phases)
+        for (size_t i : P.green)
+            if (i>=getRoadNumber())
+                throw road_address_exception(i,getRoadNumber(),getNodeID());
+
+    greenNow.assign(getRoadNumber(),false);
+    stopped.resize(getRoadNumber());
+
+    queue=&Q;
+    handlerID=Q.registerHandler(this);
+
+    currentPhase=0;
+    enterPhase(0,time);
+    Q.schedule(time+phases[0].duration,handlerID,phaseChange);
+}
+
+void Trafficlight::enterPhase(size_t i, double time)
+{
+    std::fill(greenNow.begin(),greenNow.end(),false);
+    for (size_t r : phases[i].green)
+    {
+        greenNow[r]=true;
+        if (!stopped[r].empty())
+        {
+            if (onRelease)
+                onRelease(time,r,stopped[r]);
+            stopped[r].clear();
+        }
+    }
+}
+
+bool Trafficlight::arrive(size_t localRoad, uint64_t vehicle)
+{
+    if (localRoad>=getRoadNumber())
+        throw road_address_exception(localRoad,getRoadNumber(),getNodeID());
+
+    //Not started yet, nothing is stopping anyone
+    if (greenNow.empty() || greenNow[localRoad])
+        return true;
+
+    stopped[localRoad].push_back(vehicle);
+    return false;
+}
+
+void Trafficlight::handleEvent(double time, int kind, uint64_t /*arg*/)
+{
+    if (kind!=phaseChange)
+        return;
+
+    currentPhase=(currentPhase+1)%phases.size();
+    enterPhase(currentPhase,time);
+    queue->schedule(time+phases[currentPhase].duration,handlerID,phaseChange);
+}
+
+void Trafficlight::saveState(std::string& out) const
+{
+    using namespace BinaryIO;
+    Intersection::saveState(out);
+    putVarint(out,queue!=nullptr);
+    putVarint(out,handlerID);
+    putVarint(out,currentPhase);
+    //The phases too, default phases are made from the roads at start, and the roads may have been edited since
+    putVarint(out,phases.size());
+    for (const SignalPhase& P : phases)
+    {
+        put<double>(out,P.duration);
+        putVarint(out,P.green.size());
+        for (size_t r : P.green)
+            putVarint(out,r);
+    }
+    putVarint(out,defaulted);
+    putVarint(out,greenNow.size());
+    for (bool g : greenNow)
+        putVarint(out,g);
+    putVarint(out,stopped.size());
+    for (const std::vector<uint64_t>& S : stopped)
+    {
+        putVarint(out,S.size());
+        for (uint64_t v : S)
+            putVarint(out,v);
+    }
+}
+
+void Trafficlight::loadState(const char*& p, const char* end)
+{
+    using namespace BinaryIO;
+    Intersection::loadState(p,end);
+    bool started=getVarint(p,end);
+    uint64_t handler=getVarint(p,end);
+    if (started!=(queue!=nullptr) || handler!=handlerID)
+        throw file_format_exception("Trafficlight at Node "+std::to_string(getNodeID())+" was not started the same way as the saved one");
+
+    size_t phase=getVarint(p,end);
+    std::vector<SignalPhase> P(getVarint(p,end));
+    for (SignalPhase& S : P)
+    {
+        S.duration=get<double>(p,end);
+        S.green.resize(getVarint(p,end));
+        for (size_t& r : S.green)
+        {
+            r=getVarint(p,end);
+            if (r>=getRoadNumber())
+                throw file_format_exception("Trafficlight at Node "+std::to_string(getNodeID())+" saved with a phase for local road "+std::to_string(r));
+        }
+    }
+    bool D=getVarint(p,end);
+    std::vector<bool> G(getVarint(p,end));
+    for (size_t i = 0; i < G.size(); ++i)
+        G[i]=getVarint(p,end);
+    std::vector<std::vector<uint64_t> > S(getVarint(p,end));
+    for (std::vector<uint64_t>& V : S)
+    {
+        V.resize(getVarint(p,end));
+        for (uint64_t& v : V)
+            v=getVarint(p,end);
+    }
+    if ((started && phase>=P.size()) || G.size()>getRoadNumber() || S.size()>getRoadNumber())
+        throw file_format_exception("Trafficlight at Node "+std::to_string(getNodeID())+" saved with more roads or phases than it has");
+
+    currentPhase=phase;
+    phases=std::move(P);
+    defaulted=D;
+    greenNow=std::move(G);
+    stopped=std::move(S);
+}
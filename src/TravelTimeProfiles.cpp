@@ -0,0 +1,76 @@
+#include "TravelTimeProfiles.hpp"
+
+#include <algorithm>
+
+#include "RoutingGraph.hpp"
+#include "RoadStatisticsReader.hpp"
+#include "TrafficExceptions.hpp"
+
+TravelTimeProfiles::TravelTimeProfiles(const RoutingGraph& G, size_t _points, double _dayLength):roads(G.getRoadNumber()),points(_points),dayLength(_dayLength)
+{
+    if (points==0)
+        throw TrafficSimulation_error("Travel time profiles need at least one point");
+    if (!(dayLength>0))
+        throw TrafficSimulation_error("Travel time profiles need a positive day length");
+    step=dayLength/points;
+
+    times.resize(roads*points);
+    for (size_t r = 0; r < roads; ++r)
+        std::fill(times.begin()+r*points,times.begin()+(r+1)*points,G.getFreeFlowTime(r));
+}
+
+void TravelTimeProfiles::makeFIFO(size_t road)
+{
+    //Arriving at point k+1 must not be earlier than arriving at point k, that is P[k+1]+step>=P[k]. Twice around the day, so we start over again from the slowest point, whichever it is
+    double* P=times.data()+road*points;
+    for (size_t i = 0; i < 2*points; ++i)
+    {
+        size_t k=i%points;
+        size_t next=(k+1)%points;
+        P[next]=std::max(P[next],P[k]-step);
+    }
+}
+
+void TravelTimeProfiles::setProfile(size_t road, const std::vector<double>& profile)
+{
+    if (road>=roads)
+        throw road_address_exception(road,roads);
+    if (profile.size()!=points)
+        throw TrafficSimulation_error("Travel time profile of road "+std::to_string(road)+" has "+std::to_string(profile.size())+" points, should have "+std::to_string(points));
+    for (double t : profile)
+        if (!(t>0))
+            throw TrafficSimulation_error("Travel time profile of road "+std::to_string(road)+" has a time which is not positive");
+
+    std::copy(profile.begin(),profile.end(),times.begin()+road*points);
+    makeFIFO(road);
+}
+
+void TravelTimeProfiles::loadStatistics(RoadStatisticsReader& Reader, const RoutingGraph& G)
+{
+    if (Reader.getRoadNumber()!=roads || G.getRoadNumber()!=roads)
+        throw TrafficSimulation_error("Road statistics for "+std::to_string(Reader.getRoadNumber())+" roads, but the city has "+std::to_string(roads));
+    if (std::abs(Reader.getHourLength()-step)>1e-6*step)
+        throw TrafficSimulation_error("Road statistics hours are "+std::to_string(Reader.getHourLength())+" s, but the profiles have a point every "+std::to_string(step)+" s");
+
+    std::vector<RoadStatisticsRecord> hour;
+    while (Reader.nextHour(hour))
+    {
+        //The point in the middle of this hour
+        double x=std::round(Reader.getHourStart()/step);
+        size_t k=size_t(x-std::floor(x/points)*points);
+        for (size_t r = 0; r < roads; ++r)
+        {
+            const RoadStatisticsRecord& R=hour[r];
+            double free=G.getFreeFlowTime(r);
+            double t=free;
+            if (R.travelTime.getTotal()>0)
+                t=R.travelTime.quantile(0.5);
+            else if (R.averageSpeed()>0)
+                t=G.getLength(r)/R.averageSpeed();
+            times[r*points+k]=std::max(t,free);
+        }
+    }
+
+    for (size_t r = 0; r < roads; ++r)
+        makeFIFO(r);
+}
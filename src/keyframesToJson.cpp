@@ -0,0 +1,35 @@
+#include<iostream>
+#include<fstream>
+#include"KeyframeReader.hpp"
+#include"TrafficExceptions.hpp"
+
+using std::cout, std::cerr, std::endl;
+
+//Convert a binary keyframe file to the JSON keyframe file the Processing animator reads, only sensible for small debug runs
+int main(int argc, char* argv[])
+{
+    if (argc != 3)
+    {
+        cout<<"Need: "<<argv[0]<<" input_keyframe_file output_json_file"<<endl;
+        return 1;
+    }
+
+    try
+    {
+        std::ifstream In(argv[1],std::ios::binary);
+        if (!In)
+            throw TrafficSimulation_error(std::string("Could not open ")+argv[1]);
+        std::ofstream Out(argv[2]);
+        if (!Out)
+            throw TrafficSimulation_error(std::string("Could not open ")+argv[2]);
+
+        KeyframeReader Reader(In);
+        Reader.writeJson(Out);
+    }
+    catch(TrafficSimulation_error& E)
+    {
+        cerr<<E.what()<<endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,62 @@
+#include<iostream>
+#include<fstream>
+#include<string>
+#include<vector>
+#include"RoadStatisticsReader.hpp"
+#include"TrafficExceptions.hpp"
+
+using std::cout, std::cerr, std::endl;
+
+//Print the statistics of every used road (or just one road) for every hour, with the percentiles of the speed (m/s) and travel time (s), as tab separated columns
+int main(int argc, char* argv[])
+{
+    if (argc != 2 && argc != 3)
+    {
+        cout<<"Need: "<<argv[0]<<" input_statistics_file [road_id]"<<endl;
+        return 1;
+    }
+
+    try
+    {
+        std::ifstream In(argv[1],std::ios::binary);
+        if (!In)
+            throw TrafficSimulation_error(std::string("Could not open ")+argv[1]);
+
+        RoadStatisticsReader Reader(In);
+        size_t first=0;
+        size_t last=Reader.getRoadNumber();
+        bool onlyOne=argc==3;
+        if (onlyOne)
+        {
+            first=std::stoul(argv[2]);
+            if (first>=Reader.getRoadNumber())
+                throw TrafficSimulation_error("Road "+std::to_string(first)+" does not exist, the file has "+std::to_string(Reader.getRoadNumber())+" roads");
+            last=first+1;
+        }
+
+        cout<<"hour_start\troad\tentered\tavg_vehicles\tavg_speed\tspeed_p50\tspeed_p90\tspeed_p99\ttime_p50\ttime_p90\ttime_p99\n";
+        std::vector<RoadStatisticsRecord> hour;
+        while (Reader.nextHour(hour))
+            for (size_t r = first; r < last; ++r)
+            {
+                const RoadStatisticsRecord& R=hour[r];
+                //Empty roads are just noise, unless asked for
+                if (!onlyOne && R.entered==0 && R.vehicleSeconds==0)
+                    continue;
+                cout<<Reader.getHourStart()<<'\t'<<r<<'\t'<<R.entered<<'\t'<<R.averageVehicles(Reader.getHourLength())<<'\t'<<R.averageSpeed()
+                    <<'\t'<<R.speed.quantile(0.5)<<'\t'<<R.speed.quantile(0.9)<<'\t'<<R.speed.quantile(0.99)
+                    <<'\t'<<R.travelTime.quantile(0.5)<<'\t'<<R.travelTime.quantile(0.9)<<'\t'<<R.travelTime.quantile(0.99)<<'\n';
+            }
+    }
+    catch(TrafficSimulation_error& E)
+    {
+        cerr<<E.what()<<endl;
+        return 1;
+    }
+    catch(std::logic_error& E)
+    {
+        cerr<<"Bad road ID: "<<E.what()<<endl;
+        return 1;
+    }
+    return 0;
+}
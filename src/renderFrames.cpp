@@ -0,0 +1,77 @@
+#include<iostream>
+#include<fstream>
+#include<string>
+#include<cstdio>
+#include<algorithm>
+#include"CityNetwork.hpp"
+#include"KeyframeReader.hpp"
+#include"FrameRenderer.hpp"
+#include"TrafficExceptions.hpp"
+
+using std::cout, std::cerr, std::endl;
+
+//Draw every frame of a run as numbered PPM images, which can be turned into a video with (for example) ffmpeg -i frame_%06d.ppm
+int main(int argc, char* argv[])
+{
+    if (argc != 4 && argc != 7)
+    {
+        cout<<"Need: "<<argv[0]<<" input_city_file input_keyframe_file output_folder [frames_per_second width height]"<<endl;
+        return 1;
+    }
+
+    try
+    {
+        std::ifstream CityFile(argv[1]);
+        if (!CityFile)
+            throw TrafficSimulation_error(std::string("Could not open ")+argv[1]);
+        std::ifstream In(argv[2],std::ios::binary);
+        if (!In)
+            throw TrafficSimulation_error(std::string("Could not open ")+argv[2]);
+
+        double fps=25;
+        size_t width=1920;
+        size_t height=1080;
+        if (argc==7)
+        {
+            fps=std::stod(argv[4]);
+            width=std::stoul(argv[5]);
+            height=std::stoul(argv[6]);
+            if (!(fps>0))
+                throw TrafficSimulation_error("Frames per second must be positive");
+        }
+
+        CityNetwork City(CityFile);
+        KeyframeReader Reader(In);
+        FrameRenderer Renderer(City,Reader,width,height);
+
+        double end=0;
+        for (size_t i = 0; i < Reader.getVehicleNumber(); ++i)
+            end=std::max(end,Reader.getVehicle(i).lastTime);
+
+        FrameImage Image;
+        size_t frames=size_t(end*fps)+1;
+        for (size_t f = 0; f < frames; ++f)
+        {
+            Renderer.render(f/fps,Image);
+
+            char name[32];
+            std::snprintf(name,sizeof(name),"/frame_%06zu.ppm",f);
+            std::ofstream Out(std::string(argv[3])+name,std::ios::binary);
+            if (!Out)
+                throw TrafficSimulation_error(std::string("Could not open ")+argv[3]+name);
+            Image.writePPM(Out);
+        }
+        cout<<"Wrote "<<frames<<" frames"<<endl;
+    }
+    catch(TrafficSimulation_error& E)
+    {
+        cerr<<E.what()<<endl;
+        return 1;
+    }
+    catch(std::logic_error& E)
+    {
+        cerr<<"Bad number: "<<E.what()<<endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,86 @@
+#include<iostream>
+#include<fstream>
+#include<string>
+#include<algorithm>
+#include<optional>
+#include"CityNetwork.hpp"
+#include"ArtefactCache.hpp"
+#include"RoutingGraph.hpp"
+#include"TrafficExceptions.hpp"
+
+using std::cout, std::cerr, std::endl;
+
+//How much smaller the routing graph of a city gets when the chains of nodes with two roads are collapsed, and which parts of the city are cut off from the rest by one-way roads. With a cache directory, the graphs are read from there if this city was seen before
+int main(int argc, char* argv[])
+{
+    if (argc != 2 && argc != 3)
+    {
+        cout<<"Need: "<<argv[0]<<" input_city_file [cache_directory]"<<endl;
+        return 1;
+    }
+
+    try
+    {
+        std::ifstream CityFile(argv[1]);
+        if (!CityFile)
+            throw TrafficSimulation_error(std::string("Could not open ")+argv[1]);
+
+        std::optional<ArtefactCache> Cache;
+        if (argc==3)
+            Cache.emplace(argv[2]);
+
+        CityNetwork City(CityFile,CityNetwork::fileOrder,1,Cache ? &*Cache : nullptr);
+        std::optional<RoutingGraph> Full;
+        std::optional<RoutingGraph> Compressed;
+        if (Cache)
+        {
+            Full.emplace(Cache->get<RoutingGraph>(City.getContentKey(),"routing-16",[&City](){return RoutingGraph(City);}));
+            Compressed.emplace(Cache->get<RoutingGraph>(City.getContentKey(),"routing-16-compressed",[&Full](){return RoutingGraph::compressChains(*Full);}));
+            cout<<"cache\t"<<Cache->getHits()<<" read, "<<Cache->getMisses()<<" made, in "<<Cache->getDirectory()<<endl;
+        }
+        else
+        {
+            Full.emplace(City);
+            Compressed.emplace(RoutingGraph::compressChains(*Full));
+        }
+
+        auto percent = [](size_t after, size_t before) {return before>0 ? 100.0*(before-after)/before : 0.0;};
+        cout<<"\tfull\tcompressed\treduction"<<endl;
+        cout<<"nodes\t"<<Full->getNodeNumber()<<'\t'<<Compressed->getNodeNumber()<<'\t'<<percent(Compressed->getNodeNumber(),Full->getNodeNumber())<<'%'<<endl;
+        cout<<"roads\t"<<Full->getRoadNumber()<<'\t'<<Compressed->getRoadNumber()<<'\t'<<percent(Compressed->getRoadNumber(),Full->getRoadNumber())<<'%'<<endl;
+        cout<<"edges\t"<<Full->getEdgeNumber()<<'\t'<<Compressed->getEdgeNumber()<<'\t'<<percent(Compressed->getEdgeNumber(),Full->getEdgeNumber())<<'%'<<endl;
+        cout<<"turn bytes\t"<<Full->getTurnBytes()<<'\t'<<Compressed->getTurnBytes()<<'\t'<<percent(Compressed->getTurnBytes(),Full->getTurnBytes())<<'%'<<endl;
+
+        size_t longest=0;
+        for (size_t c = 0; c < Compressed->getRoadNumber(); ++c)
+            longest=std::max(longest,Compressed->getChainLength(c));
+        cout<<"longest chain\t"<<longest<<" roads"<<endl;
+
+        const StrongComponents& C=City.getComponents();
+        size_t traps=0,unreachable=0;
+        for (size_t c = 0; c < C.getComponentNumber(); ++c)
+        {
+            traps+=C.isTrap(c);
+            unreachable+=C.isUnreachable(c);
+        }
+        std::vector<size_t> cutOff=City.getCutOffNodes();
+        cout<<"components\t"<<C.getComponentNumber()<<" ("<<traps<<" can not be left, "<<unreachable<<" can not be reached) in "<<C.getPieceNumber()<<" unconnected pieces"<<endl;
+        //An empty city has no components at all, not even a largest
+        size_t largest=C.getComponentNumber()>0 ? C.getComponentSize(C.getLargestComponent()) : 0;
+        cout<<"largest component\t"<<largest<<" nodes, "<<cutOff.size()<<" nodes cut off"<<endl;
+        //The first few, by their ID in the file, so they can be found and fixed
+        for (size_t i = 0; i < cutOff.size() && i < 20; ++i)
+        {
+            size_t c=C.getComponent(cutOff[i]);
+            cout<<"\tnode "<<City.getFileNodeID(cutOff[i])<<(C.isTrap(c) ? " can not be left" : C.isUnreachable(c) ? " can not be reached" : " is cut off")<<endl;
+        }
+        if (cutOff.size()>20)
+            cout<<"\t..."<<endl;
+    }
+    catch(TrafficSimulation_error& E)
+    {
+        cerr<<E.what()<<endl;
+        return 1;
+    }
+    return 0;
+}
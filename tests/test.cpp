@@ -3,11 +3,51 @@
 #include <vector>
 #include <string>
 #include <sstream>
+#include <thread>
+#include <algorithm>
+#include <fstream>
+#include <cstring>
+#include <numeric>
+#include <cmath>
+#include <random>
+#include <filesystem>
+#include <optional>
+#include <map>
+#include <tuple>
 
 #include "Hellhole.hpp"
 #include "TrafficExceptions.hpp"
 #include "Road.hpp"
 #include "CityNetwork.hpp"
+#include "Intersection.hpp"
+#include "Trafficlight.hpp"
+#include "EventQueue.hpp"
+#include "ReservationTable.hpp"
+#include "VehiclePool.hpp"
+#include "Car.hpp"
+#include "TrafficSource.hpp"
+#include "CounterRNG.hpp"
+#include "KeyframeWriter.hpp"
+#include "KeyframeReader.hpp"
+#include "KeyframeReplay.hpp"
+#include "FrameRenderer.hpp"
+#include "BinaryIO.hpp"
+#include "LogHistogram.hpp"
+#include "RoadStatistics.hpp"
+#include "RoadStatisticsReader.hpp"
+#include "SPSCQueue.hpp"
+#include "JourneyLog.hpp"
+#include "JourneyLogReader.hpp"
+#include "RouteStore.hpp"
+#include "RoutingGraph.hpp"
+#include "TravelTimeProfiles.hpp"
+#include "SpatialIndex.hpp"
+#include "StrongComponents.hpp"
+#include "NameTable.hpp"
+#include "ArtefactCache.hpp"
+#include "Router.hpp"
+#include "RouteCache.hpp"
+#include "Checkpointer.hpp"
 
 #define tolerance 1e-8
 
@@ -317,6 +357,2891 @@ TEST(Test_Loading, Load_CityNetwork_From_Stream)
     CityNetwork City(S);
 }
 
+//A traffic light in the middle of a plus-shaped crossing, the arms end in plain intersections
+std::string Plus_City_String(
+"{\n\
+    \"nodes\":\n\
+    [\n\
+        {\"type\":\"Trafficlight\", \"pos\":[0, 0]},\n\
+        {\"type\":\"Intersect\", \"pos\":[100, 0]},\n\
+        {\"type\":\"Intersect\", \"pos\":[0, 100]},\n\
+        {\"type\":\"Intersect\", \"pos\":[-100, 0]},\n\
+        {\"type\":\"Intersect\", \"pos\":[0, -100]}\n\
+    ],\n\
+    \"auto_roads\":\n\
+    [\n\
+        {\"type\":\"Byvej\", \"first\":0, \"second\":1},\n\
+        {\"type\":\"Byvej\", \"first\":0, \"second\":2},\n\
+        {\"type\":\"Byvej\", \"first\":0, \"second\":3},\n\
+        {\"type\":\"Byvej\", \"first\":0, \"second\":4}\n\
+    ]\n\
+}");
+
+TEST(Test_Loading, Load_Intersections_and_Trafficlights)
+{
+    std::stringstream S(Plus_City_String);
+    CityNetwork City(S);
+
+    ASSERT_EQ(City.getNodesSize(),5);
+    ASSERT_EQ(City.getRoadsSize(),4);
+    ASSERT_EQ(City.getTrafficlightsSize(),1);
+
+    std::shared_ptr<Node> Center=City.getNode(0);
+    ASSERT_EQ(Center->getRoadNumber(),4);
+    ASSERT_EQ(City.getNode(1)->getRoadNumber(),1);
+
+    //Local and global lookup agree, and the neighbours are at the other end
+    for (size_t i = 0; i < 4; ++i)
+    {
+        ASSERT_EQ(Center->getRoad(i,true).getRoadID(),i);
+        ASSERT_EQ(Center->getRoad(i).getRoadID(),i);
+        ASSERT_EQ(Center->getNeighbour(i,true).getNodeID(),i+1);
+    }
+    ASSERT_THROW(Center->getRoad(4,true), road_address_exception);
+    ASSERT_THROW(Center->getRoad(4), road_address_exception);
+    ASSERT_THROW(City.getRoad(4), road_address_exception);
+
+    //Unknown node types must not be dropped silently
+    std::stringstream Bad("{\"nodes\":[{\"type\":\"Roundabout\",\"pos\":[0,0]}],\"roads\":[]}");
+    ASSERT_THROW(CityNetwork BadCity(Bad), TrafficSimulation_error);
+}
+
+TEST(Test_Signals, Trafficlight_phases_release_queues_in_batch)
+{
+    std::stringstream S(Plus_City_String);
+    CityNetwork City(S);
+    std::shared_ptr<Trafficlight> Light=std::dynamic_pointer_cast<Trafficlight>(City.getNode(0));
+    ASSERT_NE(Light,nullptr);
+
+    std::vector<std::pair<size_t,size_t> > released;//road, number of vehicles
+    double releaseTime=-1;
+    Light->setReleaseHandler([&](double time, size_t road, const std::vector<uint64_t>& V){released.push_back({road,V.size()}); releaseTime=time;});
+
+    EventQueue Q;
+    City.startSignals(Q,0);
+
+    //Default phases: east-west (local road 0 and 2) go first
+    ASSERT_EQ(Light->getPhaseNumber(),2);
+    ASSERT_TRUE(Light->isGreen(0));
+    ASSERT_TRUE(Light->isGreen(2));
+    ASSERT_FALSE(Light->isGreen(1));
+
+    ASSERT_TRUE(Light->arrive(0,100));
+    ASSERT_FALSE(Light->arrive(1,101));
+    ASSERT_FALSE(Light->arrive(1,102));
+    ASSERT_FALSE(Light->arrive(3,103));
+    ASSERT_EQ(Light->getQueueLength(1),2);
+
+    //Only the phase change is in the queue, nothing is polled
+    ASSERT_EQ(Q.size(),1);
+    ASSERT_NEAR(Q.nextTime(),30,tolerance);
+
+    ASSERT_EQ(Q.runUntil(29),0);
+    ASSERT_TRUE(released.empty());
+
+    ASSERT_EQ(Q.runUntil(30),1);
+    ASSERT_EQ(released.size(),2);
+    ASSERT_EQ(released[0].first,1);
+    ASSERT_EQ(released[0].second,2);
+    ASSERT_EQ(released[1].first,3);
+    ASSERT_EQ(released[1].second,1);
+    ASSERT_NEAR(releaseTime,30,tolerance);
+    ASSERT_EQ(Light->getQueueLength(1),0);
+    ASSERT_FALSE(Light->isGreen(0));
+
+    //And back again
+    Q.runUntil(60);
+    ASSERT_EQ(Light->getCurrentPhase(),0);
+    ASSERT_THROW(Light->arrive(7,0), road_address_exception);
+}
+
+TEST(Test_Signals, EventQueue_order)
+{
+    struct Recorder : public IEventHandler
+    {
+        std::vector<uint64_t> seen;
+        void handleEvent(double, int, uint64_t arg){seen.push_back(arg);}
+    } R;
+
+    EventQueue Q;
+    size_t id=Q.registerHandler(&R);
+    Q.schedule(5,id,0,3);
+    Q.schedule(1,id,0,1);
+    Q.schedule(5,id,0,4);//Same time, scheduled later
+    Q.schedule(2,id,0,2);
+    ASSERT_THROW(Q.schedule(1,id+1,0), TrafficSimulation_error);
+
+    Q.runUntil(10);
+    ASSERT_EQ(R.seen,(std::vector<uint64_t>{1,2,3,4}));
+    ASSERT_THROW(Q.schedule(9,id,0), TrafficSimulation_error);//In the past
+}
+
+TEST(Test_Signals, Reservation_table_conflicts)
+{
+    std::stringstream S(Plus_City_String);
+    CityNetwork City(S);
+    std::shared_ptr<Intersection> Center=std::dynamic_pointer_cast<Intersection>(City.getNode(0));
+    ASSERT_EQ(Center->getReservations(),nullptr);
+    ReservationTable& T=Center->buildReservations(2.0,16);
+
+    //Local roads are east, north, west, south
+    ASSERT_TRUE(T.conflict(0,2,1,3));//Straight across each other
+    ASSERT_FALSE(T.conflict(0,1,2,3));//Two right turns
+    ASSERT_TRUE(T.conflict(0,1,0,3));//Same stop line
+    ASSERT_TRUE(T.conflict(0,2,3,2));//Same exit
+    ASSERT_EQ(T.getLocalID(2),2);
+    ASSERT_THROW(T.getLocalID(7),road_address_exception);
+
+    ASSERT_TRUE(T.book(0,2,1.0));
+    ASSERT_FALSE(T.isFree(1,3,1.5));
+    ASSERT_FALSE(T.book(1,3,1.5));
+    ASSERT_TRUE(T.book(1,3,2.5));//Next window
+    ASSERT_TRUE(T.book(2,1,1.5));//Does not cross
+    T.release(0,2,1.0);
+    ASSERT_TRUE(T.book(1,3,1.5));
+
+    //Outside the bookable range
+    ASSERT_FALSE(T.book(0,1,16*2.0));
+    T.advance(4.0);
+    ASSERT_FALSE(T.book(0,1,1.0));
+    ASSERT_TRUE(T.book(0,1,16*2.0));
+    ASSERT_THROW(T.book(0,4,5.0),road_address_exception);
+}
+
+TEST(Test_Signals, Reservation_table_concurrent_booking)
+{
+    std::stringstream S(Plus_City_String);
+    CityNetwork City(S);
+    std::shared_ptr<Intersection> Center=std::dynamic_pointer_cast<Intersection>(City.getNode(0));
+    const size_t windows=64;
+    ReservationTable& T=Center->buildReservations(1.0,windows);
+
+    //Every thread tries to book every movement in every window, in its own order
+    const size_t threads=8;
+    std::vector<std::vector<std::pair<size_t,size_t> > > booked(threads);//(window, movement)
+    std::vector<std::thread> workers;
+    for (size_t t = 0; t < threads; ++t)
+        workers.emplace_back([&,t](){
+            std::vector<size_t> order(16);
+            for (size_t i = 0; i < 16; ++i)
+                order[i]=(i*(2*t+1)+t)%16;
+            for (size_t w = 0; w < windows; ++w)
+                for (size_t m : order)
+                    if (T.book(m/4,m%4,w+0.5))
+                        booked[t].push_back({w,m});
+        });
+    for (std::thread& W : workers)
+        W.join();
+
+    std::vector<std::vector<size_t> > perWindow(windows);
+    for (auto& B : booked)
+        for (auto& P : B)
+            perWindow[P.first].push_back(P.second);
+
+    for (size_t w = 0; w < windows; ++w)
+    {
+        //No two bookings conflict, and nothing more could have been booked
+        for (size_t a : perWindow[w])
+            for (size_t b : perWindow[w])
+                if (a!=b)
+                {
+                    ASSERT_FALSE(T.conflict(a/4,a%4,b/4,b%4));
+                }
+        for (size_t m = 0; m < 16; ++m)
+            ASSERT_FALSE(T.isFree(m/4,m%4,w+0.5));
+    }
+}
+
+//Eight roads meeting at one intersection, the most an Intersection has by default, 64 movements do not fit in one slot
+std::string Star_City_String(
+"{\n\
+    \"nodes\":\n\
+    [\n\
+        {\"type\":\"Intersect\", \"pos\":[0, 0]},\n\
+        {\"type\":\"Intersect\", \"pos\":[100, 0]},\n\
+        {\"type\":\"Intersect\", \"pos\":[70, 70]},\n\
+        {\"type\":\"Intersect\", \"pos\":[0, 100]},\n\
+        {\"type\":\"Intersect\", \"pos\":[-70, 70]},\n\
+        {\"type\":\"Intersect\", \"pos\":[-100, 0]},\n\
+        {\"type\":\"Intersect\", \"pos\":[-70, -70]},\n\
+        {\"type\":\"Intersect\", \"pos\":[0, -100]},\n\
+        {\"type\":\"Intersect\", \"pos\":[70, -70]}\n\
+    ],\n\
+    \"auto_roads\":\n\
+    [\n\
+        {\"type\":\"Byvej\", \"first\":0, \"second\":1},\n\
+        {\"type\":\"Byvej\", \"first\":0, \"second\":2},\n\
+        {\"type\":\"Byvej\", \"first\":0, \"second\":3},\n\
+        {\"type\":\"Byvej\", \"first\":0, \"second\":4},\n\
+        {\"type\":\"Byvej\", \"first\":0, \"second\":5},\n\
+        {\"type\":\"Byvej\", \"first\":0, \"second\":6},\n\
+        {\"type\":\"Byvej\", \"first\":0, \"second\":7},\n\
+        {\"type\":\"Byvej\", \"first\":0, \"second\":8}\n\
+    ]\n\
+}");
+
+TEST(Test_Signals, Reservation_table_eight_roads)
+{
+    std::stringstream S(Star_City_String);
+    CityNetwork City(S);
+    std::shared_ptr<Intersection> Center=std::dynamic_pointer_cast<Intersection>(City.getNode(0));
+    ASSERT_EQ(Center->getRoadNumber(),8);
+    const size_t windows=64;
+    ReservationTable& T=Center->buildReservations(1.0,windows);
+
+    //Local roads go around counter-clockwise from east, east to west (movement 4) and south to north (movement 50) are in different words
+    ASSERT_TRUE(T.conflict(0,4,6,2));
+    ASSERT_TRUE(T.conflict(6,2,0,4));
+    ASSERT_FALSE(T.conflict(0,2,4,6));//Two right turns on opposite sides
+    ASSERT_TRUE(T.conflict(7,7,7,0));//Same stop line, both in the last word
+
+    ASSERT_TRUE(T.book(0,4,0.5));
+    ASSERT_FALSE(T.isFree(6,2,0.5));
+    ASSERT_FALSE(T.book(6,2,0.5));
+    ASSERT_TRUE(T.book(6,2,1.5));
+    ASSERT_FALSE(T.book(0,4,1.5));
+    T.release(0,4,0.5);
+    ASSERT_TRUE(T.book(6,2,0.5));
+    ASSERT_THROW(T.book(8,0,0.5),road_address_exception);
+
+    //The bookings are kept in the checkpoints
+    std::string state;
+    T.saveState(state);
+    T.advance(windows);
+    ASSERT_TRUE(T.book(0,4,windows+1.5));
+    const char* p=state.data();
+    T.loadState(p,p+state.size());
+    ASSERT_EQ(p,state.data()+state.size());
+    ASSERT_FALSE(T.book(0,4,1.5));
+    ASSERT_TRUE(T.book(0,4,2.5));
+
+    //Many threads booking at once never book two conflicting movements in the same window
+    T.advance(2*windows);
+    const size_t threads=8;
+    std::vector<std::vector<std::pair<size_t,size_t> > > booked(threads);//(window, movement)
+    std::vector<std::thread> workers;
+    for (size_t t = 0; t < threads; ++t)
+        workers.emplace_back([&,t](){
+            for (size_t w = 0; w < windows; ++w)
+                for (size_t i = 0; i < 64; ++i)
+                {
+                    size_t m=(i*(2*t+1)+t)%64;
+                    if (T.book(m/8,m%8,2*windows+w+0.5))
+                        booked[t].push_back({w,m});
+                }
+        });
+    for (std::thread& W : workers)
+        W.join();
+
+    std::vector<std::vector<size_t> > perWindow(windows);
+    for (auto& B : booked)
+        for (auto& P : B)
+            perWindow[P.first].push_back(P.second);
+    for (size_t w = 0; w < windows; ++w)
+    {
+        ASSERT_FALSE(perWindow[w].empty());
+        for (size_t a : perWindow[w])
+            for (size_t b : perWindow[w])
+                if (a!=b)
+                {
+                    ASSERT_FALSE(T.conflict(a/8,a%8,b/8,b%8));
+                }
+    }
+}
+
+TEST(Test_Vehicles, Vehicle_pool_recycles_slots)
+{
+    VehiclePool<Car> Pool(8,4);
+    ASSERT_EQ(Pool.getCapacity(),8);
+
+    std::vector<VehicleHandle> H;
+    for (size_t i = 0; i < 8; ++i)
+        H.push_back(Pool.spawn());
+    ASSERT_EQ(Pool.getLive(),8);
+    ASSERT_EQ(Pool.getGrowths(),0);
+
+    //Two hellholes joined by a road, the cars fall into the one at the end
+    faux_CityNetwork mockTown;
+    Json::Value RoadRoot=to_Json("{\"type\":\"Byvej\",\"first\":0,\"second\":1}");
+    Road R(0,RoadRoot,mockTown);
+    Hellhole& End=dynamic_cast<Hellhole&>(*mockTown.B);
+
+    for (size_t i = 0; i < 8; i+=2)
+        End.swallow(Pool,H[i]);
+    ASSERT_EQ(End.getSwallowed(),4);
+    ASSERT_EQ(Pool.getLive(),4);
+    ASSERT_EQ(Pool.getPeak(),8);
+
+    //Stale handles are caught, even after the slot is reused
+    ASSERT_EQ(Pool.get(H[0]),nullptr);
+    ASSERT_NE(Pool.get(H[1]),nullptr);
+    ASSERT_THROW(End.swallow(Pool,H[0]),vehicle_handle_exception);
+
+    VehicleHandle Reused=Pool.spawn(4.0,40.0,10.0,40.0);
+    ASSERT_EQ(Pool.getGrowths(),0);
+    ASSERT_FALSE(Reused==H[6]);
+    ASSERT_EQ(Reused.index%2,0);//One of the freed slots
+    ASSERT_EQ(Pool.get(H[Reused.index]),nullptr);
+    ASSERT_EQ(VehicleHandle::fromID(Reused.toID()),Reused);
+
+    //Running out of slots grows the pool by a block
+    for (size_t i = 0; i < 4; ++i)
+        Pool.spawn();
+    ASSERT_EQ(Pool.getGrowths(),1);
+    ASSERT_EQ(Pool.getCapacity(),12);
+    ASSERT_EQ(Pool.getLive(),9);
+    ASSERT_EQ(Pool.getPeak(),9);
+}
+
+//Run all traffic sources in a city file, and record every spawn
+std::vector<std::pair<double,size_t> > run_sources(const std::string& file, uint64_t seed, double until)
+{
+    std::ifstream F(std::string(SOURCE_DIR)+"/"+file);
+    CityNetwork City(F);
+    EventQueue Q;
+    std::vector<std::pair<double,size_t> > spawns;
+    City.startSources(Q,0,seed,[&](double time, size_t node){spawns.push_back({time,node});});
+    Q.runUntil(until);
+    return spawns;
+}
+
+TEST(Test_Sources, Poisson_sources_are_reproducible)
+{
+    //single_road.json has two sources with 600 vehicles per hour each
+    std::vector<std::pair<double,size_t> > A=run_sources("single_road.json",42,3600);
+    std::vector<std::pair<double,size_t> > B=run_sources("single_road.json",42,3600);
+    std::vector<std::pair<double,size_t> > C=run_sources("single_road.json",43,3600);
+
+    ASSERT_EQ(A,B);
+    ASSERT_NE(A,C);
+    //1200 expected, the standard deviation is about 35
+    ASSERT_GT(A.size(),1000);
+    ASSERT_LT(A.size(),1400);
+    for (size_t i = 1; i < A.size(); ++i)
+        ASSERT_LE(A[i-1].first,A[i].first);
+    //Sampled from the stream by hand, so these are the same with every standard library
+    ASSERT_EQ(A.size(),1198);
+    ASSERT_NEAR(A[0].first,2.3628430794862432,1e-9);
+
+    //A source busy enough that a window is counted in parts, 36000 expected, the standard deviation is about 190
+    {
+        TrafficSource Busy(0,TrafficSourceConfig{36000,{}});
+        EventQueue Q;
+        size_t spawned=0;
+        Busy.start(Q,0,42,[&spawned](double, size_t){++spawned;});
+        Q.runUntil(3600);
+        ASSERT_GT(spawned,35000);
+        ASSERT_LT(spawned,37000);
+    }
+
+    //city.json has 4 sources at 120 vehicles per hour, with a rush hour profile which is 0.05 at 3 in the night and 1.5 at 7 in the morning
+    std::vector<std::pair<double,size_t> > Day=run_sources("city.json",7,24*3600);
+    size_t night=0, rush=0;
+    for (auto& P : Day)
+    {
+        size_t hour=P.first/3600;
+        if (hour==3)
+            ++night;
+        else if (hour==7)
+            ++rush;
+    }
+    ASSERT_LT(night,50);//24 expected
+    ASSERT_GT(rush,630);//720 expected
+
+    ASSERT_THROW(TrafficSource(0,TrafficSourceConfig{-1,{}}),TrafficSimulation_error);
+
+    //Named profiles from the "profiles" of the city file
+    Json::Value Profiles=to_Json("{\"night\":[0.5,0.25]}");
+    TrafficSourceConfig Named=TrafficSource::loadConfig(to_Json("{\"rate\":60, \"profile\":\"night\"}"),Profiles);
+    ASSERT_EQ(Named.profile,(std::vector<double>{0.5,0.25}));
+    ASSERT_THROW(TrafficSource::loadConfig(to_Json("{\"rate\":60, \"profile\":\"day\"}"),Profiles),TrafficSimulation_error);
+    ASSERT_THROW(TrafficSource::loadConfig(to_Json("{\"rate\":60, \"profile\":\"night\"}")),TrafficSimulation_error);
+
+    //Started once only
+    std::ifstream F(std::string(SOURCE_DIR)+"/single_road.json");
+    CityNetwork City(F);
+    EventQueue Q;
+    City.startSources(Q,0,1,[](double, size_t){});
+    size_t pending=Q.size();
+    ASSERT_THROW(City.startSources(Q,0,1,[](double, size_t){}),TrafficSimulation_error);
+    ASSERT_EQ(Q.size(),pending);
+}
+
+TEST(Test_Random, Philox_known_answers)
+{
+    //Known answer vectors from the Random123 library
+    uint32_t out[4];
+    {
+        const uint32_t c[4]={0,0,0,0};
+        const uint32_t k[2]={0,0};
+        CounterRNG::philox(c,k,out);
+        ASSERT_EQ(out[0],0x6627e8d5u);
+        ASSERT_EQ(out[1],0xe169c58du);
+        ASSERT_EQ(out[2],0xbc57ac4cu);
+        ASSERT_EQ(out[3],0x9b00dbd8u);
+    }
+    {
+        const uint32_t c[4]={0x243f6a88u,0x85a308d3u,0x13198a2eu,0x03707344u};
+        const uint32_t k[2]={0xa4093822u,0x299f31d0u};
+        CounterRNG::philox(c,k,out);
+        ASSERT_EQ(out[0],0xd16cfe09u);
+        ASSERT_EQ(out[1],0x94fdccebu);
+        ASSERT_EQ(out[2],0x5001e420u);
+        ASSERT_EQ(out[3],0x24126ea1u);
+    }
+}
+
+TEST(Test_Random, Batched_draws_match_single_draws)
+{
+    CounterRNG R(1234);
+    for (uint64_t first : {0,1,7})
+    {
+        std::vector<double> batch(101);
+        R.fillUniform(99,3,demand,first,batch.data(),batch.size());
+        for (size_t i = 0; i < batch.size(); ++i)
+        {
+            ASSERT_EQ(batch[i],R.uniform(99,3,demand,first+i));
+            ASSERT_GE(batch[i],0.0);
+            ASSERT_LT(batch[i],1.0);
+        }
+    }
+
+    //Different entity, day, purpose or seed gives different numbers
+    double x=R.uniform(99,3,demand,0);
+    ASSERT_NE(x,R.uniform(98,3,demand,0));
+    ASSERT_NE(x,R.uniform(99,4,demand,0));
+    ASSERT_NE(x,R.uniform(99,3,routeChoice,0));
+    ASSERT_NE(x,CounterRNG(1235).uniform(99,3,demand,0));
+
+    RandomStream S(R,99,3,demand);
+    ASSERT_EQ(S.uniform(),x);
+    ASSERT_EQ(S.getIndex(),1);
+}
+
+TEST(Test_Random, Same_numbers_for_1_and_N_threads)
+{
+    CounterRNG R(2024);
+    const size_t entities=4000;
+    const size_t draws=37;
+
+    auto generate=[&](size_t threads)
+    {
+        std::vector<double> out(entities*draws);
+        std::vector<std::thread> workers;
+        //Interleave the entities, so each thread does them in a different order than a single thread would
+        for (size_t t = 0; t < threads; ++t)
+            workers.emplace_back([&,t](){
+                for (size_t e = entities-1-t; e < entities; e-=threads)
+                    R.fillUniform(e,1,driverBehaviour,0,&out[e*draws],draws);
+            });
+        for (std::thread& W : workers)
+            W.join();
+        return out;
+    };
+
+    std::vector<double> one=generate(1);
+    std::vector<double> many=generate(7);
+    ASSERT_EQ(std::memcmp(one.data(),many.data(),one.size()*sizeof(double)),0);
+
+    //A quick sanity check that the numbers are spread out
+    double mean=0;
+    for (double x : one)
+        mean+=x;
+    mean/=one.size();
+    ASSERT_NEAR(mean,0.5,0.01);
+}
+
+//A few cars driving up and down a road for some minutes, one keyframe per car every 7 seconds
+void write_test_keyframes(KeyframeWriter& W, size_t cars, double until)
+{
+    for (size_t c = 0; c < cars; ++c)
+        W.addVehicle(c%3==0 ? "truck" : "car",3+c%4);
+    for (double t = 0; t <= until; t+=7)
+        for (size_t c = 0; c < cars; ++c)
+        {
+            Keyframe K;
+            K.time=t+c*0.001;
+            K.road=(c+size_t(t/100))%5;
+            K.direction=c%2;
+            K.lane=c%3;
+            K.pos=t*13.37+c;
+            K.speed=13.37+(c%5)*0.25;
+            K.acc=(c%2 ? -1.5 : 0.75);
+            W.add(c,K);
+        }
+}
+
+TEST(Test_Keyframes, Binary_keyframes_round_trip)
+{
+    std::stringstream File;
+    {
+        KeyframeWriter W(File,60.0);
+        write_test_keyframes(W,10,600);
+        W.close();
+        ASSERT_EQ(W.getChunkNumber(),10);
+
+        Keyframe Late;
+        ASSERT_THROW(W.add(0,Late),TrafficSimulation_error);
+    }
+
+    KeyframeReader R(File);
+    ASSERT_EQ(R.getVehicleNumber(),10);
+    ASSERT_EQ(R.getChunkNumber(),10);
+    ASSERT_EQ(R.getVehicle(3).type,"truck");
+    ASSERT_NEAR(R.getVehicle(3).length,6,tolerance);
+    ASSERT_EQ(R.getVehicle(3).keyframes,86);
+    ASSERT_NEAR(R.getVehicle(3).lastTime,595.003,1e-9);
+
+    //Seek into the middle, without reading what comes before
+    ASSERT_EQ(R.findChunk(301),5);
+    ASSERT_EQ(R.findChunk(-1),R.getChunkNumber());
+    std::vector<KeyframeRecord> rows;
+    R.read(301,315,rows);
+    ASSERT_EQ(rows.size(),20);//t=301 and t=308
+    for (const KeyframeRecord& Row : rows)
+    {
+        size_t c=Row.vehicle;
+        double t=Row.frame.time-c*0.001;
+        ASSERT_NEAR(t-std::round(t),0,1e-6);
+        ASSERT_EQ(Row.frame.road,(c+size_t(t/100))%5);
+        ASSERT_EQ(Row.frame.direction,bool(c%2));
+        ASSERT_EQ(Row.frame.lane,int(c%3));
+        ASSERT_NEAR(Row.frame.pos,t*13.37+c,0.005+1e-9);
+        ASSERT_NEAR(Row.frame.speed,13.37+(c%5)*0.25,0.005+1e-9);
+        ASSERT_NEAR(Row.frame.acc,(c%2 ? -1.5 : 0.75),0.0005+1e-9);
+    }
+
+    //The JSON version has the same keyframes, and is much bigger
+    std::stringstream Json;
+    R.writeJson(Json);
+    Json::Value Root=to_Json(Json.str());
+    ASSERT_EQ(Root["vehicles"].size(),10);
+    ASSERT_EQ(Root["vehicles"][3]["keyframes"].size(),86);
+    ASSERT_EQ(Root["vehicles"][3]["type"].asString(),"truck");
+    ASSERT_GT(Json.str().size(),8*File.str().size());
+
+    //A file which was never closed has no index
+    std::stringstream Cut(File.str().substr(0,File.str().size()/2));
+    ASSERT_THROW(KeyframeReader Broken(Cut),file_format_exception);
+}
+
+
+TEST(Test_Keyframes, State_at_any_time)
+{
+    //Vehicle c spawns at 10c s at the first node of the single road, drives at 10 m/s (vehicles going backwards start at the other end) and despawns 200 s later
+    const size_t cars=30;
+    std::stringstream File;
+    {
+        KeyframeWriter W(File,60.0);
+        for (size_t c = 0; c < cars; ++c)
+            W.addVehicle("car",4);
+        for (double t = 0; t <= 10*cars+200; t+=5)
+            for (size_t c = 0; c < cars; ++c)
+            {
+                double spawn=10.0*c;
+                if (t<spawn || t>spawn+200)
+                    continue;
+                Keyframe K;
+                K.time=t;
+                K.road=0;
+                K.direction=c%2==0;
+                K.pos=10*(t-spawn);
+                K.speed=10;
+                if (t==spawn+200)
+                    W.despawn(c,K);
+                else
+                    W.add(c,K);
+            }
+        W.close();
+
+        Keyframe K;
+        K.time=10000;
+        ASSERT_THROW(W.add(0,K),TrafficSimulation_error);
+    }
+
+    std::ifstream F(std::string(SOURCE_DIR)+"/single_road.json");
+    CityNetwork City(F);
+    KeyframeReader R(File);
+    KeyframeReplay Replay(R,&City);
+
+    std::vector<KeyframeRecord> all;
+    R.read(0,1e9,all);
+
+    //Brute force: replay everything from the start, in a scrambled order of times so the cache is tested too
+    std::vector<VehicleState> states;
+    for (double t : {123.4,0.0,59.999,60.0,377.7,3.0,250.0,499.9,500.0,61.2,1000.0})
+    {
+        std::vector<const Keyframe*> last(cars,nullptr);
+        for (const KeyframeRecord& Row : all)
+            if (Row.frame.time<=t)
+                last[Row.vehicle]=&Row.frame;
+
+        Replay.stateAt(t,states);
+        size_t expected=0;
+        for (size_t c = 0; c < cars; ++c)
+            if (last[c] && t<R.getVehicle(c).lastTime)
+                ++expected;
+        ASSERT_EQ(states.size(),expected) << "at time " << t;
+
+        for (const VehicleState& S : states)
+        {
+            ASSERT_TRUE(last[S.vehicle]);
+            ASSERT_NEAR(S.frame.pos,last[S.vehicle]->pos+10*(t-last[S.vehicle]->time),0.01);
+            ASSERT_NEAR(S.frame.pos,10*(t-10.0*S.vehicle),0.01);
+            ASSERT_EQ(S.frame.direction,S.vehicle%2==0);
+        }
+    }
+
+    //Vehicle 0 despawned at 200 s
+    Replay.stateAt(250,states);
+    for (const VehicleState& S : states)
+        ASSERT_NE(S.vehicle,0);
+
+    //The road goes from (-1000,-1000) to (3000,-3000), so the western half of the map only has vehicles in the first half of the road
+    double length=City.getRoad(0)->getLength();
+    Replay.stateAt(250,states);
+    size_t west=0;
+    for (const VehicleState& S : states)
+    {
+        double fromStart=S.frame.direction ? S.frame.pos : length-S.frame.pos;
+        ASSERT_NEAR(S.x,-1000+4000*fromStart/length,1e-6);
+        ASSERT_NEAR(S.y,-1000-2000*fromStart/length,1e-6);
+        if (S.x<=1000)
+            ++west;
+    }
+    std::vector<VehicleState> inBox;
+    Replay.stateIn(250,-1000,-3000,1000,-1000,inBox);
+    ASSERT_EQ(inBox.size(),west);
+    ASSERT_GT(inBox.size(),0);
+    ASSERT_LT(inBox.size(),states.size());
+
+    //Braking vehicles stop, they do not reverse
+    Keyframe Braking;
+    Braking.speed=10;
+    Braking.acc=-2;
+    Keyframe Stopped=KeyframeReplay::extrapolate(Braking,100);
+    ASSERT_NEAR(Stopped.pos,25,tolerance);
+    ASSERT_NEAR(Stopped.speed,0,tolerance);
+
+    KeyframeReplay Blind(R);
+    ASSERT_THROW(Blind.stateIn(250,0,0,1,1,inBox),TrafficSimulation_error);
+}
+
+
+TEST(Test_Keyframes, Spatial_query)
+{
+    std::ifstream F(std::string(SOURCE_DIR)+"/city.json");
+    CityNetwork City(F);
+    const size_t roads=City.getRoadsSize();
+
+    std::stringstream File;
+    size_t farRoad=0;
+    {
+        KeyframeWriter W(File,60.0);
+        W.indexRoads(City,2.5);
+        ASSERT_THROW(W.indexRoads(City,0),TrafficSimulation_error);
+        //Vehicle c changes road every 13 s
+        const size_t cars=40;
+        for (size_t c = 0; c < cars; ++c)
+            W.addVehicle("car",4);
+        for (double t = 0; t < 600; t+=13)
+            for (size_t c = 0; c < cars; ++c)
+            {
+                Keyframe K;
+                K.time=t+c*0.01;
+                K.road=(c*7+size_t(t/13))%roads;
+                K.pos=c;
+                W.add(c,K);
+            }
+        //Two vehicles each changing road between two far apart cells at one instant, one each way, the later keyframe must stay the later one
+        auto middle = [&City](size_t r){return std::make_pair((City.getRoad(r)->getStart().getX()+City.getRoad(r)->getEnd().getX())/2,(City.getRoad(r)->getStart().getY()+City.getRoad(r)->getEnd().getY())/2);};
+        for (size_t r = 1; r < roads; ++r)
+            if (std::hypot(middle(r).first-middle(0).first,middle(r).second-middle(0).second)>std::hypot(middle(farRoad).first-middle(0).first,middle(farRoad).second-middle(0).second))
+                farRoad=r;
+        size_t X=W.addVehicle("car",4);
+        size_t Y=W.addVehicle("car",4);
+        for (auto [v,a,b] : {std::tuple<size_t,size_t,size_t>{X,0,farRoad},{Y,farRoad,0}})
+        {
+            Keyframe K;
+            K.time=610;
+            K.road=a;
+            W.add(v,K);
+            K.road=b;
+            W.add(v,K);
+        }
+        Keyframe Outside;
+        Outside.time=700;
+        Outside.road=roads;
+        ASSERT_THROW(W.add(0,Outside),TrafficSimulation_error);
+        W.close();
+    }
+
+    KeyframeReader R(File);
+    ASSERT_TRUE(R.hasSpatialIndex());
+
+    //The groups are merged back into time order
+    std::vector<KeyframeRecord> all;
+    R.read(100,400,all);
+    ASSERT_TRUE(std::is_sorted(all.begin(),all.end(),[](const KeyframeRecord& A, const KeyframeRecord& B){return A.frame.time<B.frame.time;}));
+
+    //The north-east corner of the city, compared to checking every keyframe
+    KeyframeBox View{1,1,5,5};
+    std::vector<KeyframeRecord> seen;
+    R.query(100,400,View,seen);
+    std::vector<KeyframeRecord> expected;
+    for (const KeyframeRecord& Row : all)
+    {
+        std::shared_ptr<Road> Rd=City.getRoad(Row.frame.road);
+        KeyframeBox B{std::min(Rd->getStart().getX(),Rd->getEnd().getX()),std::min(Rd->getStart().getY(),Rd->getEnd().getY()),std::max(Rd->getStart().getX(),Rd->getEnd().getX()),std::max(Rd->getStart().getY(),Rd->getEnd().getY())};
+        if (B.intersects(View))
+            expected.push_back(Row);
+    }
+    ASSERT_EQ(seen.size(),expected.size());
+    ASSERT_GT(seen.size(),0);
+    ASSERT_LT(seen.size(),all.size());
+    for (size_t i = 0; i < seen.size(); ++i)
+    {
+        ASSERT_EQ(seen[i].vehicle,expected[i].vehicle);
+        ASSERT_NEAR(seen[i].frame.time,expected[i].frame.time,1e-9);
+        ASSERT_EQ(seen[i].frame.road,expected[i].frame.road);
+    }
+
+    //Far outside the city
+    seen.clear();
+    R.query(0,600,KeyframeBox{50,50,60,60},seen);
+    ASSERT_EQ(seen.size(),0);
+
+    //Keyframes at the same time in different cells come back in the order they were written
+    ASSERT_GT(farRoad,0);
+    all.clear();
+    R.read(605,615,all);
+    std::vector<std::pair<size_t,size_t> > Changes;//vehicle, road
+    for (const KeyframeRecord& Row : all)
+        Changes.push_back({Row.vehicle,Row.frame.road});
+    ASSERT_EQ(Changes,(std::vector<std::pair<size_t,size_t> >{{40,0},{40,farRoad},{41,farRoad},{41,0}}));
+
+    //An empty file with only a road index, a huge grid is fine (only the cells with roads cost memory), more roads than the file has bytes for is not
+    auto indexOnly = [](uint64_t cells, uint64_t roadNumber, size_t roadsWritten)
+    {
+        std::string Bytes;
+        BinaryIO::put(Bytes,KeyframeFormat::headMagic);
+        BinaryIO::put(Bytes,KeyframeFormat::version);
+        BinaryIO::put(Bytes,60.0);
+        uint64_t tail=Bytes.size();
+        BinaryIO::putVarint(Bytes,0);//Vehicles
+        BinaryIO::putVarint(Bytes,0);//Chunks
+        BinaryIO::putVarint(Bytes,cells);
+        BinaryIO::putVarint(Bytes,roadNumber);
+        for (size_t r = 0; r < roadsWritten; ++r)
+        {
+            BinaryIO::putVarint(Bytes,cells-1-r);
+            for (double x : {0.0,0.0,10.0,10.0})
+                BinaryIO::put(Bytes,x);
+        }
+        BinaryIO::put(Bytes,tail);
+        BinaryIO::put(Bytes,KeyframeFormat::tailMagic);
+        return Bytes;
+    };
+    std::stringstream Sparse(indexOnly(uint64_t(1)<<60,2,2));
+    KeyframeReader SparseReader(Sparse);
+    ASSERT_TRUE(SparseReader.hasSpatialIndex());
+    seen.clear();
+    SparseReader.query(0,60,KeyframeBox{0,0,1,1},seen);
+    ASSERT_EQ(seen.size(),0);
+    std::stringstream Hostile(indexOnly(uint64_t(1)<<60,uint64_t(1)<<50,2));
+    ASSERT_THROW(KeyframeReader HostileReader(Hostile),file_format_exception);
+}
+
+
+TEST(Test_Keyframes, Render_frames)
+{
+    std::ifstream F(std::string(SOURCE_DIR)+"/single_road.json");
+    CityNetwork City(F);
+    double limit=City.getRoad(0)->getSpeedLimit();
+    ASSERT_NEAR(limit,25,tolerance);//Motortrafikvej, 90 km/h
+
+    //One vehicle standing still and one at the speed limit, both gone after 100 s
+    std::stringstream File;
+    {
+        KeyframeWriter W(File,60.0);
+        W.addVehicle("car",4);
+        W.addVehicle("truck",12);
+        Keyframe K;
+        K.pos=500;
+        W.add(0,K);
+        K.pos=1000;
+        K.speed=limit;
+        W.add(1,K);
+        K.time=100;
+        W.despawn(0,K);
+        W.despawn(1,K);
+        W.close();
+    }
+    KeyframeReader R(File);
+
+    //The same picture no matter how many threads or how big the tiles
+    FrameRenderer One(City,R,200,120,1,64);
+    FrameRenderer Many(City,R,200,120,4,16);
+    FrameImage A,B;
+    One.render(10,A);
+    Many.render(10,B);
+    ASSERT_EQ(A.pixels.size(),200*120*3);
+    ASSERT_TRUE(A.pixels==B.pixels);
+
+    //Where something on the map ends up in the picture
+    const KeyframeBox& V=One.getView();
+    double scale=std::min(200/(V.maxX-V.minX),120/(V.maxY-V.minY));
+    std::shared_ptr<Road> Rd=City.getRoad(0);
+    auto pixel = [&](double fromStart) -> const uint8_t*
+    {
+        double f=fromStart/Rd->getLength();
+        double x=Rd->getStart().getX()+(Rd->getEnd().getX()-Rd->getStart().getX())*f;
+        double y=Rd->getStart().getY()+(Rd->getEnd().getY()-Rd->getStart().getY())*f;
+        return A.at(size_t((x-V.minX)*scale),size_t((V.maxY-y)*scale));
+    };
+
+    //Half the speed limit on average is yellow
+    const uint8_t* OnRoad=pixel(3000);
+    ASSERT_EQ(OnRoad[0],255);
+    ASSERT_EQ(OnRoad[1],255);
+    ASSERT_EQ(OnRoad[2],0);
+    const uint8_t* Car=pixel(500);
+    ASSERT_EQ(Car[0],255);
+    ASSERT_EQ(Car[1],255);
+    ASSERT_EQ(Car[2],255);
+    ASSERT_EQ(A.at(0,0)[0],20);
+
+    //Empty road is grey
+    One.render(150,A);
+    OnRoad=pixel(3000);
+    ASSERT_EQ(OnRoad[0],90);
+    Car=pixel(500);
+    ASSERT_EQ(Car[0],90);
+
+    std::stringstream PPM;
+    A.writePPM(PPM);
+    ASSERT_EQ(PPM.str().substr(0,15),"P6\n200 120\n255\n");
+    ASSERT_EQ(PPM.str().size(),15+200*120*3);
+
+    ASSERT_THROW(FrameRenderer(City,R,0,100),TrafficSimulation_error);
+}
+
+
+TEST(Test_Statistics, Hourly_road_statistics)
+{
+    std::stringstream File;
+    {
+        //Hours of 100 s, to keep the numbers simple
+        RoadStatistics Stats(File,3,2,100);
+        RoadStatistics::Shard& A=Stats.getShard(0);
+        RoadStatistics::Shard& B=Stats.getShard(1);
+
+        //Enters in one shard, and leaves in the other, in the next hour
+        A.enterRoad(10,0,10);
+        B.changeSpeed(50,0,10,20);
+        B.enterRoad(20,2,5);
+        A.leaveRoad(30,2,5);
+        ASSERT_THROW(A.enterRoad(150,1,1),TrafficSimulation_error);
+        ASSERT_THROW(A.enterRoad(50,3,1),TrafficSimulation_error);
+        Stats.closeHour();
+
+        B.leaveRoad(150,0,20);
+        Stats.closeHour();
+        Stats.close();
+        ASSERT_EQ(Stats.getHoursWritten(),2);
+        ASSERT_THROW(Stats.closeHour(),TrafficSimulation_error);
+    }
+
+    RoadStatisticsReader R(File);
+    ASSERT_EQ(R.getRoadNumber(),3);
+    ASSERT_NEAR(R.getHourLength(),100,tolerance);
+    std::vector<RoadStatisticsRecord> hour;
+
+    ASSERT_TRUE(R.nextHour(hour));
+    ASSERT_NEAR(R.getHourStart(),0,tolerance);
+    ASSERT_EQ(hour[0].entered,1);
+    ASSERT_NEAR(hour[0].vehicleSeconds,90,tolerance);
+    ASSERT_NEAR(hour[0].distance,40*10+50*20,tolerance);
+    ASSERT_EQ(hour[1].entered,0);
+    ASSERT_NEAR(hour[1].averageSpeed(),0,tolerance);
+    ASSERT_EQ(hour[2].entered,1);
+    ASSERT_NEAR(hour[2].averageSpeed(),5,tolerance);
+    ASSERT_NEAR(hour[2].averageVehicles(100),0.1,tolerance);
+
+    ASSERT_TRUE(R.nextHour(hour));
+    ASSERT_NEAR(R.getHourStart(),100,tolerance);
+    ASSERT_EQ(hour[0].entered,0);
+    ASSERT_NEAR(hour[0].vehicleSeconds,50,tolerance);
+    ASSERT_NEAR(hour[0].averageSpeed(),20,tolerance);
+    ASSERT_FALSE(R.nextHour(hour));
+
+    //Many threads at once, each with its own shard, and many hours so the writer has to keep up
+    std::stringstream Big;
+    const size_t threads=4;
+    const size_t hours=20;
+    const size_t roads=50;
+    {
+        RoadStatistics Stats(Big,roads,threads,60);
+        for (size_t h = 0; h < hours; ++h)
+        {
+            std::vector<std::thread> workers;
+            for (size_t t = 0; t < threads; ++t)
+                workers.emplace_back([&,t](){
+                    RoadStatistics::Shard& S=Stats.getShard(t);
+                    for (size_t r = t; r < roads; r+=threads)
+                    {
+                        S.enterRoad(h*60+1,r,10);
+                        S.leaveRoad(h*60+11,r,10);
+                    }
+                });
+            for (std::thread& W : workers)
+                W.join();
+            Stats.closeHour();
+        }
+    }
+    RoadStatisticsReader BigR(Big);
+    size_t read=0;
+    while (BigR.nextHour(hour))
+    {
+        ++read;
+        for (const RoadStatisticsRecord& Rec : hour)
+        {
+            ASSERT_EQ(Rec.entered,1);
+            ASSERT_NEAR(Rec.distance,100,1e-6);
+        }
+    }
+    ASSERT_EQ(read,hours);
+}
+
+
+TEST(Test_Statistics, Speed_and_travel_time_histograms)
+{
+    //Every value lands in a bucket which contains it, and the buckets are at most 1/16 of their value wide
+    for (uint64_t v : {0ul,1ul,15ul,16ul,17ul,31ul,32ul,33ul,1000ul,65535ul,65536ul,123456789ul,1ul<<62})
+    {
+        size_t b=LogHistogram::bucketOf(v);
+        ASSERT_LE(LogHistogram::bucketStart(b),v);
+        ASSERT_GT(LogHistogram::bucketStart(b+1),v);
+        ASSERT_LE(LogHistogram::bucketStart(b+1)-LogHistogram::bucketStart(b),std::max<uint64_t>(1,v/16));
+    }
+
+    //Percentiles of 1 to 1000 from two threads worth of histograms, within the precision of the buckets
+    LogHistogram A(0.1),B(0.1),All(0.1);
+    for (int i = 1; i <= 1000; ++i)
+    {
+        (i%2 ? A : B).add(i);
+        All.add(i);
+    }
+    A.merge(B);
+    ASSERT_EQ(A.getTotal(),1000);
+    for (size_t i = 0; i < All.getBucketNumber(); ++i)
+        ASSERT_EQ(A.getCount(i),All.getCount(i));
+    ASSERT_NEAR(A.quantile(0.5),500,500*0.04);
+    ASSERT_NEAR(A.quantile(0.9),900,900*0.04);
+    ASSERT_NEAR(A.quantile(0.99),990,990*0.04);
+    ASSERT_THROW(A.merge(LogHistogram(1)),TrafficSimulation_error);
+    A.clear();
+    ASSERT_EQ(A.getTotal(),0);
+    ASSERT_NEAR(A.quantile(0.5),0,tolerance);
+
+    //Through the statistics file, from two shards
+    std::stringstream File;
+    {
+        RoadStatistics Stats(File,2,2,3600);
+        for (int i = 1; i <= 100; ++i)
+            Stats.getShard(i%2).traversal(i,1,i,100.0/i);
+        Stats.closeHour();
+    }
+    RoadStatisticsReader R(File);
+    std::vector<RoadStatisticsRecord> hour;
+    ASSERT_TRUE(R.nextHour(hour));
+    ASSERT_EQ(hour[0].travelTime.getTotal(),0);
+    ASSERT_EQ(hour[1].travelTime.getTotal(),100);
+    ASSERT_NEAR(hour[1].travelTime.quantile(0.9),90,90*0.04);
+    ASSERT_NEAR(hour[1].speed.quantile(0.1),100.0/91,RoadStatisticsFormat::speedUnit);//Small values are limited by the unit
+}
+
+
+TEST(Test_Statistics, Journey_log)
+{
+    //One producer and one consumer, everything arrives once, in order
+    {
+        SPSCQueue<uint64_t> Q(100);
+        ASSERT_EQ(Q.getCapacity(),128);
+        const uint64_t N=200000;
+        std::thread Consumer([&](){
+            uint64_t expected=0;
+            uint64_t x;
+            while (expected<N)
+                if (Q.tryPop(x))
+                {
+                    ASSERT_EQ(x,expected);
+                    ++expected;
+                }
+                else
+                    std::this_thread::yield();
+        });
+        for (uint64_t i = 0; i < N; ++i)
+            while (!Q.tryPush(i))
+                std::this_thread::yield();
+        Consumer.join();
+        ASSERT_TRUE(Q.empty());
+    }
+
+    //A tiny queue, so the backlog is used, and several blocks
+    auto makeLeg = [](size_t i)
+    {
+        JourneyLeg L;
+        L.journey=i/2;
+        L.mode=TravelMode(i%5);
+        L.distance=i*1.5;
+        L.startTime=i;
+        L.eta=i+60;
+        L.arrival=i+60+(i%7);
+        for (size_t r = 0; r < i%9; ++r)
+            L.roads.push_back((i*31+r*r)%1000);
+        return L;
+    };
+    const size_t legs=10000;
+    std::stringstream File;
+    {
+        JourneyLog Log(File,4);
+        for (size_t i = 0; i < legs; ++i)
+        {
+            JourneyLeg L=makeLeg(i);
+            Log.log(L);
+        }
+        Log.close();
+        ASSERT_EQ(Log.getLegsWritten(),legs);
+        JourneyLeg Late;
+        ASSERT_THROW(Log.log(Late),TrafficSimulation_error);
+    }
+
+    JourneyLogReader R(File);
+    std::vector<JourneyLeg> block;
+    size_t read=0;
+    size_t blocks=0;
+    while (R.nextBlock(block))
+    {
+        ++blocks;
+        for (const JourneyLeg& L : block)
+        {
+            JourneyLeg E=makeLeg(read++);
+            ASSERT_EQ(L.journey,E.journey);
+            ASSERT_EQ(L.mode,E.mode);
+            ASSERT_EQ(L.distance,E.distance);
+            ASSERT_EQ(L.startTime,E.startTime);
+            ASSERT_EQ(L.eta,E.eta);
+            ASSERT_EQ(L.arrival,E.arrival);
+            ASSERT_TRUE(L.roads==E.roads);
+        }
+    }
+    ASSERT_EQ(read,legs);
+    ASSERT_EQ(blocks,(legs+JourneyLogFormat::blockLegs-1)/JourneyLogFormat::blockLegs);
+
+    std::stringstream NotALog("Not a journey log");
+    ASSERT_THROW(JourneyLogReader Bad(NotALog),file_format_exception);
+}
+
+
+TEST(Test_Statistics, Interned_routes)
+{
+    RouteStore Store;
+    RouteID A=Store.intern({4,8,15,16,23,42});
+    RouteID B=Store.intern({4,8,15,16,23,42});
+    RouteID C=Store.intern({4,8,15,99});
+    ASSERT_EQ(A,B);
+    ASSERT_NE(A,C);
+    ASSERT_EQ(Store.intern({}),0);
+    //6 nodes for the first, and only one more for the third, since it starts the same way
+    ASSERT_EQ(Store.getNodeNumber(),1+6+1);
+    ASSERT_EQ(Store.getRoadsInterned(),16);
+    ASSERT_NEAR(Store.getDedupRatio(),16.0/7,tolerance);
+
+    std::vector<size_t> roads;
+    Store.getRoute(C,roads);
+    ASSERT_TRUE(roads==std::vector<size_t>({4,8,15,99}));
+    ASSERT_EQ(Store.getLength(A),6);
+    ASSERT_THROW(Store.getRoute(1000,roads),TrafficSimulation_error);
+
+    //Commuters driving 20 different routes, through a journey log with and without interning
+    auto makeLeg = [](size_t i)
+    {
+        JourneyLeg L;
+        L.journey=i;
+        L.startTime=i;
+        size_t route=(i*7)%20;
+        for (size_t r = 0; r < 30; ++r)
+            L.roads.push_back((route*977+r*r*13)%5000);
+        return L;
+    };
+    const size_t legs=5000;
+    std::stringstream Plain,Interned;
+    {
+        JourneyLog P(Plain);
+        JourneyLog I(Interned,1<<16,true);
+        for (size_t i = 0; i < legs; ++i)
+        {
+            JourneyLeg L=makeLeg(i);
+            JourneyLeg L2=L;
+            P.log(L);
+            I.log(L2);
+        }
+        P.close();
+        I.close();
+        ASSERT_EQ(I.getRouteStore().getNodeNumber(),1+20*30);
+        ASSERT_NEAR(I.getRouteStore().getDedupRatio(),legs/20.0,tolerance);
+    }
+    //The fixed width columns are the same, the road column is where the saving is
+    size_t fixed=legs*(8+1+4*8+4);
+    ASSERT_LT((Interned.str().size()-fixed)*10,Plain.str().size()-fixed);
+
+    JourneyLogReader R(Interned);
+    ASSERT_TRUE(R.hasInternedRoutes());
+    std::vector<JourneyLeg> block;
+    size_t read=0;
+    while (R.nextBlock(block))
+        for (const JourneyLeg& L : block)
+        {
+            JourneyLeg E=makeLeg(read++);
+            ASSERT_EQ(L.journey,E.journey);
+            ASSERT_TRUE(L.roads==E.roads);
+        }
+    ASSERT_EQ(read,legs);
+}
+
+
+//An n by n grid of Intersects, spacing meters apart, with streets to the right and up, node x+n*y is at (x,y)
+std::string Grid_City_String(size_t n, double spacing)
+{
+    std::stringstream S;
+    S<<"{\"nodes\":[";
+    for (size_t y = 0; y < n; ++y)
+        for (size_t x = 0; x < n; ++x)
+            S<<(x+y>0 ? "," : "")<<"{\"type\":\"Intersect\",\"pos\":["<<x*spacing<<","<<y*spacing<<"]}";
+    S<<"],\"auto_roads\":[";
+    bool first=true;
+    for (size_t y = 0; y < n; ++y)
+        for (size_t x = 0; x < n; ++x)
+        {
+            if (x+1<n)
+            {
+                S<<(first ? "" : ",")<<"{\"type\":\"Byvej\",\"first\":"<<x+n*y<<",\"second\":"<<x+1+n*y<<"}";
+                first=false;
+            }
+            if (y+1<n)
+            {
+                S<<(first ? "" : ",")<<"{\"type\":\"Byvej\",\"first\":"<<x+n*y<<",\"second\":"<<x+n*(y+1)<<"}";
+                first=false;
+            }
+        }
+    S<<"]}";
+    return S.str();
+}
+
+//Shortest times from one node to all, the slow and obviously correct way
+std::vector<double> bellman_ford(const RoutingGraph& G, size_t origin)
+{
+    std::vector<double> D(G.getNodeNumber(),1e300);
+    D[origin]=0;
+    for (size_t i = 0; i < G.getNodeNumber(); ++i)
+        for (size_t n = 0; n < G.getNodeNumber(); ++n)
+            for (const RoutingEdge* E=G.edgesBegin(n); E!=G.edgesEnd(n); ++E)
+                D[E->to]=std::min(D[E->to],D[n]+G.getTravelTime(E->road));
+    return D;
+}
+
+TEST(Test_Routing, Fastest_route)
+{
+    std::stringstream S(Grid_City_String(6,100));
+    CityNetwork City(S);
+    RoutingGraph G(City);
+    ASSERT_EQ(G.getNodeNumber(),36);
+    ASSERT_EQ(G.getEdgeNumber(),2*60);
+    ASSERT_NEAR(G.getFreeFlowTime(0),100/(50/3.6),1e-9);
+
+    //Scramble the travel times, so the fastest route is not obvious
+    uint64_t x=12345;
+    for (size_t r = 0; r < G.getRoadNumber(); ++r)
+    {
+        x=x*6364136223846793005ull+1442695040888963407ull;
+        G.setTravelTime(r,1+(x>>40)%100);
+    }
+
+    Router R(G);
+    std::vector<size_t> roads;
+    for (size_t o : {0,7,35,20})
+    {
+        std::vector<double> D=bellman_ford(G,o);
+        for (size_t d = 0; d < 36; ++d)
+        {
+            double t=R.route(o,d,roads);
+            ASSERT_NEAR(t,D[d],1e-9);
+
+            //The roads lead from the origin to the destination, and add up to the time
+            size_t at=o;
+            double sum=0;
+            for (size_t r : roads)
+            {
+                std::shared_ptr<Road> Rd=City.getRoad(r);
+                at=Rd->getOther(at).getNodeID();
+                sum+=G.getTravelTime(r);
+            }
+            ASSERT_EQ(at,d);
+            ASSERT_NEAR(sum,t,1e-9);
+        }
+    }
+    ASSERT_THROW(R.route(0,36,roads),node_address_exception);
+
+    //The direct road only goes from 1 to 0, so 0 to 1 has to go around
+    std::stringstream OneWay("{\"nodes\":[{\"type\":\"Intersect\",\"pos\":[0,0]},{\"type\":\"Intersect\",\"pos\":[100,0]},{\"type\":\"Intersect\",\"pos\":[50,500]},{\"type\":\"Intersect\",\"pos\":[50,-500]}],"
+        "\"auto_roads\":[{\"type\":\"Byvej\",\"first\":1,\"second\":0,\"oneWay\":true},{\"type\":\"Byvej\",\"first\":0,\"second\":2},{\"type\":\"Byvej\",\"first\":2,\"second\":1},{\"type\":\"Byvej\",\"first\":3,\"second\":0,\"oneWay\":true}]}");
+    CityNetwork OneWayCity(OneWay);
+    RoutingGraph OG(OneWayCity);
+    Router OR(OG);
+    OR.route(0,1,roads);
+    ASSERT_TRUE(roads==std::vector<size_t>({1,2}));
+    OR.route(1,0,roads);
+    ASSERT_TRUE(roads==std::vector<size_t>({0}));
+    ASSERT_EQ(OR.route(0,3,roads),-1);
+    ASSERT_TRUE(roads.empty());
+}
+
+TEST(Test_Routing, Route_cache_across_days)
+{
+    std::stringstream S(Grid_City_String(6,100));
+    CityNetwork City(S);
+    RoutingGraph G(City);
+    Router R(G);
+    RouteCache Cache(G,R,900,0.2);
+
+    std::vector<size_t> roads,again;
+    const double day=86400;
+    double t=Cache.lookup(0,35,8*3600,byCar,roads);
+    ASSERT_EQ(Cache.getMisses(),1);
+
+    //Same trip, a few minutes later and days later, is the same route
+    ASSERT_NEAR(Cache.lookup(0,35,8*3600+300+3*day,byCar,again),t,tolerance);
+    ASSERT_TRUE(again==roads);
+    ASSERT_EQ(Cache.getHits(),1);
+
+    //Another bucket, mode or trip is a new search
+    Cache.lookup(0,35,9*3600,byCar,again);
+    Cache.lookup(0,35,8*3600,byBus,again);
+    Cache.lookup(35,0,8*3600,byCar,again);
+    ASSERT_EQ(Cache.getMisses(),4);
+    ASSERT_EQ(Cache.getSize(),4);
+    size_t searches=R.getSearches();
+
+    //A small change on the route is tolerated
+    size_t used=roads[0];
+    Cache.setTravelTime(used,G.getTravelTime(used)*1.1);
+    Cache.lookup(0,35,8*3600,byCar,again);
+    ASSERT_EQ(R.getSearches(),searches);
+    ASSERT_EQ(Cache.getInvalidations(),0);
+
+    //A big one is not, every cached route through the road is planned again
+    Cache.setTravelTime(used,t);
+    ASSERT_GT(Cache.getInvalidations(),0);
+    Cache.lookup(0,35,8*3600,byCar,again);
+    ASSERT_EQ(R.getSearches(),searches+1);
+    //The road is now so slow the new route goes around it
+    ASSERT_TRUE(std::find(again.begin(),again.end(),used)==again.end());
+    ASSERT_GT(Cache.getHitRate(),0);
+    ASSERT_LT(Cache.getHitRate(),1);
+}
+
+
+TEST(Test_Routing, Time_dependent_route)
+{
+    //Two equally long ways from 0 to 3, over 1 or over 2
+    std::stringstream S("{\"nodes\":[{\"type\":\"Intersect\",\"pos\":[0,0]},{\"type\":\"Intersect\",\"pos\":[100,0]},{\"type\":\"Intersect\",\"pos\":[0,100]},{\"type\":\"Intersect\",\"pos\":[100,100]}],"
+        "\"auto_roads\":[{\"type\":\"Byvej\",\"first\":0,\"second\":1},{\"type\":\"Byvej\",\"first\":0,\"second\":2},{\"type\":\"Byvej\",\"first\":1,\"second\":3},{\"type\":\"Byvej\",\"first\":2,\"second\":3}]}");
+    CityNetwork City(S);
+    RoutingGraph G(City);
+    Router R(G);
+    double free=G.getFreeFlowTime(0);
+
+    //Without data, every time of day is the same as the static search
+    TravelTimeProfiles P(G);
+    std::vector<size_t> roads;
+    ASSERT_NEAR(R.route(0,3,8*3600,P,roads),2*free,1e-9);
+    ASSERT_NEAR(R.route(0,3,roads),2*free,1e-9);
+
+    //Points in the middle of the hours, linear between them, and around the clock
+    std::vector<double> profile(24,free);
+    profile[7]=2*free;
+    profile[8]=10*free;
+    P.setProfile(0,profile);
+    ASSERT_NEAR(P.travelTime(0,8.5*3600),10*free,1e-9);
+    ASSERT_NEAR(P.travelTime(0,8*3600),6*free,1e-9);
+    ASSERT_NEAR(P.travelTime(0,8*3600+3*86400),6*free,1e-9);
+    ASSERT_NEAR(P.travelTime(0,23.75*3600),free,1e-9);
+    ASSERT_NEAR(P.travelTime(0,-0.25*3600),free,1e-9);
+    ASSERT_THROW(P.setProfile(4,profile),road_address_exception);
+    ASSERT_THROW(P.setProfile(0,std::vector<double>(23,1)),TrafficSimulation_error);
+
+    //Road 1 is a little slower all day, so it is only used when road 0 is busy
+    P.setProfile(1,std::vector<double>(24,1.1*free));
+    R.route(0,3,3*3600,P,roads);
+    ASSERT_TRUE(roads==std::vector<size_t>({0,2}));
+    R.route(0,3,8.5*3600,P,roads);
+    ASSERT_TRUE(roads==std::vector<size_t>({1,3}));
+
+    //Leaving later never gets you there earlier, even if the data says so
+    TravelTimeProfiles Short(G,4,400);
+    Short.setProfile(0,{500,10,10,10});
+    ASSERT_NEAR(Short.getPoint(0,1),400,1e-9);
+    ASSERT_NEAR(Short.getPoint(0,2),300,1e-9);
+    ASSERT_NEAR(Short.getPoint(0,3),200,1e-9);
+    double lastArrival=-1;
+    for (double t = 0; t < 1200; t+=7)
+    {
+        double arrival=t+Short.travelTime(0,t);
+        ASSERT_GE(arrival,lastArrival-1e-9);
+        lastArrival=arrival;
+    }
+
+    //From yesterday's statistics: road 2 took 60 s at 8, everything else was empty
+    std::stringstream File;
+    {
+        RoadStatistics Stats(File,4,1,3600);
+        for (size_t h = 0; h < 24; ++h)
+        {
+            if (h==8)
+                for (size_t v = 0; v < 10; ++v)
+                    Stats.getShard(0).traversal(h*3600+100*v,2,60,100/60.0);
+            Stats.closeHour();
+        }
+    }
+    RoadStatisticsReader Reader(File);
+    TravelTimeProfiles Yesterday(G);
+    Yesterday.loadStatistics(Reader,G);
+    ASSERT_NEAR(Yesterday.getPoint(2,8),60,60*0.07);
+    ASSERT_NEAR(Yesterday.getPoint(2,12),free,1e-9);
+    ASSERT_NEAR(Yesterday.getPoint(0,8),free,1e-9);
+
+    std::stringstream File2(File.str());
+    RoadStatisticsReader Reader2(File2);
+    TravelTimeProfiles HalfHours(G,48);
+    ASSERT_THROW(HalfHours.loadStatistics(Reader2,G),TrafficSimulation_error);
+}
+
+
+//Fastest time with turns, the slow and obviously correct way, over every edge (road in one direction)
+double bellman_ford_turns(const RoutingGraph& G, size_t origin, size_t destination)
+{
+    if (origin==destination)
+        return 0;
+    std::vector<double> D(G.getEdgeNumber(),1e300);
+    for (size_t e = G.getFirstEdge(origin); e < G.getFirstEdge(origin+1); ++e)
+        D[e]=G.getTravelTime(G.getEdge(e).road);
+    for (size_t i = 0; i < G.getEdgeNumber(); ++i)
+        for (size_t e = 0; e < G.getEdgeNumber(); ++e)
+        {
+            size_t v=G.getEdge(e).to;
+            for (size_t next = G.getFirstEdge(v); next < G.getFirstEdge(v+1); ++next)
+            {
+                double turn=G.getTurnCost(v,G.getHeadSlot(e),G.getTailSlot(next));
+                if (turn!=RoutingGraph::forbidden)
+                    D[next]=std::min(D[next],D[e]+turn+G.getTravelTime(G.getEdge(next).road));
+            }
+        }
+    double best=1e300;
+    for (size_t e = 0; e < G.getEdgeNumber(); ++e)
+        if (G.getEdge(e).to==destination)
+            best=std::min(best,D[e]);
+    return best<1e300 ? best : -1;
+}
+
+TEST(Test_Routing, Turn_costs)
+{
+    std::stringstream S(Grid_City_String(4,100));
+    CityNetwork City(S);
+    auto roadBetween = [&City](size_t a, size_t b)
+    {
+        for (size_t r = 0; r < City.getRoadsSize(); ++r)
+        {
+            std::shared_ptr<Road> Rd=City.getRoad(r);
+            size_t start=Rd->getStart().getNodeID();
+            size_t end=Rd->getEnd().getNodeID();
+            if ((start==a && end==b) || (start==b && end==a))
+                return r;
+        }
+        return City.getRoadsSize();
+    };
+    size_t west=roadBetween(4,5);
+    size_t east=roadBetween(5,6);
+    size_t north=roadBetween(5,9);
+    size_t south=roadBetween(1,5);
+
+    //Going east through node 5, north is to the left
+    Intersection& I=dynamic_cast<Intersection&>(*City.getNode(5));
+    ASSERT_NEAR(I.idealTransferTime(west,east),0,1e-9);
+    ASSERT_NEAR(I.idealTransferTime(west,north),6,1e-9);
+    ASSERT_NEAR(I.idealTransferTime(west,south),3,1e-9);
+    ASSERT_NEAR(I.idealTransferTime(west,west),20,1e-9);
+    ASSERT_THROW(I.idealTransferTime(west,roadBetween(0,1)),road_address_exception);
+
+    //The same graph, with and without turn matrices
+    RoutingGraph Dense(City);
+    RoutingGraph Sparse(City,2);
+    ASSERT_EQ(Dense.getTurnBytes(),sizeof(float)*(4*4*4+8*3*3+4*2*2));
+    ASSERT_EQ(Sparse.getTurnBytes(),sizeof(float)*(4*2*2));
+
+    Router R(Dense);
+    std::vector<size_t> roads;
+    double free=Dense.getFreeFlowTime(west);
+    ASSERT_NEAR(R.routeWithTurns(4,6,roads),2*free,1e-9);
+    ASSERT_TRUE(roads==std::vector<size_t>({west,east}));
+    //Left at 5, or right at 8
+    ASSERT_NEAR(R.routeWithTurns(4,9,roads),2*free+3,1e-9);
+    ASSERT_NEAR(R.routeWithTurns(4,4,roads),0,1e-9);
+
+    //No straight on, or right, at 5
+    for (RoutingGraph* G : {&Dense,&Sparse})
+    {
+        G->forbidTurn(5,west,east);
+        G->setTurnCost(5,west,south,100);
+        ASSERT_THROW(G->forbidTurn(5,west,roadBetween(0,1)),road_address_exception);
+        ASSERT_THROW(G->forbidTurn(16,west,east),node_address_exception);
+        ASSERT_THROW(G->setTurnCost(5,west,north,-1),TrafficSimulation_error);
+    }
+    ASSERT_GT(Sparse.getTurnBytes(),sizeof(float)*(4*2*2));
+    ASSERT_GT(R.routeWithTurns(4,6,roads),2*free);
+
+    //Scramble the travel times, and compare every trip
+    uint64_t x=777;
+    for (size_t r = 0; r < Dense.getRoadNumber(); ++r)
+    {
+        x=x*6364136223846793005ull+1442695040888963407ull;
+        Dense.setTravelTime(r,1+(x>>40)%20);
+        Sparse.setTravelTime(r,Dense.getTravelTime(r));
+    }
+    Router SR(Sparse);
+    std::vector<size_t> sparseRoads;
+    for (size_t o = 0; o < 16; ++o)
+        for (size_t d = 0; d < 16; ++d)
+        {
+            double t=R.routeWithTurns(o,d,roads);
+            ASSERT_NEAR(t,bellman_ford_turns(Dense,o,d),1e-6);
+            ASSERT_NEAR(SR.routeWithTurns(o,d,sparseRoads),t,1e-6);
+
+            //Never straight on from west to east at 5
+            size_t at=o;
+            for (size_t i = 0; i < roads.size(); ++i)
+            {
+                ASSERT_FALSE(i>0 && roads[i-1]==west && roads[i]==east && at==5);
+                at=City.getRoad(roads[i])->getOther(at).getNodeID();
+            }
+            ASSERT_EQ(at,d);
+        }
+}
+
+
+//Like Grid_City_String, but 300 m apart and every street is parts roads long, with bent nodes in between. The streets along the bottom are one-way to the right, the first street from node n only one-way for its first road, there is a Hellhole on a driveway of two roads to node 0, and a ring of 4 nodes on its own
+std::string Chain_City_String(size_t n, size_t parts)
+{
+    std::vector<std::string> nodes;
+    std::vector<std::string> roads;
+    auto node = [&nodes](std::string type, double x, double y)
+    {
+        nodes.push_back("{\"type\":\""+type+"\",\"pos\":["+std::to_string(int(x))+","+std::to_string(int(y))+"]}");
+        return nodes.size()-1;
+    };
+    auto road = [&roads](size_t a, size_t b, bool oneWay)
+    {
+        roads.push_back("{\"type\":\"Byvej\",\"first\":"+std::to_string(a)+",\"second\":"+std::to_string(b)+(oneWay ? ",\"oneWay\":true}" : "}"));
+    };
+
+    for (size_t y = 0; y < n; ++y)
+        for (size_t x = 0; x < n; ++x)
+            node("Intersect",x*300.0,y*300.0);
+    auto street = [&](size_t a, size_t b, bool oneWay, bool firstOneWay)
+    {
+        double ax=(a%n)*300.0, ay=(a/n)*300.0, bx=(b%n)*300.0, by=(b/n)*300.0;
+        size_t last=a;
+        for (size_t k = 1; k < parts; ++k)
+        {
+            double f=double(k)/parts;
+            double bend=0;
+            size_t mid=node("Intersect",ax+f*(bx-ax)+(ay==by ? 0 : bend),ay+f*(by-ay)+(ax==bx ? 0 : bend));
+            road(last,mid,oneWay || (firstOneWay && k==1));
+            last=mid;
+        }
+        road(last,b,oneWay);
+    };
+    for (size_t y = 0; y < n; ++y)
+        for (size_t x = 0; x < n; ++x)
+        {
+            if (x+1<n)
+                street(x+n*y,x+1+n*y,y==0,y==1 && x==0);
+            if (y+1<n)
+                street(x+n*y,x+n*(y+1),false,false);
+        }
+
+    size_t drive=node("Intersect",-150,0);
+    size_t hole=node("Hellhole",-300,0);
+    road(hole,drive,false);
+    road(drive,0,false);
+
+    size_t ring=nodes.size();
+    node("Intersect",5000,5000);
+    node("Intersect",5100,5000);
+    node("Intersect",5100,5100);
+    node("Intersect",5000,5100);
+    for (size_t i = 0; i < 4; ++i)
+        road(ring+i,ring+(i+1)%4,false);
+
+    std::string out="{\"nodes\":[";
+    for (size_t i = 0; i < nodes.size(); ++i)
+        out+=(i>0 ? "," : "")+nodes[i];
+    out+="],\"auto_roads\":[";
+    for (size_t i = 0; i < roads.size(); ++i)
+        out+=(i>0 ? "," : "")+roads[i];
+    return out+"]}";
+}
+
+TEST(Test_Routing, Chain_compression)
+{
+    std::stringstream S(Chain_City_String(3,3));
+    CityNetwork City(S);
+    RoutingGraph Full(City);
+    //The corners of the ring are free to drive through, as in a roundabout, so it is a ring of collapsed nodes
+    for (size_t i = 0; i < 4; ++i)
+    {
+        size_t a=38+(i+3)%4, b=38+i;
+        Full.setTurnCost(35+i,a,b,0);
+        Full.setTurnCost(35+i,b,a,0);
+    }
+    RoutingGraph Compressed=RoutingGraph::compressChains(Full);
+    ASSERT_THROW(RoutingGraph::compressChains(Compressed),TrafficSimulation_error);
+
+    //The grid (the corners with two roads cost a turn), the Hellhole, one node of the ring, and the node between one-way and two-way
+    ASSERT_EQ(Full.getNodeNumber(),39);
+    ASSERT_EQ(Compressed.getNodeNumber(),12);
+    ASSERT_EQ(Full.getRoadNumber(),42);
+    ASSERT_EQ(Compressed.getRoadNumber(),15);
+    ASSERT_EQ(Compressed.getCompressedNode(9),RoutingGraph::removedNode);
+    ASSERT_NE(Compressed.getCompressedNode(6),RoutingGraph::removedNode);//A corner
+    ASSERT_EQ(Compressed.getCompressedNode(36),RoutingGraph::removedNode);//In the ring
+    ASSERT_NE(Compressed.getCompressedNode(2),RoutingGraph::removedNode);
+    ASSERT_EQ(Compressed.getOriginalNode(Compressed.getCompressedNode(4)),4);
+    ASSERT_EQ(Full.getCompressedNode(9),9);
+
+    //Every road is in exactly one chain
+    std::vector<size_t> seen(Full.getRoadNumber(),0);
+    for (size_t c = 0; c < Compressed.getRoadNumber(); ++c)
+        for (size_t i = 0; i < Compressed.getChainLength(c); ++i)
+        {
+            ++seen[Compressed.getChainRoad(c,i)];
+            ASSERT_EQ(Compressed.getChainOf(Compressed.getChainRoad(c,i)),c);
+        }
+    ASSERT_TRUE(seen==std::vector<size_t>(Full.getRoadNumber(),1));
+
+    Router FullRouter(Full);
+    Router CompressedRouter(Compressed);
+    std::vector<size_t> fullRoads,chains,expanded;
+    for (size_t round = 0; round < 2; ++round)
+    {
+        for (size_t a = 0; a < Compressed.getNodeNumber(); ++a)
+            for (size_t b = 0; b < Compressed.getNodeNumber(); ++b)
+            {
+                size_t o=Compressed.getOriginalNode(a);
+                size_t d=Compressed.getOriginalNode(b);
+                double t=FullRouter.route(o,d,fullRoads);
+                ASSERT_NEAR(CompressedRouter.route(a,b,chains),t,1e-6);
+
+                //The chains are roads the vehicles can drive, in the same time
+                Compressed.expandRoute(a,chains,expanded);
+                size_t at=o;
+                double sum=0;
+                for (size_t r : expanded)
+                {
+                    std::shared_ptr<Road> Rd=City.getRoad(r);
+                    ASSERT_TRUE(!Rd->getOneWay() || Rd->getStart().getNodeID()==at);
+                    at=Rd->getOther(at).getNodeID();
+                    sum+=Full.getTravelTime(r);
+                }
+                if (t>=0)
+                {
+                    ASSERT_EQ(at,d);
+                    ASSERT_NEAR(sum,t,1e-6);
+                }
+
+                //And with the turns, nothing inside a chain costs a turn
+                ASSERT_NEAR(CompressedRouter.routeWithTurns(a,b,chains),FullRouter.routeWithTurns(o,d,fullRoads),1e-6);
+            }
+
+        //Again with other travel times
+        uint64_t x=99;
+        for (size_t r = 0; r < Full.getRoadNumber(); ++r)
+        {
+            x=x*6364136223846793005ull+1442695040888963407ull;
+            Full.setTravelTime(r,1+(x>>40)%30);
+        }
+        Compressed.updateTravelTimes(Full);
+    }
+    ASSERT_THROW(Compressed.updateTravelTimes(Compressed),TrafficSimulation_error);
+    ASSERT_THROW(Compressed.expandRoute(0,{Compressed.getRoadNumber()},expanded),TrafficSimulation_error);
+}
+
+
+TEST(Test_Routing, Chain_compression_keeps_signals_and_bends)
+{
+    //A road from Hellhole to Hellhole, through a traffic light and a bend, with a straight plain intersection before each
+    std::stringstream S("{\"nodes\":["
+        "{\"type\":\"Hellhole\",\"pos\":[0,0]},"
+        "{\"type\":\"Intersect\",\"pos\":[100,0]},"
+        "{\"type\":\"Trafficlight\",\"pos\":[200,0]},"
+        "{\"type\":\"Intersect\",\"pos\":[300,0]},"
+        "{\"type\":\"Intersect\",\"pos\":[400,100]},"
+        "{\"type\":\"Hellhole\",\"pos\":[500,200]}],"
+        "\"auto_roads\":["
+        "{\"type\":\"Byvej\",\"first\":0,\"second\":1},"
+        "{\"type\":\"Byvej\",\"first\":1,\"second\":2},"
+        "{\"type\":\"Byvej\",\"first\":2,\"second\":3},"
+        "{\"type\":\"Byvej\",\"first\":3,\"second\":4},"
+        "{\"type\":\"Byvej\",\"first\":4,\"second\":5}]}");
+    CityNetwork City(S);
+    RoutingGraph Full(City);
+    RoutingGraph Compressed=RoutingGraph::compressChains(Full);
+
+    //The traffic light and the bend have two roads, but are kept, the straight intersections are not
+    ASSERT_EQ(Compressed.getNodeNumber(),4);
+    ASSERT_EQ(Compressed.getCompressedNode(1),RoutingGraph::removedNode);
+    ASSERT_NE(Compressed.getCompressedNode(2),RoutingGraph::removedNode);
+    ASSERT_NE(Compressed.getCompressedNode(3),RoutingGraph::removedNode);
+    ASSERT_EQ(Compressed.getCompressedNode(4),RoutingGraph::removedNode);
+    ASSERT_GT(Full.getTurnCost(3,0,1),0);
+
+    //So the turn at the bend is paid both ways, and the traffic light is still somewhere to go
+    Router FullRouter(Full);
+    Router CompressedRouter(Compressed);
+    std::vector<size_t> roads;
+    for (auto [o,d] : {std::pair<size_t,size_t>{0,5},{5,0},{0,2},{2,5}})
+    {
+        double t=FullRouter.routeWithTurns(o,d,roads);
+        ASSERT_GT(t,0);
+        ASSERT_NEAR(CompressedRouter.routeWithTurns(Compressed.getCompressedNode(o),Compressed.getCompressedNode(d),roads),t,1e-6);
+    }
+}
+
+//Grid_City_String, with the nodes and roads written in a random order
+std::string Shuffled_Grid_City_String(size_t n, uint64_t seed)
+{
+    std::vector<size_t> place(n*n);
+    std::iota(place.begin(),place.end(),0);
+    std::mt19937_64 G(seed);
+    std::shuffle(place.begin(),place.end(),G);//place[grid node]=index in the file
+
+    std::vector<std::string> nodes(n*n);
+    std::vector<std::string> roads;
+    for (size_t y = 0; y < n; ++y)
+        for (size_t x = 0; x < n; ++x)
+        {
+            nodes[place[x+n*y]]="{\"type\":\"Intersect\",\"pos\":["+std::to_string(x*100)+","+std::to_string(y*100)+"]}";
+            if (x+1<n)
+                roads.push_back("{\"type\":\"Byvej\",\"first\":"+std::to_string(place[x+n*y])+",\"second\":"+std::to_string(place[x+1+n*y])+"}");
+            if (y+1<n)
+                roads.push_back("{\"type\":\"Byvej\",\"first\":"+std::to_string(place[x+n*y])+",\"second\":"+std::to_string(place[x+n*(y+1)])+"}");
+        }
+    std::shuffle(roads.begin(),roads.end(),G);
+
+    std::string out="{\"nodes\":[";
+    for (size_t i = 0; i < nodes.size(); ++i)
+        out+=(i>0 ? "," : "")+nodes[i];
+    out+="],\"auto_roads\":[";
+    for (size_t i = 0; i < roads.size(); ++i)
+        out+=(i>0 ? "," : "")+roads[i];
+    return out+"]}";
+}
+
+TEST(Test_Loading, Renumber_on_load)
+{
+    std::string Grid=Shuffled_Grid_City_String(20,5);
+    std::stringstream S(Grid);
+    CityNetwork File(S);
+    ASSERT_EQ(File.getFileNodeID(7),7);
+    ASSERT_EQ(File.getRoadFromFileID(7),7);
+
+    //How far apart the IDs of the ends of the roads are
+    auto spread = [](CityNetwork& City)
+    {
+        size_t sum=0;
+        for (size_t r = 0; r < City.getRoadsSize(); ++r)
+        {
+            size_t a=City.getRoad(r)->getStart().getNodeID();
+            size_t b=City.getRoad(r)->getEnd().getNodeID();
+            sum+=a>b ? a-b : b-a;
+        }
+        return sum;
+    };
+
+    for (CityNetwork::Ordering Order : {CityNetwork::hilbertOrder,CityNetwork::bandwidthOrder})
+    {
+        std::stringstream S2(Grid);
+        CityNetwork City(S2,Order);
+        ASSERT_EQ(City.getOrdering(),Order);
+        ASSERT_EQ(City.getNodesSize(),File.getNodesSize());
+        ASSERT_EQ(City.getRoadsSize(),File.getRoadsSize());
+
+        //The same city, with other IDs
+        for (size_t n = 0; n < City.getNodesSize(); ++n)
+        {
+            size_t f=City.getFileNodeID(n);
+            ASSERT_EQ(City.getNodeFromFileID(f),n);
+            ASSERT_EQ(City.getNode(n)->getNodeID(),n);
+            ASSERT_NEAR(City.getNode(n)->getX(),File.getNode(f)->getX(),tolerance);
+            ASSERT_NEAR(City.getNode(n)->getY(),File.getNode(f)->getY(),tolerance);
+            //The roads keep their local IDs at the node
+            ASSERT_EQ(City.getNode(n)->getRoadNumber(),File.getNode(f)->getRoadNumber());
+            for (size_t i = 0; i < City.getNode(n)->getRoadNumber(); ++i)
+                ASSERT_EQ(City.getFileRoadID(City.getNode(n)->getRoad(i,true).getRoadID()),File.getNode(f)->getRoad(i,true).getRoadID());
+        }
+        for (size_t r = 0; r < City.getRoadsSize(); ++r)
+        {
+            size_t f=City.getFileRoadID(r);
+            ASSERT_EQ(City.getRoadFromFileID(f),r);
+            ASSERT_EQ(City.getFileNodeID(City.getRoad(r)->getStart().getNodeID()),File.getRoad(f)->getStart().getNodeID());
+            ASSERT_EQ(City.getFileNodeID(City.getRoad(r)->getEnd().getNodeID()),File.getRoad(f)->getEnd().getNodeID());
+        }
+        ASSERT_THROW(City.getFileNodeID(400),node_address_exception);
+        ASSERT_THROW(City.getRoadFromFileID(760),road_address_exception);
+
+        //Neighbours get close IDs
+        ASSERT_LT(spread(City)*5,spread(File));
+
+        //And the routes are the same
+        RoutingGraph FG(File);
+        RoutingGraph G(City);
+        Router FR(FG);
+        Router R(G);
+        std::vector<size_t> roads;
+        for (size_t o : {0,13,200,399})
+            for (size_t d : {5,77,390})
+                ASSERT_NEAR(R.route(City.getNodeFromFileID(o),City.getNodeFromFileID(d),roads),FR.route(o,d,roads),1e-9);
+    }
+
+    //The same vehicles from the same sources, only the node IDs differ
+    std::vector<std::pair<double,size_t> > FileSpawns=run_sources("city.json",3,3600);
+    std::ifstream F(std::string(SOURCE_DIR)+"/city.json");
+    CityNetwork City(F,CityNetwork::hilbertOrder);
+    EventQueue Q;
+    std::vector<std::pair<double,size_t> > Spawns;
+    City.startSources(Q,0,3,[&](double time, size_t node){Spawns.push_back({time,City.getFileNodeID(node)});});
+    Q.runUntil(3600);
+    std::sort(FileSpawns.begin(),FileSpawns.end());
+    std::sort(Spawns.begin(),Spawns.end());
+    ASSERT_FALSE(Spawns.empty());
+    ASSERT_EQ(Spawns,FileSpawns);
+}
+
+
+//Does segment ab cross segment cd (touching counts)
+bool segments_cross(double ax, double ay, double bx, double by, double cx, double cy, double dx, double dy)
+{
+    auto side = [](double px, double py, double qx, double qy, double rx, double ry)
+    {
+        double c=(qx-px)*(ry-py)-(qy-py)*(rx-px);
+        return (c>0)-(c<0);
+    };
+    auto within = [](double p, double q, double r){return std::min(p,q)<=r && r<=std::max(p,q);};
+    int d1=side(cx,cy,dx,dy,ax,ay), d2=side(cx,cy,dx,dy,bx,by), d3=side(ax,ay,bx,by,cx,cy), d4=side(ax,ay,bx,by,dx,dy);
+    if (d1*d2<0 && d3*d4<0)
+        return true;
+    return (d1==0 && within(cx,dx,ax) && within(cy,dy,ay)) || (d2==0 && within(cx,dx,bx) && within(cy,dy,by))
+        || (d3==0 && within(ax,bx,cx) && within(ay,by,cy)) || (d4==0 && within(ax,bx,dx) && within(ay,by,dy));
+}
+
+TEST(Test_Spatial, Nearest_and_box_queries)
+{
+    //300 nodes spread at random, with roads to the next node and to one far away
+    std::mt19937_64 Gen(11);
+    const size_t nodes=300;
+    std::stringstream S;
+    S<<"{\"nodes\":[";
+    for (size_t n = 0; n < nodes; ++n)
+        S<<(n>0 ? "," : "")<<"{\"type\":\"Intersect\",\"pos\":["<<Gen()%5000<<","<<Gen()%3000<<"]}";
+    S<<"],\"auto_roads\":[";
+    for (size_t n = 0; n < nodes; ++n)
+        S<<(n>0 ? "," : "")<<"{\"type\":\"Byvej\",\"first\":"<<n<<",\"second\":"<<(n+1)%nodes<<"},{\"type\":\"Byvej\",\"first\":"<<n<<",\"second\":"<<(n*7+13)%nodes<<"}";
+    S<<"]}";
+    CityNetwork City(S);
+    SpatialIndex Index(City);
+    ASSERT_GT(Index.getCellNumber(),100);
+    ASSERT_THROW(SpatialIndex(City,-1),TrafficSimulation_error);
+
+    auto distanceToRoad = [&City](size_t r, double x, double y)
+    {
+        std::shared_ptr<Road> R=City.getRoad(r);
+        double ax=R->getStart().getX(), ay=R->getStart().getY(), bx=R->getEnd().getX(), by=R->getEnd().getY();
+        double f=std::clamp(((x-ax)*(bx-ax)+(y-ay)*(by-ay))/((bx-ax)*(bx-ax)+(by-ay)*(by-ay)),0.0,1.0);
+        return std::hypot(x-ax-f*(bx-ax),y-ay-f*(by-ay));
+    };
+
+    SpatialHit hits[5];
+    for (size_t q = 0; q < 200; ++q)
+    {
+        //Some of the points are outside the city
+        double x=double(Gen()%7000)-1000;
+        double y=double(Gen()%5000)-1000;
+
+        std::vector<double> all;
+        for (size_t n = 0; n < nodes; ++n)
+            all.push_back(std::hypot(x-City.getNode(n)->getX(),y-City.getNode(n)->getY()));
+        std::sort(all.begin(),all.end());
+        ASSERT_EQ(Index.nearestNodes(x,y,hits,5),5);
+        for (size_t i = 0; i < 5; ++i)
+        {
+            ASSERT_NEAR(hits[i].distance,all[i],1e-9);
+            ASSERT_NEAR(hits[i].distance,std::hypot(x-City.getNode(hits[i].id)->getX(),y-City.getNode(hits[i].id)->getY()),1e-9);
+        }
+
+        all.clear();
+        for (size_t r = 0; r < City.getRoadsSize(); ++r)
+            all.push_back(distanceToRoad(r,x,y));
+        std::sort(all.begin(),all.end());
+        ASSERT_EQ(Index.nearestRoads(x,y,hits,3),3);
+        for (size_t i = 0; i < 3; ++i)
+        {
+            ASSERT_NEAR(hits[i].distance,all[i],1e-9);
+            ASSERT_NEAR(hits[i].distance,distanceToRoad(hits[i].id,x,y),1e-9);
+            ASSERT_NEAR(hits[i].distance,std::hypot(x-hits[i].x,y-hits[i].y),1e-9);
+        }
+        ASSERT_TRUE(hits[0].id!=hits[1].id && hits[1].id!=hits[2].id && hits[0].id!=hits[2].id);
+    }
+    ASSERT_EQ(Index.nearestNodes(0,0,hits,0),0);
+
+    std::vector<size_t> found(1000);
+    for (size_t q = 0; q < 200; ++q)
+    {
+        double x0=double(Gen()%6000)-500, y0=double(Gen()%4000)-500;
+        KeyframeBox Box{x0,y0,x0+double(Gen()%1500),y0+double(Gen()%1500)};
+
+        std::vector<size_t> expected;
+        for (size_t n = 0; n < nodes; ++n)
+        {
+            double x=City.getNode(n)->getX(), y=City.getNode(n)->getY();
+            if (x>=Box.minX && x<=Box.maxX && y>=Box.minY && y<=Box.maxY)
+                expected.push_back(n);
+        }
+        size_t count=Index.nodesIn(Box,found.data(),found.size());
+        std::vector<size_t> got(found.begin(),found.begin()+count);
+        std::sort(got.begin(),got.end());
+        ASSERT_TRUE(got==expected);
+
+        expected.clear();
+        for (size_t r = 0; r < City.getRoadsSize(); ++r)
+        {
+            std::shared_ptr<Road> R=City.getRoad(r);
+            double ax=R->getStart().getX(), ay=R->getStart().getY(), bx=R->getEnd().getX(), by=R->getEnd().getY();
+            bool inside=ax>=Box.minX && ax<=Box.maxX && ay>=Box.minY && ay<=Box.maxY;
+            if (inside || segments_cross(ax,ay,bx,by,Box.minX,Box.minY,Box.maxX,Box.minY) || segments_cross(ax,ay,bx,by,Box.maxX,Box.minY,Box.maxX,Box.maxY)
+                || segments_cross(ax,ay,bx,by,Box.maxX,Box.maxY,Box.minX,Box.maxY) || segments_cross(ax,ay,bx,by,Box.minX,Box.maxY,Box.minX,Box.minY))
+                expected.push_back(r);
+        }
+        count=Index.roadsIn(Box,found.data(),found.size());
+        got.assign(found.begin(),found.begin()+count);
+        std::sort(got.begin(),got.end());
+        ASSERT_TRUE(got==expected);
+
+        //Too small an array still gives the count
+        if (count>2)
+        {
+            size_t two[2];
+            ASSERT_EQ(Index.roadsIn(Box,two,2),count);
+        }
+    }
+
+    //Many threads snapping at once get what one thread gets
+    std::vector<std::pair<double,double> > points;
+    for (size_t i = 0; i < 2000; ++i)
+        points.push_back({double(Gen()%5000),double(Gen()%3000)});
+    std::vector<size_t> single(points.size());
+    for (size_t i = 0; i < points.size(); ++i)
+    {
+        Index.nearestRoads(points[i].first,points[i].second,hits,1);
+        single[i]=hits[0].id;
+    }
+    std::vector<size_t> parallel(points.size());
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < 4; ++t)
+        threads.emplace_back([&,t](){
+            SpatialHit H;
+            for (size_t i = t; i < points.size(); i+=4)
+            {
+                Index.nearestRoads(points[i].first,points[i].second,&H,1);
+                parallel[i]=H.id;
+            }
+        });
+    for (std::thread& T : threads)
+        T.join();
+    ASSERT_TRUE(single==parallel);
+}
+
+
+//An n by n grid where most streets are one-way in a random direction, so parts of it are cut off
+std::string One_Way_Grid_City_String(size_t n, uint64_t seed)
+{
+    std::mt19937_64 Gen(seed);
+    std::stringstream S;
+    S<<"{\"nodes\":[";
+    for (size_t y = 0; y < n; ++y)
+        for (size_t x = 0; x < n; ++x)
+            S<<(x+y>0 ? "," : "")<<"{\"type\":\"Intersect\",\"pos\":["<<x*100<<","<<y*100<<"]}";
+    S<<"],\"auto_roads\":[";
+    bool first=true;
+    auto road = [&](size_t a, size_t b)
+    {
+        bool oneWay=Gen()%10<7;
+        if (oneWay && Gen()%2)
+            std::swap(a,b);
+        S<<(first ? "" : ",")<<"{\"type\":\"Byvej\",\"first\":"<<a<<",\"second\":"<<b<<",\"oneWay\":"<<(oneWay ? "true" : "false")<<"}";
+        first=false;
+    };
+    for (size_t y = 0; y < n; ++y)
+        for (size_t x = 0; x < n; ++x)
+        {
+            //A few holes, so it is not all one piece either
+            if (x+1<n && Gen()%8)
+                road(x+n*y,x+1+n*y);
+            if (y+1<n && Gen()%8)
+                road(x+n*y,x+n*(y+1));
+        }
+    S<<"]}";
+    return S.str();
+}
+
+TEST(Test_Routing, Strong_components)
+{
+    for (uint64_t seed : {1,2,3})
+    {
+        std::stringstream S(One_Way_Grid_City_String(8,seed));
+        CityNetwork City(S);
+        RoutingGraph G(City);
+        const StrongComponents& C=City.getComponents();
+        size_t N=G.getNodeNumber();
+        ASSERT_EQ(C.getNodeNumber(),N);
+
+        //Who can reach whom, the slow way
+        std::vector<std::vector<uint8_t> > reach(N,std::vector<uint8_t>(N,0));
+        for (size_t o = 0; o < N; ++o)
+        {
+            std::vector<size_t> todo={o};
+            reach[o][o]=1;
+            while (!todo.empty())
+            {
+                size_t n=todo.back();
+                todo.pop_back();
+                for (const RoutingEdge* E=G.edgesBegin(n); E!=G.edgesEnd(n); ++E)
+                    if (!reach[o][E->to])
+                    {
+                        reach[o][E->to]=1;
+                        todo.push_back(E->to);
+                    }
+            }
+        }
+
+        std::vector<size_t> sizes(C.getComponentNumber(),0);
+        for (size_t a = 0; a < N; ++a)
+        {
+            ++sizes[C.getComponent(a)];
+            //The routing graph found the same
+            ASSERT_EQ(G.getComponents().getComponent(a),C.getComponent(a));
+            for (size_t b = 0; b < N; ++b)
+            {
+                ASSERT_EQ(C.getComponent(a)==C.getComponent(b),reach[a][b] && reach[b][a]);
+                //Never turns down a trip which is possible, and the order is right
+                if (reach[a][b])
+                {
+                    ASSERT_TRUE(C.mayReach(a,b));
+                    ASSERT_GE(C.getComponent(a),C.getComponent(b));
+                }
+            }
+        }
+        for (size_t c = 0; c < C.getComponentNumber(); ++c)
+        {
+            ASSERT_EQ(C.getComponentSize(c),sizes[c]);
+            ASSERT_LE(sizes[c],sizes[C.getLargestComponent()]);
+        }
+        std::vector<size_t> cutOff=City.getCutOffNodes();
+        ASSERT_EQ(cutOff.size(),N-sizes[C.getLargestComponent()]);
+        ASSERT_GT(C.getComponentNumber(),1);
+
+        //The router fails the impossible trips, most of them without searching
+        Router R(G);
+        std::vector<size_t> roads;
+        size_t impossible=0;
+        for (size_t a = 0; a < N; ++a)
+            for (size_t b = 0; b < N; ++b)
+            {
+                ASSERT_EQ(R.route(a,b,roads)<0,!reach[a][b]);
+                //Forbidden U-turns can make more trips impossible with turns, never fewer
+                double t=R.routeWithTurns(a,b,roads);
+                if (!reach[a][b])
+                {
+                    ASSERT_LT(t,0);
+                }
+                impossible+=!reach[a][b];
+            }
+        ASSERT_GT(R.getRejected(),impossible);//Twice the impossible trips, more than half turned down without searching
+        ASSERT_EQ(R.getSearches()+R.getRejected(),2*N*N);
+
+        //The compressed graph agrees on who can reach whom
+        RoutingGraph CG=RoutingGraph::compressChains(G);
+        for (size_t a = 0; a < CG.getNodeNumber(); ++a)
+            for (size_t b = 0; b < CG.getNodeNumber(); ++b)
+                ASSERT_EQ(CG.getComponents().getComponent(a)==CG.getComponents().getComponent(b),C.getComponent(CG.getOriginalNode(a))==C.getComponent(CG.getOriginalNode(b)));
+    }
+
+    //Node 3 only has a road out, and node 4 only a road in
+    std::stringstream OneWay("{\"nodes\":[{\"type\":\"Intersect\",\"pos\":[0,0]},{\"type\":\"Intersect\",\"pos\":[100,0]},{\"type\":\"Intersect\",\"pos\":[50,500]},{\"type\":\"Intersect\",\"pos\":[50,-500]},{\"type\":\"Intersect\",\"pos\":[200,0]}],"
+        "\"auto_roads\":[{\"type\":\"Byvej\",\"first\":1,\"second\":0,\"oneWay\":true},{\"type\":\"Byvej\",\"first\":0,\"second\":2},{\"type\":\"Byvej\",\"first\":2,\"second\":1},{\"type\":\"Byvej\",\"first\":3,\"second\":0,\"oneWay\":true},{\"type\":\"Byvej\",\"first\":1,\"second\":4,\"oneWay\":true}]}");
+    CityNetwork OneWayCity(OneWay);
+    const StrongComponents& C=OneWayCity.getComponents();
+    ASSERT_EQ(C.getComponentNumber(),3);
+    ASSERT_EQ(C.getPieceNumber(),1);
+    ASSERT_EQ(C.getComponentSize(C.getLargestComponent()),3);
+    ASSERT_TRUE(OneWayCity.getCutOffNodes()==std::vector<size_t>({3,4}));
+    ASSERT_TRUE(C.isUnreachable(C.getComponent(3)));
+    ASSERT_FALSE(C.isTrap(C.getComponent(3)));
+    ASSERT_TRUE(C.isTrap(C.getComponent(4)));
+    ASSERT_FALSE(C.mayReach(0,3));
+    ASSERT_FALSE(C.mayReach(4,0));
+    ASSERT_FALSE(C.mayReach(4,3));
+    ASSERT_TRUE(C.mayReach(3,4));
+    ASSERT_TRUE(C.mayReach(3,0));
+
+    //A ring of a million one-way roads is one component, and does not run out of stack
+    size_t ring=1000000;
+    std::vector<uint32_t> first(ring+1);
+    std::vector<uint32_t> to(ring);
+    for (size_t n = 0; n < ring; ++n)
+    {
+        first[n]=n;
+        to[n]=(n+1)%ring;
+    }
+    first[ring]=ring;
+    StrongComponents Ring(first,to);
+    ASSERT_EQ(Ring.getComponentNumber(),1);
+    ASSERT_EQ(Ring.getComponentSize(0),ring);
+    ASSERT_FALSE(Ring.isTrap(0));
+    //Cut it, and it is a million components, each can only reach the ones after it
+    first[ring-1]=ring-1;
+    first[ring]=ring-1;
+    to.pop_back();
+    StrongComponents Line(first,to);
+    ASSERT_EQ(Line.getComponentNumber(),ring);
+    ASSERT_TRUE(Line.mayReach(0,ring-1));
+    ASSERT_FALSE(Line.mayReach(ring-1,0));
+    ASSERT_THROW(StrongComponents(first,std::vector<uint32_t>()),TrafficSimulation_error);
+}
+
+
+TEST(Test_Loading, Parallel_load)
+{
+    //A shuffled grid, big enough to be split between the threads, with traffic lights, and Hellholes hanging off some nodes
+    std::string Grid=Shuffled_Grid_City_String(40,11);
+    for (size_t at = Grid.find("Intersect"), i = 0; at != std::string::npos; at=Grid.find("Intersect",at+1), ++i)
+        if (i%7==0)
+            Grid.replace(at,9,"Trafficlight");
+    std::string Holes;
+    std::string HoleRoads;
+    for (size_t h = 0; h < 30; ++h)
+    {
+        Holes+=",{\"type\":\"Hellhole\",\"pos\":["+std::to_string(h*100)+",-100],\"source\":{\"rate\":0.1}}";
+        HoleRoads+=",{\"type\":\"Byvej\",\"first\":"+std::to_string(1600+h)+",\"second\":"+std::to_string(h*53)+"}";
+    }
+    Grid.insert(Grid.find("],\"auto_roads\""),Holes);
+    Grid.insert(Grid.size()-2,HoleRoads);
+
+    //The error message, or "" if it loads
+    auto load = [](const std::string& Text, CityNetwork::Ordering Order, unsigned Threads)
+    {
+        try
+        {
+            std::stringstream S(Text);
+            CityNetwork City(S,Order,Threads);
+        }
+        catch (TrafficSimulation_error& E)
+        {
+            return std::string(E.what());
+        }
+        return std::string();
+    };
+
+    for (CityNetwork::Ordering Order : {CityNetwork::fileOrder,CityNetwork::hilbertOrder})
+    {
+        std::stringstream S1(Grid);
+        CityNetwork Serial(S1,Order,1);
+        for (unsigned Threads : {2u,4u,0u})
+        {
+            std::stringstream S2(Grid);
+            CityNetwork City(S2,Order,Threads);
+            ASSERT_EQ(City.getNodesSize(),1630);
+            ASSERT_EQ(City.getRoadsSize(),Serial.getRoadsSize());
+            ASSERT_EQ(City.getTrafficlightsSize(),Serial.getTrafficlightsSize());
+            ASSERT_GT(City.getTrafficlightsSize(),200);
+            ASSERT_EQ(City.getSourcesSize(),30);
+            for (size_t n = 0; n < City.getNodesSize(); ++n)
+            {
+                std::shared_ptr<Node> A=City.getNode(n);
+                std::shared_ptr<Node> B=Serial.getNode(n);
+                ASSERT_EQ(A->getNodeID(),n);
+                ASSERT_EQ(A->getX(),B->getX());
+                ASSERT_EQ(A->getY(),B->getY());
+                ASSERT_EQ(std::dynamic_pointer_cast<Trafficlight>(A)!=nullptr,std::dynamic_pointer_cast<Trafficlight>(B)!=nullptr);
+                ASSERT_EQ(std::dynamic_pointer_cast<Hellhole>(A)!=nullptr,std::dynamic_pointer_cast<Hellhole>(B)!=nullptr);
+                //The same roads, in the same local order
+                ASSERT_EQ(A->getRoadNumber(),B->getRoadNumber());
+                for (size_t i = 0; i < A->getRoadNumber(); ++i)
+                {
+                    ASSERT_EQ(A->getRoad(i,true).getRoadID(),B->getRoad(i,true).getRoadID());
+                    ASSERT_EQ(A->getNeighbour(i,true).getNodeID(),B->getNeighbour(i,true).getNodeID());
+                }
+            }
+            for (size_t r = 0; r < City.getRoadsSize(); ++r)
+            {
+                ASSERT_EQ(City.getRoad(r)->getRoadID(),r);
+                ASSERT_EQ(City.getRoad(r)->getStart().getNodeID(),Serial.getRoad(r)->getStart().getNodeID());
+                ASSERT_EQ(City.getRoad(r)->getEnd().getNodeID(),Serial.getRoad(r)->getEnd().getNodeID());
+                ASSERT_EQ(City.getRoad(r)->getLength(),Serial.getRoad(r)->getLength());
+            }
+            ASSERT_EQ(City.getComponents().getComponentNumber(),1);
+        }
+    }
+
+    //Broken cities throw the same as when loaded by one thread, also with more than one thing wrong
+    std::vector<std::string> Broken;
+    auto breakAt = [&Grid](const std::string& what, size_t skip, const std::string& with)
+    {
+        std::string B=Grid;
+        size_t at=B.find(what);
+        for (size_t i = 0; i < skip; ++i)
+            at=B.find(what,at+1);
+        return B.replace(at,what.size(),with);
+    };
+    Broken.push_back(breakAt("Byvej",2000,"Gade"));
+    Broken.push_back(breakAt("Byvej",100,"Gade"));
+    Broken.back().replace(Broken.back().rfind("Byvej"),5,"Vej");
+    Broken.push_back(breakAt("\"first\":",500,"\"first\":99999,\"x\":"));
+    Broken.push_back(breakAt("Intersect",1000,"Roundabout"));
+    Broken.push_back(Grid);
+    Broken.back().insert(Broken.back().size()-2,",{\"type\":\"Byvej\",\"first\":1601,\"second\":7}");//A second road at a Hellhole
+    for (const std::string& B : Broken)
+    {
+        std::string Expected=load(B,CityNetwork::fileOrder,1);
+        ASSERT_NE(Expected,"");
+        ASSERT_EQ(load(B,CityNetwork::fileOrder,4),Expected);
+    }
+}
+
+
+TEST(Test_Loading, Type_names)
+{
+    NameTable T={{"Byvej",0},{"street",0},{"Country Road",1}};
+    ASSERT_EQ(T.size(),3);
+    ASSERT_EQ(T.find("byvej"),0);
+    ASSERT_EQ(T.find("BYVEJ"),0);
+    ASSERT_EQ(T.find("Street"),0);
+    ASSERT_EQ(T.find("country road"),1);
+    ASSERT_EQ(T.find("country  road"),NameTable::notFound);
+    ASSERT_EQ(T.find("byve"),NameTable::notFound);
+    ASSERT_EQ(T.find(""),NameTable::notFound);
+    ASSERT_EQ(NameTable().find("byvej"),NameTable::notFound);
+    ASSERT_THROW(T.add("STREET",4),TrafficSimulation_error);
+    ASSERT_THROW(T.add("gade",-1),TrafficSimulation_error);
+
+    //Growing keeps everything
+    for (int i = 0; i < 1000; ++i)
+        T.add("name"+std::to_string(i),i+10);
+    for (int i = 0; i < 1000; ++i)
+        ASSERT_EQ(T.find("NAME"+std::to_string(i)),i+10);
+    ASSERT_EQ(T.find("byvej"),0);
+
+    //The road and node types in the files are found in any case
+    std::stringstream S("{\"nodes\":[{\"type\":\"intersect\",\"pos\":[0,0]},{\"type\":\"TRAFFICLIGHT\",\"pos\":[100,0]},{\"type\":\"Hellhole\",\"pos\":[200,0]}],"
+        "\"auto_roads\":[{\"type\":\"COUNTRY ROAD\",\"first\":0,\"second\":1},{\"type\":\"MotorVej\",\"first\":1,\"second\":2}]}");
+    CityNetwork City(S);
+    ASSERT_EQ(City.getTrafficlightsSize(),1);
+    ASSERT_EQ(City.getRoad(0)->getType(),countryRoad);
+    ASSERT_EQ(City.getRoad(1)->getType(),highway);
+    ASSERT_NE(std::dynamic_pointer_cast<Hellhole>(City.getNode(2)),nullptr);
+
+    //The errors still name the type
+    std::stringstream Bad("{\"nodes\":[{\"type\":\"Intersect\",\"pos\":[0,0]},{\"type\":\"Intersect\",\"pos\":[100,0]}],\"auto_roads\":[{\"type\":\"Gade\",\"first\":0,\"second\":1}]}");
+    try
+    {
+        CityNetwork BadCity(Bad);
+        FAIL();
+    }
+    catch (TrafficSimulation_error& E)
+    {
+        ASSERT_NE(std::string(E.what()).find("type does not exist : Gade"),std::string::npos);
+    }
+
+    //A road from a node to itself is reported as that, whatever its type
+    faux_CityNetwork mockTown;
+    Json::Value Loop=to_Json("{\"type\":\"Gade\",\"first\":0,\"second\":0}");
+    try
+    {
+        Road R(0,Loop,mockTown);
+        FAIL();
+    }
+    catch (TrafficSimulation_error& E)
+    {
+        ASSERT_NE(std::string(E.what()).find("must be unique"),std::string::npos);
+    }
+}
+
+
+TEST(Test_Loading, Edit_network)
+{
+    //The city as a list of nodes and roads, edited alongside the city, so we can load the edited city from scratch and compare
+    struct RoadSpec {std::string type; size_t first,second; int lanes; bool oneWay;};
+    std::vector<std::string> NodeSpec;
+    std::vector<RoadSpec> RoadSpecs;
+    for (size_t y = 0; y < 4; ++y)
+        for (size_t x = 0; x < 4; ++x)
+            NodeSpec.push_back("{\"type\":\""+std::string(x+4*y==5 ? "Trafficlight" : "Intersect")+"\",\"pos\":["+std::to_string(100*x)+","+std::to_string(100*y)+"]}");
+    for (size_t y = 0; y < 4; ++y)
+        for (size_t x = 0; x < 4; ++x)
+        {
+            if (x+1<4)
+                RoadSpecs.push_back({"Byvej",x+4*y,x+1+4*y,1,false});
+            if (y+1<4)
+                RoadSpecs.push_back({"Landevej",x+4*y,x+4*(y+1),2,y==2});
+        }
+    NodeSpec.push_back("{\"type\":\"Hellhole\",\"pos\":[-100,0]}");
+    NodeSpec.push_back("{\"type\":\"Hellhole\",\"pos\":[400,-100]}");
+    RoadSpecs.push_back({"Byvej",16,0,1,false});
+    RoadSpecs.push_back({"Byvej",17,3,1,false});
+
+    auto roadJson = [](const RoadSpec& R)
+    {
+        return "{\"type\":\""+R.type+"\",\"first\":"+std::to_string(R.first)+",\"second\":"+std::to_string(R.second)+",\"lanes\":"+std::to_string(R.lanes)+",\"oneWay\":"+(R.oneWay ? "true" : "false")+"}";
+    };
+    auto cityText = [&]()
+    {
+        std::string Text="{\"nodes\":[";
+        for (size_t n = 0; n < NodeSpec.size(); ++n)
+        {
+            Text+=n>0 ? "," : "";
+            Text+=NodeSpec[n];
+        }
+        Text+="],\"auto_roads\":[";
+        for (size_t r = 0; r < RoadSpecs.size(); ++r)
+        {
+            Text+=r>0 ? "," : "";
+            Text+=roadJson(RoadSpecs[r]);
+        }
+        return Text+"]}";
+    };
+    auto parse = [](const std::string& Text)
+    {
+        std::stringstream S(Text);
+        Json::Value V;
+        S>>V;
+        return V;
+    };
+    auto roadBetween = [&RoadSpecs](size_t a, size_t b)
+    {
+        for (size_t r = 0; r < RoadSpecs.size(); ++r)
+            if ((RoadSpecs[r].first==a && RoadSpecs[r].second==b) || (RoadSpecs[r].first==b && RoadSpecs[r].second==a))
+                return r;
+        return RoadSpecs.size();
+    };
+
+    //The edited city and graphs must be exactly the loaded ones
+    auto compare = [&cityText](CityNetwork& City, const RoutingGraph& Dense, const RoutingGraph& Sparse)
+    {
+        std::stringstream S(cityText());
+        CityNetwork Loaded(S);
+        ASSERT_EQ(City.getNodesSize(),Loaded.getNodesSize());
+        ASSERT_EQ(City.getRoadsSize(),Loaded.getRoadsSize());
+        ASSERT_EQ(City.getTrafficlightsSize(),Loaded.getTrafficlightsSize());
+        ASSERT_EQ(City.getComponents().getComponentNumber(),Loaded.getComponents().getComponentNumber());
+        for (size_t n = 0; n < City.getNodesSize(); ++n)
+        {
+            std::shared_ptr<Node> A=City.getNode(n);
+            std::shared_ptr<Node> B=Loaded.getNode(n);
+            ASSERT_EQ(A->getNodeID(),n);
+            ASSERT_EQ(A->getX(),B->getX());
+            ASSERT_EQ(A->getY(),B->getY());
+            ASSERT_EQ(std::dynamic_pointer_cast<Trafficlight>(A)!=nullptr,std::dynamic_pointer_cast<Trafficlight>(B)!=nullptr);
+            ASSERT_EQ(std::dynamic_pointer_cast<Hellhole>(A)!=nullptr,std::dynamic_pointer_cast<Hellhole>(B)!=nullptr);
+            ASSERT_EQ(A->getRoadNumber(),B->getRoadNumber());
+            for (size_t i = 0; i < A->getRoadNumber(); ++i)
+            {
+                ASSERT_EQ(A->getRoad(i,true).getRoadID(),B->getRoad(i,true).getRoadID());
+                ASSERT_EQ(A->getNeighbour(i,true).getNodeID(),B->getNeighbour(i,true).getNodeID());
+            }
+            ASSERT_EQ(City.getComponents().getComponent(n),Loaded.getComponents().getComponent(n));
+        }
+        for (size_t r = 0; r < City.getRoadsSize(); ++r)
+        {
+            std::shared_ptr<Road> A=City.getRoad(r);
+            std::shared_ptr<Road> B=Loaded.getRoad(r);
+            ASSERT_EQ(A->getRoadID(),r);
+            ASSERT_EQ(A->getStart().getNodeID(),B->getStart().getNodeID());
+            ASSERT_EQ(A->getEnd().getNodeID(),B->getEnd().getNodeID());
+            ASSERT_EQ(A->getType(),B->getType());
+            ASSERT_EQ(A->getLanes(),B->getLanes());
+            ASSERT_EQ(A->getOneWay(),B->getOneWay());
+            ASSERT_EQ(A->getLength(),B->getLength());
+        }
+
+        RoutingGraph LoadedDense(Loaded);
+        RoutingGraph LoadedSparse(Loaded,2);
+        for (auto [G,L] : {std::pair<const RoutingGraph*,const RoutingGraph*>{&Dense,&LoadedDense},{&Sparse,&LoadedSparse}})
+        {
+            ASSERT_EQ(G->getNodeNumber(),L->getNodeNumber());
+            ASSERT_EQ(G->getRoadNumber(),L->getRoadNumber());
+            ASSERT_EQ(G->getEdgeNumber(),L->getEdgeNumber());
+            ASSERT_EQ(G->getTurnBytes(),L->getTurnBytes());
+            ASSERT_EQ(G->getComponents().getComponentNumber(),L->getComponents().getComponentNumber());
+            for (size_t r = 0; r < G->getRoadNumber(); ++r)
+            {
+                ASSERT_EQ(G->getRoadStart(r),L->getRoadStart(r));
+                ASSERT_EQ(G->getRoadEnd(r),L->getRoadEnd(r));
+                ASSERT_EQ(G->getOneWay(r),L->getOneWay(r));
+                ASSERT_EQ(G->getTravelTime(r),L->getTravelTime(r));
+                ASSERT_EQ(G->getFreeFlowTime(r),L->getFreeFlowTime(r));
+                ASSERT_EQ(G->getLength(r),L->getLength(r));
+            }
+            for (size_t n = 0; n < G->getNodeNumber(); ++n)
+            {
+                ASSERT_EQ(G->getFirstEdge(n),L->getFirstEdge(n));
+                ASSERT_EQ(G->getDegree(n),L->getDegree(n));
+                for (size_t i = 0; i < G->getDegree(n); ++i)
+                    for (size_t j = 0; j < G->getDegree(n); ++j)
+                        ASSERT_EQ(G->getTurnCost(n,i,j),L->getTurnCost(n,i,j));
+            }
+            for (size_t e = 0; e < G->getEdgeNumber(); ++e)
+            {
+                ASSERT_EQ(G->getEdge(e).to,L->getEdge(e).to);
+                ASSERT_EQ(G->getEdge(e).road,L->getEdge(e).road);
+                ASSERT_EQ(G->getTailSlot(e),L->getTailSlot(e));
+                ASSERT_EQ(G->getHeadSlot(e),L->getHeadSlot(e));
+            }
+        }
+    };
+
+    std::stringstream S(cityText());
+    CityNetwork City(S);
+    RoutingGraph Dense(City);
+    RoutingGraph Sparse(City,2);
+    compare(City,Dense,Sparse);
+    //A router made before the edits, which has to follow the graph as it grows
+    Router EarlyRouter(Dense);
+    std::vector<size_t> Route;
+    ASSERT_GT(EarlyRouter.route(0,15,Route),0);
+
+    //The default signal phases follow the roads, (a light is started only once, so the one before the edits is in a copy of the city)
+    Trafficlight& Light=dynamic_cast<Trafficlight&>(*City.getNode(5));
+    {
+        std::stringstream Before(cityText());
+        CityNetwork Unedited(Before);
+        EventQueue Q;
+        Trafficlight& UneditedLight=dynamic_cast<Trafficlight&>(*Unedited.getNode(5));
+        UneditedLight.start(Q,0);
+        ASSERT_EQ(UneditedLight.getPhaseNumber(),2);
+        ASSERT_EQ(Q.size(),1);
+        ASSERT_THROW(UneditedLight.start(Q,0),TrafficSimulation_error);
+        ASSERT_EQ(Q.size(),1);
+    }
+
+    //A new node, and a one-way highway to it
+    Json::Value NewNode=parse("{\"type\":\"Intersect\",\"pos\":[500,0]}");
+    ASSERT_EQ(City.addNode(NewNode),18);
+    NodeSpec.push_back("{\"type\":\"Intersect\",\"pos\":[500,0]}");
+    Dense.nodeAdded(City);
+    Sparse.nodeAdded(City);
+    compare(City,Dense,Sparse);
+    ASSERT_GT(City.getComponents().getComponentNumber(),1);
+
+    RoadSpecs.push_back({"Motorvej",3,18,2,true});
+    Json::Value NewRoad=parse(roadJson(RoadSpecs.back()));
+    ASSERT_EQ(City.addRoad(NewRoad),RoadSpecs.size()-1);
+    Dense.roadAdded(City);
+    Sparse.roadAdded(City);
+    compare(City,Dense,Sparse);
+    RoadSpecs.push_back({"Byvej",18,7,1,false});
+    Json::Value Back=parse(roadJson(RoadSpecs.back()));
+    City.addRoad(Back);
+    Dense.roadAdded(City);
+    Sparse.roadAdded(City);
+    compare(City,Dense,Sparse);
+    ASSERT_GT(EarlyRouter.route(0,18,Route),0);
+    ASSERT_EQ(Route.back(),roadBetween(3,18));
+    ASSERT_GT(EarlyRouter.route(18,0,Route),0);
+    ASSERT_EQ(Route.front(),roadBetween(18,7));
+    ASSERT_GT(EarlyRouter.routeWithTurns(16,18,Route),0);
+
+    //Removing roads at the traffic light, and at a Hellhole, moves every later road down
+    for (auto [a,b] : {std::pair<size_t,size_t>{4,5},{5,6},{16,0}})
+    {
+        size_t r=roadBetween(a,b);
+        City.removeRoad(r);
+        RoadSpecs.erase(RoadSpecs.begin()+r);
+        Dense.roadRemoved(City,r);
+        Sparse.roadRemoved(City,r);
+        compare(City,Dense,Sparse);
+    }
+    EventQueue LightQueue;
+    Light.start(LightQueue,0);
+    ASSERT_EQ(Light.getPhaseNumber(),1);
+
+    //The Hellhole can get a road again
+    RoadSpecs.push_back({"Byvej",1,16,1,false});
+    Json::Value Again=parse(roadJson(RoadSpecs.back()));
+    City.addRoad(Again);
+    Dense.roadAdded(City);
+    Sparse.roadAdded(City);
+    compare(City,Dense,Sparse);
+
+    //Wider and faster
+    size_t r=roadBetween(9,13);
+    City.setLanes(r,3);
+    City.setRoadType(r,highway);
+    RoadSpecs[r].lanes=3;
+    RoadSpecs[r].type="Motorvej";
+    Dense.roadChanged(City,r);
+    Sparse.roadChanged(City,r);
+    compare(City,Dense,Sparse);
+
+    //Errors leave everything as it was
+    ASSERT_THROW(City.removeRoad(City.getRoadsSize()),road_address_exception);
+    ASSERT_THROW(City.setLanes(0,0),TrafficSimulation_error);
+    ASSERT_THROW(City.setRoadType(0,RoadType(7)),TrafficSimulation_error);
+    Json::Value Full=parse("{\"type\":\"Byvej\",\"first\":17,\"second\":2}");
+    ASSERT_THROW(City.addRoad(Full),road_address_exception);
+    Json::Value Nowhere=parse("{\"type\":\"Byvej\",\"first\":2,\"second\":2}");
+    ASSERT_THROW(City.addRoad(Nowhere),TrafficSimulation_error);
+    Json::Value NoType=parse("{\"pos\":[0,0]}");
+    ASSERT_THROW(City.addNode(NoType),TrafficSimulation_error);
+    compare(City,Dense,Sparse);
+    ASSERT_EQ(City.getNode(2)->getRoadNumber(),3);
+
+    //The graph must be told about every edit, and a compressed graph can not follow at all
+    ASSERT_THROW(Dense.roadAdded(City),TrafficSimulation_error);
+    ASSERT_THROW(Dense.roadRemoved(City,0),TrafficSimulation_error);
+    ASSERT_THROW(Dense.roadChanged(City,Dense.getRoadNumber()),road_address_exception);
+    RoutingGraph Compressed=RoutingGraph::compressChains(Dense);
+    ASSERT_THROW(Compressed.roadChanged(City,0),TrafficSimulation_error);
+
+    //A route cache throws out its routes when the graph is edited, as their road IDs may have moved
+    RoutingGraph CacheGraph(City);
+    Router CacheRouter(CacheGraph);
+    RouteCache Cache(CacheGraph,CacheRouter);
+    std::vector<size_t> Cached,Fresh;
+    ASSERT_GT(Cache.lookup(0,15,0,byCar,Cached),0);
+    ASSERT_EQ(Cache.getSize(),1);
+
+    Json::Value Far=parse("{\"type\":\"Intersect\",\"pos\":[600,0]}");
+    City.addNode(Far);
+    CacheGraph.nodeAdded(City);
+    RoadSpecs.push_back({"Byvej",18,City.getNodesSize()-1,1,false});
+    Json::Value ToFar=parse(roadJson(RoadSpecs.back()));
+    size_t farRoad=City.addRoad(ToFar);
+    CacheGraph.roadAdded(City);
+    Cache.setTravelTime(farRoad,100);
+    ASSERT_EQ(Cache.getSize(),0);
+    ASSERT_GT(Cache.lookup(0,City.getNodesSize()-1,0,byCar,Cached),0);
+    ASSERT_EQ(Cached.back(),farRoad);
+
+    //Take out a road of the cached route, every later road moves down
+    ASSERT_GT(Cache.lookup(0,15,0,byCar,Cached),0);
+    City.removeRoad(Cached.front());
+    CacheGraph.roadRemoved(City,Cached.front());
+    double time=Cache.lookup(0,15,0,byCar,Cached);
+    ASSERT_EQ(Cache.getMisses(),4);
+    ASSERT_EQ(time,Router(CacheGraph).route(0,15,Fresh));
+    ASSERT_EQ(Cached,Fresh);
+    Cache.rebuild();
+    ASSERT_EQ(Cache.getSize(),0);
+}
+
+
+TEST(Test_Loading, Artefact_cache)
+{
+    std::filesystem::path Directory=std::filesystem::temp_directory_path()/("artefactCacheTest"+std::to_string(std::random_device()()));
+    std::filesystem::remove_all(Directory);
+    std::string Text=Shuffled_Grid_City_String(20,5);
+
+    //The keys follow the bytes, and nothing else
+    ASSERT_EQ(ArtefactCache::keyOf(Text),ArtefactCache::keyOf(std::string(Text)));
+    ASSERT_NE(ArtefactCache::keyOf(Text),ArtefactCache::keyOf(Text+" "));
+    ASSERT_NE(ArtefactCache::keyOf(""),ArtefactCache::keyOf(std::string(1,'\0')));
+    //An empty view may have no data at all
+    ASSERT_EQ(BinaryIO::hash128(std::string_view()),BinaryIO::hash128(std::string()));
+    ASSERT_NE(BinaryIO::hash128(std::string_view()),BinaryIO::hash128(std::string(1,'\0')));
+    ASSERT_EQ(ArtefactCache::keyOf(Text).hex().size(),32);
+
+    //Everything the first time, nothing the second
+    auto buildAll = [&Text,&Directory](size_t& built, std::optional<CityNetwork>& City, std::optional<RoutingGraph>& Graph, std::optional<SpatialIndex>& Index)
+    {
+        ArtefactCache Cache(Directory.string());
+        std::stringstream S(Text);
+        City.emplace(S,CityNetwork::hilbertOrder,1,&Cache);
+        EXPECT_TRUE(City->hasContentKey());
+        Graph.emplace(Cache.get<RoutingGraph>(City->getContentKey(),"routing-16",[&](){++built; return RoutingGraph(*City);}));
+        Index.emplace(Cache.get<SpatialIndex>(City->getContentKey(),"spatial-0",[&](){++built; return SpatialIndex(*City);}));
+        return std::make_pair(Cache.getHits(),Cache.getMisses());
+    };
+    size_t built=0;
+    std::optional<CityNetwork> City1,City2;
+    std::optional<RoutingGraph> Graph1,Graph2;
+    std::optional<SpatialIndex> Index1,Index2;
+    ASSERT_EQ(buildAll(built,City1,Graph1,Index1),std::make_pair(size_t(0),size_t(3)));
+    ASSERT_EQ(built,2);
+    ASSERT_EQ(buildAll(built,City2,Graph2,Index2),std::make_pair(size_t(3),size_t(0)));
+    ASSERT_EQ(built,2);
+
+    //The same file in the order of the file has other IDs, so it has its own artefacts in the same directory
+    {
+        ArtefactCache Cache(Directory.string());
+        std::stringstream S(Text);
+        CityNetwork InFileOrder(S,CityNetwork::fileOrder,1,&Cache);
+        ASSERT_NE(InFileOrder.getContentKey(),City1->getContentKey());
+        RoutingGraph Graph=Cache.get<RoutingGraph>(InFileOrder.getContentKey(),"routing-16",[&](){++built; return RoutingGraph(InFileOrder);});
+        ASSERT_EQ(built,3);
+        std::string Cached,Made;
+        Graph.toBinary(Cached);
+        RoutingGraph(InFileOrder).toBinary(Made);
+        ASSERT_EQ(Cached,Made);
+        Made.clear();
+        Graph1->toBinary(Made);
+        ASSERT_NE(Cached,Made);
+    }
+
+    //The same city, graph and index
+    std::stringstream S(Text);
+    CityNetwork Plain(S,CityNetwork::hilbertOrder);
+    ASSERT_FALSE(Plain.hasContentKey());
+    ASSERT_NE(City2->getContentKey(),ArtefactCache::keyOf(Text));
+    for (size_t n = 0; n < Plain.getNodesSize(); ++n)
+    {
+        ASSERT_EQ(City2->getFileNodeID(n),Plain.getFileNodeID(n));
+        ASSERT_EQ(City2->getNode(n)->getX(),Plain.getNode(n)->getX());
+    }
+    for (size_t r = 0; r < Plain.getRoadsSize(); ++r)
+        ASSERT_EQ(City2->getFileRoadID(r),Plain.getFileRoadID(r));
+    std::string A,B;
+    Graph1->toBinary(A);
+    Graph2->toBinary(B);
+    ASSERT_EQ(A,B);
+    ASSERT_EQ(Graph2->getComponents().getComponentNumber(),Graph1->getComponents().getComponentNumber());
+    A.clear();
+    B.clear();
+    Index1->toBinary(A);
+    Index2->toBinary(B);
+    ASSERT_EQ(A,B);
+    SpatialHit Hits1[3],Hits2[3];
+    ASSERT_EQ(Index1->nearestRoads(555,333,Hits1,3),Index2->nearestRoads(555,333,Hits2,3));
+    for (size_t i = 0; i < 3; ++i)
+        ASSERT_EQ(Hits1[i].id,Hits2[i].id);
+
+    //A compressed graph, with turns set by hand, both ways through bytes
+    RoutingGraph Full(Plain,2);
+    size_t busy=0;
+    while (Full.getDegree(busy)<3)
+        ++busy;
+    size_t road0=Full.getEdge(Full.getFirstEdge(busy)).road;
+    size_t road1=Full.getEdge(Full.getFirstEdge(busy)+1).road;
+    Full.setTurnCost(busy,road0,road1,42);
+    RoutingGraph Compressed=RoutingGraph::compressChains(Full);
+    for (const RoutingGraph* G : {&Full,&Compressed})
+    {
+        A.clear();
+        G->toBinary(A);
+        RoutingGraph Again=RoutingGraph::fromBinary(A);
+        B.clear();
+        Again.toBinary(B);
+        ASSERT_EQ(A,B);
+        ASSERT_EQ(Again.isCompressed(),G->isCompressed());
+        ASSERT_EQ(Again.getTurnBytes(),G->getTurnBytes());
+    }
+    ASSERT_THROW(RoutingGraph::fromBinary(A.substr(0,A.size()-1)),file_format_exception);
+    ASSERT_THROW(RoutingGraph::fromBinary(A+"x"),file_format_exception);
+    ASSERT_THROW(SpatialIndex::fromBinary(A),file_format_exception);
+
+    //Damaged or changed files are made again, and overwritten
+    {
+        ArtefactCache Cache(Directory.string());
+        ArtefactKey Key=ArtefactCache::keyOf(Text);
+        std::string Path=Cache.getPath(Key,"routing-16");
+        std::string Good;
+        {
+            std::ifstream In(Path,std::ios::binary);
+            Good.assign((std::istreambuf_iterator<char>(In)),std::istreambuf_iterator<char>());
+        }
+        for (size_t at : {size_t(3),Good.size()/2,Good.size()-1})
+        {
+            std::string Bad=Good;
+            Bad[at]^=0x10;
+            {
+                std::ofstream Out(Path,std::ios::binary|std::ios::trunc);
+                Out<<Bad;
+            }
+            std::string Content;
+            ASSERT_FALSE(Cache.load(Key,"routing-16",Content));
+        }
+        {
+            std::ofstream Out(Path,std::ios::binary|std::ios::trunc);
+            Out<<Good.substr(0,Good.size()-10);
+        }
+        size_t again=0;
+        Cache.get<RoutingGraph>(Key,"routing-16",[&](){++again; return RoutingGraph(*City2);});
+        ASSERT_EQ(again,1);
+        std::string Content;
+        ASSERT_TRUE(Cache.load(Key,"routing-16",Content));
+
+        //Another key, or another name, is another artefact
+        ASSERT_FALSE(Cache.load(ArtefactCache::keyOf(Text+" "),"routing-16",Content));
+        ASSERT_FALSE(Cache.load(Key,"routing-8",Content));
+        ASSERT_THROW(Cache.load(Key,"../routing-16",Content),TrafficSimulation_error);
+
+        //A city with the same roads in another order is another city
+        std::stringstream Other(Shuffled_Grid_City_String(20,6));
+        CityNetwork OtherCity(Other,CityNetwork::hilbertOrder,1,&Cache);
+        ASSERT_NE(OtherCity.getContentKey(),Key);
+        ASSERT_EQ(Cache.getMisses(),7);
+    }
+
+    //An edited city is no longer the file
+    City2->setLanes(0,2);
+    ASSERT_FALSE(City2->hasContentKey());
+
+    std::filesystem::remove_all(Directory);
+}
+
+
+//A small simulation for the checkpoint test: cars from the sources in city.json drive from node to node, at the speed limit, turning at random (or around at dead ends), wait at red lights, and disappear in the first Hellhole they reach
+struct Checkpoint_world : public IEventHandler
+{
+    struct Trip
+    {
+        size_t road;
+        size_t to;//The node at the end of the road
+        double entered;
+        uint64_t hops;
+    };
+
+    std::ifstream F;
+    CityNetwork City;
+    EventQueue Q;
+    VehiclePool<Car> Pool;
+    std::stringstream StatsFile;
+    RoadStatistics Stats;
+    CounterRNG rng;
+    size_t id;
+    std::map<uint64_t,Trip> trips;
+    std::vector<std::tuple<double,uint64_t,size_t> > trace;//Time, vehicle, node it got to
+
+    //@param statsStart the start of the statistics hour, the same as start for a new run, the hour of the checkpoint for a resumed one
+    Checkpoint_world(double start, double statsStart) : F(std::string(SOURCE_DIR)+"/city.json"),City(F),Pool(64,64),Stats(StatsFile,City.getRoadsSize(),1,600,statsStart),rng(11)
+    {
+        for (size_t n = 0; n < City.getNodesSize(); ++n)
+            if (Trafficlight* Light=dynamic_cast<Trafficlight*>(City.getNode(n).get()))
+                Light->setReleaseHandler([this](double time, size_t, const std::vector<uint64_t>& V){
+                    for (uint64_t v : V)
+                        drive(time,v);
+                });
+        City.startSignals(Q,start);
+        City.startSources(Q,start,5,[this](double time, size_t node){
+            VehicleHandle H=Pool.spawn();
+            const Road& R=City.getNode(node)->getRoad(0,true);
+            enter(time,H.toID(),R,R.getOther(node).getNodeID(),0);
+        });
+        id=Q.registerHandler(this);
+    }
+
+    void enter(double time, uint64_t v, const Road& R, size_t to, uint64_t hops)
+    {
+        trips[v]=Trip{R.getRoadID(),to,time,hops};
+        Stats.getShard(0).enterRoad(time,R.getRoadID(),R.getSpeedLimit());
+        Q.schedule(time+R.getLength()/R.getSpeedLimit(),id,0,v);
+    }
+
+    //On from the node at the end of the current road, by any other road
+    void drive(double time, uint64_t v)
+    {
+        Trip T=trips.at(v);
+        Node& N=*City.getNode(T.to);
+        std::vector<size_t> exits;
+        for (size_t i = 0; i < N.getRoadNumber(); ++i)
+            if (N.getRoad(i,true).getRoadID()!=T.road)
+                exits.push_back(i);
+        //Turn around at a dead end
+        if (exits.empty())
+            exits.push_back(0);
+        const Road& R=N.getRoad(exits[size_t(rng.uniform(v,0,1,T.hops)*exits.size())],true);
+        enter(time,v,R,R.getOther(T.to).getNodeID(),T.hops+1);
+    }
+
+    void handleEvent(double time, int, uint64_t v)
+    {
+        Trip T=trips.at(v);
+        const Road& R=*City.getRoad(T.road);
+        Stats.getShard(0).leaveRoad(time,T.road,R.getSpeedLimit());
+        Stats.getShard(0).traversal(time,T.road,time-T.entered,R.getSpeedLimit());
+        trace.push_back({time,v,T.to});
+
+        Node& N=*City.getNode(T.to);
+        if (Hellhole* Hole=dynamic_cast<Hellhole*>(&N))
+        {
+            Hole->swallow(Pool,VehicleHandle::fromID(v));
+            trips.erase(v);
+        }
+        else if (Trafficlight* Light=dynamic_cast<Trafficlight*>(&N))
+        {
+            size_t local=0;
+            while (N.getRoad(local,true).getRoadID()!=T.road)
+                ++local;
+            if (Light->arrive(local,v))
+                drive(time,v);
+        }
+        else
+            drive(time,v);
+    }
+
+    void addTo(Checkpointer& C)
+    {
+        C.add("queue",Q);
+        C.add("city",City);
+        C.add("vehicles",Pool);
+        C.add("statistics",Stats);
+        C.add("trips",[this](std::string& out){
+            BinaryIO::putVarint(out,trips.size());
+            for (auto& [v,T] : trips)
+            {
+                BinaryIO::putVarint(out,v);
+                BinaryIO::putVarint(out,T.road);
+                BinaryIO::putVarint(out,T.to);
+                BinaryIO::put(out,T.entered);
+                BinaryIO::putVarint(out,T.hops);
+            }
+        },[this](const char*& p, const char* end){
+            trips.clear();
+            for (uint64_t n=BinaryIO::getVarint(p,end); n>0; --n)
+            {
+                uint64_t v=BinaryIO::getVarint(p,end);
+                Trip& T=trips[v];
+                T.road=BinaryIO::getVarint(p,end);
+                T.to=BinaryIO::getVarint(p,end);
+                T.entered=BinaryIO::get<double>(p,end);
+                T.hops=BinaryIO::getVarint(p,end);
+            }
+        });
+    }
+
+    //Hour by hour, the checkpoints are taken on the way
+    void run(Checkpointer& C, double until)
+    {
+        for (double h = Stats.getHourStart()+600; h <= until; h+=600)
+        {
+            C.runUntil(Q,h);
+            Stats.closeHour();
+        }
+        Stats.close();
+        C.close();
+    }
+};
+
+static std::string read_file(const std::string& path)
+{
+    std::ifstream In(path,std::ios::binary);
+    return std::string((std::istreambuf_iterator<char>(In)),std::istreambuf_iterator<char>());
+}
+
+TEST(Test_Checkpoint, Resume_equals_uninterrupted)
+{
+    std::filesystem::path Directory=std::filesystem::temp_directory_path()/("checkpointTest"+std::to_string(std::random_device()()));
+    std::filesystem::remove_all(Directory);
+    const double start=7*3600;
+    const double until=8*3600;
+
+    //From 7 to 8 in the morning, with a checkpoint every quarter
+    Checkpoint_world Whole(start,start);
+    {
+        Checkpointer C((Directory/"whole").string(),900,start);
+        Whole.addTo(C);
+        Whole.run(C,until);
+        ASSERT_EQ(C.getWritten(),4);
+    }
+    ASSERT_EQ(Checkpointer::latest((Directory/"whole").string()),Checkpointer::getPath((Directory/"whole").string(),until));
+    ASSERT_EQ(Checkpointer::latest((Directory/"nothing").string()),"");
+    ASSERT_GT(Whole.trace.size(),1000);
+
+    //From the quarter past 7 checkpoint, which is in the middle of a statistics hour (they are 10 minutes here)
+    const double quarter=start+900;
+    std::string QuarterPath=Checkpointer::getPath((Directory/"whole").string(),quarter);
+    Checkpoint_world Resumed(start,start+600);
+    {
+        Checkpointer C((Directory/"resumed").string(),900);
+        Resumed.addTo(C);
+        ASSERT_NEAR(C.restore(QuarterPath),quarter,tolerance);
+        ASSERT_NEAR(C.getNextCheckpoint(),start+1800,tolerance);
+        ASSERT_FALSE(Resumed.trips.empty());
+        Resumed.run(C,until);
+        ASSERT_EQ(C.getWritten(),3);
+    }
+
+    //Every event after the checkpoint, the final state, and every hour of statistics from the checkpoint on are the same
+    std::vector<std::tuple<double,uint64_t,size_t> > After;
+    for (auto& E : Whole.trace)
+        if (std::get<0>(E)>quarter)
+            After.push_back(E);
+    ASSERT_EQ(Resumed.trace,After);
+    for (double t : {start+1800,start+2700,until})
+        ASSERT_EQ(read_file(Checkpointer::getPath((Directory/"whole").string(),t)),read_file(Checkpointer::getPath((Directory/"resumed").string(),t)));
+
+    RoadStatisticsReader WholeStats(Whole.StatsFile);
+    RoadStatisticsReader ResumedStats(Resumed.StatsFile);
+    std::vector<RoadStatisticsRecord> W,R;
+    ASSERT_TRUE(WholeStats.nextHour(W));//7:00 to 7:10, before the checkpoint
+    size_t hours=0;
+    while (ResumedStats.nextHour(R))
+    {
+        ASSERT_TRUE(WholeStats.nextHour(W));
+        ASSERT_NEAR(ResumedStats.getHourStart(),WholeStats.getHourStart(),tolerance);
+        for (size_t r = 0; r < W.size(); ++r)
+        {
+            ASSERT_EQ(R[r].entered,W[r].entered);
+            ASSERT_EQ(R[r].vehicleSeconds,W[r].vehicleSeconds);
+            ASSERT_EQ(R[r].distance,W[r].distance);
+            ASSERT_EQ(R[r].travelTime.getTotal(),W[r].travelTime.getTotal());
+        }
+        ++hours;
+    }
+    ASSERT_EQ(hours,5);
+    ASSERT_FALSE(WholeStats.nextHour(W));
+
+    //A simulation with other parts, a damaged file, and a missing one, are all refused before anything changes
+    {
+        Checkpoint_world Other(start,start+600);
+        Checkpointer C((Directory/"other").string(),900);
+        C.add("queue",Other.Q);
+        C.add("city",Other.City);
+        ASSERT_THROW(C.restore(QuarterPath),file_format_exception);
+        ASSERT_THROW(C.add("queue",Other.Q),TrafficSimulation_error);
+
+        std::string Damaged=read_file(QuarterPath);
+        Damaged[Damaged.size()/2]^=1;
+        std::string DamagedPath=(Directory/"damaged.bin").string();
+        std::ofstream(DamagedPath,std::ios::binary)<<Damaged;
+        Checkpointer D((Directory/"other").string(),900);
+        Other.addTo(D);
+        ASSERT_THROW(D.restore(DamagedPath),file_format_exception);
+        ASSERT_THROW(D.restore((Directory/"missing.bin").string()),TrafficSimulation_error);
+        ASSERT_EQ(Other.Q.getTime(),0);
+        ASSERT_TRUE(Other.trips.empty());
+    }
+    ASSERT_THROW(Checkpointer((Directory/"bad").string(),0),TrafficSimulation_error);
+    std::filesystem::remove_all(Directory);
+}
 
 int main(int argc, char **argv) {
     testing::InitGoogleTest(&argc, argv);